@@ -6,7 +6,7 @@ build_dir="${BUILD_DIR:-"$root_dir/build"}"
 
 usage() {
   cat <<'EOF'
-Usage: scripts/dev.sh <build|clean|run> [args...]
+Usage: scripts/dev.sh <build|clean|run|bench> [args...]
 
 Environment:
   BUILD_DIR   Build directory (default: ./build)
@@ -14,6 +14,7 @@ Environment:
 Examples:
   bash scripts/dev.sh build
   bash scripts/dev.sh run
+  bash scripts/dev.sh bench --latency-us 5000
   BUILD_DIR=build-debug bash scripts/dev.sh build
 EOF
 }
@@ -23,7 +24,7 @@ shift || true
 
 case "$cmd" in
   build)
-    cmake -S "$root_dir" -B "$build_dir" -DKITAPLIK_BUILD_APP=ON
+    cmake -S "$root_dir" -B "$build_dir" -DKITAPLIK_BUILD_APP=ON -DKITAPLIK_BUILD_BENCH=ON
     cmake --build "$build_dir" --parallel
     ;;
   clean)
@@ -37,6 +38,14 @@ case "$cmd" in
     fi
     exec "$exe" "$@"
     ;;
+  bench)
+    exe="$build_dir/kitaplik-vfsbench"
+    if [[ ! -x "$exe" ]]; then
+      echo "error: executable not found at: $exe (run: bash scripts/dev.sh build)" >&2
+      exit 1
+    fi
+    exec "$exe" "$@"
+    ;;
   *)
     usage
     exit 2
@@ -0,0 +1,158 @@
+#include "accountnames.hpp"
+
+#include <QMetaObject>
+
+#include "memorygovernor.hpp"
+
+#include <cerrno>
+
+#include <grp.h>
+#include <pwd.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::chrono::minutes NameTtl(10);
+constexpr std::chrono::minutes MissingTtl(1);
+// Rough memory of a cached name and its hash node, without the name.
+constexpr std::int64_t NameBytes = 64;
+
+std::int64_t entryBytes(const QString& name)
+{
+    return NameBytes + name.size() * std::int64_t(sizeof(QChar));
+}
+
+QString lookUp(AccountNames::Kind kind, std::uint32_t id)
+{
+    std::vector<char> buffer(16384);
+    for (;;) {
+        int result = 0;
+        const char* name = nullptr;
+        if (kind == AccountNames::Kind::User) {
+            passwd entry {};
+            passwd* found = nullptr;
+            result = ::getpwuid_r(id, &entry, buffer.data(), buffer.size(), &found);
+            name = found ? found->pw_name : nullptr;
+        } else {
+            group entry {};
+            group* found = nullptr;
+            result = ::getgrgid_r(id, &entry, buffer.data(), buffer.size(), &found);
+            name = found ? found->gr_name : nullptr;
+        }
+        // Groups with many members don't fit the default buffer.
+        if (result == ERANGE && buffer.size() < (1u << 22)) {
+            buffer.resize(buffer.size() * 4);
+            continue;
+        }
+        return name ? QString::fromLocal8Bit(name) : QString();
+    }
+}
+
+} // namespace
+
+AccountNames::AccountNames(QObject* parent)
+    : QObject(parent)
+{
+    // A name costs a round trip to the directory server at worst.
+    memoryHandle_ = MemoryGovernor::instance().registerCache(QStringLiteral("Account names"), 8, [this](std::int64_t target) {
+        shrink(target);
+    });
+    thread_ = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+AccountNames::~AccountNames()
+{
+    thread_.request_stop();
+    thread_ = std::jthread();
+    MemoryGovernor::instance().unregisterCache(memoryHandle_);
+}
+
+quint64 AccountNames::keyOf(Kind kind, std::uint32_t id)
+{
+    return (static_cast<quint64>(kind) << 32) | id;
+}
+
+QString AccountNames::name(Kind kind, std::uint32_t id)
+{
+    const quint64 key = keyOf(kind, id);
+    const auto it = cache_.constFind(key);
+    const bool fresh = it != cache_.constEnd() && it.value().expires > std::chrono::steady_clock::now();
+    if (!fresh && !pending_.contains(key)) {
+        pending_.insert(key);
+        std::lock_guard lock(mutex_);
+        queue_.push_back({kind, id, QString()});
+        wake_.notify_one();
+    }
+    return it != cache_.constEnd() ? it.value().name : QString();
+}
+
+void AccountNames::run(std::stop_token stop)
+{
+    for (;;) {
+        std::deque<Lookup> batch;
+        {
+            std::unique_lock lock(mutex_);
+            if (!wake_.wait(lock, stop, [this] { return !queue_.empty(); }))
+                return;
+            batch.swap(queue_);
+        }
+        std::vector<Lookup> done;
+        done.reserve(batch.size());
+        for (Lookup& lookup : batch) {
+            if (stop.stop_requested())
+                return;
+            lookup.name = lookUp(lookup.kind, lookup.id);
+            done.push_back(std::move(lookup));
+        }
+        QMetaObject::invokeMethod(this, [this, done = std::move(done)] { deliver(done); }, Qt::QueuedConnection);
+    }
+}
+
+void AccountNames::deliver(const std::vector<Lookup>& lookups)
+{
+    const auto now = std::chrono::steady_clock::now();
+    QSet<std::uint32_t> users;
+    QSet<std::uint32_t> groups;
+    for (const Lookup& lookup : lookups) {
+        const quint64 key = keyOf(lookup.kind, lookup.id);
+        pending_.remove(key);
+        if (!cache_.contains(key))
+            cacheBytes_ += NameBytes;
+        Cached& cached = cache_[key];
+        cacheBytes_ += entryBytes(lookup.name) - entryBytes(cached.name);
+        const bool changed = cached.name != lookup.name || cached.name.isNull() != lookup.name.isNull();
+        cached.name = lookup.name;
+        cached.expires = now + (lookup.name.isNull() ? MissingTtl : NameTtl);
+        if (!changed)
+            continue;
+        if (lookup.kind == Kind::User)
+            users.insert(lookup.id);
+        else
+            groups.insert(lookup.id);
+    }
+    reportUsage();
+    if (!users.isEmpty() || !groups.isEmpty())
+        emit namesResolved(users, groups);
+}
+
+// Expired entries go first, then any, until the cache is down to the target.
+void AccountNames::shrink(std::int64_t targetBytes)
+{
+    const auto now = std::chrono::steady_clock::now();
+    for (const bool expiredOnly : {true, false}) {
+        for (auto it = cache_.begin(); it != cache_.end() && cacheBytes_ > targetBytes;) {
+            if (expiredOnly && it.value().expires > now) {
+                ++it;
+                continue;
+            }
+            cacheBytes_ -= entryBytes(it.value().name);
+            it = cache_.erase(it);
+        }
+    }
+    reportUsage();
+}
+
+void AccountNames::reportUsage()
+{
+    MemoryGovernor::instance().reportUsage(memoryHandle_, cacheBytes_);
+}
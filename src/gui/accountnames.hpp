@@ -0,0 +1,82 @@
+#ifndef ACCOUNTNAMES_HPP
+#define ACCOUNTNAMES_HPP
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// User and group names by ID, for the Owner and Group columns. A lookup goes
+// through NSS, which on LDAP or SSSD hosts can be a round trip to a server,
+// so lookups run on a background thread: name() answers from the cache and
+// queues what it doesn't have, and namesResolved() reports each batch as it
+// arrives. Names are kept for ten minutes and IDs without one for a minute,
+// so a busy listing asks about each ID once, and no longer than the
+// MemoryGovernor allows.
+class AccountNames : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Kind
+    {
+        User,
+        Group,
+    };
+
+    explicit AccountNames(QObject* parent = nullptr);
+    ~AccountNames() override;
+
+    // Null until the name is known, and for IDs that have none; a stale
+    // name is returned while it is looked up again.
+    QString name(Kind kind, std::uint32_t id);
+
+signals:
+    // The IDs whose names arrived, in one batch.
+    void namesResolved(const QSet<std::uint32_t>& users, const QSet<std::uint32_t>& groups);
+
+private:
+    struct Lookup
+    {
+        Kind kind = Kind::User;
+        std::uint32_t id = 0;
+        QString name;
+    };
+
+    struct Cached
+    {
+        QString name;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    static quint64 keyOf(Kind kind, std::uint32_t id);
+    void run(std::stop_token stop);
+    void deliver(const std::vector<Lookup>& lookups);
+    void shrink(std::int64_t targetBytes);
+    void reportUsage();
+
+    QHash<quint64, Cached> cache_;
+    // Of cache_, counting the names.
+    std::int64_t cacheBytes_ = 0;
+    int memoryHandle_ = 0;
+    // Queued or being looked up.
+    QSet<quint64> pending_;
+
+    // Shared with the thread.
+    std::mutex mutex_;
+    std::condition_variable_any wake_;
+    std::deque<Lookup> queue_;
+
+    // Last, so it is joined before anything it uses goes away.
+    std::jthread thread_;
+};
+
+#endif // ACCOUNTNAMES_HPP
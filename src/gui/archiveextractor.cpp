@@ -0,0 +1,268 @@
+#include "archiveextractor.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QThreadPool>
+
+#include "archiveindex.hpp"
+#include "parallelcopier.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr int ProgressIntervalMs = 100;
+// In a single-pass decode, members up to this size are buffered and handed to
+// a worker whole; larger ones are written by the decoding thread itself.
+constexpr std::uint64_t HandOffLimit = 8 * 1024 * 1024;
+constexpr std::uint64_t MaxBufferedBytes = 256 * 1024 * 1024;
+
+struct ExtractJob
+{
+    size_t member = 0;
+    QString destination;
+};
+
+bool isCancelled(const std::atomic_bool* cancel)
+{
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+ArchiveExtractor::ArchiveExtractor() = default;
+
+ArchiveExtractor::ArchiveExtractor(Options options)
+    : options_(options)
+{
+}
+
+bool ArchiveExtractor::run(const ArchiveIndex& archive,
+                           const QString& destinationDir,
+                           const ProgressCallback& onProgress,
+                           const std::atomic_bool* cancel,
+                           QStringList* errors) const
+{
+    const std::vector<ArchiveNode>& nodes = archive.nodes();
+    const std::vector<ArchiveMember>& members = archive.members();
+    const QDir root(destinationDir);
+
+    std::mutex mutex;
+    std::uint64_t bytesDone = 0;
+    std::uint64_t bytesTotal = 0;
+    bool failed = false;
+    auto lastReport = std::chrono::steady_clock::now();
+    const auto reportLocked = [&](bool force) {
+        const auto now = std::chrono::steady_clock::now();
+        if (!force && now - lastReport < std::chrono::milliseconds(ProgressIntervalMs))
+            return;
+        lastReport = now;
+        if (onProgress)
+            onProgress(bytesDone, bytesTotal);
+    };
+    const auto addBytes = [&](std::uint64_t bytes) {
+        std::lock_guard lock(mutex);
+        bytesDone += bytes;
+        reportLocked(false);
+    };
+    const auto failLocked = [&](const QString& error) {
+        failed = true;
+        if (errors && !error.isEmpty() && !isCancelled(cancel))
+            errors->push_back(error);
+    };
+
+    // buildTree() adds every directory ahead of its children, so creating
+    // them in node order never misses a parent.
+    std::vector<ExtractJob> files;
+    std::vector<ExtractJob> links;
+    std::vector<std::pair<QString, std::int64_t>> directoryTimes;
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        const ArchiveNode& node = nodes[i];
+        const QString path = root.filePath(archive.nodePath(static_cast<int>(i)));
+        if (node.isDir) {
+            const std::uint32_t mode = node.member >= 0 ? members[static_cast<size_t>(node.member)].mode : 0;
+            if (::mkdir(QFile::encodeName(path).constData(), mode ? (mode & 0777) | 0700 : 0755) != 0 && errno != EEXIST)
+                failLocked(QString("Failed to create directory: %1").arg(path));
+            else if (node.member >= 0 && members[static_cast<size_t>(node.member)].mtime > 0)
+                directoryTimes.emplace_back(path, members[static_cast<size_t>(node.member)].mtime);
+            continue;
+        }
+        if (node.member < 0)
+            continue;
+        const ArchiveMember& member = members[static_cast<size_t>(node.member)];
+        if (member.type == ArchiveMember::Type::SymLink) {
+            links.push_back({static_cast<size_t>(node.member), path});
+        } else {
+            files.push_back({static_cast<size_t>(node.member), path});
+            bytesTotal += member.size;
+        }
+    }
+    {
+        std::lock_guard lock(mutex);
+        reportLocked(true);
+    }
+
+    QThreadPool pool;
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    pool.setMaxThreadCount(options_.maxThreads > 0 ? options_.maxThreads : static_cast<int>(hardware));
+
+    if (archive.isRandomAccess()) {
+        // Larger members first, so a big one doesn't start last and run alone.
+        std::sort(files.begin(), files.end(), [&](const ExtractJob& a, const ExtractJob& b) {
+            return members[a.member].size > members[b.member].size;
+        });
+        for (size_t i = 0; i < files.size(); ++i) {
+            pool.start([&, i] {
+                const ExtractJob& job = files[i];
+                QString error;
+                const bool ok = !isCancelled(cancel) && archive.extractToFile(members[job.member], job.destination, addBytes, cancel, &error);
+                if (!ok) {
+                    std::lock_guard lock(mutex);
+                    failLocked(error);
+                }
+            });
+        }
+        pool.waitForDone();
+    } else {
+        std::sort(files.begin(), files.end(), [&](const ExtractJob& a, const ExtractJob& b) {
+            return members[a.member].offset < members[b.member].offset;
+        });
+
+        // tar hard links share their target's data; those are copied from
+        // the first extracted file afterwards instead of decoding it again.
+        std::vector<size_t> memberOrder;
+        std::vector<std::pair<size_t, size_t>> copies;
+        std::unordered_map<size_t, size_t> jobByMember;
+        size_t previous = files.size();
+        for (size_t i = 0; i < files.size(); ++i) {
+            const ArchiveMember& member = members[files[i].member];
+            if (previous < files.size() && member.size > 0 && members[files[previous].member].offset == member.offset) {
+                copies.emplace_back(previous, i);
+                continue;
+            }
+            previous = i;
+            memberOrder.push_back(files[i].member);
+            jobByMember.emplace(files[i].member, i);
+        }
+
+        std::condition_variable budget;
+        std::uint64_t buffered = 0;
+        QByteArray pending;
+        std::optional<ExtractedFile> current;
+        bool currentFailed = false;
+        const auto sink = [&](size_t memberIndex, const char* data, size_t size) {
+            const ExtractJob& job = files[jobByMember.at(memberIndex)];
+            const ArchiveMember& member = members[memberIndex];
+            if (member.size <= HandOffLimit) {
+                if (data) {
+                    pending.append(data, static_cast<qsizetype>(size));
+                    return true;
+                }
+                const auto pendingSize = static_cast<std::uint64_t>(pending.size());
+                {
+                    std::unique_lock lock(mutex);
+                    budget.wait(lock, [&] { return buffered == 0 || buffered + pendingSize <= MaxBufferedBytes; });
+                    buffered += pendingSize;
+                }
+                pool.start([&, memberIndex, destination = job.destination, contents = std::move(pending)] {
+                    ExtractedFile file;
+                    QString error;
+                    bool ok = file.open(members[memberIndex], destination, &error);
+                    if (ok && !file.write(contents.constData(), static_cast<size_t>(contents.size()))) {
+                        ok = false;
+                        error = QString("Write error: %1").arg(destination);
+                    }
+                    ok = ok && file.commit(&error);
+                    std::lock_guard lock(mutex);
+                    buffered -= static_cast<std::uint64_t>(contents.size());
+                    bytesDone += static_cast<std::uint64_t>(contents.size());
+                    if (!ok)
+                        failLocked(error);
+                    reportLocked(false);
+                    budget.notify_all();
+                });
+                pending = QByteArray();
+                return !isCancelled(cancel);
+            }
+
+            QString error;
+            if (!current && !currentFailed) {
+                current.emplace();
+                if (!current->open(member, job.destination, &error)) {
+                    current.reset();
+                    currentFailed = true;
+                }
+            }
+            if (data) {
+                if (current && !current->write(data, size)) {
+                    current.reset();
+                    currentFailed = true;
+                    error = QString("Write error: %1").arg(job.destination);
+                }
+                addBytes(size);
+            } else {
+                if (current && !current->commit(&error))
+                    currentFailed = true;
+                current.reset();
+            }
+            if (!error.isEmpty()) {
+                std::lock_guard lock(mutex);
+                failLocked(error);
+            }
+            if (!data)
+                currentFailed = false;
+            return !isCancelled(cancel);
+        };
+
+        QString error;
+        const bool ok = archive.readSequential(memberOrder, sink, cancel, &error);
+        current.reset();
+        pool.waitForDone();
+        if (!ok) {
+            std::lock_guard lock(mutex);
+            failLocked(error);
+        }
+
+        for (const auto& [from, to] : copies) {
+            if (isCancelled(cancel))
+                break;
+            QString copyError;
+            if (!copyFileAtomically(files[from].destination, files[to].destination, true, addBytes, cancel, &copyError)) {
+                std::lock_guard lock(mutex);
+                failLocked(copyError);
+            }
+        }
+    }
+
+    for (const ExtractJob& job : links) {
+        if (isCancelled(cancel))
+            break;
+        QString error;
+        if (!archive.extractToFile(members[job.member], job.destination, {}, cancel, &error)) {
+            std::lock_guard lock(mutex);
+            failLocked(error);
+        }
+    }
+
+    // Writing into a folder bumps its mtime, so folder times go on last,
+    // innermost first.
+    for (auto it = directoryTimes.rbegin(); it != directoryTimes.rend(); ++it) {
+        const timespec times[2] = {{it->second, 0}, {it->second, 0}};
+        ::utimensat(AT_FDCWD, QFile::encodeName(it->first).constData(), times, 0);
+    }
+
+    std::lock_guard lock(mutex);
+    reportLocked(true);
+    return !failed && !isCancelled(cancel);
+}
@@ -0,0 +1,46 @@
+#ifndef ARCHIVEEXTRACTOR_HPP
+#define ARCHIVEEXTRACTOR_HPP
+
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+class ArchiveIndex;
+
+// Extracts every member of an archive below a destination folder. The folder
+// tree is created first; file members are then written by a bounded pool of
+// workers, each into a preallocated temporary file that replaces the
+// destination only once complete. Archives that can only be decoded front to
+// back (.tar.zst without a seek table) are decoded in a single pass on the
+// calling thread, and the writes of the decoded members are spread across the
+// workers instead. Symbolic links are created last, so none of them can
+// redirect a write outside the destination.
+class ArchiveExtractor
+{
+public:
+    struct Options
+    {
+        int maxThreads = 0;
+    };
+
+    using ProgressCallback = std::function<void(std::uint64_t done, std::uint64_t total)>;
+
+    ArchiveExtractor();
+    explicit ArchiveExtractor(Options options);
+
+    // The destination folder must exist. Returns false if any member failed
+    // or the run was cancelled; the remaining members are still attempted.
+    bool run(const ArchiveIndex& archive,
+             const QString& destinationDir,
+             const ProgressCallback& onProgress,
+             const std::atomic_bool* cancel,
+             QStringList* errors) const;
+
+private:
+    Options options_;
+};
+
+#endif // ARCHIVEEXTRACTOR_HPP
@@ -0,0 +1,1151 @@
+#include "archiveindex.hpp"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDate>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTime>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef KITAPLIK_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef KITAPLIK_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr std::uint32_t ZipLocalHeaderSignature = 0x04034b50;
+constexpr std::uint32_t ZipCentralHeaderSignature = 0x02014b50;
+constexpr std::uint32_t ZipEndSignature = 0x06054b50;
+constexpr std::uint32_t Zip64EndSignature = 0x06064b50;
+constexpr std::uint32_t Zip64LocatorSignature = 0x07064b50;
+constexpr size_t ZipEndSize = 22;
+constexpr size_t ZipCentralHeaderSize = 46;
+constexpr size_t ZipLocalHeaderSize = 30;
+constexpr std::uint16_t ZipMethodStored = 0;
+constexpr std::uint16_t ZipMethodDeflated = 8;
+
+constexpr std::uint32_t ZstdFrameMagic = 0xFD2FB528;
+constexpr std::uint32_t ZstdSeekTableMagic = 0x8F92EAB1;
+constexpr std::uint32_t ZstdSeekableFrameMagic = 0x184D2A5E;
+constexpr size_t ZstdSeekFooterSize = 9;
+
+constexpr size_t TarBlockSize = 512;
+constexpr size_t ReadChunkSize = 1024 * 1024;
+
+constexpr quint32 IndexCacheMagic = 0x4b544149; // "KTAI"
+constexpr quint32 IndexCacheVersion = 1;
+
+std::uint16_t le16(const unsigned char* p)
+{
+    return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+}
+
+std::uint32_t le32(const unsigned char* p)
+{
+    return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8)
+        | (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+std::uint64_t le64(const unsigned char* p)
+{
+    return static_cast<std::uint64_t>(le32(p)) | (static_cast<std::uint64_t>(le32(p + 4)) << 32);
+}
+
+bool preadFully(int fd, void* data, size_t length, std::uint64_t offset)
+{
+    auto* out = static_cast<char*>(data);
+    while (length > 0) {
+        const ssize_t n = ::pread(fd, out, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        out += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+bool isCancelled(const std::atomic_bool* cancel)
+{
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+// Strips "./" and leading or trailing slashes; rejects paths that would
+// escape the archive root.
+bool normalizeMemberPath(QString* path)
+{
+    QStringList parts;
+    for (const QString& part : path->split('/')) {
+        if (part.isEmpty() || part == ".")
+            continue;
+        if (part == "..")
+            return false;
+        parts.push_back(part);
+    }
+    *path = parts.join('/');
+    return !path->isEmpty();
+}
+
+std::int64_t dosTimeToEpoch(std::uint16_t time, std::uint16_t date)
+{
+    const QDate day(((date >> 9) & 0x7f) + 1980, (date >> 5) & 0x0f, date & 0x1f);
+    const QTime clock((time >> 11) & 0x1f, (time >> 5) & 0x3f, (time & 0x1f) * 2);
+    const QDateTime stamp(day, clock);
+    return stamp.isValid() ? stamp.toSecsSinceEpoch() : 0;
+}
+
+std::uint64_t parseTarNumber(const char* field, size_t length)
+{
+    const auto* bytes = reinterpret_cast<const unsigned char*>(field);
+    // GNU base-256 encoding for values that don't fit in octal.
+    if (bytes[0] & 0x80) {
+        std::uint64_t value = bytes[0] & 0x3f;
+        for (size_t i = 1; i < length; ++i)
+            value = (value << 8) | bytes[i];
+        return value;
+    }
+    std::uint64_t value = 0;
+    size_t i = 0;
+    while (i < length && (field[i] == ' ' || field[i] == '\0'))
+        ++i;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i)
+        value = (value << 3) | static_cast<std::uint64_t>(field[i] - '0');
+    return value;
+}
+
+QString tarString(const char* field, size_t length)
+{
+    return QString::fromUtf8(field, static_cast<qsizetype>(strnlen(field, length)));
+}
+
+bool tarChecksumMatches(const char* header)
+{
+    const auto* bytes = reinterpret_cast<const unsigned char*>(header);
+    std::uint64_t sum = 0;
+    for (size_t i = 0; i < TarBlockSize; ++i)
+        sum += (i >= 148 && i < 156) ? ' ' : bytes[i];
+    return sum == parseTarNumber(header + 148, 8);
+}
+
+// Sequential reader over the uncompressed bytes of a tar stream.
+class TarStream
+{
+public:
+    virtual ~TarStream() = default;
+    virtual bool read(char* data, size_t size) = 0;
+    virtual bool skip(std::uint64_t size) = 0;
+};
+
+class FileTarStream final : public TarStream
+{
+public:
+    FileTarStream(int fd, std::uint64_t fileSize)
+        : fd_(fd)
+        , fileSize_(fileSize)
+    {
+    }
+
+    bool read(char* data, size_t size) override
+    {
+        if (!preadFully(fd_, data, size, position_))
+            return false;
+        position_ += size;
+        return true;
+    }
+
+    bool skip(std::uint64_t size) override
+    {
+        if (size > fileSize_ - std::min(position_, fileSize_))
+            return false;
+        position_ += size;
+        return true;
+    }
+
+private:
+    int fd_ = -1;
+    std::uint64_t fileSize_ = 0;
+    std::uint64_t position_ = 0;
+};
+
+#ifdef KITAPLIK_HAS_ZSTD
+class ZstdTarStream final : public TarStream
+{
+public:
+    explicit ZstdTarStream(int fd)
+        : fd_(fd)
+        , stream_(ZSTD_createDStream())
+        , input_(ZSTD_DStreamInSize())
+        , output_(ZSTD_DStreamOutSize())
+    {
+    }
+
+    ~ZstdTarStream() override
+    {
+        ZSTD_freeDStream(stream_);
+    }
+
+    bool read(char* data, size_t size) override
+    {
+        while (size > 0) {
+            if (outPos_ == outSize_ && !refill())
+                return false;
+            const size_t n = std::min(size, outSize_ - outPos_);
+            if (data) {
+                std::memcpy(data, output_.data() + outPos_, n);
+                data += n;
+            }
+            outPos_ += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool skip(std::uint64_t size) override
+    {
+        while (size > 0) {
+            const size_t n = static_cast<size_t>(std::min<std::uint64_t>(size, ReadChunkSize));
+            if (!read(nullptr, n))
+                return false;
+            size -= n;
+        }
+        return true;
+    }
+
+private:
+    bool refill()
+    {
+        outPos_ = 0;
+        outSize_ = 0;
+        while (outSize_ == 0) {
+            if (in_.pos == in_.size) {
+                const ssize_t n = ::pread(fd_, input_.data(), input_.size(), static_cast<off_t>(filePos_));
+                if (n <= 0)
+                    return false;
+                filePos_ += static_cast<std::uint64_t>(n);
+                in_ = {input_.data(), static_cast<size_t>(n), 0};
+            }
+            ZSTD_outBuffer out = {output_.data(), output_.size(), 0};
+            if (ZSTD_isError(ZSTD_decompressStream(stream_, &out, &in_)))
+                return false;
+            outSize_ = out.pos;
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+    ZSTD_DStream* stream_ = nullptr;
+    std::vector<char> input_;
+    std::vector<char> output_;
+    ZSTD_inBuffer in_ = {nullptr, 0, 0};
+    std::uint64_t filePos_ = 0;
+    size_t outPos_ = 0;
+    size_t outSize_ = 0;
+};
+#endif
+
+QString indexCachePath(const QString& archivePath)
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dir.isEmpty())
+        return QString();
+    const QByteArray key = QCryptographicHash::hash(archivePath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(dir).filePath(QString("archive-index/%1.idx").arg(QString::fromLatin1(key)));
+}
+
+} // namespace
+
+ArchiveFormat ArchiveIndex::formatForName(const QString& name)
+{
+    if (name.endsWith(".zip", Qt::CaseInsensitive) || name.endsWith(".jar", Qt::CaseInsensitive))
+        return ArchiveFormat::Zip;
+    if (name.endsWith(".tar", Qt::CaseInsensitive))
+        return ArchiveFormat::Tar;
+    if (name.endsWith(".tar.zst", Qt::CaseInsensitive) || name.endsWith(".tzst", Qt::CaseInsensitive))
+        return ArchiveFormat::TarZstd;
+    return ArchiveFormat::Unknown;
+}
+
+ArchiveFormat ArchiveIndex::detectFormat(const QString& path)
+{
+    const ArchiveFormat format = formatForName(path);
+    if (format == ArchiveFormat::Unknown)
+        return format;
+
+    // Non-blocking, so a FIFO named like an archive can't hang the caller.
+    const ScopedFd fd(::open(QFile::encodeName(path).constData(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC));
+    struct stat st {};
+    if (!fd.isValid() || ::fstat(fd.get(), &st) != 0 || !S_ISREG(st.st_mode))
+        return ArchiveFormat::Unknown;
+    unsigned char header[TarBlockSize] = {};
+    const ssize_t n = ::pread(fd.get(), header, sizeof(header), 0);
+    switch (format) {
+    case ArchiveFormat::Zip:
+        return n >= 4 && (le32(header) == ZipLocalHeaderSignature || le32(header) == ZipEndSignature) ? format : ArchiveFormat::Unknown;
+    case ArchiveFormat::Tar:
+        return n == static_cast<ssize_t>(TarBlockSize) && std::memcmp(header + 257, "ustar", 5) == 0 ? format : ArchiveFormat::Unknown;
+    case ArchiveFormat::TarZstd:
+        // The seekable format may start with a skippable frame as well.
+        return n >= 4 && (le32(header) == ZstdFrameMagic || (le32(header) & 0xFFFFFFF0) == 0x184D2A50) ? format : ArchiveFormat::Unknown;
+    case ArchiveFormat::Unknown:
+        break;
+    }
+    return ArchiveFormat::Unknown;
+}
+
+std::shared_ptr<ArchiveIndex> ArchiveIndex::open(const QString& path, const std::atomic_bool* cancel, QString* error)
+{
+    const ArchiveFormat format = detectFormat(path);
+    if (format == ArchiveFormat::Unknown) {
+        if (error)
+            *error = QString("Not a supported archive: %1").arg(path);
+        return nullptr;
+    }
+#ifndef KITAPLIK_HAS_ZSTD
+    if (format == ArchiveFormat::TarZstd) {
+        if (error)
+            *error = QString("This build has no zstd support: %1").arg(path);
+        return nullptr;
+    }
+#endif
+
+    std::shared_ptr<ArchiveIndex> index(new ArchiveIndex(path, format));
+    index->fd_ = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    struct stat st {};
+    if (index->fd_ < 0 || ::fstat(index->fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (error)
+            *error = QString("Failed to open: %1").arg(path);
+        return nullptr;
+    }
+    index->fileSize_ = static_cast<std::uint64_t>(st.st_size);
+    index->fileMtimeNs_ = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+
+    const bool loaded = format == ArchiveFormat::Zip ? index->loadZip(error) : index->loadTar(cancel, error);
+    if (!loaded)
+        return nullptr;
+    index->buildTree();
+    return index;
+}
+
+ArchiveIndex::ArchiveIndex(const QString& path, ArchiveFormat format)
+    : archivePath_(path)
+    , format_(format)
+{
+}
+
+ArchiveIndex::~ArchiveIndex()
+{
+    if (map_)
+        ::munmap(const_cast<unsigned char*>(map_), static_cast<size_t>(fileSize_));
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+bool ArchiveIndex::loadZip(QString* error)
+{
+    const auto fail = [&](const QString& reason) {
+        if (error)
+            *error = QString("%1: %2").arg(reason, archivePath_);
+        return false;
+    };
+    if (fileSize_ < ZipEndSize)
+        return fail("Not a ZIP archive");
+
+    void* map = ::mmap(nullptr, static_cast<size_t>(fileSize_), PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED)
+        return fail("Failed to map archive");
+    map_ = static_cast<const unsigned char*>(map);
+
+    // The end record sits before an optional comment of up to 64 KiB.
+    const std::uint64_t searchStart = fileSize_ > ZipEndSize + 0xFFFF ? fileSize_ - ZipEndSize - 0xFFFF : 0;
+    std::uint64_t endOffset = fileSize_ - ZipEndSize;
+    while (le32(map_ + endOffset) != ZipEndSignature) {
+        if (endOffset == searchStart)
+            return fail("ZIP end of central directory not found");
+        --endOffset;
+    }
+
+    const unsigned char* end = map_ + endOffset;
+    std::uint64_t entryCount = le16(end + 10);
+    std::uint64_t directorySize = le32(end + 12);
+    std::uint64_t directoryOffset = le32(end + 16);
+    if (endOffset >= 20 && le32(map_ + endOffset - 20) == Zip64LocatorSignature) {
+        const std::uint64_t zip64Offset = le64(map_ + endOffset - 20 + 8);
+        if (fileSize_ < 56 || zip64Offset > fileSize_ - 56 || le32(map_ + zip64Offset) != Zip64EndSignature)
+            return fail("Corrupt ZIP64 end record");
+        const unsigned char* zip64 = map_ + zip64Offset;
+        entryCount = le64(zip64 + 32);
+        directorySize = le64(zip64 + 40);
+        directoryOffset = le64(zip64 + 48);
+    }
+    if (directoryOffset > fileSize_ || directorySize > fileSize_ - directoryOffset)
+        return fail("Corrupt ZIP central directory");
+
+    members_.reserve(static_cast<size_t>(std::min<std::uint64_t>(entryCount, directorySize / ZipCentralHeaderSize)));
+    std::uint64_t pos = directoryOffset;
+    const std::uint64_t directoryEnd = directoryOffset + directorySize;
+    for (std::uint64_t i = 0; i < entryCount; ++i) {
+        if (pos + ZipCentralHeaderSize > directoryEnd || le32(map_ + pos) != ZipCentralHeaderSignature)
+            return fail("Corrupt ZIP central directory");
+        const unsigned char* h = map_ + pos;
+        const std::uint16_t madeBy = le16(h + 4);
+        const std::uint16_t flags = le16(h + 8);
+        const std::uint16_t nameLength = le16(h + 28);
+        const std::uint16_t extraLength = le16(h + 30);
+        const std::uint16_t commentLength = le16(h + 32);
+        const std::uint64_t recordSize = ZipCentralHeaderSize + nameLength + extraLength + commentLength;
+        if (pos + recordSize > directoryEnd)
+            return fail("Corrupt ZIP central directory");
+
+        ArchiveMember member;
+        member.method = le16(h + 10);
+        member.encrypted = flags & 0x1;
+        member.crc32 = le32(h + 16);
+        member.compressedSize = le32(h + 20);
+        member.size = le32(h + 24);
+        member.offset = le32(h + 42);
+        member.mtime = dosTimeToEpoch(le16(h + 12), le16(h + 14));
+        if ((madeBy >> 8) == 3)
+            member.mode = le32(h + 38) >> 16;
+
+        // ZIP64 and extended-timestamp extra fields.
+        const unsigned char* extra = h + ZipCentralHeaderSize + nameLength;
+        for (size_t e = 0; e + 4 <= extraLength;) {
+            const std::uint16_t id = le16(extra + e);
+            const std::uint16_t length = le16(extra + e + 2);
+            const unsigned char* data = extra + e + 4;
+            if (e + 4 + length > extraLength)
+                break;
+            if (id == 0x0001) {
+                size_t field = 0;
+                if (member.size == 0xFFFFFFFF && field + 8 <= length) {
+                    member.size = le64(data + field);
+                    field += 8;
+                }
+                if (member.compressedSize == 0xFFFFFFFF && field + 8 <= length) {
+                    member.compressedSize = le64(data + field);
+                    field += 8;
+                }
+                if (member.offset == 0xFFFFFFFF && field + 8 <= length)
+                    member.offset = le64(data + field);
+            } else if (id == 0x5455 && length >= 5 && (data[0] & 0x1)) {
+                member.mtime = static_cast<std::int32_t>(le32(data + 1));
+            }
+            e += 4 + length;
+        }
+
+        member.path = QString::fromUtf8(reinterpret_cast<const char*>(h + ZipCentralHeaderSize), nameLength);
+        const bool isDir = member.path.endsWith('/') || S_ISDIR(member.mode);
+        member.type = isDir ? ArchiveMember::Type::Directory
+            : S_ISLNK(member.mode) ? ArchiveMember::Type::SymLink
+                                   : ArchiveMember::Type::File;
+        if (normalizeMemberPath(&member.path))
+            members_.push_back(std::move(member));
+        pos += recordSize;
+    }
+    return true;
+}
+
+bool ArchiveIndex::loadZstdSeekTable()
+{
+    if (fileSize_ < ZstdSeekFooterSize + 8)
+        return false;
+    unsigned char footer[ZstdSeekFooterSize];
+    if (!preadFully(fd_, footer, sizeof(footer), fileSize_ - ZstdSeekFooterSize) || le32(footer + 5) != ZstdSeekTableMagic)
+        return false;
+
+    const std::uint32_t frameCount = le32(footer);
+    const size_t entrySize = (footer[4] & 0x80) ? 12 : 8;
+    const std::uint64_t tableSize = static_cast<std::uint64_t>(frameCount) * entrySize + ZstdSeekFooterSize;
+    if (tableSize + 8 > fileSize_)
+        return false;
+    std::vector<unsigned char> table(static_cast<size_t>(tableSize + 8));
+    if (!preadFully(fd_, table.data(), table.size(), fileSize_ - table.size())
+        || le32(table.data()) != ZstdSeekableFrameMagic || le32(table.data() + 4) != tableSize)
+        return false;
+
+    std::uint64_t compressed = 0;
+    std::uint64_t uncompressed = 0;
+    seekFrames_.reserve(frameCount);
+    for (std::uint32_t i = 0; i < frameCount; ++i) {
+        const unsigned char* entry = table.data() + 8 + static_cast<size_t>(i) * entrySize;
+        seekFrames_.push_back({compressed, uncompressed});
+        compressed += le32(entry);
+        uncompressed += le32(entry + 4);
+    }
+    return true;
+}
+
+bool ArchiveIndex::loadTar(const std::atomic_bool* cancel, QString* error)
+{
+    if (format_ == ArchiveFormat::TarZstd)
+        loadZstdSeekTable();
+
+    const QString cachePath = indexCachePath(archivePath_);
+    if (!cachePath.isEmpty() && loadCachedIndex(cachePath))
+        return true;
+
+    std::unique_ptr<TarStream> stream;
+#ifdef KITAPLIK_HAS_ZSTD
+    if (format_ == ArchiveFormat::TarZstd)
+        stream = std::make_unique<ZstdTarStream>(fd_);
+#endif
+    if (!stream)
+        stream = std::make_unique<FileTarStream>(fd_, fileSize_);
+
+    QHash<QString, size_t> memberByPath;
+    QString longName;
+    QString longLink;
+    QString paxPath;
+    std::int64_t paxSize = -1;
+    std::int64_t paxMtime = -1;
+    std::uint64_t offset = 0;
+    char header[TarBlockSize];
+
+    const auto readPayload = [&](std::uint64_t size, QByteArray* payload) {
+        const std::uint64_t padded = (size + TarBlockSize - 1) & ~static_cast<std::uint64_t>(TarBlockSize - 1);
+        if (size > 16 * 1024 * 1024)
+            return false;
+        payload->resize(static_cast<qsizetype>(size));
+        if (!stream->read(payload->data(), static_cast<size_t>(size)) || !stream->skip(padded - size))
+            return false;
+        offset += padded;
+        return true;
+    };
+
+    for (;;) {
+        if (isCancelled(cancel)) {
+            if (error)
+                *error = QStringLiteral("Operation cancelled.");
+            return false;
+        }
+        // A missing end-of-archive marker is common enough to accept.
+        if (!stream->read(header, TarBlockSize))
+            break;
+        offset += TarBlockSize;
+        if (std::all_of(header, header + TarBlockSize, [](char c) { return c == 0; }))
+            break;
+        if (!tarChecksumMatches(header)) {
+            if (error)
+                *error = QString("Corrupt tar header at offset %1: %2").arg(QString::number(offset - TarBlockSize), archivePath_);
+            return false;
+        }
+
+        const char typeFlag = header[156];
+        std::uint64_t size = parseTarNumber(header + 124, 12);
+        QByteArray payload;
+        if (typeFlag == 'L' || typeFlag == 'K' || typeFlag == 'x' || typeFlag == 'g') {
+            if (!readPayload(size, &payload)) {
+                if (error)
+                    *error = QString("Corrupt tar extended header: %1").arg(archivePath_);
+                return false;
+            }
+            if (typeFlag == 'L')
+                longName = QString::fromUtf8(payload.constData(), static_cast<qsizetype>(strnlen(payload.constData(), payload.size())));
+            else if (typeFlag == 'K')
+                longLink = QString::fromUtf8(payload.constData(), static_cast<qsizetype>(strnlen(payload.constData(), payload.size())));
+            // pax records are "<length> <key>=<value>\n".
+            for (qsizetype pos = 0; typeFlag == 'x' && pos < payload.size();) {
+                const qsizetype space = payload.indexOf(' ', pos);
+                const qsizetype length = space > pos ? payload.mid(pos, space - pos).toLongLong() : 0;
+                if (length <= 0 || pos + length > payload.size())
+                    break;
+                const QByteArray record = payload.mid(space + 1, pos + length - space - 2);
+                const qsizetype equals = record.indexOf('=');
+                const QByteArray key = record.left(equals);
+                const QByteArray value = record.mid(equals + 1);
+                if (key == "path")
+                    paxPath = QString::fromUtf8(value);
+                else if (key == "size")
+                    paxSize = value.toLongLong();
+                else if (key == "mtime")
+                    paxMtime = static_cast<std::int64_t>(value.toDouble());
+                else if (key == "linkpath")
+                    longLink = QString::fromUtf8(value);
+                pos += length;
+            }
+            continue;
+        }
+
+        if (paxSize >= 0)
+            size = static_cast<std::uint64_t>(paxSize);
+        QString path = !paxPath.isEmpty() ? paxPath : longName;
+        if (path.isEmpty()) {
+            const QString name = tarString(header, 100);
+            const QString prefix = std::memcmp(header + 257, "ustar", 5) == 0 ? tarString(header + 345, 155) : QString();
+            path = prefix.isEmpty() ? name : prefix + '/' + name;
+        }
+
+        ArchiveMember member;
+        member.mode = static_cast<std::uint32_t>(parseTarNumber(header + 100, 8));
+        member.mtime = paxMtime >= 0 ? paxMtime : static_cast<std::int64_t>(parseTarNumber(header + 136, 12));
+        member.offset = offset;
+        member.size = size;
+        member.compressedSize = size;
+        bool keep = normalizeMemberPath(&path);
+        switch (typeFlag) {
+        case '0':
+        case '\0':
+        case '7':
+            member.type = path.endsWith('/') ? ArchiveMember::Type::Directory : ArchiveMember::Type::File;
+            break;
+        case '5':
+            member.type = ArchiveMember::Type::Directory;
+            member.size = 0;
+            break;
+        case '2':
+            member.type = ArchiveMember::Type::SymLink;
+            member.linkTarget = longLink.isEmpty() ? tarString(header + 157, 100) : longLink;
+            member.size = 0;
+            break;
+        case '1': {
+            // Hard links carry no data; point at the earlier member instead.
+            QString target = longLink.isEmpty() ? tarString(header + 157, 100) : longLink;
+            const auto it = normalizeMemberPath(&target) ? memberByPath.constFind(target) : memberByPath.constEnd();
+            keep = keep && it != memberByPath.constEnd();
+            if (keep) {
+                const ArchiveMember& linked = members_[it.value()];
+                member.offset = linked.offset;
+                member.size = linked.size;
+                member.compressedSize = linked.size;
+            }
+            size = 0;
+            break;
+        }
+        default:
+            keep = false;
+            break;
+        }
+        if (keep) {
+            member.path = path;
+            memberByPath.insert(member.path, members_.size());
+            members_.push_back(std::move(member));
+        }
+
+        longName.clear();
+        longLink.clear();
+        paxPath.clear();
+        paxSize = -1;
+        paxMtime = -1;
+        const std::uint64_t padded = (size + TarBlockSize - 1) & ~static_cast<std::uint64_t>(TarBlockSize - 1);
+        if (!stream->skip(padded))
+            break;
+        offset += padded;
+    }
+
+    if (!cachePath.isEmpty())
+        saveCachedIndex(cachePath);
+    return true;
+}
+
+bool ArchiveIndex::loadCachedIndex(const QString& cachePath)
+{
+    QFile file(cachePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint64 size = 0;
+    qint64 mtimeNs = 0;
+    quint8 format = 0;
+    quint32 count = 0;
+    in >> magic >> version >> size >> mtimeNs >> format >> count;
+    if (in.status() != QDataStream::Ok || magic != IndexCacheMagic || version != IndexCacheVersion
+        || size != fileSize_ || mtimeNs != fileMtimeNs_ || format != static_cast<quint8>(format_))
+        return false;
+
+    std::vector<ArchiveMember> members(count);
+    for (ArchiveMember& member : members) {
+        quint8 type = 0;
+        quint64 memberSize = 0;
+        quint64 offset = 0;
+        qint64 mtime = 0;
+        quint32 mode = 0;
+        in >> member.path >> member.linkTarget >> type >> memberSize >> offset >> mtime >> mode;
+        member.type = static_cast<ArchiveMember::Type>(type);
+        member.size = memberSize;
+        member.compressedSize = memberSize;
+        member.offset = offset;
+        member.mtime = mtime;
+        member.mode = mode;
+    }
+    if (in.status() != QDataStream::Ok)
+        return false;
+    members_ = std::move(members);
+    return true;
+}
+
+void ArchiveIndex::saveCachedIndex(const QString& cachePath) const
+{
+    if (!QDir().mkpath(QFileInfo(cachePath).absolutePath()))
+        return;
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    QDataStream out(&file);
+    out << IndexCacheMagic << IndexCacheVersion << static_cast<quint64>(fileSize_) << static_cast<qint64>(fileMtimeNs_)
+        << static_cast<quint8>(format_) << static_cast<quint32>(members_.size());
+    for (const ArchiveMember& member : members_) {
+        out << member.path << member.linkTarget << static_cast<quint8>(member.type) << static_cast<quint64>(member.size)
+            << static_cast<quint64>(member.offset) << static_cast<qint64>(member.mtime) << static_cast<quint32>(member.mode);
+    }
+    file.commit();
+}
+
+void ArchiveIndex::buildTree()
+{
+    nodes_.clear();
+    dirNodes_.clear();
+    nodes_.push_back({QString(), -1, -1, true, {}});
+    dirNodes_.insert(QString(), 0);
+
+    const auto ensureDir = [this](const QString& path) {
+        int node = 0;
+        qsizetype start = 0;
+        while (start < path.size()) {
+            qsizetype slash = path.indexOf('/', start);
+            if (slash < 0)
+                slash = path.size();
+            const QString prefix = path.left(slash);
+            const auto it = dirNodes_.constFind(prefix);
+            if (it != dirNodes_.constEnd()) {
+                node = it.value();
+            } else {
+                const int child = static_cast<int>(nodes_.size());
+                nodes_.push_back({path.mid(start, slash - start), node, -1, true, {}});
+                nodes_[static_cast<size_t>(node)].children.push_back(child);
+                dirNodes_.insert(prefix, child);
+                node = child;
+            }
+            start = slash + 1;
+        }
+        return node;
+    };
+
+    QHash<QString, int> fileNodes;
+    for (int i = 0; i < static_cast<int>(members_.size()); ++i) {
+        const ArchiveMember& member = members_[static_cast<size_t>(i)];
+        if (member.isDir()) {
+            nodes_[static_cast<size_t>(ensureDir(member.path))].member = i;
+            continue;
+        }
+        // A later entry for the same path replaces the earlier one, as with tar -r.
+        const auto existing = fileNodes.constFind(member.path);
+        if (existing != fileNodes.constEnd()) {
+            nodes_[static_cast<size_t>(existing.value())].member = i;
+            continue;
+        }
+        const qsizetype slash = member.path.lastIndexOf('/');
+        const int parent = slash < 0 ? 0 : ensureDir(member.path.left(slash));
+        const int node = static_cast<int>(nodes_.size());
+        nodes_.push_back({member.path.mid(slash + 1), parent, i, false, {}});
+        nodes_[static_cast<size_t>(parent)].children.push_back(node);
+        fileNodes.insert(member.path, node);
+    }
+}
+
+int ArchiveIndex::findNode(const QString& relativePath) const
+{
+    QString path = relativePath;
+    if (!path.isEmpty() && !normalizeMemberPath(&path))
+        return -1;
+    return dirNodes_.value(path, -1);
+}
+
+QString ArchiveIndex::nodePath(int node) const
+{
+    QStringList parts;
+    for (; node > 0; node = nodes_[static_cast<size_t>(node)].parent)
+        parts.prepend(nodes_[static_cast<size_t>(node)].name);
+    return parts.join('/');
+}
+
+bool ArchiveIndex::read(const ArchiveMember& member, const Sink& sink, const std::atomic_bool* cancel, QString* error) const
+{
+    switch (format_) {
+    case ArchiveFormat::Zip:
+        return readZip(member, sink, cancel, error);
+    case ArchiveFormat::Tar:
+        return readTar(member, sink, cancel, error);
+    case ArchiveFormat::TarZstd:
+        return readTarZstd(member, sink, cancel, error);
+    case ArchiveFormat::Unknown:
+        break;
+    }
+    return false;
+}
+
+bool ArchiveIndex::readZip(const ArchiveMember& member, const Sink& sink, const std::atomic_bool* cancel, QString* error) const
+{
+    const auto fail = [&](const QString& reason) {
+        if (error)
+            *error = QString("%1: %2").arg(reason, member.path);
+        return false;
+    };
+    if (member.encrypted)
+        return fail("Encrypted members are not supported");
+    // The member is read with pread, not from the mapping: an archive cut
+    // short while it is browsed gives a read error instead of SIGBUS.
+    unsigned char local[ZipLocalHeaderSize];
+    if (fileSize_ < ZipLocalHeaderSize || member.offset > fileSize_ - ZipLocalHeaderSize
+        || !preadFully(fd_, local, sizeof(local), member.offset) || le32(local) != ZipLocalHeaderSignature)
+        return fail("Corrupt local header");
+    const std::uint64_t dataOffset = member.offset + ZipLocalHeaderSize + le16(local + 26) + le16(local + 28);
+    if (dataOffset > fileSize_ || member.compressedSize > fileSize_ - dataOffset)
+        return fail("Truncated member");
+    ::posix_fadvise(fd_, static_cast<off_t>(dataOffset), static_cast<off_t>(member.compressedSize), POSIX_FADV_SEQUENTIAL);
+    std::vector<unsigned char> input(static_cast<size_t>(std::min<std::uint64_t>(ReadChunkSize, std::max<std::uint64_t>(member.compressedSize, 1))));
+
+#ifdef KITAPLIK_HAS_ZLIB
+    uLong crc = ::crc32(0L, Z_NULL, 0);
+#endif
+    const auto deliver = [&](const unsigned char* bytes, size_t size) {
+#ifdef KITAPLIK_HAS_ZLIB
+        crc = ::crc32_z(crc, bytes, size);
+#endif
+        return sink(reinterpret_cast<const char*>(bytes), size);
+    };
+
+    if (member.method == ZipMethodStored) {
+        for (std::uint64_t done = 0; done < member.compressedSize;) {
+            if (isCancelled(cancel))
+                return fail("Operation cancelled");
+            const size_t n = static_cast<size_t>(std::min<std::uint64_t>(input.size(), member.compressedSize - done));
+            if (!preadFully(fd_, input.data(), n, dataOffset + done))
+                return fail("Read error");
+            if (!deliver(input.data(), n))
+                return fail("Write error");
+            done += n;
+        }
+    } else if (member.method == ZipMethodDeflated) {
+#ifdef KITAPLIK_HAS_ZLIB
+        z_stream stream {};
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+            return fail("Failed to initialise inflate");
+        std::vector<unsigned char> output(256 * 1024);
+        std::uint64_t consumed = 0;
+        int status = Z_OK;
+        while (status != Z_STREAM_END) {
+            if (isCancelled(cancel)) {
+                inflateEnd(&stream);
+                return fail("Operation cancelled");
+            }
+            if (stream.avail_in == 0) {
+                const size_t n = static_cast<size_t>(std::min<std::uint64_t>(input.size(), member.compressedSize - consumed));
+                if (!preadFully(fd_, input.data(), n, dataOffset + consumed)) {
+                    inflateEnd(&stream);
+                    return fail("Read error");
+                }
+                stream.next_in = input.data();
+                stream.avail_in = static_cast<uInt>(n);
+                consumed += n;
+            }
+            stream.next_out = output.data();
+            stream.avail_out = static_cast<uInt>(output.size());
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END) {
+                inflateEnd(&stream);
+                return fail("Corrupt compressed data");
+            }
+            const size_t produced = output.size() - stream.avail_out;
+            if (produced > 0 && !deliver(output.data(), produced)) {
+                inflateEnd(&stream);
+                return fail("Write error");
+            }
+            if (status == Z_OK && produced == 0 && stream.avail_in == 0 && consumed == member.compressedSize) {
+                inflateEnd(&stream);
+                return fail("Truncated compressed data");
+            }
+        }
+        inflateEnd(&stream);
+#else
+        return fail("This build has no deflate support");
+#endif
+    } else {
+        return fail(QString("Unsupported compression method %1").arg(member.method));
+    }
+
+#ifdef KITAPLIK_HAS_ZLIB
+    if (static_cast<std::uint32_t>(crc) != member.crc32)
+        return fail("CRC mismatch");
+#endif
+    return true;
+}
+
+bool ArchiveIndex::readTar(const ArchiveMember& member, const Sink& sink, const std::atomic_bool* cancel, QString* error) const
+{
+    std::vector<char> buffer(static_cast<size_t>(std::min<std::uint64_t>(ReadChunkSize, std::max<std::uint64_t>(member.size, 1))));
+    for (std::uint64_t done = 0; done < member.size;) {
+        if (isCancelled(cancel)) {
+            if (error)
+                *error = QStringLiteral("Operation cancelled.");
+            return false;
+        }
+        const size_t n = static_cast<size_t>(std::min<std::uint64_t>(buffer.size(), member.size - done));
+        if (!preadFully(fd_, buffer.data(), n, member.offset + done)) {
+            if (error)
+                *error = QString("Read error: %1").arg(member.path);
+            return false;
+        }
+        if (!sink(buffer.data(), n)) {
+            if (error)
+                *error = QString("Write error: %1").arg(member.path);
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+bool ArchiveIndex::readTarZstd(const ArchiveMember& member, const Sink& sink, const std::atomic_bool* cancel, QString* error) const
+{
+#ifdef KITAPLIK_HAS_ZSTD
+    // Start at the seekable frame holding the member, or at the very
+    // beginning if the archive wasn't written in the seekable format.
+    std::uint64_t filePos = 0;
+    std::uint64_t skip = member.offset;
+    if (!seekFrames_.empty()) {
+        auto it = std::upper_bound(seekFrames_.begin(), seekFrames_.end(), member.offset, [](std::uint64_t offset, const SeekFrame& frame) {
+            return offset < frame.uncompressedOffset;
+        });
+        --it;
+        filePos = it->compressedOffset;
+        skip = member.offset - it->uncompressedOffset;
+    }
+
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    std::vector<char> input(ZSTD_DStreamInSize());
+    std::vector<char> output(ZSTD_DStreamOutSize());
+    ZSTD_inBuffer in = {input.data(), 0, 0};
+    std::uint64_t remaining = member.size;
+    QString failure;
+    while (remaining > 0 && failure.isEmpty()) {
+        if (isCancelled(cancel)) {
+            failure = QStringLiteral("Operation cancelled.");
+            break;
+        }
+        if (in.pos == in.size) {
+            const ssize_t n = ::pread(fd_, input.data(), input.size(), static_cast<off_t>(filePos));
+            if (n <= 0) {
+                failure = QString("Truncated archive: %1").arg(member.path);
+                break;
+            }
+            filePos += static_cast<std::uint64_t>(n);
+            in = {input.data(), static_cast<size_t>(n), 0};
+        }
+        ZSTD_outBuffer out = {output.data(), output.size(), 0};
+        if (ZSTD_isError(ZSTD_decompressStream(stream, &out, &in))) {
+            failure = QString("Corrupt compressed data: %1").arg(member.path);
+            break;
+        }
+        size_t begin = 0;
+        if (skip > 0) {
+            begin = static_cast<size_t>(std::min<std::uint64_t>(skip, out.pos));
+            skip -= begin;
+        }
+        const size_t n = static_cast<size_t>(std::min<std::uint64_t>(out.pos - begin, remaining));
+        if (n > 0 && !sink(output.data() + begin, n))
+            failure = QString("Write error: %1").arg(member.path);
+        remaining -= n;
+    }
+    ZSTD_freeDStream(stream);
+    if (!failure.isEmpty()) {
+        if (error)
+            *error = failure;
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(member);
+    Q_UNUSED(sink);
+    Q_UNUSED(cancel);
+    if (error)
+        *error = QString("This build has no zstd support: %1").arg(archivePath_);
+    return false;
+#endif
+}
+
+bool ArchiveIndex::isRandomAccess() const
+{
+    return format_ != ArchiveFormat::TarZstd || !seekFrames_.empty();
+}
+
+bool ArchiveIndex::readSequential(const std::vector<size_t>& members, const MemberSink& sink, const std::atomic_bool* cancel, QString* error) const
+{
+    if (isRandomAccess()) {
+        for (size_t index : members) {
+            const auto memberSink = [&](const char* data, size_t size) { return sink(index, data, size); };
+            if (!read(members_[index], memberSink, cancel, error) || !sink(index, nullptr, 0))
+                return false;
+        }
+        return true;
+    }
+
+#ifdef KITAPLIK_HAS_ZSTD
+    ZstdTarStream stream(fd_);
+    std::vector<char> buffer(ReadChunkSize);
+    std::uint64_t position = 0;
+    for (size_t index : members) {
+        const ArchiveMember& member = members_[index];
+        if (member.offset < position || !stream.skip(member.offset - position)) {
+            if (error)
+                *error = QString("Failed to seek to %1 in %2").arg(member.path, archivePath_);
+            return false;
+        }
+        position = member.offset;
+        for (std::uint64_t done = 0; done < member.size;) {
+            if (isCancelled(cancel)) {
+                if (error)
+                    *error = QStringLiteral("Operation cancelled.");
+                return false;
+            }
+            const size_t n = static_cast<size_t>(std::min<std::uint64_t>(buffer.size(), member.size - done));
+            if (!stream.read(buffer.data(), n)) {
+                if (error)
+                    *error = QString("Truncated archive: %1").arg(member.path);
+                return false;
+            }
+            if (!sink(index, buffer.data(), n)) {
+                if (error)
+                    *error = QString("Write error: %1").arg(member.path);
+                return false;
+            }
+            done += n;
+            position += n;
+        }
+        if (!sink(index, nullptr, 0))
+            return false;
+    }
+    return true;
+#else
+    Q_UNUSED(members);
+    Q_UNUSED(sink);
+    Q_UNUSED(cancel);
+    if (error)
+        *error = QString("This build has no zstd support: %1").arg(archivePath_);
+    return false;
+#endif
+}
+
+bool ArchiveIndex::extractToFile(const ArchiveMember& member,
+                                 const QString& destination,
+                                 const std::function<void(std::uint64_t bytes)>& onBytes,
+                                 const std::atomic_bool* cancel,
+                                 QString* error) const
+{
+    const QByteArray nativeDestination = QFile::encodeName(destination);
+    if (member.isDir()) {
+        if (::mkdir(nativeDestination.constData(), member.mode ? (member.mode & 0777) | 0700 : 0755) != 0 && errno != EEXIST) {
+            if (error)
+                *error = QString("Failed to create directory: %1").arg(destination);
+            return false;
+        }
+        return true;
+    }
+
+    if (member.type == ArchiveMember::Type::SymLink) {
+        QByteArray target;
+        if (format_ == ArchiveFormat::Zip) {
+            if (!read(member, [&](const char* data, size_t size) { target.append(data, static_cast<qsizetype>(size)); return true; }, cancel, error))
+                return false;
+        } else {
+            target = QFile::encodeName(member.linkTarget);
+        }
+        if (target.isEmpty() || ::symlink(target.constData(), nativeDestination.constData()) != 0) {
+            if (error)
+                *error = QString("Failed to create symbolic link: %1").arg(destination);
+            return false;
+        }
+        return true;
+    }
+
+    ExtractedFile file;
+    if (!file.open(member, destination, error))
+        return false;
+    const bool ok = read(
+        member,
+        [&](const char* data, size_t size) {
+            if (!file.write(data, size))
+                return false;
+            if (onBytes)
+                onBytes(size);
+            return true;
+        },
+        cancel,
+        error);
+    return ok && file.commit(error);
+}
+
+ExtractedFile::~ExtractedFile()
+{
+    if (fd_.isValid()) {
+        fd_.reset();
+        ::unlink(tempPath_.constData());
+    }
+}
+
+bool ExtractedFile::open(const ArchiveMember& member, const QString& destination, QString* error)
+{
+    static std::atomic<std::uint64_t> tempCounter {0};
+    destination_ = destination;
+    mtime_ = member.mtime;
+    const QString tempPath = QString("%1.kitaplik-tmp-%2-%3")
+                                 .arg(destination,
+                                      QString::number(QDateTime::currentMSecsSinceEpoch()),
+                                      QString::number(tempCounter.fetch_add(1, std::memory_order_relaxed)));
+    tempPath_ = QFile::encodeName(tempPath);
+    // Set-id bits are dropped, as tar does for unprivileged extraction.
+    fd_.reset(::open(tempPath_.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, member.mode ? member.mode & 0777 : 0644));
+    if (!fd_.isValid()) {
+        if (error)
+            *error = QString("Failed to create temporary file: %1").arg(tempPath);
+        return false;
+    }
+    if (member.size > 0)
+        ::posix_fallocate(fd_.get(), 0, static_cast<off_t>(member.size));
+    return true;
+}
+
+bool ExtractedFile::write(const char* data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t n = ::write(fd_.get(), data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool ExtractedFile::commit(QString* error)
+{
+    const timespec times[2] = {{mtime_, 0}, {mtime_, 0}};
+    ::futimens(fd_.get(), times);
+    if (::close(fd_.release()) != 0 || ::rename(tempPath_.constData(), QFile::encodeName(destination_).constData()) != 0) {
+        ::unlink(tempPath_.constData());
+        if (error)
+            *error = QString("Failed to write: %1").arg(destination_);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,167 @@
+#ifndef ARCHIVEINDEX_HPP
+#define ARCHIVEINDEX_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "scopedfd.hpp"
+
+enum class ArchiveFormat
+{
+    Unknown,
+    Zip,
+    Tar,
+    TarZstd,
+};
+
+struct ArchiveMember
+{
+    enum class Type : std::uint8_t
+    {
+        File,
+        Directory,
+        SymLink,
+    };
+
+    QString path;
+    // tar only; ZIP stores the target as the member's data.
+    QString linkTarget;
+    Type type = Type::File;
+    std::uint64_t size = 0;
+    std::uint64_t compressedSize = 0;
+    // ZIP: offset of the local file header. tar: offset of the data in the
+    // uncompressed tar stream.
+    std::uint64_t offset = 0;
+    std::int64_t mtime = 0;
+    std::uint32_t mode = 0;
+    std::uint32_t crc32 = 0;
+    std::uint16_t method = 0;
+    bool encrypted = false;
+
+    bool isDir() const { return type == Type::Directory; }
+};
+
+// Directory tree over the members of an archive. Parent directories that
+// have no entry of their own are added as implicit nodes.
+struct ArchiveNode
+{
+    QString name;
+    int parent = -1;
+    int member = -1;
+    bool isDir = false;
+    std::vector<int> children;
+};
+
+// Read-only random access to the members of a ZIP, tar or zstd-compressed
+// tar archive.
+//
+// ZIP archives (including ZIP64) are memory-mapped and indexed straight from
+// the central directory, so opening costs one pass over it. tar archives are
+// indexed in one streaming pass that reads only headers and seeks over data;
+// .tar.zst has to be decompressed once for that, and the index is cached in
+// the cache directory keyed by the archive's size and mtime. Reading a member
+// touches only its own bytes: for ZIP and plain tar, the member's range; for
+// .tar.zst written in the zstd seekable format, the frames that hold it.
+class ArchiveIndex
+{
+public:
+    // By suffix only, without touching the file.
+    static ArchiveFormat formatForName(const QString& name);
+    static ArchiveFormat detectFormat(const QString& path);
+    static std::shared_ptr<ArchiveIndex> open(const QString& path, const std::atomic_bool* cancel, QString* error);
+
+    ~ArchiveIndex();
+    ArchiveIndex(const ArchiveIndex&) = delete;
+    ArchiveIndex& operator=(const ArchiveIndex&) = delete;
+
+    QString archivePath() const { return archivePath_; }
+    ArchiveFormat format() const { return format_; }
+    const std::vector<ArchiveMember>& members() const { return members_; }
+    const std::vector<ArchiveNode>& nodes() const { return nodes_; }
+
+    // Node of a directory path relative to the archive root ("" is the root),
+    // or -1.
+    int findNode(const QString& relativePath) const;
+    QString nodePath(int node) const;
+
+    // False for a .tar.zst without a seek table, where every read() decodes
+    // from the start of the archive; use readSequential() for those.
+    bool isRandomAccess() const;
+
+    using Sink = std::function<bool(const char* data, size_t size)>;
+    bool read(const ArchiveMember& member, const Sink& sink, const std::atomic_bool* cancel, QString* error) const;
+
+    // Delivers the data of several members, given as indices sorted by
+    // offset, in one pass over the archive.
+    using MemberSink = std::function<bool(size_t member, const char* data, size_t size)>;
+    bool readSequential(const std::vector<size_t>& members, const MemberSink& sink, const std::atomic_bool* cancel, QString* error) const;
+
+    bool extractToFile(const ArchiveMember& member,
+                       const QString& destination,
+                       const std::function<void(std::uint64_t bytes)>& onBytes,
+                       const std::atomic_bool* cancel,
+                       QString* error) const;
+
+private:
+    ArchiveIndex(const QString& path, ArchiveFormat format);
+
+    bool loadZip(QString* error);
+    bool loadTar(const std::atomic_bool* cancel, QString* error);
+    bool loadZstdSeekTable();
+    bool loadCachedIndex(const QString& cachePath);
+    void saveCachedIndex(const QString& cachePath) const;
+    void buildTree();
+
+    bool readZip(const ArchiveMember& member, const Sink& sink, const std::atomic_bool* cancel, QString* error) const;
+    bool readTar(const ArchiveMember& member, const Sink& sink, const std::atomic_bool* cancel, QString* error) const;
+    bool readTarZstd(const ArchiveMember& member, const Sink& sink, const std::atomic_bool* cancel, QString* error) const;
+
+    struct SeekFrame
+    {
+        std::uint64_t compressedOffset = 0;
+        std::uint64_t uncompressedOffset = 0;
+    };
+
+    QString archivePath_;
+    ArchiveFormat format_ = ArchiveFormat::Unknown;
+    int fd_ = -1;
+    std::uint64_t fileSize_ = 0;
+    std::int64_t fileMtimeNs_ = 0;
+    const unsigned char* map_ = nullptr;
+    std::vector<ArchiveMember> members_;
+    std::vector<ArchiveNode> nodes_;
+    QHash<QString, int> dirNodes_;
+    std::vector<SeekFrame> seekFrames_;
+};
+
+// Writes one extracted member to a temporary file next to its destination,
+// preallocated to the member's size, and moves it into place with the
+// member's mode and mtime on commit(). Dropping it unfinished removes the
+// temporary file.
+class ExtractedFile
+{
+public:
+    ExtractedFile() = default;
+    ~ExtractedFile();
+    ExtractedFile(const ExtractedFile&) = delete;
+    ExtractedFile& operator=(const ExtractedFile&) = delete;
+
+    bool open(const ArchiveMember& member, const QString& destination, QString* error);
+    bool write(const char* data, size_t size);
+    bool commit(QString* error);
+
+private:
+    ScopedFd fd_;
+    QString destination_;
+    QByteArray tempPath_;
+    std::int64_t mtime_ = 0;
+};
+
+#endif // ARCHIVEINDEX_HPP
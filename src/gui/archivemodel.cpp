@@ -0,0 +1,122 @@
+#include "archivemodel.hpp"
+
+#include <QDateTime>
+#include <QLocale>
+#include <QMimeDatabase>
+
+ArchiveModel::ArchiveModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+void ArchiveModel::setDirectory(const std::shared_ptr<ArchiveIndex>& archive, int node)
+{
+    beginResetModel();
+    archive_ = archive;
+    node_ = archive && node >= 0 && node < static_cast<int>(archive->nodes().size()) ? node : -1;
+    endResetModel();
+}
+
+void ArchiveModel::clear()
+{
+    setDirectory(nullptr, -1);
+}
+
+const ArchiveNode* ArchiveModel::nodeAt(const QModelIndex& index) const
+{
+    if (!index.isValid() || node_ < 0)
+        return nullptr;
+    const std::vector<int>& children = archive_->nodes()[static_cast<size_t>(node_)].children;
+    if (index.row() < 0 || index.row() >= static_cast<int>(children.size()))
+        return nullptr;
+    return &archive_->nodes()[static_cast<size_t>(children[static_cast<size_t>(index.row())])];
+}
+
+const ArchiveMember* ArchiveModel::memberAt(const QModelIndex& index) const
+{
+    const ArchiveNode* node = nodeAt(index);
+    if (!node || node->member < 0)
+        return nullptr;
+    return &archive_->members()[static_cast<size_t>(node->member)];
+}
+
+bool ArchiveModel::isDir(const QModelIndex& index) const
+{
+    const ArchiveNode* node = nodeAt(index);
+    return node && node->isDir;
+}
+
+QString ArchiveModel::typeName(const QModelIndex& index) const
+{
+    const ArchiveNode* node = nodeAt(index);
+    if (!node)
+        return QString();
+    if (node->isDir)
+        return QStringLiteral("Folder");
+    const ArchiveMember* member = memberAt(index);
+    if (member && member->type == ArchiveMember::Type::SymLink)
+        return QStringLiteral("Link");
+    return QMimeDatabase().mimeTypeForFile(node->name, QMimeDatabase::MatchExtension).comment();
+}
+
+int ArchiveModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid() || node_ < 0)
+        return 0;
+    return static_cast<int>(archive_->nodes()[static_cast<size_t>(node_)].children.size());
+}
+
+int ArchiveModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant ArchiveModel::data(const QModelIndex& index, int role) const
+{
+    const ArchiveNode* node = nodeAt(index);
+    if (!node)
+        return QVariant();
+    const ArchiveMember* member = memberAt(index);
+
+    if (role == Qt::DecorationRole && index.column() == NameColumn)
+        return iconProvider_.icon(node->isDir ? QFileIconProvider::Folder : QFileIconProvider::File);
+    if (role == Qt::TextAlignmentRole && index.column() == SizeColumn)
+        return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+    if (role != Qt::DisplayRole && role != Qt::ToolTipRole)
+        return QVariant();
+
+    switch (index.column()) {
+    case NameColumn:
+        return node->name;
+    case SizeColumn:
+        return node->isDir || !member ? QString() : QLocale::system().formattedDataSize(static_cast<qint64>(member->size));
+    case TypeColumn:
+        return typeName(index);
+    case ModifiedColumn:
+        return member && member->mtime > 0
+            ? QLocale::system().toString(QDateTime::fromSecsSinceEpoch(member->mtime), QLocale::ShortFormat)
+            : QString();
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+QVariant ArchiveModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+    switch (section) {
+    case NameColumn:
+        return QStringLiteral("Name");
+    case SizeColumn:
+        return QStringLiteral("Size");
+    case TypeColumn:
+        return QStringLiteral("Type");
+    case ModifiedColumn:
+        return QStringLiteral("Date Modified");
+    default:
+        break;
+    }
+    return QVariant();
+}
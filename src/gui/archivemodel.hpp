@@ -0,0 +1,51 @@
+#ifndef ARCHIVEMODEL_HPP
+#define ARCHIVEMODEL_HPP
+
+#include <QAbstractTableModel>
+#include <QFileIconProvider>
+
+#include "archiveindex.hpp"
+
+#include <memory>
+
+// Lists one directory of an ArchiveIndex with the same columns as
+// QFileSystemModel, so the file view can show it in place of the disk.
+class ArchiveModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column
+    {
+        NameColumn,
+        SizeColumn,
+        TypeColumn,
+        ModifiedColumn,
+        ColumnCount,
+    };
+
+    explicit ArchiveModel(QObject* parent = nullptr);
+
+    void setDirectory(const std::shared_ptr<ArchiveIndex>& archive, int node);
+    void clear();
+
+    std::shared_ptr<ArchiveIndex> archive() const { return archive_; }
+    int directoryNode() const { return node_; }
+
+    const ArchiveNode* nodeAt(const QModelIndex& index) const;
+    const ArchiveMember* memberAt(const QModelIndex& index) const;
+    bool isDir(const QModelIndex& index) const;
+    QString typeName(const QModelIndex& index) const;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    std::shared_ptr<ArchiveIndex> archive_;
+    int node_ = -1;
+    QFileIconProvider iconProvider_;
+};
+
+#endif // ARCHIVEMODEL_HPP
@@ -0,0 +1,446 @@
+#include "archivewriter.hpp"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QThreadPool>
+
+#include "parallelwalker.hpp"
+#include "scopedfd.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef KITAPLIK_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr std::uint64_t TarBlockSize = 512;
+constexpr qsizetype TarNameSize = 100;
+// Uncompressed bytes per independently compressed frame; also the unit of
+// random access for readers of the finished archive.
+constexpr std::uint64_t FrameSize = 4 * 1024 * 1024;
+constexpr std::uint32_t ZstdSeekableFrameMagic = 0x184D2A5E;
+constexpr std::uint32_t ZstdSeekTableMagic = 0x8F92EAB1;
+
+struct TarEntry
+{
+    QString sourcePath;
+    QByteArray name;
+    QByteArray linkTarget;
+    char type = '0';
+    std::uint64_t size = 0;
+    std::uint32_t mode = 0;
+    std::int64_t mtime = 0;
+    std::uint64_t headerOffset = 0;
+    std::uint64_t headerSize = 0;
+
+    std::uint64_t dataOffset() const { return headerOffset + headerSize; }
+};
+
+struct Frame
+{
+    QByteArray data;
+    std::uint32_t rawSize = 0;
+    bool ok = true;
+};
+
+bool isCancelled(const std::atomic_bool* cancel)
+{
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+std::uint64_t paddedSize(std::uint64_t size)
+{
+    return (size + TarBlockSize - 1) & ~(TarBlockSize - 1);
+}
+
+void putNumber(char* field, size_t width, std::uint64_t value)
+{
+    // Sizes of 8 GiB and more don't fit in 11 octal digits; those use the
+    // GNU base-256 form.
+    if (width == 12 && value > 077777777777ULL) {
+        std::memset(field, 0, width);
+        for (size_t i = width - 1; i > 0; --i, value >>= 8)
+            field[i] = static_cast<char>(value & 0xff);
+        field[0] = static_cast<char>(0x80);
+        return;
+    }
+    std::snprintf(field, width, "%0*llo", static_cast<int>(width - 1), static_cast<unsigned long long>(value));
+}
+
+void writeHeaderBlock(char* block, const QByteArray& name, const QByteArray& linkTarget, char type, std::uint64_t size, std::uint32_t mode, std::int64_t mtime)
+{
+    std::memset(block, 0, TarBlockSize);
+    std::memcpy(block, name.constData(), static_cast<size_t>(std::min(name.size(), TarNameSize)));
+    putNumber(block + 100, 8, mode & 07777);
+    putNumber(block + 108, 8, 0);
+    putNumber(block + 116, 8, 0);
+    putNumber(block + 124, 12, size);
+    putNumber(block + 136, 12, static_cast<std::uint64_t>(std::max<std::int64_t>(mtime, 0)));
+    block[156] = type;
+    std::memcpy(block + 157, linkTarget.constData(), static_cast<size_t>(std::min(linkTarget.size(), TarNameSize)));
+    std::memcpy(block + 257, "ustar", 6);
+    std::memcpy(block + 263, "00", 2);
+
+    std::memset(block + 148, ' ', 8);
+    unsigned int sum = 0;
+    for (size_t i = 0; i < TarBlockSize; ++i)
+        sum += static_cast<unsigned char>(block[i]);
+    std::snprintf(block + 148, 8, "%06o", sum);
+    block[155] = ' ';
+}
+
+std::uint64_t headerSizeFor(const TarEntry& entry)
+{
+    std::uint64_t size = TarBlockSize;
+    if (entry.name.size() > TarNameSize)
+        size += TarBlockSize + paddedSize(static_cast<std::uint64_t>(entry.name.size()) + 1);
+    if (entry.linkTarget.size() > TarNameSize)
+        size += TarBlockSize + paddedSize(static_cast<std::uint64_t>(entry.linkTarget.size()) + 1);
+    return size;
+}
+
+// The header blocks of one entry, with GNU long-name records in front when
+// the name or link target doesn't fit the 100-byte fields.
+QByteArray renderHeaders(const TarEntry& entry)
+{
+    QByteArray headers(static_cast<qsizetype>(entry.headerSize), '\0');
+    char* out = headers.data();
+    const auto longRecord = [&out](char type, const QByteArray& value) {
+        writeHeaderBlock(out, "././@LongLink", QByteArray(), type, static_cast<std::uint64_t>(value.size()) + 1, 0644, 0);
+        out += TarBlockSize;
+        std::memcpy(out, value.constData(), static_cast<size_t>(value.size()));
+        out += paddedSize(static_cast<std::uint64_t>(value.size()) + 1);
+    };
+    if (entry.linkTarget.size() > TarNameSize)
+        longRecord('K', entry.linkTarget);
+    if (entry.name.size() > TarNameSize)
+        longRecord('L', entry.name);
+    writeHeaderBlock(out, entry.name, entry.linkTarget, entry.type, entry.size, entry.mode, entry.mtime);
+    return headers;
+}
+
+QByteArray readLinkTarget(const QString& path)
+{
+    QByteArray target(4096, '\0');
+    const ssize_t n = ::readlink(QFile::encodeName(path).constData(), target.data(), static_cast<size_t>(target.size()));
+    if (n < 0)
+        return {};
+    target.resize(n);
+    return target;
+}
+
+bool makeEntry(const QString& path, const QString& name, std::uint32_t mode, std::uint64_t size, std::int64_t mtimeNs, TarEntry* entry)
+{
+    entry->sourcePath = path;
+    entry->name = name.toUtf8();
+    entry->mode = mode & 07777;
+    entry->mtime = mtimeNs / 1000000000LL;
+    if (S_ISREG(mode)) {
+        entry->type = '0';
+        entry->size = size;
+    } else if (S_ISDIR(mode)) {
+        entry->type = '5';
+        entry->name += '/';
+    } else if (S_ISLNK(mode)) {
+        entry->type = '2';
+        entry->linkTarget = readLinkTarget(path);
+        return !entry->linkTarget.isEmpty();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool collectEntries(const QStringList& sources, int maxThreads, std::vector<TarEntry>* entries, const std::atomic_bool* cancel, QStringList* errors)
+{
+    ParallelWalker::Options walkOptions;
+    walkOptions.maxThreads = maxThreads;
+    const ParallelWalker walker(walkOptions);
+
+    for (const QString& source : sources) {
+        struct stat st {};
+        if (::lstat(QFile::encodeName(source).constData(), &st) != 0) {
+            errors->push_back(QString("Failed to read: %1").arg(source));
+            continue;
+        }
+        const QString rootName = QFileInfo(source).fileName();
+        TarEntry root;
+        if (makeEntry(source, rootName, st.st_mode, static_cast<std::uint64_t>(st.st_size),
+                      static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec, &root))
+            entries->push_back(std::move(root));
+        if (!S_ISDIR(st.st_mode))
+            continue;
+
+        std::mutex mutex;
+        std::vector<WalkEntry> walked;
+        walker.walk(
+            source,
+            [&](std::vector<WalkEntry>&& batch) {
+                std::lock_guard lock(mutex);
+                walked.insert(walked.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+            },
+            cancel,
+            errors);
+        if (isCancelled(cancel))
+            return false;
+        for (const WalkEntry& walkEntry : walked) {
+            TarEntry entry;
+            if (makeEntry(walkEntry.path, rootName + '/' + walkEntry.relativePath, walkEntry.mode, walkEntry.size, walkEntry.mtimeNs, &entry))
+                entries->push_back(std::move(entry));
+        }
+    }
+
+    // Name order keeps each directory ahead of its contents and files of one
+    // folder together in the stream.
+    std::sort(entries->begin(), entries->end(), [](const TarEntry& a, const TarEntry& b) { return a.name < b.name; });
+    return !isCancelled(cancel);
+}
+
+// Assembles bytes [start, start + length) of the tar stream. The buffer must
+// be zeroed; padding and the end-of-archive blocks are left as they are.
+bool fillFrame(const std::vector<TarEntry>& entries, std::uint64_t start, char* out, size_t length, QStringList* errors)
+{
+    const std::uint64_t end = start + length;
+    auto it = std::upper_bound(entries.begin(), entries.end(), start, [](std::uint64_t offset, const TarEntry& entry) {
+        return offset < entry.headerOffset;
+    });
+    if (it != entries.begin())
+        --it;
+
+    bool ok = true;
+    for (; it != entries.end() && it->headerOffset < end; ++it) {
+        const TarEntry& entry = *it;
+        if (entry.dataOffset() > start) {
+            const QByteArray headers = renderHeaders(entry);
+            const std::uint64_t from = std::max(start, entry.headerOffset);
+            const std::uint64_t to = std::min(end, entry.dataOffset());
+            std::memcpy(out + (from - start), headers.constData() + (from - entry.headerOffset), static_cast<size_t>(to - from));
+        }
+
+        const std::uint64_t from = std::max(start, entry.dataOffset());
+        const std::uint64_t to = std::min(end, entry.dataOffset() + entry.size);
+        if (from >= to)
+            continue;
+        const ScopedFd fd(::open(QFile::encodeName(entry.sourcePath).constData(), O_RDONLY | O_CLOEXEC));
+        if (!fd.isValid()) {
+            errors->push_back(QString("Failed to read: %1").arg(entry.sourcePath));
+            ok = false;
+            continue;
+        }
+        char* data = out + (from - start);
+        std::uint64_t position = from - entry.dataOffset();
+        size_t remaining = static_cast<size_t>(to - from);
+        while (remaining > 0) {
+            const ssize_t n = ::pread(fd.get(), data, remaining, static_cast<off_t>(position));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                errors->push_back(QString("File changed while archiving: %1").arg(entry.sourcePath));
+                ok = false;
+                break;
+            }
+            data += n;
+            position += static_cast<std::uint64_t>(n);
+            remaining -= static_cast<size_t>(n);
+        }
+    }
+    return ok;
+}
+
+void appendLe32(QByteArray* out, std::uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out->append(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+bool writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+#ifdef KITAPLIK_HAS_ZSTD
+struct CompressContext
+{
+    ZSTD_CCtx* context = ZSTD_createCCtx();
+    ~CompressContext() { ZSTD_freeCCtx(context); }
+};
+#endif
+
+} // namespace
+
+ArchiveWriter::ArchiveWriter() = default;
+
+ArchiveWriter::ArchiveWriter(Options options)
+    : options_(options)
+{
+}
+
+QString ArchiveWriter::defaultSuffix()
+{
+#ifdef KITAPLIK_HAS_ZSTD
+    return QStringLiteral(".tar.zst");
+#else
+    return QStringLiteral(".tar");
+#endif
+}
+
+bool ArchiveWriter::run(const QStringList& sources,
+                        const QString& destination,
+                        const ProgressCallback& onProgress,
+                        const std::atomic_bool* cancel,
+                        QStringList* errors) const
+{
+    const int threads = options_.maxThreads > 0
+        ? options_.maxThreads
+        : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    std::vector<TarEntry> entries;
+    QStringList localErrors;
+    if (!collectEntries(sources, threads, &entries, cancel, &localErrors))
+        return false;
+
+    std::uint64_t offset = 0;
+    for (TarEntry& entry : entries) {
+        entry.headerOffset = offset;
+        entry.headerSize = headerSizeFor(entry);
+        offset = entry.dataOffset() + paddedSize(entry.size);
+    }
+    const std::uint64_t total = offset + 2 * TarBlockSize;
+    const std::uint64_t frameCount = (total + FrameSize - 1) / FrameSize;
+
+    const QString tempPath = QString("%1.kitaplik-tmp-%2").arg(destination, QString::number(QDateTime::currentMSecsSinceEpoch()));
+    const QByteArray nativeTemp = QFile::encodeName(tempPath);
+    ScopedFd out(::open(nativeTemp.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644));
+    if (!out.isValid()) {
+        if (errors)
+            errors->push_back(QString("Failed to create temporary file: %1").arg(tempPath));
+        return false;
+    }
+
+    std::mutex mutex;
+    std::condition_variable frameReady;
+    std::map<std::uint64_t, Frame> finished;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    const auto submit = [&](std::uint64_t index) {
+        pool.start([&, index] {
+            const std::uint64_t start = index * FrameSize;
+            const size_t length = static_cast<size_t>(std::min(FrameSize, total - start));
+            Frame frame;
+            frame.rawSize = static_cast<std::uint32_t>(length);
+            if (!isCancelled(cancel)) {
+                QByteArray raw(static_cast<qsizetype>(length), '\0');
+                QStringList readErrors;
+                fillFrame(entries, start, raw.data(), length, &readErrors);
+                if (!readErrors.isEmpty()) {
+                    std::lock_guard lock(mutex);
+                    localErrors.append(readErrors);
+                }
+#ifdef KITAPLIK_HAS_ZSTD
+                thread_local CompressContext compressor;
+                frame.data.resize(static_cast<qsizetype>(ZSTD_compressBound(length)));
+                const size_t n = ZSTD_compressCCtx(compressor.context, frame.data.data(), static_cast<size_t>(frame.data.size()),
+                                                   raw.constData(), length, options_.compressionLevel);
+                frame.ok = !ZSTD_isError(n);
+                frame.data.resize(frame.ok ? static_cast<qsizetype>(n) : 0);
+#else
+                frame.data = std::move(raw);
+#endif
+            }
+            {
+                std::lock_guard lock(mutex);
+                finished.emplace(index, std::move(frame));
+            }
+            frameReady.notify_all();
+        });
+    };
+
+    // Frames are written strictly in order; a bounded window of frames in
+    // flight keeps every worker busy without buffering the whole archive.
+    const std::uint64_t window = static_cast<std::uint64_t>(threads) * 2;
+    std::uint64_t submitted = 0;
+    QByteArray seekTable;
+    QString failure;
+    for (std::uint64_t next = 0; next < frameCount; ++next) {
+        while (submitted < frameCount && submitted < next + window)
+            submit(submitted++);
+
+        Frame frame;
+        {
+            std::unique_lock lock(mutex);
+            frameReady.wait(lock, [&] { return finished.count(next) > 0; });
+            frame = std::move(finished[next]);
+            finished.erase(next);
+        }
+        if (isCancelled(cancel)) {
+            failure = QStringLiteral("Operation cancelled.");
+            break;
+        }
+        if (!frame.ok) {
+            failure = QString("Compression failed: %1").arg(destination);
+            break;
+        }
+        if (!writeAll(out.get(), frame.data.constData(), static_cast<size_t>(frame.data.size()))) {
+            failure = QString("Write error: %1").arg(tempPath);
+            break;
+        }
+        appendLe32(&seekTable, static_cast<std::uint32_t>(frame.data.size()));
+        appendLe32(&seekTable, frame.rawSize);
+        if (onProgress)
+            onProgress(std::min(total, (next + 1) * FrameSize), total);
+    }
+    pool.waitForDone();
+
+#ifdef KITAPLIK_HAS_ZSTD
+    if (failure.isEmpty()) {
+        QByteArray table;
+        appendLe32(&table, ZstdSeekableFrameMagic);
+        appendLe32(&table, static_cast<std::uint32_t>(seekTable.size() + 9));
+        table.append(seekTable);
+        appendLe32(&table, static_cast<std::uint32_t>(frameCount));
+        table.append('\0');
+        appendLe32(&table, ZstdSeekTableMagic);
+        if (!writeAll(out.get(), table.constData(), static_cast<size_t>(table.size())))
+            failure = QString("Write error: %1").arg(tempPath);
+    }
+#endif
+
+    if (failure.isEmpty() && ::close(out.release()) != 0)
+        failure = QString("Write error: %1").arg(tempPath);
+    if (failure.isEmpty() && ::rename(nativeTemp.constData(), QFile::encodeName(destination).constData()) != 0)
+        failure = QString("Failed to finalize destination: %1").arg(destination);
+    if (!failure.isEmpty()) {
+        out.reset();
+        ::unlink(nativeTemp.constData());
+        localErrors.push_back(failure);
+    }
+
+    localErrors.removeDuplicates();
+    if (errors && !isCancelled(cancel))
+        errors->append(localErrors);
+    return localErrors.isEmpty();
+}
@@ -0,0 +1,50 @@
+#ifndef ARCHIVEWRITER_HPP
+#define ARCHIVEWRITER_HPP
+
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+// Packs files and folders into a tar archive, compressed with zstd in the
+// seekable format when the build has zstd (a plain .tar otherwise).
+//
+// The tar layout is planned up front from a scan of the sources, so every
+// frame of the stream can be assembled on its own: workers read the file
+// ranges for one frame with pread, compress it independently and hand it
+// back for in-order writing. Reading and compression both scale with the
+// thread count, and the resulting archive can be browsed with random access
+// by ArchiveIndex.
+class ArchiveWriter
+{
+public:
+    struct Options
+    {
+        int maxThreads = 0;
+        int compressionLevel = 3;
+    };
+
+    using ProgressCallback = std::function<void(std::uint64_t done, std::uint64_t total)>;
+
+    ArchiveWriter();
+    explicit ArchiveWriter(Options options);
+
+    // ".tar.zst", or ".tar" without zstd support.
+    static QString defaultSuffix();
+
+    // Each source is stored under its own file name at the archive root.
+    // The destination is replaced only once the archive is complete. Files
+    // that can't be read are reported but don't stop the archive.
+    bool run(const QStringList& sources,
+             const QString& destination,
+             const ProgressCallback& onProgress,
+             const std::atomic_bool* cancel,
+             QStringList* errors) const;
+
+private:
+    Options options_;
+};
+
+#endif // ARCHIVEWRITER_HPP
@@ -0,0 +1,103 @@
+#include "catalogsearchdialog.hpp"
+
+#include <QDialogButtonBox>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QLocale>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include "drivecatalog.hpp"
+
+#include <utility>
+
+namespace {
+
+constexpr int FolderUrlRole = Qt::UserRole + 1;
+// Past this many matches the query is too broad to be useful as a list.
+constexpr size_t MaxResults = 1000;
+
+} // namespace
+
+CatalogSearchDialog::CatalogSearchDialog(OpenFunction openFolder, QWidget* parent)
+    : QDialog(parent)
+    , openFolder_(std::move(openFolder))
+{
+    setWindowTitle("Search Drive Catalogs");
+    resize(800, 500);
+
+    for (const QString& uuid : DriveCatalog::catalogUuids()) {
+        if (std::shared_ptr<DriveCatalog> catalog = DriveCatalog::open(uuid, nullptr))
+            catalogs_.push_back(std::move(catalog));
+    }
+
+    queryEdit_ = new QLineEdit(this);
+    queryEdit_->setPlaceholderText("File or folder name");
+    statusLabel_ = new QLabel(this);
+    resultsTree_ = new QTreeWidget(this);
+    resultsTree_->setColumnCount(4);
+    resultsTree_->setHeaderLabels({"Name", "Drive", "Folder", "Size"});
+    resultsTree_->setRootIsDecorated(false);
+    resultsTree_->setUniformRowHeights(true);
+    resultsTree_->header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
+    resultsTree_->header()->setSectionResizeMode(1, QHeaderView::ResizeToContents);
+    resultsTree_->header()->setSectionResizeMode(2, QHeaderView::Stretch);
+    resultsTree_->header()->setSectionResizeMode(3, QHeaderView::ResizeToContents);
+    QDialogButtonBox* closeBox = new QDialogButtonBox(QDialogButtonBox::Close, this);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(queryEdit_);
+    layout->addWidget(statusLabel_);
+    layout->addWidget(resultsTree_, 1);
+    layout->addWidget(closeBox);
+
+    // Searching is quick, but not so quick that it should run per keystroke.
+    searchTimer_ = new QTimer(this);
+    searchTimer_->setSingleShot(true);
+    searchTimer_->setInterval(150);
+    connect(searchTimer_, &QTimer::timeout, this, &CatalogSearchDialog::runSearch);
+    connect(queryEdit_, &QLineEdit::textChanged, this, [this](const QString&) { searchTimer_->start(); });
+    connect(resultsTree_, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem* item, int) {
+        if (openFolder_)
+            openFolder_(item->data(0, FolderUrlRole).toString());
+    });
+    connect(closeBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    statusLabel_->setText(catalogs_.empty() ? "No drives have been cataloged yet."
+                                            : QString("%1 cataloged drive(s).").arg(catalogs_.size()));
+}
+
+void CatalogSearchDialog::runSearch()
+{
+    resultsTree_->clear();
+    const QString query = queryEdit_->text().trimmed();
+    if (query.isEmpty()) {
+        statusLabel_->setText(QString("%1 cataloged drive(s).").arg(catalogs_.size()));
+        return;
+    }
+
+    size_t found = 0;
+    QList<QTreeWidgetItem*> items;
+    for (const std::shared_ptr<DriveCatalog>& catalog : catalogs_) {
+        for (const std::uint32_t entry : catalog->search(query, MaxResults - found)) {
+            const QString folder = catalog->relativePath(catalog->parent(entry));
+            auto* item = new QTreeWidgetItem();
+            item->setText(0, catalog->name(entry));
+            item->setText(1, catalog->label());
+            item->setText(2, folder.isEmpty() ? QString("/") : folder);
+            if (!catalog->isDir(entry))
+                item->setText(3, QLocale::system().formattedDataSize(static_cast<qint64>(catalog->size(entry))));
+            item->setData(0, FolderUrlRole, folder.isEmpty() ? DriveCatalog::rootUrl(catalog->uuid())
+                                                             : DriveCatalog::rootUrl(catalog->uuid()) + '/' + folder);
+            items << item;
+            ++found;
+        }
+        if (found >= MaxResults)
+            break;
+    }
+    resultsTree_->addTopLevelItems(items);
+    statusLabel_->setText(found >= MaxResults ? QString("Showing the first %1 matches.").arg(MaxResults)
+                                              : QString("%1 match(es).").arg(found));
+}
@@ -0,0 +1,37 @@
+#ifndef CATALOGSEARCHDIALOG_HPP
+#define CATALOGSEARCHDIALOG_HPP
+
+#include <QDialog>
+#include <QString>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class DriveCatalog;
+class QLabel;
+class QLineEdit;
+class QTimer;
+class QTreeWidget;
+
+// Searches the names in every drive catalog at once, mounted or not, and
+// opens the folder holding a result.
+class CatalogSearchDialog : public QDialog
+{
+public:
+    using OpenFunction = std::function<void(const QString& folderUrl)>;
+
+    explicit CatalogSearchDialog(OpenFunction openFolder, QWidget* parent = nullptr);
+
+private:
+    void runSearch();
+
+    OpenFunction openFolder_;
+    std::vector<std::shared_ptr<DriveCatalog>> catalogs_;
+    QLineEdit* queryEdit_ = nullptr;
+    QLabel* statusLabel_ = nullptr;
+    QTreeWidget* resultsTree_ = nullptr;
+    QTimer* searchTimer_ = nullptr;
+};
+
+#endif // CATALOGSEARCHDIALOG_HPP
@@ -0,0 +1,99 @@
+#include "catalogvfs.hpp"
+
+#include "drivecatalog.hpp"
+
+#include <sys/stat.h>
+
+CatalogVfs::CatalogVfs(std::shared_ptr<const DriveCatalog> catalog)
+    : catalog_(std::move(catalog))
+{
+}
+
+qint64 CatalogVfs::findEntry(const QString& path) const
+{
+    QString uuid;
+    QString innerPath;
+    if (!DriveCatalog::splitUrl(path, &uuid, &innerPath) || uuid != catalog_->uuid())
+        return -1;
+    return catalog_->findEntry(innerPath);
+}
+
+VfsStat CatalogVfs::statOf(std::uint32_t entry) const
+{
+    VfsStat st;
+    st.inode = entry + 1;
+    st.size = catalog_->size(entry);
+    st.mtimeNs = catalog_->mtimeNs(entry);
+    st.ctimeNs = st.mtimeNs;
+    st.mode = catalog_->isDir(entry) ? (S_IFDIR | 0555) : (S_IFREG | 0444);
+    st.linkCount = 1;
+    return st;
+}
+
+std::unique_ptr<VfsFile> CatalogVfs::open(const QString& path, OpenMode, std::uint32_t, QString* error) const
+{
+    if (error)
+        *error = QString("The drive is offline: %1").arg(path);
+    return nullptr;
+}
+
+bool CatalogVfs::stat(const QString& path, VfsStat* st, QString* error) const
+{
+    const qint64 entry = findEntry(path);
+    if (entry < 0) {
+        if (error)
+            *error = QString("Failed to read: %1").arg(path);
+        return false;
+    }
+    *st = statOf(static_cast<std::uint32_t>(entry));
+    return true;
+}
+
+bool CatalogVfs::statTarget(const QString& path, VfsStat* st, QString* error) const
+{
+    return stat(path, st, error);
+}
+
+bool CatalogVfs::list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    const qint64 entry = findEntry(path);
+    if (entry < 0 || !catalog_->isDir(static_cast<std::uint32_t>(entry))) {
+        if (error)
+            *error = QString("Failed to read directory: %1").arg(path);
+        return false;
+    }
+
+    const std::uint32_t first = catalog_->firstChild(static_cast<std::uint32_t>(entry));
+    const std::uint32_t count = catalog_->childCount(static_cast<std::uint32_t>(entry));
+    entries->clear();
+    entries->reserve(count);
+    for (std::uint32_t child = first; child < first + count; ++child)
+        entries->push_back({catalog_->name(child), statOf(child)});
+    return true;
+}
+
+bool CatalogVfs::listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    return list(path, entries, error);
+}
+
+bool CatalogVfs::makeDirectory(const QString& path, std::uint32_t, QString* error) const
+{
+    if (error)
+        *error = QString("The catalog is read-only: %1").arg(path);
+    return false;
+}
+
+bool CatalogVfs::rename(const QString& from, const QString&, QString* error) const
+{
+    if (error)
+        *error = QString("The catalog is read-only: %1").arg(from);
+    return false;
+}
+
+bool CatalogVfs::unlink(const QString& path, QString* error) const
+{
+    if (error)
+        *error = QString("The catalog is read-only: %1").arg(path);
+    return false;
+}
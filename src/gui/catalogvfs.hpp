@@ -0,0 +1,34 @@
+#ifndef CATALOGVFS_HPP
+#define CATALOGVFS_HPP
+
+#include "vfs.hpp"
+
+class DriveCatalog;
+
+// Presents a drive catalog as a read-only filesystem rooted at its
+// "catalog://<uuid>" URL, so an offline drive browses like any folder. Only
+// metadata is there: files can't be opened and nothing can be changed.
+class CatalogVfs final : public Vfs
+{
+public:
+    explicit CatalogVfs(std::shared_ptr<const DriveCatalog> catalog);
+
+    std::unique_ptr<VfsFile> open(const QString& path, OpenMode mode, std::uint32_t permissions, QString* error) const override;
+    bool stat(const QString& path, VfsStat* st, QString* error) const override;
+    bool statTarget(const QString& path, VfsStat* st, QString* error) const override;
+    bool list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool makeDirectory(const QString& path, std::uint32_t permissions, QString* error) const override;
+    bool rename(const QString& from, const QString& to, QString* error) const override;
+    bool unlink(const QString& path, QString* error) const override;
+
+    const std::shared_ptr<const DriveCatalog>& catalog() const { return catalog_; }
+
+private:
+    qint64 findEntry(const QString& path) const;
+    VfsStat statOf(std::uint32_t entry) const;
+
+    std::shared_ptr<const DriveCatalog> catalog_;
+};
+
+#endif // CATALOGVFS_HPP
@@ -0,0 +1,602 @@
+#include "drivecatalog.hpp"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+
+#include "hashcache.hpp"
+#include "metadataindex.hpp"
+#include "parallelwalker.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char CatalogMagic[8] = {'K', 'T', 'C', 'A', 'T', 'L', 'O', 'G'};
+constexpr std::uint32_t CatalogVersion = 1;
+constexpr const char* CatalogSuffix = ".kcat";
+constexpr const char* UrlScheme = "catalog://";
+constexpr size_t DigestSize = 32;
+constexpr std::uint16_t RecordIsDir = 0x1;
+constexpr std::uint32_t NoEntry = 0xFFFFFFFFu;
+// Files hashed per pool task.
+constexpr size_t HashBatchSize = 64;
+
+struct CatalogHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t entryCount;
+    std::uint32_t labelSize;
+    std::uint32_t rootPathSize;
+    std::int64_t createdNs;
+    std::uint64_t totalBytes;
+    std::uint64_t recordsOffset;
+    std::uint64_t namesOffset;
+    std::uint64_t namesSize;
+    // 0 when the catalog has no digests.
+    std::uint64_t hashesOffset;
+};
+
+struct ScannedEntry
+{
+    QString relativePath;
+    std::uint64_t size = 0;
+    std::int64_t mtimeNs = 0;
+    std::uint32_t uid = 0;
+    bool isDir = false;
+};
+
+std::uint64_t alignTo8(std::uint64_t offset)
+{
+    return (offset + 7) & ~static_cast<std::uint64_t>(7);
+}
+
+// Orders names by their UTF-8 bytes, the same as QByteArray's operator<.
+int compareName(const char* name, size_t size, const QByteArray& other)
+{
+    const size_t common = std::min(size, static_cast<size_t>(other.size()));
+    const int result = common == 0 ? 0 : std::memcmp(name, other.constData(), common);
+    if (result != 0)
+        return result;
+    return size < static_cast<size_t>(other.size()) ? -1 : (size > static_cast<size_t>(other.size()) ? 1 : 0);
+}
+
+char asciiLower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool isValidUuid(const QString& uuid)
+{
+    if (uuid.isEmpty())
+        return false;
+    for (const QChar c : uuid) {
+        const char16_t u = c.unicode();
+        if (!((u >= '0' && u <= '9') || (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || u == '-'))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+struct DriveCatalog::Record
+{
+    std::uint64_t size;
+    std::int64_t mtimeNs;
+    std::uint32_t parent;
+    std::uint32_t firstChild;
+    std::uint32_t childCount;
+    std::uint32_t nameOffset;
+    std::uint16_t nameSize;
+    std::uint16_t flags;
+    std::uint32_t reserved;
+};
+
+QString DriveCatalog::rootUrl(const QString& uuid)
+{
+    return UrlScheme + uuid;
+}
+
+bool DriveCatalog::splitUrl(const QString& url, QString* uuid, QString* innerPath)
+{
+    if (!url.startsWith(UrlScheme))
+        return false;
+    const QString rest = url.mid(static_cast<qsizetype>(std::strlen(UrlScheme)));
+    const qsizetype slash = rest.indexOf('/');
+    const QString id = slash < 0 ? rest : rest.left(slash);
+    if (!isValidUuid(id))
+        return false;
+    *uuid = id;
+    *innerPath = slash < 0 ? QString() : QDir::cleanPath('/' + rest.mid(slash + 1)).mid(1);
+    return true;
+}
+
+QString DriveCatalog::catalogDirectory()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    return dir.isEmpty() ? QString() : QDir(dir).filePath("catalogs");
+}
+
+QString DriveCatalog::catalogPath(const QString& uuid)
+{
+    const QString dir = catalogDirectory();
+    return dir.isEmpty() ? QString() : QDir(dir).filePath(uuid + CatalogSuffix);
+}
+
+QStringList DriveCatalog::catalogUuids()
+{
+    const QString dir = catalogDirectory();
+    if (dir.isEmpty())
+        return {};
+    QStringList uuids;
+    for (const QString& file : QDir(dir).entryList({QString("*") + CatalogSuffix}, QDir::Files)) {
+        const QString uuid = file.chopped(static_cast<qsizetype>(std::strlen(CatalogSuffix)));
+        if (isValidUuid(uuid))
+            uuids << uuid;
+    }
+    return uuids;
+}
+
+QString DriveCatalog::filesystemUuid(const QString& device)
+{
+    if (!device.startsWith("/dev/"))
+        return QString();
+    const QString target = QFileInfo(device).canonicalFilePath();
+    if (target.isEmpty())
+        return QString();
+    const QDir byUuid("/dev/disk/by-uuid");
+    for (const QFileInfo& link : byUuid.entryInfoList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot)) {
+        if (link.canonicalFilePath() == target)
+            return link.fileName();
+    }
+    return QString();
+}
+
+bool DriveCatalog::build(const QString& rootPath,
+                         const QString& uuid,
+                         const QString& label,
+                         Options options,
+                         const ProgressCallback& onProgress,
+                         const std::atomic_bool* cancel,
+                         QStringList* errors)
+{
+    const auto fail = [errors](const QString& error) {
+        if (errors)
+            errors->push_back(error);
+        return false;
+    };
+    const auto cancelled = [cancel] { return cancel && cancel->load(); };
+    if (!isValidUuid(uuid))
+        return fail(QString("Volume has no filesystem UUID: %1").arg(rootPath));
+    const QString path = catalogPath(uuid);
+    if (path.isEmpty() || !QDir().mkpath(QFileInfo(path).absolutePath()))
+        return fail("Failed to create the catalog folder.");
+
+    // Walk the volume.
+    std::vector<ScannedEntry> scanned(1);
+    scanned[0].isDir = true;
+    std::mutex mutex;
+    ParallelWalker::Options walkOptions;
+    walkOptions.maxThreads = options.maxThreads;
+    walkOptions.sameFilesystem = true;
+    ParallelWalker(walkOptions).walk(
+        rootPath,
+        [&](std::vector<WalkEntry>&& batch) {
+            const std::lock_guard<std::mutex> lock(mutex);
+            for (WalkEntry& entry : batch) {
+                if (!entry.isDir() && !entry.isFile())
+                    continue;
+                ScannedEntry scannedEntry;
+                scannedEntry.relativePath = std::move(entry.relativePath);
+                scannedEntry.size = entry.isFile() ? entry.size : 0;
+                scannedEntry.mtimeNs = entry.mtimeNs;
+                scannedEntry.uid = entry.uid;
+                scannedEntry.isDir = entry.isDir();
+                scanned.push_back(std::move(scannedEntry));
+            }
+            if (onProgress)
+                onProgress(scanned.size(), 0);
+        },
+        cancel,
+        errors);
+    if (cancelled())
+        return false;
+
+    // Link entries to their parents and lay them out breadth-first, each
+    // folder's children sorted by name.
+    const size_t scannedCount = scanned.size();
+    QHash<QString, std::uint32_t> dirIndex;
+    dirIndex.insert(QString(), 0);
+    for (size_t i = 1; i < scannedCount; ++i) {
+        if (scanned[i].isDir)
+            dirIndex.insert(scanned[i].relativePath, static_cast<std::uint32_t>(i));
+    }
+    std::vector<QByteArray> names(scannedCount);
+    std::vector<std::vector<std::uint32_t>> children(scannedCount);
+    for (size_t i = 1; i < scannedCount; ++i) {
+        const QString& relativePath = scanned[i].relativePath;
+        const qsizetype slash = relativePath.lastIndexOf('/');
+        const std::uint32_t parent = dirIndex.value(slash < 0 ? QString() : relativePath.left(slash), NoEntry);
+        if (parent == NoEntry)
+            continue;
+        names[i] = relativePath.mid(slash + 1).toUtf8();
+        children[parent].push_back(static_cast<std::uint32_t>(i));
+    }
+    dirIndex.clear();
+
+    std::vector<std::uint32_t> order;
+    order.reserve(scannedCount);
+    order.push_back(0);
+    std::vector<Record> records;
+    records.reserve(scannedCount);
+    QByteArray namePool;
+    std::uint64_t totalBytes = 0;
+    for (size_t next = 0; next < order.size(); ++next) {
+        const std::uint32_t source = order[next];
+        std::vector<std::uint32_t>& kids = children[source];
+        std::sort(kids.begin(), kids.end(), [&names](std::uint32_t a, std::uint32_t b) { return names[a] < names[b]; });
+
+        Record record {};
+        record.size = scanned[source].size;
+        record.mtimeNs = scanned[source].mtimeNs;
+        record.flags = scanned[source].isDir ? RecordIsDir : 0;
+        record.nameOffset = static_cast<std::uint32_t>(namePool.size());
+        record.nameSize = static_cast<std::uint16_t>(names[source].size());
+        record.firstChild = static_cast<std::uint32_t>(order.size());
+        record.childCount = static_cast<std::uint32_t>(kids.size());
+        records.push_back(record);
+        namePool.append(names[source]);
+        totalBytes += record.size;
+        order.insert(order.end(), kids.begin(), kids.end());
+        std::vector<std::uint32_t>().swap(kids);
+    }
+    // Parents are known once every record has its final index.
+    records[0].parent = NoEntry;
+    for (std::uint32_t entry = 0; entry < records.size(); ++entry) {
+        for (std::uint32_t child = 0; child < records[entry].childCount; ++child)
+            records[records[entry].firstChild + child].parent = entry;
+    }
+
+    // Optionally hash every file.
+    QByteArray digests;
+    if (options.withHashes) {
+        digests.fill('\0', static_cast<qsizetype>(records.size() * DigestSize));
+        std::vector<std::uint32_t> files;
+        for (std::uint32_t entry = 0; entry < records.size(); ++entry) {
+            if (!(records[entry].flags & RecordIsDir))
+                files.push_back(entry);
+        }
+
+        std::atomic<std::uint64_t> hashedBytes = 0;
+        QThreadPool pool;
+        pool.setMaxThreadCount(options.maxThreads > 0 ? options.maxThreads
+                                                      : static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+        for (size_t begin = 0; begin < files.size(); begin += HashBatchSize) {
+            const size_t end = std::min(files.size(), begin + HashBatchSize);
+            pool.start([&, begin, end] {
+                for (size_t i = begin; i < end && !cancelled(); ++i) {
+                    const std::uint32_t entry = files[i];
+                    const QString filePath = QDir(rootPath).filePath(scanned[order[entry]].relativePath);
+                    QString error;
+                    // Indexing reads the drive; it doesn't write to it.
+                    const QByteArray digest = HashCache::instance().fileDigest(filePath, cancel, &error, HashCache::Store::TableOnly);
+                    if (digest.size() == static_cast<qsizetype>(DigestSize)) {
+                        std::memcpy(digests.data() + static_cast<qsizetype>(entry * DigestSize), digest.constData(), DigestSize);
+                    } else if (!error.isEmpty() && errors) {
+                        const std::lock_guard<std::mutex> lock(mutex);
+                        errors->push_back(error);
+                    }
+                    hashedBytes.fetch_add(records[entry].size, std::memory_order_relaxed);
+                }
+            });
+        }
+        while (!pool.waitForDone(100)) {
+            if (onProgress)
+                onProgress(hashedBytes.load(std::memory_order_relaxed), totalBytes);
+        }
+        if (cancelled())
+            return false;
+    }
+
+    // Write the file.
+    const std::int64_t createdNs = QDateTime::currentMSecsSinceEpoch() * 1000000LL;
+    const QByteArray labelBytes = label.toUtf8();
+    const QByteArray rootBytes = rootPath.toUtf8();
+    CatalogHeader header {};
+    std::memcpy(header.magic, CatalogMagic, sizeof(CatalogMagic));
+    header.version = CatalogVersion;
+    header.entryCount = static_cast<std::uint32_t>(records.size());
+    header.labelSize = static_cast<std::uint32_t>(labelBytes.size());
+    header.rootPathSize = static_cast<std::uint32_t>(rootBytes.size());
+    header.createdNs = createdNs;
+    header.totalBytes = totalBytes;
+    header.recordsOffset = alignTo8(sizeof(header) + labelBytes.size() + rootBytes.size());
+    header.namesOffset = header.recordsOffset + records.size() * sizeof(Record);
+    header.namesSize = static_cast<std::uint64_t>(namePool.size());
+    header.hashesOffset = options.withHashes ? alignTo8(header.namesOffset + header.namesSize) : 0;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return fail(QString("Failed to write catalog: %1").arg(path));
+    const QByteArray padding(8, '\0');
+    bool ok = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == static_cast<qint64>(sizeof(header))
+        && file.write(labelBytes) == labelBytes.size()
+        && file.write(rootBytes) == rootBytes.size()
+        && file.write(padding.constData(), static_cast<qint64>(header.recordsOffset - sizeof(header) - labelBytes.size() - rootBytes.size())) >= 0
+        && file.write(reinterpret_cast<const char*>(records.data()), static_cast<qint64>(records.size() * sizeof(Record)))
+            == static_cast<qint64>(records.size() * sizeof(Record))
+        && file.write(namePool) == namePool.size();
+    if (ok && options.withHashes) {
+        ok = file.write(padding.constData(), static_cast<qint64>(header.hashesOffset - header.namesOffset - header.namesSize)) >= 0
+            && file.write(digests) == digests.size();
+    }
+    if (!ok || !file.commit())
+        return fail(QString("Failed to write catalog: %1").arg(path));
+
+    // The columns for metadata queries, in the same order. A catalog without
+    // them still browses and searches by name.
+    MetadataIndex::Columns columns;
+    columns.sizes.resize(records.size());
+    columns.mtimesNs.resize(records.size());
+    columns.uids.resize(records.size());
+    columns.parents.resize(records.size());
+    columns.types.resize(records.size());
+    QHash<QString, std::uint16_t> typeIds;
+    for (std::uint32_t entry = 0; entry < records.size(); ++entry) {
+        const ScannedEntry& source = scanned[order[entry]];
+        columns.sizes[entry] = records[entry].size;
+        columns.mtimesNs[entry] = records[entry].mtimeNs;
+        columns.uids[entry] = source.uid;
+        columns.parents[entry] = entry == 0 ? 0 : records[entry].parent;
+        std::uint16_t type = MetadataIndex::NoSuffixType;
+        if (source.isDir) {
+            type = MetadataIndex::FolderType;
+        } else {
+            const qsizetype dot = source.relativePath.lastIndexOf('.');
+            const qsizetype slash = source.relativePath.lastIndexOf('/');
+            if (dot > slash + 1) {
+                const QString suffix = source.relativePath.mid(dot + 1).toLower();
+                auto it = typeIds.constFind(suffix);
+                if (it == typeIds.constEnd() && columns.typeNames.size() <= 0xFFFF) {
+                    it = typeIds.insert(suffix, static_cast<std::uint16_t>(columns.typeNames.size()));
+                    columns.typeNames.push_back(suffix);
+                }
+                if (it != typeIds.constEnd())
+                    type = it.value();
+            }
+        }
+        columns.types[entry] = type;
+    }
+    QString indexError;
+    if (!MetadataIndex::write(uuid, createdNs, columns, &indexError) && errors)
+        errors->push_back(indexError);
+    return true;
+}
+
+std::shared_ptr<DriveCatalog> DriveCatalog::open(const QString& uuid, QString* error)
+{
+    const auto fail = [&](const QString& reason) {
+        if (error)
+            *error = QString("%1: %2").arg(reason, uuid);
+        return nullptr;
+    };
+    const QString path = isValidUuid(uuid) ? catalogPath(uuid) : QString();
+    if (path.isEmpty())
+        return fail("No catalog for drive");
+
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return fail("No catalog for drive");
+    struct stat st {};
+    void* map = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(CatalogHeader))
+        map = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return fail("Failed to read catalog");
+
+    std::shared_ptr<DriveCatalog> catalog(new DriveCatalog());
+    catalog->map_ = static_cast<const unsigned char*>(map);
+    catalog->mapSize_ = static_cast<size_t>(st.st_size);
+
+    CatalogHeader header;
+    std::memcpy(&header, catalog->map_, sizeof(header));
+    const std::uint64_t size = catalog->mapSize_;
+    const std::uint64_t recordsSize = static_cast<std::uint64_t>(header.entryCount) * sizeof(Record);
+    const bool valid = std::memcmp(header.magic, CatalogMagic, sizeof(CatalogMagic)) == 0
+        && header.version == CatalogVersion
+        && header.entryCount > 0
+        && sizeof(header) + static_cast<std::uint64_t>(header.labelSize) + header.rootPathSize <= header.recordsOffset
+        && header.recordsOffset % 8 == 0
+        && header.recordsOffset + recordsSize <= header.namesOffset
+        && header.namesOffset <= size && header.namesSize <= size - header.namesOffset
+        && (header.hashesOffset == 0
+            || (header.hashesOffset >= header.namesOffset + header.namesSize && header.hashesOffset <= size
+                && static_cast<std::uint64_t>(header.entryCount) * DigestSize <= size - header.hashesOffset));
+    if (!valid)
+        return fail("Corrupt catalog");
+
+    const char* strings = reinterpret_cast<const char*>(catalog->map_ + sizeof(header));
+    catalog->uuid_ = uuid;
+    catalog->label_ = QString::fromUtf8(strings, static_cast<qsizetype>(header.labelSize));
+    catalog->rootPath_ = QString::fromUtf8(strings + header.labelSize, static_cast<qsizetype>(header.rootPathSize));
+    catalog->createdNs_ = header.createdNs;
+    catalog->totalBytes_ = header.totalBytes;
+    catalog->entryCount_ = header.entryCount;
+    catalog->records_ = reinterpret_cast<const Record*>(catalog->map_ + header.recordsOffset);
+    catalog->names_ = reinterpret_cast<const char*>(catalog->map_ + header.namesOffset);
+    catalog->namesSize_ = header.namesSize;
+    catalog->hashes_ = header.hashesOffset ? catalog->map_ + header.hashesOffset : nullptr;
+    return catalog;
+}
+
+bool DriveCatalog::remove(const QString& uuid, QString* error)
+{
+    const QString path = isValidUuid(uuid) ? catalogPath(uuid) : QString();
+    if (path.isEmpty() || !QFile::remove(path)) {
+        if (error)
+            *error = QString("Failed to delete catalog: %1").arg(uuid);
+        return false;
+    }
+    MetadataIndex::remove(uuid);
+    return true;
+}
+
+DriveCatalog::~DriveCatalog()
+{
+    if (map_)
+        ::munmap(const_cast<unsigned char*>(map_), mapSize_);
+}
+
+const DriveCatalog::Record& DriveCatalog::record(std::uint32_t entry) const
+{
+    return records_[entry];
+}
+
+const char* DriveCatalog::nameData(std::uint32_t entry) const
+{
+    const Record& r = record(entry);
+    if (static_cast<std::uint64_t>(r.nameOffset) + r.nameSize > namesSize_)
+        return nullptr;
+    return names_ + r.nameOffset;
+}
+
+std::uint32_t DriveCatalog::parent(std::uint32_t entry) const
+{
+    const std::uint32_t parentEntry = record(entry).parent;
+    return parentEntry < entryCount_ ? parentEntry : 0;
+}
+
+std::uint32_t DriveCatalog::firstChild(std::uint32_t entry) const
+{
+    return record(entry).firstChild;
+}
+
+std::uint32_t DriveCatalog::childCount(std::uint32_t entry) const
+{
+    // A damaged file must not send readers past the record table.
+    const Record& r = record(entry);
+    if (r.firstChild >= entryCount_)
+        return 0;
+    return std::min(r.childCount, entryCount_ - r.firstChild);
+}
+
+QString DriveCatalog::name(std::uint32_t entry) const
+{
+    const char* data = nameData(entry);
+    return data ? QString::fromUtf8(data, record(entry).nameSize) : QString();
+}
+
+QString DriveCatalog::relativePath(std::uint32_t entry) const
+{
+    QStringList parts;
+    // Bounded by the entry count in case of a cycle in a damaged file.
+    for (std::uint32_t steps = 0; entry != 0 && steps < entryCount_; ++steps) {
+        parts.prepend(name(entry));
+        entry = parent(entry);
+    }
+    return parts.join('/');
+}
+
+std::uint64_t DriveCatalog::size(std::uint32_t entry) const
+{
+    return record(entry).size;
+}
+
+std::int64_t DriveCatalog::mtimeNs(std::uint32_t entry) const
+{
+    return record(entry).mtimeNs;
+}
+
+bool DriveCatalog::isDir(std::uint32_t entry) const
+{
+    return record(entry).flags & RecordIsDir;
+}
+
+QByteArray DriveCatalog::digest(std::uint32_t entry) const
+{
+    if (!hashes_)
+        return QByteArray();
+    const unsigned char* data = hashes_ + static_cast<size_t>(entry) * DigestSize;
+    if (std::all_of(data, data + DigestSize, [](unsigned char c) { return c == 0; }))
+        return QByteArray();
+    return QByteArray(reinterpret_cast<const char*>(data), DigestSize);
+}
+
+qint64 DriveCatalog::findEntry(const QString& relativePath) const
+{
+    std::uint32_t entry = 0;
+    for (const QString& part : relativePath.split('/', Qt::SkipEmptyParts)) {
+        const QByteArray wanted = part.toUtf8();
+        std::uint32_t low = firstChild(entry);
+        std::uint32_t high = low + childCount(entry);
+        bool found = false;
+        while (low < high) {
+            const std::uint32_t mid = low + (high - low) / 2;
+            const char* data = nameData(mid);
+            const int order = data ? compareName(data, record(mid).nameSize, wanted) : -1;
+            if (order == 0) {
+                entry = mid;
+                found = true;
+                break;
+            }
+            if (order < 0)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        if (!found)
+            return -1;
+    }
+    return entry;
+}
+
+std::vector<std::uint32_t> DriveCatalog::search(const QString& text, size_t limit) const
+{
+    std::vector<std::uint32_t> matches;
+    if (text.isEmpty() || limit == 0)
+        return matches;
+
+    bool ascii = true;
+    for (const QChar c : text)
+        ascii = ascii && c.unicode() < 0x80;
+
+    // ASCII needles, the usual case, are matched on the UTF-8 bytes in
+    // place; anything else decodes each name.
+    QByteArray needle = text.toUtf8();
+    for (char& c : needle)
+        c = asciiLower(c);
+    for (std::uint32_t entry = 1; entry < entryCount_ && matches.size() < limit; ++entry) {
+        const char* data = nameData(entry);
+        if (!data)
+            continue;
+        const size_t nameSize = record(entry).nameSize;
+        bool match = false;
+        if (ascii) {
+            const char* end = data + nameSize;
+            match = std::search(data, end, needle.constData(), needle.constData() + needle.size(),
+                                [](char a, char b) { return asciiLower(a) == b; })
+                != end;
+        } else {
+            match = QString::fromUtf8(data, static_cast<qsizetype>(nameSize)).contains(text, Qt::CaseInsensitive);
+        }
+        if (match)
+            matches.push_back(entry);
+    }
+    return matches;
+}
@@ -0,0 +1,113 @@
+#ifndef DRIVECATALOG_HPP
+#define DRIVECATALOG_HPP
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// A snapshot of everything on a volume, kept after the volume is unplugged so
+// shelf and archive disks stay browsable and searchable. Catalogs live in the
+// app data directory, one file per filesystem UUID, and are memory-mapped:
+// opening one reads only its header, and a search scans the name pool in
+// place.
+//
+// The file holds fixed-size records in breadth-first order, so the children
+// of a folder are one contiguous, name-sorted run, followed by a pool of
+// UTF-8 base names and, optionally, a content digest per file. Storing base
+// names under their parent instead of full paths is what keeps a catalog
+// small; a million entries take about 60 MB.
+class DriveCatalog
+{
+public:
+    struct Options
+    {
+        int maxThreads = 0;
+        // Reads every file for its content digest (hashFileContents()),
+        // reusing digests the HashCache already has.
+        bool withHashes = false;
+    };
+
+    using ProgressCallback = std::function<void(std::uint64_t done, std::uint64_t total)>;
+
+    // Paths of the form "catalog://<uuid>/<path inside the volume>" name
+    // entries of a catalog wherever a folder path is expected.
+    static QString rootUrl(const QString& uuid);
+    static bool splitUrl(const QString& url, QString* uuid, QString* innerPath);
+
+    static QString catalogDirectory();
+    static QString catalogPath(const QString& uuid);
+    static QStringList catalogUuids();
+    // The UUID under /dev/disk/by-uuid of a block device such as "/dev/sdb1",
+    // or an empty string for volumes without one (network, tmpfs, ...).
+    static QString filesystemUuid(const QString& device);
+
+    // Walks rootPath without leaving its filesystem and replaces the catalog
+    // for uuid. Progress counts entries while walking and bytes while hashing.
+    static bool build(const QString& rootPath,
+                      const QString& uuid,
+                      const QString& label,
+                      Options options,
+                      const ProgressCallback& onProgress,
+                      const std::atomic_bool* cancel,
+                      QStringList* errors);
+    static std::shared_ptr<DriveCatalog> open(const QString& uuid, QString* error);
+    static bool remove(const QString& uuid, QString* error);
+
+    ~DriveCatalog();
+    DriveCatalog(const DriveCatalog&) = delete;
+    DriveCatalog& operator=(const DriveCatalog&) = delete;
+
+    const QString& uuid() const { return uuid_; }
+    const QString& label() const { return label_; }
+    // Where the volume was mounted when it was scanned.
+    const QString& rootPath() const { return rootPath_; }
+    std::int64_t createdNs() const { return createdNs_; }
+    std::uint64_t totalBytes() const { return totalBytes_; }
+    bool hasHashes() const { return hashes_ != nullptr; }
+
+    // Entry 0 is the root of the volume.
+    std::uint32_t entryCount() const { return entryCount_; }
+    std::uint32_t parent(std::uint32_t entry) const;
+    std::uint32_t firstChild(std::uint32_t entry) const;
+    std::uint32_t childCount(std::uint32_t entry) const;
+    QString name(std::uint32_t entry) const;
+    QString relativePath(std::uint32_t entry) const;
+    std::uint64_t size(std::uint32_t entry) const;
+    std::int64_t mtimeNs(std::uint32_t entry) const;
+    bool isDir(std::uint32_t entry) const;
+    // Empty when the catalog has no digest for the entry.
+    QByteArray digest(std::uint32_t entry) const;
+
+    // -1 if the catalog has no such entry.
+    qint64 findEntry(const QString& relativePath) const;
+    // Entries whose name contains text, ignoring case, in catalog order.
+    std::vector<std::uint32_t> search(const QString& text, size_t limit) const;
+
+private:
+    struct Record;
+
+    DriveCatalog() = default;
+    const Record& record(std::uint32_t entry) const;
+    const char* nameData(std::uint32_t entry) const;
+
+    QString uuid_;
+    QString label_;
+    QString rootPath_;
+    std::int64_t createdNs_ = 0;
+    std::uint64_t totalBytes_ = 0;
+    std::uint32_t entryCount_ = 0;
+    const unsigned char* map_ = nullptr;
+    size_t mapSize_ = 0;
+    const Record* records_ = nullptr;
+    const char* names_ = nullptr;
+    std::uint64_t namesSize_ = 0;
+    const unsigned char* hashes_ = nullptr;
+};
+
+#endif // DRIVECATALOG_HPP
@@ -0,0 +1,370 @@
+#include "duplicatefinder.hpp"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThreadPool>
+
+#include "filehash.hpp"
+#include "hashcache.hpp"
+#include "parallelwalker.hpp"
+#include "scopedfd.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct InodeKey
+{
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+
+    bool operator==(const InodeKey&) const = default;
+};
+
+struct InodeKeyHash
+{
+    size_t operator()(const InodeKey& key) const noexcept
+    {
+        return std::hash<std::uint64_t>{}(key.inode * 0x9e3779b97f4a7c15ULL ^ key.device);
+    }
+};
+
+struct Candidate
+{
+    DuplicateFile file;
+    std::uint64_t size = 0;
+    QByteArray sample;
+    QByteArray digest;
+};
+
+struct HashBatch
+{
+    std::uint64_t size = 0;
+    std::vector<size_t> members;
+    std::atomic<size_t> pending = 0;
+};
+
+constexpr int ProgressIntervalMs = 100;
+constexpr int FullHashPriority = 1;
+constexpr size_t CompareChunkSize = 1024 * 1024;
+
+bool preadFully(int fd, char* data, size_t length, std::uint64_t offset)
+{
+    while (length > 0) {
+        const ssize_t n = ::pread(fd, data, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+// The file as scanned, or an invalid descriptor if it changed or was
+// replaced since.
+ScopedFd openUnchanged(const DuplicateFile& file, std::uint64_t size)
+{
+    ScopedFd fd(::open(QFile::encodeName(file.path).constData(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_NOFOLLOW | O_CLOEXEC));
+    struct stat st {};
+    if (!fd.isValid() || ::fstat(fd.get(), &st) != 0 || !S_ISREG(st.st_mode))
+        return ScopedFd();
+    const std::int64_t mtimeNs = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    if (static_cast<std::uint64_t>(st.st_dev) != file.device || static_cast<std::uint64_t>(st.st_ino) != file.inode
+        || static_cast<std::uint64_t>(st.st_size) != size || mtimeNs != file.mtimeNs)
+        return ScopedFd();
+    return fd;
+}
+
+} // namespace
+
+std::uint64_t DuplicateGroup::reclaimableBytes() const
+{
+    return files.size() > 1 ? size * (files.size() - 1) : 0;
+}
+
+DuplicateFinder::DuplicateFinder() = default;
+
+DuplicateFinder::DuplicateFinder(Options options)
+    : options_(options)
+{
+}
+
+bool DuplicateFinder::run(const QString& root,
+                          const GroupCallback& onGroup,
+                          const ProgressCallback& onProgress,
+                          const std::atomic_bool* cancel,
+                          QStringList* errors) const
+{
+    const auto isCancelled = [cancel] { return cancel && cancel->load(std::memory_order_relaxed); };
+
+    std::mutex mutex;
+    std::vector<Candidate> candidates;
+    std::unordered_set<InodeKey, InodeKeyHash> linkedInodes;
+    Progress progress;
+    auto lastReport = std::chrono::steady_clock::now();
+
+    const auto reportLocked = [&](bool force) {
+        const auto now = std::chrono::steady_clock::now();
+        if (!force && now - lastReport < std::chrono::milliseconds(ProgressIntervalMs))
+            return;
+        lastReport = now;
+        if (onProgress)
+            onProgress(progress);
+    };
+
+    ParallelWalker::Options walkOptions;
+    walkOptions.maxThreads = options_.maxThreads;
+    walkOptions.includeHidden = options_.includeHidden;
+    const ParallelWalker walker(walkOptions);
+    const bool walked = walker.walk(
+        root,
+        [&](std::vector<WalkEntry>&& batch) {
+            std::lock_guard lock(mutex);
+            for (WalkEntry& entry : batch) {
+                if (!entry.isFile() || entry.size < options_.minimumSize)
+                    continue;
+                ++progress.filesScanned;
+                if (entry.linkCount > 1 && !linkedInodes.insert({entry.device, entry.inode}).second)
+                    continue;
+                Candidate candidate;
+                candidate.file = {std::move(entry.path), entry.device, entry.inode, entry.mtimeNs};
+                candidate.size = entry.size;
+                candidates.push_back(std::move(candidate));
+            }
+            reportLocked(false);
+        },
+        cancel,
+        errors);
+    if (!walked)
+        return false;
+    linkedInodes.clear();
+
+    std::vector<size_t> order(candidates.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return candidates[a].size > candidates[b].size;
+    });
+
+    std::vector<std::unique_ptr<HashBatch>> sizeBatches;
+    for (size_t begin = 0; begin < order.size();) {
+        size_t end = begin + 1;
+        while (end < order.size() && candidates[order[end]].size == candidates[order[begin]].size)
+            ++end;
+        if (end - begin > 1) {
+            auto batch = std::make_unique<HashBatch>();
+            batch->size = candidates[order[begin]].size;
+            batch->members.assign(order.begin() + static_cast<std::ptrdiff_t>(begin),
+                                  order.begin() + static_cast<std::ptrdiff_t>(end));
+            batch->pending = batch->members.size();
+            sizeBatches.push_back(std::move(batch));
+        }
+        begin = end;
+    }
+    order.clear();
+    order.shrink_to_fit();
+
+    {
+        std::lock_guard lock(mutex);
+        progress.stage = Stage::Hashing;
+        for (const auto& batch : sizeBatches)
+            progress.filesToHash += batch->members.size();
+        reportLocked(true);
+    }
+
+    QThreadPool pool;
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    pool.setMaxThreadCount(options_.maxThreads > 0 ? options_.maxThreads : static_cast<int>(hardware));
+
+    std::vector<std::unique_ptr<HashBatch>> fullBatches;
+
+    const auto noteHashed = [&](const QString& error) {
+        std::lock_guard lock(mutex);
+        ++progress.filesHashed;
+        if (!error.isEmpty() && errors)
+            errors->push_back(error);
+        reportLocked(false);
+    };
+
+    // Splits a finished batch into runs of two or more files with equal digests.
+    const auto splitByDigest = [&](const HashBatch& batch, QByteArray Candidate::*digest) {
+        std::vector<std::vector<size_t>> runs;
+        std::vector<size_t> members;
+        members.reserve(batch.members.size());
+        for (const size_t index : batch.members) {
+            if (!(candidates[index].*digest).isEmpty())
+                members.push_back(index);
+        }
+        std::stable_sort(members.begin(), members.end(), [&](size_t a, size_t b) {
+            return candidates[a].*digest < candidates[b].*digest;
+        });
+        for (size_t begin = 0; begin < members.size();) {
+            size_t end = begin + 1;
+            while (end < members.size() && candidates[members[end]].*digest == candidates[members[begin]].*digest)
+                ++end;
+            if (end - begin > 1)
+                runs.emplace_back(members.begin() + static_cast<std::ptrdiff_t>(begin),
+                                  members.begin() + static_cast<std::ptrdiff_t>(end));
+            begin = end;
+        }
+        return runs;
+    };
+
+    const auto emitGroup = [&](std::uint64_t size, const std::vector<size_t>& members, QByteArray Candidate::*digest) {
+        if (!onGroup || isCancelled())
+            return;
+        DuplicateGroup group;
+        group.size = size;
+        group.digest = candidates[members.front()].*digest;
+        group.files.reserve(members.size());
+        for (const size_t index : members)
+            group.files.push_back(candidates[index].file);
+        std::sort(group.files.begin(), group.files.end(), [](const DuplicateFile& a, const DuplicateFile& b) {
+            return a.path < b.path;
+        });
+        onGroup(std::move(group));
+    };
+
+    const auto finishFullBatch = [&](const HashBatch& batch) {
+        for (const std::vector<size_t>& run : splitByDigest(batch, &Candidate::digest))
+            emitGroup(batch.size, run, &Candidate::digest);
+    };
+
+    const auto finishSampleBatch = [&](const HashBatch& batch) {
+        for (const std::vector<size_t>& run : splitByDigest(batch, &Candidate::sample)) {
+            if (batch.size <= FileHashSampleThreshold) {
+                emitGroup(batch.size, run, &Candidate::sample);
+                continue;
+            }
+
+            HashBatch* fullBatch = nullptr;
+            {
+                std::lock_guard lock(mutex);
+                auto owned = std::make_unique<HashBatch>();
+                owned->size = batch.size;
+                owned->members = run;
+                owned->pending = run.size();
+                fullBatch = owned.get();
+                fullBatches.push_back(std::move(owned));
+                progress.filesToHash += run.size();
+            }
+            for (const size_t index : run) {
+                pool.start(
+                    [&, fullBatch, index] {
+                        Candidate& candidate = candidates[index];
+                        QString error;
+                        // Duplicates get trashed or replaced: the attribute alone isn't proof enough.
+                        if (!isCancelled()) {
+                            candidate.digest = HashCache::instance().fileDigest(
+                                candidate.file.path, cancel, &error, HashCache::Store::Everywhere, HashCache::Match::FullKey);
+                        }
+                        noteHashed(isCancelled() ? QString() : error);
+                        if (fullBatch->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                            finishFullBatch(*fullBatch);
+                    },
+                    FullHashPriority);
+            }
+        }
+    };
+
+    for (const auto& owned : sizeBatches) {
+        HashBatch* batch = owned.get();
+        for (const size_t index : batch->members) {
+            pool.start([&, batch, index] {
+                Candidate& candidate = candidates[index];
+                QString error;
+                if (!isCancelled())
+                    candidate.sample = hashFileSample(candidate.file.path, candidate.size, &error);
+                noteHashed(isCancelled() ? QString() : error);
+                if (batch->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    finishSampleBatch(*batch);
+            });
+        }
+    }
+    pool.waitForDone();
+
+    {
+        std::lock_guard lock(mutex);
+        reportLocked(true);
+    }
+    return !isCancelled();
+}
+
+bool hasSameContents(const DuplicateFile& keep,
+                     const DuplicateFile& target,
+                     std::uint64_t size,
+                     const std::atomic_bool* cancel,
+                     QString* error)
+{
+    const auto fail = [&](const QString& reason) {
+        if (error)
+            *error = QString("%1: %2").arg(reason, target.path);
+        return false;
+    };
+    const ScopedFd keepFd = openUnchanged(keep, size);
+    const ScopedFd targetFd = openUnchanged(target, size);
+    if (!keepFd.isValid() || !targetFd.isValid())
+        return fail("Changed since the scan, skipped");
+
+    std::vector<char> keepData(CompareChunkSize);
+    std::vector<char> targetData(CompareChunkSize);
+    for (std::uint64_t done = 0; done < size;) {
+        if (cancel && cancel->load())
+            return fail("Operation cancelled");
+        const size_t n = static_cast<size_t>(std::min<std::uint64_t>(CompareChunkSize, size - done));
+        if (!preadFully(keepFd.get(), keepData.data(), n, done) || !preadFully(targetFd.get(), targetData.data(), n, done))
+            return fail("Failed to read, skipped");
+        if (std::memcmp(keepData.data(), targetData.data(), n) != 0)
+            return fail("Contents differ from the kept copy, skipped");
+        done += n;
+    }
+    return true;
+}
+
+bool replaceWithHardLink(const DuplicateFile& keep,
+                         const DuplicateFile& target,
+                         std::uint64_t size,
+                         const std::atomic_bool* cancel,
+                         QString* error)
+{
+    if (keep.device != target.device) {
+        if (error)
+            *error = QString("Hard links can't cross filesystems:\n%1\n→ %2").arg(keep.path, target.path);
+        return false;
+    }
+    if (!hasSameContents(keep, target, size, cancel, error))
+        return false;
+
+    const QFileInfo targetInfo(target.path);
+    const QString tempPath = targetInfo.dir().filePath(
+        QString(".%1.kitaplik-link-%2").arg(targetInfo.fileName(), QString::number(QDateTime::currentMSecsSinceEpoch())));
+    const QByteArray nativeTemp = QFile::encodeName(tempPath);
+    if (::link(QFile::encodeName(keep.path).constData(), nativeTemp.constData()) != 0) {
+        if (error)
+            *error = QString("Failed to create hard link: %1").arg(target.path);
+        return false;
+    }
+    if (::rename(nativeTemp.constData(), QFile::encodeName(target.path).constData()) != 0) {
+        ::unlink(nativeTemp.constData());
+        if (error)
+            *error = QString("Failed to replace: %1").arg(target.path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,90 @@
+#ifndef DUPLICATEFINDER_HPP
+#define DUPLICATEFINDER_HPP
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct DuplicateFile
+{
+    QString path;
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::int64_t mtimeNs = 0;
+};
+
+struct DuplicateGroup
+{
+    std::uint64_t size = 0;
+    QByteArray digest;
+    std::vector<DuplicateFile> files;
+
+    std::uint64_t reclaimableBytes() const;
+};
+
+// Finds identical files below a root in three narrowing stages: files are
+// grouped by size during a parallel scan, same-size files are compared by a
+// sampled hash of their head, middle and tail, and only the survivors are
+// hashed completely, through HashCache so unchanged files aren't read again.
+// Hardlinks to an already seen inode are skipped.
+class DuplicateFinder
+{
+public:
+    enum class Stage
+    {
+        Scanning,
+        Hashing,
+    };
+
+    struct Options
+    {
+        int maxThreads = 0;
+        std::uint64_t minimumSize = 1;
+        bool includeHidden = false;
+    };
+
+    struct Progress
+    {
+        Stage stage = Stage::Scanning;
+        std::uint64_t filesScanned = 0;
+        std::uint64_t filesHashed = 0;
+        std::uint64_t filesToHash = 0;
+    };
+
+    using GroupCallback = std::function<void(DuplicateGroup&& group)>;
+    using ProgressCallback = std::function<void(const Progress& progress)>;
+
+    DuplicateFinder();
+    explicit DuplicateFinder(Options options);
+
+    // Callbacks run on worker threads; groups are delivered as soon as their
+    // full hashes are known, largest file sizes first.
+    bool run(const QString& root,
+             const GroupCallback& onGroup,
+             const ProgressCallback& onProgress,
+             const std::atomic_bool* cancel,
+             QStringList* errors) const;
+
+private:
+    Options options_;
+};
+
+// Compares the two files byte for byte, each opened and checked against its
+// scan first, so a digest alone never decides what is deleted or replaced.
+bool hasSameContents(const DuplicateFile& keep,
+                     const DuplicateFile& target,
+                     std::uint64_t size,
+                     const std::atomic_bool* cancel,
+                     QString* error);
+bool replaceWithHardLink(const DuplicateFile& keep,
+                         const DuplicateFile& target,
+                         std::uint64_t size,
+                         const std::atomic_bool* cancel,
+                         QString* error);
+
+#endif // DUPLICATEFINDER_HPP
@@ -0,0 +1,525 @@
+#include "duplicatefinderdialog.hpp"
+
+#include <QDialogButtonBox>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLocale>
+#include <QMessageBox>
+#include <QMetaObject>
+#include <QPointer>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include <algorithm>
+#include <climits>
+#include <utility>
+
+namespace {
+
+constexpr int GroupIndexRole = Qt::UserRole + 1;
+constexpr int FileIndexRole = Qt::UserRole + 2;
+
+QString formatSize(std::uint64_t bytes)
+{
+    return QLocale::system().formattedDataSize(static_cast<qint64>(bytes));
+}
+
+} // namespace
+
+DuplicateFinderDialog::DuplicateFinderDialog(const QString& root, TrashFunction moveToTrash, QWidget* parent)
+    : QDialog(parent)
+    , root_(root)
+    , moveToTrash_(std::move(moveToTrash))
+{
+    setWindowTitle(QString("Duplicates in %1").arg(root_));
+    resize(800, 500);
+
+    statusLabel_ = new QLabel(this);
+    progressBar_ = new QProgressBar(this);
+    resultsTree_ = new QTreeWidget(this);
+    resultsTree_->setColumnCount(2);
+    resultsTree_->setHeaderLabels({"File", "Size"});
+    resultsTree_->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    resultsTree_->header()->setSectionResizeMode(1, QHeaderView::ResizeToContents);
+    resultsTree_->setUniformRowHeights(true);
+
+    QPushButton* selectButton = new QPushButton("Check All but First", this);
+    trashButton_ = new QPushButton("Move Checked to Trash", this);
+    hardLinkButton_ = new QPushButton("Replace Checked with Hard Links", this);
+    reflinkButton_ = new QPushButton("Dedupe Checked (Reflink)", this);
+    reflinkButton_->setToolTip("Share the data of checked files with the unchecked copy in their group.\n"
+                               "Both paths stay independent files; needs btrfs, XFS or another reflink-capable filesystem.");
+    stopButton_ = new QPushButton("Stop", this);
+    QDialogButtonBox* closeBox = new QDialogButtonBox(QDialogButtonBox::Close, this);
+
+    QHBoxLayout* actions = new QHBoxLayout();
+    actions->addWidget(selectButton);
+    actions->addWidget(trashButton_);
+    actions->addWidget(hardLinkButton_);
+    actions->addWidget(reflinkButton_);
+    actions->addStretch(1);
+    actions->addWidget(stopButton_);
+    actions->addWidget(closeBox);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(statusLabel_);
+    layout->addWidget(progressBar_);
+    layout->addWidget(resultsTree_, 1);
+    layout->addLayout(actions);
+
+    connect(selectButton, &QPushButton::clicked, this, &DuplicateFinderDialog::checkAllButFirst);
+    connect(trashButton_, &QPushButton::clicked, this, &DuplicateFinderDialog::trashCheckedFiles);
+    connect(hardLinkButton_, &QPushButton::clicked, this, &DuplicateFinderDialog::hardLinkCheckedFiles);
+    connect(reflinkButton_, &QPushButton::clicked, this, &DuplicateFinderDialog::reflinkCheckedFiles);
+    connect(stopButton_, &QPushButton::clicked, this, [this] { cancel_.store(true); });
+    connect(closeBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    startSearch();
+}
+
+DuplicateFinderDialog::~DuplicateFinderDialog()
+{
+    cancel_.store(true);
+    if (worker_.joinable())
+        worker_.join();
+}
+
+void DuplicateFinderDialog::startSearch()
+{
+    searching_ = true;
+    cancel_.store(false);
+    stopButton_->setEnabled(true);
+    progressBar_->setRange(0, 0);
+    statusLabel_->setText("Scanning...");
+    updateSummary();
+
+    QPointer<DuplicateFinderDialog> self(this);
+    worker_ = std::jthread([self, this, root = root_] {
+        const auto onGroup = [self, this](DuplicateGroup&& group) {
+            bool schedule = false;
+            {
+                std::lock_guard lock(pendingMutex_);
+                pendingGroups_.push_back(std::move(group));
+                schedule = !std::exchange(flushScheduled_, true);
+            }
+            if (schedule && self) {
+                QMetaObject::invokeMethod(
+                    self,
+                    [self] {
+                        if (self)
+                            self->flushPendingGroups();
+                    },
+                    Qt::QueuedConnection);
+            }
+        };
+        const auto onProgress = [self](const DuplicateFinder::Progress& progress) {
+            if (!self)
+                return;
+            QMetaObject::invokeMethod(
+                self,
+                [self, progress] {
+                    if (self)
+                        self->updateProgress(progress);
+                },
+                Qt::QueuedConnection);
+        };
+
+        QStringList errors;
+        const bool completed = DuplicateFinder().run(root, onGroup, onProgress, &cancel_, &errors);
+
+        QString errorText;
+        if (!completed && !cancel_.load() && !errors.isEmpty())
+            errorText = errors.front();
+        if (!self)
+            return;
+        QMetaObject::invokeMethod(
+            self,
+            [self, errorText] {
+                if (!self)
+                    return;
+                self->flushPendingGroups();
+                self->finishSearch(errorText);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void DuplicateFinderDialog::flushPendingGroups()
+{
+    std::vector<DuplicateGroup> groups;
+    {
+        std::lock_guard lock(pendingMutex_);
+        groups.swap(pendingGroups_);
+        flushScheduled_ = false;
+    }
+    for (DuplicateGroup& group : groups)
+        addGroup(std::move(group));
+    updateSummary();
+}
+
+void DuplicateFinderDialog::addGroup(DuplicateGroup&& group)
+{
+    const int groupIndex = static_cast<int>(groups_.size());
+    QTreeWidgetItem* groupItem = new QTreeWidgetItem(resultsTree_);
+    groupItem->setData(0, GroupIndexRole, groupIndex);
+
+    for (int i = 0; i < static_cast<int>(group.files.size()); ++i) {
+        QTreeWidgetItem* fileItem = new QTreeWidgetItem(groupItem);
+        fileItem->setText(0, group.files[static_cast<size_t>(i)].path);
+        fileItem->setText(1, formatSize(group.size));
+        fileItem->setData(0, GroupIndexRole, groupIndex);
+        fileItem->setData(0, FileIndexRole, i);
+        fileItem->setFlags(fileItem->flags() | Qt::ItemIsUserCheckable);
+        fileItem->setCheckState(0, i == 0 ? Qt::Unchecked : Qt::Checked);
+    }
+    setGroupItemText(groupItem, group);
+    groupItem->setExpanded(true);
+    groups_.push_back(std::move(group));
+}
+
+void DuplicateFinderDialog::updateProgress(const DuplicateFinder::Progress& progress)
+{
+    if (!searching_)
+        return;
+    if (progress.stage == DuplicateFinder::Stage::Scanning) {
+        progressBar_->setRange(0, 0);
+        statusLabel_->setText(QString("Scanning... %1 files").arg(QLocale::system().toString(static_cast<qulonglong>(progress.filesScanned))));
+        return;
+    }
+
+    const int total = static_cast<int>(std::min<std::uint64_t>(progress.filesToHash, INT_MAX));
+    progressBar_->setRange(0, std::max(total, 1));
+    progressBar_->setValue(static_cast<int>(std::min<std::uint64_t>(progress.filesHashed, INT_MAX)));
+    statusLabel_->setText(QString("Comparing contents... %1 of %2 files")
+                              .arg(QLocale::system().toString(static_cast<qulonglong>(progress.filesHashed)),
+                                   QLocale::system().toString(static_cast<qulonglong>(progress.filesToHash))));
+}
+
+void DuplicateFinderDialog::finishSearch(const QString& errorText)
+{
+    searching_ = false;
+    stopButton_->setEnabled(false);
+    progressBar_->setRange(0, 1);
+    progressBar_->setValue(1);
+    updateSummary();
+    if (!errorText.trimmed().isEmpty())
+        QMessageBox::warning(this, "Find Duplicates", errorText);
+}
+
+void DuplicateFinderDialog::updateSummary()
+{
+    std::uint64_t reclaimable = 0;
+    int groupCount = 0;
+    for (int i = 0; i < resultsTree_->topLevelItemCount(); ++i) {
+        const QTreeWidgetItem* groupItem = resultsTree_->topLevelItem(i);
+        const DuplicateGroup* group = groupForItem(groupItem);
+        if (!group || groupItem->childCount() < 2)
+            continue;
+        ++groupCount;
+        reclaimable += group->size * static_cast<std::uint64_t>(groupItem->childCount() - 1);
+    }
+
+    const bool hasResults = groupCount > 0;
+    // Each action runs on worker_, which the search holds until it is done.
+    trashButton_->setEnabled(hasResults && !searching_ && !applying_);
+    hardLinkButton_->setEnabled(hasResults && !searching_ && !applying_);
+    reflinkButton_->setEnabled(hasResults && !searching_ && !applying_);
+    if (searching_ || applying_)
+        return;
+    statusLabel_->setText(hasResults
+        ? QString("%1 groups of duplicates, %2 reclaimable").arg(QString::number(groupCount), formatSize(reclaimable))
+        : (cancel_.load() ? QString("Search stopped.") : QString("No duplicates found.")));
+}
+
+void DuplicateFinderDialog::checkAllButFirst()
+{
+    if (applying_)
+        return;
+    for (int i = 0; i < resultsTree_->topLevelItemCount(); ++i) {
+        QTreeWidgetItem* groupItem = resultsTree_->topLevelItem(i);
+        for (int j = 0; j < groupItem->childCount(); ++j)
+            groupItem->child(j)->setCheckState(0, j == 0 ? Qt::Unchecked : Qt::Checked);
+    }
+}
+
+std::vector<QTreeWidgetItem*> DuplicateFinderDialog::checkedFileItems() const
+{
+    std::vector<QTreeWidgetItem*> items;
+    for (int i = 0; i < resultsTree_->topLevelItemCount(); ++i) {
+        QTreeWidgetItem* groupItem = resultsTree_->topLevelItem(i);
+        for (int j = 0; j < groupItem->childCount(); ++j) {
+            if (groupItem->child(j)->checkState(0) == Qt::Checked)
+                items.push_back(groupItem->child(j));
+        }
+    }
+    return items;
+}
+
+const DuplicateGroup* DuplicateFinderDialog::groupForItem(const QTreeWidgetItem* item) const
+{
+    if (!item)
+        return nullptr;
+    bool ok = false;
+    const int index = item->data(0, GroupIndexRole).toInt(&ok);
+    if (!ok || index < 0 || static_cast<size_t>(index) >= groups_.size())
+        return nullptr;
+    return &groups_[static_cast<size_t>(index)];
+}
+
+const DuplicateFile* DuplicateFinderDialog::fileForItem(const QTreeWidgetItem* item) const
+{
+    const DuplicateGroup* group = groupForItem(item);
+    if (!group)
+        return nullptr;
+    bool ok = false;
+    const int index = item->data(0, FileIndexRole).toInt(&ok);
+    if (!ok || index < 0 || static_cast<size_t>(index) >= group->files.size())
+        return nullptr;
+    return &group->files[static_cast<size_t>(index)];
+}
+
+void DuplicateFinderDialog::pruneResolvedGroups()
+{
+    for (int i = resultsTree_->topLevelItemCount() - 1; i >= 0; --i) {
+        QTreeWidgetItem* groupItem = resultsTree_->topLevelItem(i);
+        const DuplicateGroup* group = groupForItem(groupItem);
+        if (!group || groupItem->childCount() < 2) {
+            delete resultsTree_->takeTopLevelItem(i);
+            continue;
+        }
+        setGroupItemText(groupItem, *group);
+    }
+}
+
+void DuplicateFinderDialog::setGroupItemText(QTreeWidgetItem* groupItem, const DuplicateGroup& group)
+{
+    const int count = groupItem->childCount();
+    groupItem->setText(0, QString("%1 identical files, %2 each").arg(QString::number(count), formatSize(group.size)));
+    groupItem->setText(1, QString("%1 reclaimable").arg(formatSize(group.size * static_cast<std::uint64_t>(std::max(count - 1, 0)))));
+}
+
+void DuplicateFinderDialog::trashCheckedFiles()
+{
+    if (searching_ || applying_ || !moveToTrash_)
+        return;
+    const std::vector<QTreeWidgetItem*> items = checkedFileItems();
+    if (items.empty())
+        return;
+
+    const auto choice = QMessageBox::question(this,
+                                              "Move to Trash",
+                                              QString("Move %1 checked files to trash?").arg(QString::number(items.size())),
+                                              QMessageBox::Yes | QMessageBox::No);
+    if (choice != QMessageBox::Yes)
+        return;
+
+    QStringList errors;
+    std::vector<FileJob> jobs = checkedFileJobs(&errors);
+    runFileJobs(FileAction::Trash, std::move(jobs), errors);
+}
+
+void DuplicateFinderDialog::hardLinkCheckedFiles()
+{
+    if (searching_ || applying_)
+        return;
+    const std::vector<QTreeWidgetItem*> items = checkedFileItems();
+    if (items.empty())
+        return;
+
+    const auto choice = QMessageBox::question(this,
+                                              "Replace with Hard Links",
+                                              QString("Replace %1 checked files with hard links to the unchecked copy in their group?\n\n"
+                                                      "Afterwards, editing any of the paths changes all of them.")
+                                                  .arg(QString::number(items.size())),
+                                              QMessageBox::Yes | QMessageBox::No);
+    if (choice != QMessageBox::Yes)
+        return;
+
+    QStringList errors;
+    std::vector<FileJob> jobs = checkedFileJobs(&errors);
+    runFileJobs(FileAction::HardLink, std::move(jobs), errors);
+}
+
+std::vector<DuplicateFinderDialog::FileJob> DuplicateFinderDialog::checkedFileJobs(QStringList* errors)
+{
+    std::vector<FileJob> jobs;
+    jobItems_.clear();
+    for (QTreeWidgetItem* item : checkedFileItems()) {
+        const DuplicateGroup* group = groupForItem(item);
+        const DuplicateFile* target = fileForItem(item);
+        QTreeWidgetItem* groupItem = item->parent();
+        if (!group || !target || !groupItem)
+            continue;
+
+        const DuplicateFile* keep = nullptr;
+        for (int i = 0; i < groupItem->childCount() && !keep; ++i) {
+            if (groupItem->child(i)->checkState(0) == Qt::Unchecked)
+                keep = fileForItem(groupItem->child(i));
+        }
+        if (!keep) {
+            errors->push_back(QString("Leave one file unchecked to keep: %1").arg(target->path));
+            continue;
+        }
+        jobs.push_back({*keep, *target, group->size});
+        jobItems_.push_back(item);
+    }
+    return jobs;
+}
+
+// The copy that stays has to be there, and byte for byte the same, for each
+// checked file to go.
+void DuplicateFinderDialog::runFileJobs(FileAction action, std::vector<FileJob> jobs, const QStringList& errors)
+{
+    const QString title = action == FileAction::Trash ? QString("Move to Trash") : QString("Replace with Hard Links");
+    if (jobs.empty()) {
+        if (!errors.isEmpty())
+            QMessageBox::warning(this, title, errors.join("\n\n"));
+        return;
+    }
+    startBatch(jobs.size(), action == FileAction::Trash ? QString("Moving to trash...") : QString("Replacing with hard links..."));
+
+    QPointer<DuplicateFinderDialog> self(this);
+    worker_ = std::jthread([self, this, action, jobs = std::move(jobs), errors, moveToTrash = moveToTrash_] {
+        FileJobsResult result;
+        result.errors = errors;
+        for (size_t i = 0; i < jobs.size() && !cancel_.load(); ++i) {
+            const FileJob& job = jobs[i];
+            QString error;
+            bool done = false;
+            if (action == FileAction::HardLink) {
+                done = replaceWithHardLink(job.keep, job.target, job.size, &cancel_, &error);
+            } else if (hasSameContents(job.keep, job.target, job.size, &cancel_, &error)) {
+                done = moveToTrash(job.target.path, &error);
+                if (!done && error.isEmpty())
+                    error = QString("Failed to move to trash: %1").arg(job.target.path);
+            }
+            if (done) {
+                result.bytesReclaimed += job.size;
+                result.doneJobs.push_back(i);
+            } else if (!cancel_.load()) {
+                result.errors.push_back(error);
+            }
+            if (!self)
+                return;
+            QMetaObject::invokeMethod(
+                self,
+                [self, done = i + 1] {
+                    if (self)
+                        self->progressBar_->setValue(static_cast<int>(std::min<size_t>(done, INT_MAX)));
+                },
+                Qt::QueuedConnection);
+        }
+        if (!self)
+            return;
+        QMetaObject::invokeMethod(
+            self,
+            [self, action, result = std::move(result)] {
+                if (self)
+                    self->finishFileJobs(action, result);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void DuplicateFinderDialog::finishFileJobs(FileAction action, const FileJobsResult& result)
+{
+    for (const size_t index : result.doneJobs) {
+        if (index < jobItems_.size())
+            delete jobItems_[index];
+    }
+    finishBatch();
+
+    const QString title = action == FileAction::Trash ? QString("Move to Trash") : QString("Replace with Hard Links");
+    if (!result.errors.isEmpty())
+        QMessageBox::warning(this, title, result.errors.join("\n\n"));
+    else if (action == FileAction::HardLink)
+        QMessageBox::information(this, title, QString("Reclaimed %1.").arg(formatSize(result.bytesReclaimed)));
+}
+
+void DuplicateFinderDialog::reflinkCheckedFiles()
+{
+    if (searching_ || applying_)
+        return;
+    QStringList errors;
+    std::vector<ReflinkDedupeJob> jobs;
+    for (const FileJob& job : checkedFileJobs(&errors))
+        jobs.push_back({job.keep, job.target, job.size});
+    if (jobs.empty()) {
+        if (!errors.isEmpty())
+            QMessageBox::warning(this, "Dedupe (Reflink)", errors.join("\n\n"));
+        return;
+    }
+    startBatch(jobs.size(), "Deduplicating...");
+
+    QPointer<DuplicateFinderDialog> self(this);
+    worker_ = std::jthread([self, this, jobs = std::move(jobs), errors] {
+        const auto onProgress = [self](size_t done, size_t total) {
+            if (!self)
+                return;
+            QMetaObject::invokeMethod(
+                self,
+                [self, done, total] {
+                    if (!self)
+                        return;
+                    self->progressBar_->setValue(static_cast<int>(std::min<size_t>(done, INT_MAX)));
+                    self->statusLabel_->setText(QString("Deduplicating... %1 of %2 files").arg(QString::number(done), QString::number(total)));
+                },
+                Qt::QueuedConnection);
+        };
+
+        ReflinkDedupeResult result = ReflinkDeduper().run(jobs, onProgress, &cancel_);
+        result.errors.append(errors);
+        if (!self)
+            return;
+        QMetaObject::invokeMethod(
+            self,
+            [self, result = std::move(result)] {
+                if (self)
+                    self->finishReflink(result);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void DuplicateFinderDialog::finishReflink(const ReflinkDedupeResult& result)
+{
+    // Both paths still exist, but the deduplicated copies no longer take space
+    // of their own, so they leave the list like hard-linked ones do.
+    for (const size_t index : result.dedupedJobs) {
+        if (index < jobItems_.size())
+            delete jobItems_[index];
+    }
+    finishBatch();
+
+    const QString summary = QString("Shared %1 between %2 files.")
+                                .arg(formatSize(result.bytesDeduped), QString::number(result.dedupedJobs.size()));
+    if (!result.errors.isEmpty())
+        QMessageBox::warning(this, "Dedupe (Reflink)", summary + "\n\n" + result.errors.join("\n\n"));
+    else
+        QMessageBox::information(this, "Dedupe (Reflink)", summary);
+}
+
+void DuplicateFinderDialog::startBatch(size_t jobs, const QString& status)
+{
+    applying_ = true;
+    cancel_.store(false);
+    stopButton_->setEnabled(true);
+    progressBar_->setRange(0, static_cast<int>(std::min<size_t>(jobs, INT_MAX)));
+    progressBar_->setValue(0);
+    statusLabel_->setText(status);
+    updateSummary();
+}
+
+void DuplicateFinderDialog::finishBatch()
+{
+    jobItems_.clear();
+    applying_ = false;
+    stopButton_->setEnabled(false);
+    progressBar_->setRange(0, 1);
+    progressBar_->setValue(1);
+    pruneResolvedGroups();
+    updateSummary();
+}
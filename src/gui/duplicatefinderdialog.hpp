@@ -0,0 +1,100 @@
+#ifndef DUPLICATEFINDERDIALOG_HPP
+#define DUPLICATEFINDERDIALOG_HPP
+
+#include <QDialog>
+#include <QString>
+#include <QStringList>
+
+#include "duplicatefinder.hpp"
+#include "reflinkdedupe.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class QLabel;
+class QProgressBar;
+class QPushButton;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+class DuplicateFinderDialog : public QDialog
+{
+public:
+    using TrashFunction = std::function<bool(const QString& path, QString* error)>;
+
+    DuplicateFinderDialog(const QString& root, TrashFunction moveToTrash, QWidget* parent = nullptr);
+    ~DuplicateFinderDialog() override;
+
+private:
+    void startSearch();
+    void flushPendingGroups();
+    void addGroup(DuplicateGroup&& group);
+    void updateProgress(const DuplicateFinder::Progress& progress);
+    void finishSearch(const QString& errorText);
+    void updateSummary();
+    void checkAllButFirst();
+    enum class FileAction
+    {
+        Trash,
+        HardLink,
+    };
+
+    struct FileJob
+    {
+        DuplicateFile keep;
+        DuplicateFile target;
+        std::uint64_t size = 0;
+    };
+
+    struct FileJobsResult
+    {
+        std::uint64_t bytesReclaimed = 0;
+        std::vector<size_t> doneJobs;
+        QStringList errors;
+    };
+
+    void trashCheckedFiles();
+    void hardLinkCheckedFiles();
+    // Each checked file against the unchecked copy kept in its group; the
+    // rows go to jobItems_, in the same order.
+    std::vector<FileJob> checkedFileJobs(QStringList* errors);
+    void runFileJobs(FileAction action, std::vector<FileJob> jobs, const QStringList& errors);
+    void finishFileJobs(FileAction action, const FileJobsResult& result);
+    void reflinkCheckedFiles();
+    void finishReflink(const ReflinkDedupeResult& result);
+    void startBatch(size_t jobs, const QString& status);
+    void finishBatch();
+    void pruneResolvedGroups();
+    void setGroupItemText(QTreeWidgetItem* groupItem, const DuplicateGroup& group);
+    std::vector<QTreeWidgetItem*> checkedFileItems() const;
+    const DuplicateGroup* groupForItem(const QTreeWidgetItem* item) const;
+    const DuplicateFile* fileForItem(const QTreeWidgetItem* item) const;
+
+    QString root_;
+    TrashFunction moveToTrash_;
+    QLabel* statusLabel_ = nullptr;
+    QProgressBar* progressBar_ = nullptr;
+    QTreeWidget* resultsTree_ = nullptr;
+    QPushButton* trashButton_ = nullptr;
+    QPushButton* hardLinkButton_ = nullptr;
+    QPushButton* reflinkButton_ = nullptr;
+    QPushButton* stopButton_ = nullptr;
+
+    std::vector<DuplicateGroup> groups_;
+    std::mutex pendingMutex_;
+    std::vector<DuplicateGroup> pendingGroups_;
+    bool flushScheduled_ = false;
+    // Rows of the running batch's jobs, deleted as their files are dealt with.
+    std::vector<QTreeWidgetItem*> jobItems_;
+    bool searching_ = false;
+    // A trash, hard link or reflink batch is running.
+    bool applying_ = false;
+    std::atomic_bool cancel_ = false;
+    std::jthread worker_;
+};
+
+#endif // DUPLICATEFINDERDIALOG_HPP
@@ -0,0 +1,125 @@
+#include "entryselection.hpp"
+
+#include <algorithm>
+
+std::uint64_t EntrySelection::size() const
+{
+    std::uint64_t total = 0;
+    for (const Container& container : containers_)
+        total += container.count;
+    return total;
+}
+
+bool EntrySelection::contains(std::uint32_t id) const
+{
+    const Container* container = find(static_cast<std::uint16_t>(id >> 16));
+    if (!container)
+        return false;
+    const std::uint16_t low = static_cast<std::uint16_t>(id);
+    if (!container->bits.empty())
+        return (container->bits[low / 64] >> (low % 64)) & 1;
+    return std::binary_search(container->array.begin(), container->array.end(), low);
+}
+
+void EntrySelection::add(std::uint32_t id)
+{
+    Container& container = findOrInsert(static_cast<std::uint16_t>(id >> 16));
+    const std::uint16_t low = static_cast<std::uint16_t>(id);
+    if (!container.bits.empty()) {
+        std::uint64_t& word = container.bits[low / 64];
+        const std::uint64_t bit = std::uint64_t(1) << (low % 64);
+        if (!(word & bit)) {
+            word |= bit;
+            ++container.count;
+        }
+        return;
+    }
+    const auto it = std::lower_bound(container.array.begin(), container.array.end(), low);
+    if (it != container.array.end() && *it == low)
+        return;
+    container.array.insert(it, low);
+    ++container.count;
+    if (container.count > MaxArraySize)
+        toBitmap(container);
+}
+
+void EntrySelection::remove(std::uint32_t id)
+{
+    const auto found = lowerBound(static_cast<std::uint16_t>(id >> 16));
+    if (found == containers_.end() || found->key != static_cast<std::uint16_t>(id >> 16))
+        return;
+    Container& container = containers_[static_cast<size_t>(found - containers_.begin())];
+    const std::uint16_t low = static_cast<std::uint16_t>(id);
+    if (!container.bits.empty()) {
+        std::uint64_t& word = container.bits[low / 64];
+        const std::uint64_t bit = std::uint64_t(1) << (low % 64);
+        if (!(word & bit))
+            return;
+        word &= ~bit;
+        --container.count;
+        if (container.count <= MaxArraySize / 2)
+            toArray(container);
+    } else {
+        const auto it = std::lower_bound(container.array.begin(), container.array.end(), low);
+        if (it == container.array.end() || *it != low)
+            return;
+        container.array.erase(it);
+        --container.count;
+    }
+    if (container.count == 0)
+        containers_.erase(found);
+}
+
+void EntrySelection::toggle(std::uint32_t id)
+{
+    if (contains(id))
+        remove(id);
+    else
+        add(id);
+}
+
+std::vector<EntrySelection::Container>::const_iterator EntrySelection::lowerBound(std::uint16_t key) const
+{
+    return std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, std::uint16_t k) {
+        return container.key < k;
+    });
+}
+
+const EntrySelection::Container* EntrySelection::find(std::uint16_t key) const
+{
+    const auto it = lowerBound(key);
+    return it != containers_.end() && it->key == key ? &*it : nullptr;
+}
+
+EntrySelection::Container& EntrySelection::findOrInsert(std::uint16_t key)
+{
+    auto it = containers_.begin() + (lowerBound(key) - containers_.cbegin());
+    if (it == containers_.end() || it->key != key) {
+        it = containers_.insert(it, Container());
+        it->key = key;
+    }
+    return *it;
+}
+
+void EntrySelection::toBitmap(Container& container)
+{
+    container.bits.assign(BitmapWords, 0);
+    for (const std::uint16_t low : container.array)
+        container.bits[low / 64] |= std::uint64_t(1) << (low % 64);
+    container.array.clear();
+    container.array.shrink_to_fit();
+}
+
+// Switching back at half the array limit, not at the limit, keeps a container
+// that hovers around it from converting on every change.
+void EntrySelection::toArray(Container& container)
+{
+    container.array.clear();
+    container.array.reserve(container.count);
+    for (size_t word = 0; word < container.bits.size(); ++word) {
+        for (std::uint64_t bits = container.bits[word]; bits != 0; bits &= bits - 1)
+            container.array.push_back(static_cast<std::uint16_t>(word * 64 + std::countr_zero(bits)));
+    }
+    container.bits.clear();
+    container.bits.shrink_to_fit();
+}
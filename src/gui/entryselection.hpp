@@ -0,0 +1,71 @@
+#ifndef ENTRYSELECTION_HPP
+#define ENTRYSELECTION_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A set of 32-bit entry IDs, stored the way roaring bitmaps store them: IDs
+// are grouped by their upper 16 bits, and each group is a sorted array of the
+// lower halves while it is sparse and a 65536-bit bitmap once it holds more
+// than 4096 of them. Selecting every entry of a 500k-entry folder takes
+// 64 KB, and a few scattered entries take a few bytes each.
+class EntrySelection
+{
+public:
+    bool isEmpty() const { return containers_.empty(); }
+    std::uint64_t size() const;
+    bool contains(std::uint32_t id) const;
+
+    void clear() { containers_.clear(); }
+    void add(std::uint32_t id);
+    void remove(std::uint32_t id);
+    void toggle(std::uint32_t id);
+
+    // In increasing order.
+    template<typename Function>
+    void forEach(Function&& function) const;
+
+private:
+    // Beyond this many IDs an array takes more room than a bitmap.
+    static constexpr std::uint32_t MaxArraySize = 4096;
+    static constexpr size_t BitmapWords = 65536 / 64;
+
+    struct Container
+    {
+        std::uint16_t key = 0;
+        std::uint32_t count = 0;
+        // Sorted, while bits is empty.
+        std::vector<std::uint16_t> array;
+        std::vector<std::uint64_t> bits;
+    };
+
+    std::vector<Container>::const_iterator lowerBound(std::uint16_t key) const;
+    const Container* find(std::uint16_t key) const;
+    Container& findOrInsert(std::uint16_t key);
+    static void toBitmap(Container& container);
+    static void toArray(Container& container);
+
+    // Sorted by key.
+    std::vector<Container> containers_;
+};
+
+template<typename Function>
+void EntrySelection::forEach(Function&& function) const
+{
+    for (const Container& container : containers_) {
+        const std::uint32_t high = std::uint32_t(container.key) << 16;
+        if (container.bits.empty()) {
+            for (const std::uint16_t low : container.array)
+                function(high | low);
+            continue;
+        }
+        for (size_t word = 0; word < container.bits.size(); ++word) {
+            for (std::uint64_t bits = container.bits[word]; bits != 0; bits &= bits - 1)
+                function(high | static_cast<std::uint32_t>(word * 64 + std::countr_zero(bits)));
+        }
+    }
+}
+
+#endif // ENTRYSELECTION_HPP
@@ -0,0 +1,228 @@
+#include "entryselectionmodel.hpp"
+
+#include <QSortFilterProxyModel>
+
+#include "listingmodel.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Below one selected entry in this many rows, restoring the ranges looks the
+// entries up instead of scanning the rows.
+constexpr std::uint64_t SparseRestoreFactor = 8;
+
+} // namespace
+
+EntrySelectionModel::EntrySelectionModel(QSortFilterProxyModel* proxy, ListingModel* listing, QObject* parent)
+    : QItemSelectionModel(nullptr, parent)
+    , proxy_(proxy)
+    , listing_(listing)
+{
+    // Ahead of QItemSelectionModel's own handler, so it has no ranges to
+    // save persistent indexes for.
+    connect(proxy_, &QAbstractItemModel::layoutAboutToBeChanged, this, [this] { clearRanges(); });
+    connect(listing_, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this](const QModelIndex&, int first, int last) {
+        dropEntries(first, last);
+    });
+    setModel(proxy_);
+    // After it, since it replaces the ranges with the ones it saved.
+    connect(proxy_, &QAbstractItemModel::layoutChanged, this, [this] { restoreRanges(); });
+    // A sorted proxy moves a changed row by removing and inserting it.
+    connect(proxy_, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex&, int first, int last) {
+        selectRuns(first, last);
+    });
+}
+
+void EntrySelectionModel::select(const QItemSelection& selection, QItemSelectionModel::SelectionFlags command)
+{
+    const bool cleared = command & Clear;
+    EntrySelection rows;
+    if (command & (Select | Deselect | Toggle)) {
+        for (const QItemSelectionRange& range : selection) {
+            for (int row = range.top(); row <= range.bottom(); ++row) {
+                const std::uint32_t id = idForRow(row);
+                if (id != EntryStore::NoEntry)
+                    rows.add(id);
+            }
+        }
+    }
+    // Only these can change: the rows, and what the last Current command
+    // covered, which this one replaces.
+    EntrySelection touched = rows;
+    EntrySelection before;
+    if (!cleared) {
+        current_.forEach([&](std::uint32_t id) { touched.add(id); });
+        touched.forEach([&](std::uint32_t id) {
+            if (isSelectedId(id))
+                before.add(id);
+        });
+    }
+
+    if (cleared) {
+        committed_.clear();
+        current_.clear();
+    }
+    if (!(command & Current))
+        finalize();
+    if (command & (Select | Deselect | Toggle)) {
+        current_ = std::move(rows);
+        currentCommand_ = command;
+    }
+    QItemSelectionModel::select(selection, command);
+
+    EntrySelection added;
+    EntrySelection removed;
+    touched.forEach([&](std::uint32_t id) {
+        const bool selected = isSelectedId(id);
+        if (selected && !before.contains(id))
+            added.add(id);
+        else if (!selected && before.contains(id))
+            removed.add(id);
+    });
+    if (cleared || !added.isEmpty() || !removed.isEmpty())
+        emit idsChanged(added, removed, cleared);
+}
+
+void EntrySelectionModel::reset()
+{
+    finalize();
+    const EntrySelection previous = std::move(committed_);
+    committed_.clear();
+    QItemSelectionModel::reset();
+    if (proxy_->sourceModel() == listing_) {
+        const EntryStore& entries = listing_->entries();
+        previous.forEach([&](std::uint32_t id) {
+            if (entries.indexOfId(id) != EntryStore::NoEntry)
+                committed_.add(id);
+        });
+    }
+    restoreRanges();
+
+    EntrySelection removed;
+    previous.forEach([&](std::uint32_t id) {
+        if (!committed_.contains(id))
+            removed.add(id);
+    });
+    if (!removed.isEmpty())
+        emit idsChanged(EntrySelection(), removed, false);
+}
+
+EntrySelection EntrySelectionModel::selectedIds() const
+{
+    EntrySelection result = committed_;
+    current_.forEach([&](std::uint32_t id) {
+        if (isSelectedId(id))
+            result.add(id);
+        else
+            result.remove(id);
+    });
+    return result;
+}
+
+bool EntrySelectionModel::isSelectedId(std::uint32_t id) const
+{
+    const bool committed = committed_.contains(id);
+    if (!current_.contains(id))
+        return committed;
+    // The precedence QItemSelection::merge() gives the flags.
+    if (currentCommand_ & Deselect)
+        return false;
+    if (currentCommand_ & Toggle)
+        return !committed;
+    return true;
+}
+
+std::uint32_t EntrySelectionModel::idForRow(int row) const
+{
+    if (proxy_->sourceModel() != listing_)
+        return EntryStore::NoEntry;
+    const QModelIndex source = proxy_->mapToSource(proxy_->index(row, 0));
+    return source.isValid() ? listing_->entries().id(listing_->entryAt(source)) : EntryStore::NoEntry;
+}
+
+void EntrySelectionModel::finalize()
+{
+    if (current_.isEmpty())
+        return;
+    committed_ = selectedIds();
+    current_.clear();
+}
+
+// Selects, in the view's ranges only, the selected entries among rows first
+// to last, one range per run of adjacent rows.
+void EntrySelectionModel::selectRuns(int first, int last)
+{
+    if (committed_.isEmpty() && current_.isEmpty())
+        return;
+    const int lastColumn = proxy_->columnCount() - 1;
+    QItemSelection runs;
+    int start = -1;
+    for (int row = first; row <= last + 1; ++row) {
+        const bool selected = row <= last && isSelectedId(idForRow(row));
+        if (selected && start < 0) {
+            start = row;
+        } else if (!selected && start >= 0) {
+            runs.append(QItemSelectionRange(proxy_->index(start, 0), proxy_->index(row - 1, lastColumn)));
+            start = -1;
+        }
+    }
+    if (!runs.isEmpty())
+        QItemSelectionModel::select(runs, Select);
+}
+
+void EntrySelectionModel::clearRanges()
+{
+    finalize();
+    if (!committed_.isEmpty())
+        QItemSelectionModel::select(QItemSelection(), Clear);
+}
+
+// A few selected entries are looked up by ID, each in constant time, rather
+// than checking every row of the folder.
+void EntrySelectionModel::restoreRanges()
+{
+    if (committed_.isEmpty())
+        return;
+    const int rowCount = proxy_->rowCount();
+    if (proxy_->sourceModel() != listing_ || committed_.size() * SparseRestoreFactor > std::uint64_t(rowCount)) {
+        selectRuns(0, rowCount - 1);
+        return;
+    }
+    std::vector<int> rows;
+    selectedIds().forEach([&](std::uint32_t id) {
+        const QModelIndex index = proxy_->mapFromSource(listing_->indexForId(id));
+        if (index.isValid())
+            rows.push_back(index.row());
+    });
+    std::sort(rows.begin(), rows.end());
+    const int lastColumn = proxy_->columnCount() - 1;
+    QItemSelection runs;
+    for (size_t i = 0; i < rows.size();) {
+        size_t end = i + 1;
+        while (end < rows.size() && rows[end] == rows[end - 1] + 1)
+            ++end;
+        runs.append(QItemSelectionRange(proxy_->index(rows[i], 0), proxy_->index(rows[end - 1], lastColumn)));
+        i = end;
+    }
+    if (!runs.isEmpty())
+        QItemSelectionModel::select(runs, Select);
+}
+
+void EntrySelectionModel::dropEntries(int first, int last)
+{
+    if (committed_.isEmpty() && current_.isEmpty())
+        return;
+    const EntryStore& entries = listing_->entries();
+    EntrySelection removed;
+    for (int row = first; row <= last; ++row) {
+        const std::uint32_t id = entries.id(static_cast<std::uint32_t>(row));
+        if (isSelectedId(id))
+            removed.add(id);
+        committed_.remove(id);
+        current_.remove(id);
+    }
+    if (!removed.isEmpty())
+        emit idsChanged(EntrySelection(), removed, false);
+}
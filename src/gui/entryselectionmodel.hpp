@@ -0,0 +1,61 @@
+#ifndef ENTRYSELECTIONMODEL_HPP
+#define ENTRYSELECTIONMODEL_HPP
+
+#include <QItemSelectionModel>
+
+#include "entryselection.hpp"
+
+#include <cstdint>
+
+class ListingModel;
+class QSortFilterProxyModel;
+
+// The file view's selection, kept as the IDs of the selected entries (see
+// EntryStore::id()) next to the ranges QItemSelectionModel paints from.
+//
+// The IDs are what counts. They don't change when rows move, so a sort
+// rebuilds the view's ranges from them as a few maximal runs instead of
+// tracking one persistent index per selected row, and a refresh only drops
+// the IDs of entries that went away. Operations read the IDs directly rather
+// than collecting indexes or paths.
+class EntrySelectionModel : public QItemSelectionModel
+{
+    Q_OBJECT
+
+public:
+    EntrySelectionModel(QSortFilterProxyModel* proxy, ListingModel* listing, QObject* parent = nullptr);
+
+    using QItemSelectionModel::select;
+    void select(const QItemSelection& selection, QItemSelectionModel::SelectionFlags command) override;
+    // Called by the view when the model is reset, which for a listing that
+    // was compacted only means its rows moved: keeps the entries still there.
+    void reset() override;
+
+    // Empty while the view shows something other than the listing.
+    EntrySelection selectedIds() const;
+    bool isSelectedId(std::uint32_t id) const;
+
+signals:
+    // What a select(), a reset or removed rows changed, found among the IDs
+    // it touched rather than by comparing whole selections. When cleared,
+    // everything selected before went first.
+    void idsChanged(const EntrySelection& added, const EntrySelection& removed, bool cleared);
+
+private:
+    std::uint32_t idForRow(int row) const;
+    void finalize();
+    void selectRuns(int first, int last);
+    void clearRanges();
+    void restoreRanges();
+    void dropEntries(int first, int last);
+
+    QSortFilterProxyModel* proxy_;
+    ListingModel* listing_;
+    EntrySelection committed_;
+    // What is still being dragged out, applied with currentCommand_ and
+    // replaced by every select() with Current, as in QItemSelectionModel.
+    EntrySelection current_;
+    QItemSelectionModel::SelectionFlags currentCommand_ = NoUpdate;
+};
+
+#endif // ENTRYSELECTIONMODEL_HPP
@@ -0,0 +1,261 @@
+#include "entrystore.hpp"
+
+#include <cstring>
+#include <utility>
+
+#include <sys/stat.h>
+
+namespace {
+
+template<typename T>
+void appendColumn(QByteArray* out, const std::vector<T>& column)
+{
+    out->append(reinterpret_cast<const char*>(column.data()), static_cast<qsizetype>(column.size() * sizeof(T)));
+}
+
+template<typename T>
+bool readColumn(const char** data, const char* end, size_t count, std::vector<T>* column)
+{
+    if (static_cast<size_t>(end - *data) < count * sizeof(T))
+        return false;
+    column->resize(count);
+    if (count > 0)
+        std::memcpy(column->data(), *data, count * sizeof(T));
+    *data += count * sizeof(T);
+    return true;
+}
+
+} // namespace
+
+void EntryStore::clear()
+{
+    names_.clear();
+    nameEnds_.clear();
+    sizes_.clear();
+    mtimes_.clear();
+    btimes_.clear();
+    devices_.clear();
+    inodes_.clear();
+    modes_.clear();
+    uids_.clear();
+    gids_.clear();
+    flags_.clear();
+    ids_.clear();
+    indexById_.clear();
+    firstId_ = nextId_;
+}
+
+void EntryStore::reserve(std::uint32_t count)
+{
+    // Most file names are well under 32 characters.
+    names_.reserve(static_cast<size_t>(count) * 24);
+    nameEnds_.reserve(count);
+    sizes_.reserve(count);
+    mtimes_.reserve(count);
+    btimes_.reserve(count);
+    devices_.reserve(count);
+    inodes_.reserve(count);
+    modes_.reserve(count);
+    uids_.reserve(count);
+    gids_.reserve(count);
+    flags_.reserve(count);
+    ids_.reserve(count);
+    indexById_.reserve(indexById_.size() + (count > size() ? count - size() : 0));
+}
+
+std::uint32_t EntryStore::append(QStringView name, const VfsStat& st, std::uint8_t flags)
+{
+    const std::uint32_t index = size();
+    names_.insert(names_.end(), name.utf16(), name.utf16() + name.size());
+    nameEnds_.push_back(static_cast<std::uint32_t>(names_.size()));
+    sizes_.push_back(st.size);
+    mtimes_.push_back(st.mtimeNs);
+    btimes_.push_back(st.btimeNs);
+    devices_.push_back(st.device);
+    inodes_.push_back(st.inode);
+    modes_.push_back(st.mode);
+    uids_.push_back(st.uid);
+    gids_.push_back(st.gid);
+    flags_.push_back(flags);
+    ids_.push_back(nextId_++);
+    indexById_.push_back(index);
+    return index;
+}
+
+void EntryStore::setStat(std::uint32_t index, const VfsStat& st, std::uint8_t flags)
+{
+    sizes_[index] = st.size;
+    mtimes_[index] = st.mtimeNs;
+    btimes_[index] = st.btimeNs;
+    devices_[index] = st.device;
+    inodes_[index] = st.inode;
+    modes_[index] = st.mode;
+    uids_[index] = st.uid;
+    gids_[index] = st.gid;
+    flags_[index] = flags;
+}
+
+void EntryStore::compact(const std::vector<bool>& keep)
+{
+    std::vector<char16_t> names;
+    names.reserve(names_.size());
+    std::uint32_t out = 0;
+    for (std::uint32_t i = 0; i < size(); ++i) {
+        if (!keep[i])
+            continue;
+        const QStringView name = nameView(i);
+        names.insert(names.end(), name.utf16(), name.utf16() + name.size());
+        nameEnds_[out] = static_cast<std::uint32_t>(names.size());
+        sizes_[out] = sizes_[i];
+        mtimes_[out] = mtimes_[i];
+        btimes_[out] = btimes_[i];
+        devices_[out] = devices_[i];
+        inodes_[out] = inodes_[i];
+        modes_[out] = modes_[i];
+        uids_[out] = uids_[i];
+        gids_[out] = gids_[i];
+        flags_[out] = flags_[i];
+        ids_[out] = ids_[i];
+        ++out;
+    }
+    names_ = std::move(names);
+    nameEnds_.resize(out);
+    sizes_.resize(out);
+    mtimes_.resize(out);
+    btimes_.resize(out);
+    devices_.resize(out);
+    inodes_.resize(out);
+    modes_.resize(out);
+    uids_.resize(out);
+    gids_.resize(out);
+    flags_.resize(out);
+    ids_.resize(out);
+    rebuildIdIndex();
+}
+
+void EntryStore::erase(std::uint32_t first, std::uint32_t count)
+{
+    const std::uint32_t last = first + count;
+    const std::uint32_t nameBegin = first == 0 ? 0 : nameEnds_[first - 1];
+    const std::uint32_t nameEnd = nameEnds_[last - 1];
+    names_.erase(names_.begin() + nameBegin, names_.begin() + nameEnd);
+    for (std::uint32_t i = last; i < size(); ++i)
+        nameEnds_[i] -= nameEnd - nameBegin;
+    for (std::uint32_t i = first; i < last; ++i)
+        indexById_[ids_[i] - firstId_] = NoEntry;
+    for (std::uint32_t i = last; i < size(); ++i)
+        indexById_[ids_[i] - firstId_] -= count;
+
+    const auto eraseRange = [first, last](auto& column) {
+        column.erase(column.begin() + first, column.begin() + last);
+    };
+    eraseRange(nameEnds_);
+    eraseRange(sizes_);
+    eraseRange(mtimes_);
+    eraseRange(btimes_);
+    eraseRange(devices_);
+    eraseRange(inodes_);
+    eraseRange(modes_);
+    eraseRange(uids_);
+    eraseRange(gids_);
+    eraseRange(flags_);
+    eraseRange(ids_);
+}
+
+// IDs increase with the index, so the first entry has the lowest one; the
+// slots of IDs removed before it are dropped.
+void EntryStore::rebuildIdIndex()
+{
+    firstId_ = ids_.empty() ? nextId_ : ids_.front();
+    indexById_.assign(nextId_ - firstId_, NoEntry);
+    for (std::uint32_t i = 0; i < size(); ++i)
+        indexById_[ids_[i] - firstId_] = i;
+}
+
+QStringView EntryStore::nameView(std::uint32_t index) const
+{
+    const std::uint32_t begin = index == 0 ? 0 : nameEnds_[index - 1];
+    return QStringView(names_.data() + begin, static_cast<qsizetype>(nameEnds_[index] - begin));
+}
+
+VfsStat EntryStore::stat(std::uint32_t index) const
+{
+    VfsStat st;
+    st.size = sizes_[index];
+    st.mtimeNs = mtimes_[index];
+    st.btimeNs = btimes_[index];
+    st.device = devices_[index];
+    st.inode = inodes_[index];
+    st.mode = modes_[index];
+    st.uid = uids_[index];
+    st.gid = gids_[index];
+    return st;
+}
+
+std::uint8_t EntryStore::flagsFor(const VfsStat& st, bool hasStat, const VfsStat* target)
+{
+    std::uint8_t flags = hasStat ? HasStat : 0;
+    if (st.isSymLink()) {
+        flags |= IsSymLink;
+        if (target && target->isDir())
+            flags |= IsDir;
+    } else if (st.isDir()) {
+        flags |= IsDir;
+    }
+    return flags;
+}
+
+QByteArray EntryStore::serialize() const
+{
+    const std::uint32_t header[2] = {size(), static_cast<std::uint32_t>(names_.size())};
+    QByteArray out;
+    out.reserve(static_cast<qsizetype>(sizeof(header) + names_.size() * sizeof(char16_t) + size() * 65));
+    out.append(reinterpret_cast<const char*>(header), sizeof(header));
+    appendColumn(&out, names_);
+    appendColumn(&out, nameEnds_);
+    appendColumn(&out, sizes_);
+    appendColumn(&out, mtimes_);
+    appendColumn(&out, btimes_);
+    appendColumn(&out, devices_);
+    appendColumn(&out, inodes_);
+    appendColumn(&out, modes_);
+    appendColumn(&out, uids_);
+    appendColumn(&out, gids_);
+    appendColumn(&out, flags_);
+    return out;
+}
+
+bool EntryStore::readFrom(const char* data, size_t size)
+{
+    clear();
+    std::uint32_t header[2] = {};
+    if (size < sizeof(header))
+        return false;
+    std::memcpy(header, data, sizeof(header));
+    const char* cursor = data + sizeof(header);
+    const char* end = data + size;
+    const size_t count = header[0];
+    const bool read = readColumn(&cursor, end, header[1], &names_)
+        && readColumn(&cursor, end, count, &nameEnds_)
+        && readColumn(&cursor, end, count, &sizes_)
+        && readColumn(&cursor, end, count, &mtimes_)
+        && readColumn(&cursor, end, count, &btimes_)
+        && readColumn(&cursor, end, count, &devices_)
+        && readColumn(&cursor, end, count, &inodes_)
+        && readColumn(&cursor, end, count, &modes_)
+        && readColumn(&cursor, end, count, &uids_)
+        && readColumn(&cursor, end, count, &gids_)
+        && readColumn(&cursor, end, count, &flags_);
+    bool valid = read;
+    for (size_t i = 0; valid && i < count; ++i)
+        valid = nameEnds_[i] <= header[1] && (i == 0 || nameEnds_[i] >= nameEnds_[i - 1]);
+    if (!valid || (count > 0 && nameEnds_.back() != header[1])) {
+        clear();
+        return false;
+    }
+    ids_.resize(count);
+    for (std::uint32_t& id : ids_)
+        id = nextId_++;
+    rebuildIdIndex();
+    return true;
+}
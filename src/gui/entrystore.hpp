@@ -0,0 +1,104 @@
+#ifndef ENTRYSTORE_HPP
+#define ENTRYSTORE_HPP
+
+#include <QByteArray>
+#include <QString>
+#include <QStringView>
+
+#include "vfs.hpp"
+
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+// Directory entries in a compact columnar layout. Names share one UTF-16
+// buffer and each entry keeps only the stat fields the views use, in one
+// array per field, so a million entries cost tens of megabytes instead of a
+// QFileInfo each and a sort or filter over one field scans contiguous memory.
+class EntryStore
+{
+public:
+    enum Flag : std::uint8_t
+    {
+        HasStat = 0x01,
+        // Directories, and symbolic links that resolve to one.
+        IsDir = 0x02,
+        IsSymLink = 0x04,
+    };
+
+    static constexpr std::uint32_t NoEntry = UINT32_MAX;
+
+    std::uint32_t size() const { return static_cast<std::uint32_t>(flags_.size()); }
+    bool isEmpty() const { return flags_.empty(); }
+    // Keeps counting IDs, so an ID from before still names no entry after.
+    void clear();
+    void reserve(std::uint32_t count);
+
+    // Until HasStat is set, only the file type bits of mode are known.
+    std::uint32_t append(QStringView name, const VfsStat& st, std::uint8_t flags);
+    void setStat(std::uint32_t index, const VfsStat& st, std::uint8_t flags);
+    // Drops the entries whose keep flag is false; the rest keep their order.
+    void compact(const std::vector<bool>& keep);
+    void erase(std::uint32_t first, std::uint32_t count);
+
+    // Each entry gets an ID when appended and keeps it while other entries
+    // come and go. IDs are never reused by a store. indexOfId() is a lookup
+    // in an array indexed by ID, kept current as entries are removed; the
+    // slots of removed IDs are given back when the store is cleared.
+    std::uint32_t id(std::uint32_t index) const { return ids_[index]; }
+    std::uint32_t indexOfId(std::uint32_t id) const
+    {
+        const std::uint32_t slot = id - firstId_;
+        return id >= firstId_ && slot < indexById_.size() ? indexById_[slot] : NoEntry;
+    }
+
+    QStringView nameView(std::uint32_t index) const;
+    QString name(std::uint32_t index) const { return nameView(index).toString(); }
+    std::uint64_t fileSize(std::uint32_t index) const { return sizes_[index]; }
+    std::int64_t mtimeNs(std::uint32_t index) const { return mtimes_[index]; }
+    std::int64_t btimeNs(std::uint32_t index) const { return btimes_[index]; }
+    std::uint64_t device(std::uint32_t index) const { return devices_[index]; }
+    std::uint64_t inode(std::uint32_t index) const { return inodes_[index]; }
+    std::uint32_t mode(std::uint32_t index) const { return modes_[index]; }
+    std::uint32_t uid(std::uint32_t index) const { return uids_[index]; }
+    std::uint32_t gid(std::uint32_t index) const { return gids_[index]; }
+    std::uint8_t flags(std::uint32_t index) const { return flags_[index]; }
+    bool hasStat(std::uint32_t index) const { return flags_[index] & HasStat; }
+    bool isDir(std::uint32_t index) const { return flags_[index] & IsDir; }
+    bool isSymLink(std::uint32_t index) const { return flags_[index] & IsSymLink; }
+    VfsStat stat(std::uint32_t index) const;
+
+    // A raw dump of the columns, for listing snapshots. readFrom() checks the
+    // sizes and name offsets, and leaves the store empty if they don't add up.
+    // IDs aren't saved; the loaded entries get new ones.
+    QByteArray serialize() const;
+    bool readFrom(const char* data, size_t size);
+
+    // Flags for an entry from its own stat and, for a symbolic link, the
+    // stat of its target (nullptr if unknown or dangling).
+    static std::uint8_t flagsFor(const VfsStat& st, bool hasStat, const VfsStat* target);
+
+private:
+    void rebuildIdIndex();
+
+    std::vector<char16_t> names_;
+    // Name i spans [nameEnds_[i - 1], nameEnds_[i]) of names_.
+    std::vector<std::uint32_t> nameEnds_;
+    std::vector<std::uint64_t> sizes_;
+    std::vector<std::int64_t> mtimes_;
+    std::vector<std::int64_t> btimes_;
+    std::vector<std::uint64_t> devices_;
+    std::vector<std::uint64_t> inodes_;
+    std::vector<std::uint32_t> modes_;
+    std::vector<std::uint32_t> uids_;
+    std::vector<std::uint32_t> gids_;
+    std::vector<std::uint8_t> flags_;
+    std::vector<std::uint32_t> ids_;
+    // indexById_[id - firstId_] is the index of the entry with that ID, or
+    // NoEntry; it has a slot for every ID from firstId_ up to nextId_.
+    std::vector<std::uint32_t> indexById_;
+    std::uint32_t firstId_ = 0;
+    std::uint32_t nextId_ = 0;
+};
+
+#endif // ENTRYSTORE_HPP
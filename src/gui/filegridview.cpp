@@ -0,0 +1,365 @@
+#include "filegridview.hpp"
+
+#include <QAbstractProxyModel>
+#include <QEvent>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QScrollBar>
+
+#include "listingmodel.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace {
+
+constexpr int ThumbnailSize = 96;
+constexpr int IconSize = 48;
+constexpr int CellPadding = 6;
+constexpr int MinCellWidth = ThumbnailSize + 2 * CellPadding;
+
+} // namespace
+
+FileGridView::FileGridView(QWidget* parent)
+    : QAbstractItemView(parent)
+{
+    setSelectionBehavior(SelectRows);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    viewport()->setAttribute(Qt::WA_OpaquePaintEvent);
+    thumbnails_.setSize(ThumbnailSize);
+    connect(&thumbnails_, &ThumbnailLoader::thumbnailReady, this, &FileGridView::onThumbnailReady);
+    updateLayout();
+}
+
+void FileGridView::setListingModel(const ListingModel* listing)
+{
+    listing_ = listing;
+    requestedFirst_ = -1;
+    viewport()->update();
+}
+
+QRect FileGridView::visualRect(const QModelIndex& index) const
+{
+    if (!index.isValid() || index.parent() != rootIndex() || isIndexHidden(index))
+        return QRect();
+    return cellRect(index.row());
+}
+
+void FileGridView::scrollTo(const QModelIndex& index, ScrollHint hint)
+{
+    if (!index.isValid() || index.parent() != rootIndex())
+        return;
+    // The layout may still be waiting for a delayed update.
+    updateLayout();
+    const int top = index.row() / columns_ * cellHeight_;
+    const int height = viewport()->height();
+    int value = verticalScrollBar()->value();
+    switch (hint) {
+    case EnsureVisible:
+        if (top < value)
+            value = top;
+        else if (top + cellHeight_ > value + height)
+            value = top + cellHeight_ - height;
+        break;
+    case PositionAtTop:
+        value = top;
+        break;
+    case PositionAtBottom:
+        value = top + cellHeight_ - height;
+        break;
+    case PositionAtCenter:
+        value = top - (height - cellHeight_) / 2;
+        break;
+    }
+    verticalScrollBar()->setValue(value);
+}
+
+QModelIndex FileGridView::indexAt(const QPoint& point) const
+{
+    if (!model() || point.x() < 0 || point.y() < 0 || point.x() >= columns_ * cellWidth_)
+        return QModelIndex();
+    const int item = (point.y() + verticalOffset()) / cellHeight_ * columns_ + point.x() / cellWidth_;
+    return item < itemCount() ? model()->index(item, 0, rootIndex()) : QModelIndex();
+}
+
+void FileGridView::reset()
+{
+    requestedFirst_ = -1;
+    QAbstractItemView::reset();
+}
+
+QModelIndex FileGridView::moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers)
+{
+    const int count = itemCount();
+    if (count == 0)
+        return QModelIndex();
+    const QModelIndex current = currentIndex();
+    if (!current.isValid())
+        return model()->index(0, 0, rootIndex());
+    int item = current.row();
+    const int page = std::max(1, viewport()->height() / cellHeight_) * columns_;
+    switch (cursorAction) {
+    case MoveLeft:
+    case MovePrevious:
+        --item;
+        break;
+    case MoveRight:
+    case MoveNext:
+        ++item;
+        break;
+    case MoveUp:
+        item -= columns_;
+        break;
+    case MoveDown:
+        item += columns_;
+        break;
+    case MovePageUp:
+        item -= page;
+        break;
+    case MovePageDown:
+        item += page;
+        break;
+    case MoveHome:
+        item = 0;
+        break;
+    case MoveEnd:
+        item = count - 1;
+        break;
+    }
+    return model()->index(std::clamp(item, 0, count - 1), 0, rootIndex());
+}
+
+int FileGridView::horizontalOffset() const
+{
+    return 0;
+}
+
+int FileGridView::verticalOffset() const
+{
+    return verticalScrollBar()->value();
+}
+
+bool FileGridView::isIndexHidden(const QModelIndex& index) const
+{
+    return index.column() != 0;
+}
+
+void FileGridView::setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command)
+{
+    const QRect area = rect.normalized();
+    const int count = itemCount();
+    const int offset = verticalOffset();
+    const int firstColumn = std::max(area.left(), 0) / cellWidth_;
+    const int lastColumn = std::min(std::max(area.right(), 0) / cellWidth_, columns_ - 1);
+    const int firstLine = (std::max(area.top(), 0) + offset) / cellHeight_;
+    const int lastLine = (std::max(area.bottom(), 0) + offset) / cellHeight_;
+
+    QItemSelection selection;
+    const int modelColumns = model() ? model()->columnCount(rootIndex()) : 0;
+    const auto add = [&](int first, int last) {
+        last = std::min(last, count - 1);
+        if (first <= last)
+            selection.append(QItemSelectionRange(model()->index(first, 0, rootIndex()), model()->index(last, modelColumns - 1, rootIndex())));
+    };
+    if (firstColumn <= lastColumn) {
+        // Whole lines make one run of rows.
+        if (firstColumn == 0 && lastColumn == columns_ - 1) {
+            add(firstLine * columns_, lastLine * columns_ + columns_ - 1);
+        } else {
+            for (int line = firstLine; line <= lastLine && line * columns_ < count; ++line)
+                add(line * columns_ + firstColumn, line * columns_ + lastColumn);
+        }
+    }
+    selectionModel()->select(selection, command);
+}
+
+QRegion FileGridView::visualRegionForSelection(const QItemSelection& selection) const
+{
+    const int offset = verticalOffset();
+    const int firstVisible = offset / cellHeight_;
+    const int lastVisible = (offset + viewport()->height()) / cellHeight_;
+    QRegion region;
+    for (const QItemSelectionRange& range : selection) {
+        if (range.parent() != rootIndex())
+            continue;
+        const int topLine = range.top() / columns_;
+        const int bottomLine = range.bottom() / columns_;
+        for (int line = std::max(topLine, firstVisible); line <= std::min(bottomLine, lastVisible); ++line) {
+            const int first = line == topLine ? range.top() % columns_ : 0;
+            const int last = line == bottomLine ? range.bottom() % columns_ : columns_ - 1;
+            region += QRect(first * cellWidth_, line * cellHeight_ - offset, (last - first + 1) * cellWidth_, cellHeight_);
+        }
+    }
+    return region;
+}
+
+void FileGridView::dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QList<int>& roles)
+{
+    // A file rewritten in place keeps its entry but not its thumbnail.
+    requestedFirst_ = -1;
+    QAbstractItemView::dataChanged(topLeft, bottomRight, roles);
+}
+
+void FileGridView::updateGeometries()
+{
+    updateLayout();
+    QAbstractItemView::updateGeometries();
+}
+
+void FileGridView::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(viewport());
+    const QRect exposed = event->rect();
+    const QPalette colors = palette();
+    painter.fillRect(exposed, colors.color(QPalette::Base));
+    const int count = itemCount();
+    if (count == 0)
+        return;
+
+    const int offset = verticalOffset();
+    const int firstVisible = offset / cellHeight_ * columns_;
+    const int lastVisible = std::min(count - 1, ((offset + viewport()->height()) / cellHeight_ + 1) * columns_ - 1);
+    requestThumbnails(firstVisible, lastVisible);
+
+    const int first = std::max(0, (exposed.top() + offset) / cellHeight_ * columns_);
+    const int last = std::min(count - 1, ((exposed.bottom() + offset) / cellHeight_ + 1) * columns_ - 1);
+    const QModelIndex current = currentIndex();
+    const QItemSelectionModel* selection = selectionModel();
+    const QFontMetrics metrics = fontMetrics();
+    const QColor folderColor(0x4f, 0xc3, 0xf7);
+    for (int item = first; item <= last; ++item) {
+        const QModelIndex index = model()->index(item, 0, rootIndex());
+        const QRect cell = cellRect(item);
+        const bool selected = selection && selection->isSelected(index);
+        if (selected)
+            painter.fillRect(cell.adjusted(2, 2, -2, -2), colors.color(QPalette::Highlight));
+
+        const QRect thumbnailBox(cell.left() + (cellWidth_ - ThumbnailSize) / 2, cell.top() + CellPadding, ThumbnailSize, ThumbnailSize);
+        const std::uint32_t entry = entryAt(index);
+        const QPixmap* thumbnail = entry != EntryStore::NoEntry
+            ? thumbnails_.thumbnail(listing_->entries().id(entry), listing_->entries().mtimeNs(entry))
+            : nullptr;
+        if (thumbnail) {
+            const QSize size = thumbnail->size();
+            painter.drawPixmap(QRect(thumbnailBox.left() + (ThumbnailSize - size.width()) / 2,
+                                     thumbnailBox.top() + (ThumbnailSize - size.height()) / 2,
+                                     size.width(),
+                                     size.height()),
+                               *thumbnail);
+        } else {
+            const int margin = (ThumbnailSize - IconSize) / 2;
+            index.data(Qt::DecorationRole).value<QIcon>().paint(&painter, thumbnailBox.adjusted(margin, margin, -margin, -margin));
+        }
+
+        const QRect textRect(cell.left() + CellPadding, thumbnailBox.bottom() + 1 + CellPadding, cellWidth_ - 2 * CellPadding, metrics.height());
+        const QString text = metrics.elidedText(index.data(Qt::DisplayRole).toString(), Qt::ElideMiddle, textRect.width());
+        painter.setPen(selected ? colors.color(QPalette::HighlightedText)
+                                : index.data(ListingModel::IsDirRole).toBool() ? folderColor : colors.color(QPalette::Text));
+        painter.drawText(textRect, Qt::AlignHCenter | Qt::AlignTop, text);
+        if (index == current && hasFocus()) {
+            painter.setPen(colors.color(QPalette::Highlight));
+            painter.drawRect(cell.adjusted(2, 2, -3, -3));
+        }
+    }
+}
+
+void FileGridView::changeEvent(QEvent* event)
+{
+    if (event->type() == QEvent::FontChange || event->type() == QEvent::StyleChange) {
+        updateLayout();
+        viewport()->update();
+    }
+    QAbstractItemView::changeEvent(event);
+}
+
+void FileGridView::updateLayout()
+{
+    const int width = viewport()->width();
+    columns_ = std::max(1, width / MinCellWidth);
+    // Spread what is left over a line across its cells.
+    cellWidth_ = std::max(MinCellWidth, width / columns_);
+    cellHeight_ = ThumbnailSize + fontMetrics().height() + 3 * CellPadding;
+
+    const qint64 lines = (qint64(itemCount()) + columns_ - 1) / columns_;
+    const int height = viewport()->height();
+    verticalScrollBar()->setRange(0, static_cast<int>(std::clamp<qint64>(lines * cellHeight_ - height, 0, INT_MAX)));
+    verticalScrollBar()->setPageStep(height);
+    verticalScrollBar()->setSingleStep(cellHeight_ / 2);
+}
+
+int FileGridView::itemCount() const
+{
+    return model() ? model()->rowCount(rootIndex()) : 0;
+}
+
+QRect FileGridView::cellRect(int item) const
+{
+    return QRect(item % columns_ * cellWidth_, item / columns_ * cellHeight_ - verticalOffset(), cellWidth_, cellHeight_);
+}
+
+std::uint32_t FileGridView::entryAt(const QModelIndex& index) const
+{
+    if (!listing_ || !index.isValid())
+        return EntryStore::NoEntry;
+    const auto* proxy = qobject_cast<const QAbstractProxyModel*>(model());
+    const QModelIndex source = proxy ? proxy->mapToSource(index) : index;
+    if (!source.isValid() || source.model() != listing_)
+        return EntryStore::NoEntry;
+    return listing_->entryAt(source);
+}
+
+// Asks for the thumbnails and media info of the visible cells, then of a
+// screen below and a screen above them, nearest first.
+void FileGridView::requestThumbnails(int firstVisible, int lastVisible)
+{
+    if (firstVisible == requestedFirst_ && lastVisible == requestedLast_)
+        return;
+    requestedFirst_ = firstVisible;
+    requestedLast_ = lastVisible;
+    // Entries of catalogs and other non-local listings aren't readable files.
+    if (!listing_ || !listing_->directory().startsWith('/'))
+        return;
+
+    const EntryStore& entries = listing_->entries();
+    const int count = itemCount();
+    const int page = lastVisible - firstVisible + 1;
+    std::vector<ThumbnailLoader::Request> requests;
+    std::vector<std::uint32_t> media;
+    const auto add = [&](int item) {
+        if (item < 0 || item >= count)
+            return;
+        const std::uint32_t entry = entryAt(model()->index(item, 0, rootIndex()));
+        if (entry == EntryStore::NoEntry || entries.isDir(entry))
+            return;
+        media.push_back(entry);
+        // FIFOs, devices and sockets named like images aren't decoded.
+        if ((!S_ISREG(entries.mode(entry)) && !entries.isSymLink(entry)) || !ThumbnailLoader::canLoad(entries.name(entry)))
+            return;
+        const std::uint32_t id = entries.id(entry);
+        const std::int64_t mtimeNs = entries.mtimeNs(entry);
+        if (!thumbnails_.thumbnail(id, mtimeNs) && !thumbnails_.hasFailed(id, mtimeNs))
+            requests.push_back({id, mtimeNs, listing_->filePathForId(id)});
+    };
+    for (int item = firstVisible; item <= lastVisible; ++item)
+        add(item);
+    for (int item = lastVisible + 1; item <= lastVisible + page; ++item)
+        add(item);
+    for (int item = firstVisible - 1; item >= firstVisible - page; --item)
+        add(item);
+    thumbnails_.request(requests);
+    listing_->requestMediaInfo(media);
+}
+
+void FileGridView::onThumbnailReady(std::uint32_t id)
+{
+    const auto* proxy = qobject_cast<const QAbstractProxyModel*>(model());
+    if (!listing_ || (proxy && proxy->sourceModel() != listing_))
+        return;
+    const QModelIndex source = listing_->indexForId(id);
+    const QModelIndex index = proxy ? proxy->mapFromSource(source) : source;
+    if (index.isValid())
+        viewport()->update(visualRect(index));
+}
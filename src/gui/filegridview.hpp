@@ -0,0 +1,66 @@
+#ifndef FILEGRIDVIEW_HPP
+#define FILEGRIDVIEW_HPP
+
+#include <QAbstractItemView>
+
+#include "thumbnailloader.hpp"
+
+#include <cstdint>
+
+class ListingModel;
+
+// The file grid: same-sized cells filled left to right, as many to a line as
+// the viewport is wide. Where an item sits follows from its row number and
+// the column count alone, so layout, hit-testing and scrolling cost nothing
+// per item, and only the cells in the viewport are painted.
+//
+// Images of a ListingModel, directly or through a proxy, show as thumbnails.
+// Each paint that shows a new stretch of the folder asks the ThumbnailLoader
+// for the visible cells first, then a screen ahead and a screen behind;
+// cells show their type icon until their thumbnail arrives.
+class FileGridView : public QAbstractItemView
+{
+    Q_OBJECT
+
+public:
+    explicit FileGridView(QWidget* parent = nullptr);
+
+    void setListingModel(const ListingModel* listing);
+
+    QRect visualRect(const QModelIndex& index) const override;
+    void scrollTo(const QModelIndex& index, ScrollHint hint = EnsureVisible) override;
+    QModelIndex indexAt(const QPoint& point) const override;
+    void reset() override;
+
+protected:
+    QModelIndex moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers) override;
+    int horizontalOffset() const override;
+    int verticalOffset() const override;
+    bool isIndexHidden(const QModelIndex& index) const override;
+    void setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command) override;
+    QRegion visualRegionForSelection(const QItemSelection& selection) const override;
+    void dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QList<int>& roles = QList<int>()) override;
+    void updateGeometries() override;
+    void paintEvent(QPaintEvent* event) override;
+    void changeEvent(QEvent* event) override;
+
+private:
+    void updateLayout();
+    int itemCount() const;
+    QRect cellRect(int item) const;
+    // The listing entry shown at index; NoEntry for rows of other models.
+    std::uint32_t entryAt(const QModelIndex& index) const;
+    void requestThumbnails(int firstVisible, int lastVisible);
+    void onThumbnailReady(std::uint32_t id);
+
+    const ListingModel* listing_ = nullptr;
+    ThumbnailLoader thumbnails_;
+    int cellWidth_ = 0;
+    int cellHeight_ = 0;
+    int columns_ = 1;
+    // The cells last asked for; -1 when thumbnails must be asked for again.
+    int requestedFirst_ = -1;
+    int requestedLast_ = -1;
+};
+
+#endif // FILEGRIDVIEW_HPP
@@ -0,0 +1,106 @@
+#include "filehash.hpp"
+
+#include <QCryptographicHash>
+#include <QFile>
+
+#include "scopedfd.hpp"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr auto HashAlgorithm = QCryptographicHash::Blake2b_256;
+constexpr qsizetype ReadBufferSize = 1024 * 1024;
+
+bool readFully(int fd, char* data, std::uint64_t length, std::uint64_t offset)
+{
+    while (length > 0) {
+        const ssize_t n = ::pread(fd, data, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= static_cast<std::uint64_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+QByteArray hashFileSample(const QString& path, std::uint64_t size, QString* error)
+{
+    const ScopedFd fd(::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        if (error)
+            *error = QString("Failed to open: %1").arg(path);
+        return {};
+    }
+
+    QCryptographicHash hash(HashAlgorithm);
+    QByteArray buffer;
+    if (size <= FileHashSampleThreshold) {
+        buffer.resize(static_cast<qsizetype>(size));
+        if (!readFully(fd.get(), buffer.data(), size, 0)) {
+            if (error)
+                *error = QString("Read error: %1").arg(path);
+            return {};
+        }
+        hash.addData(buffer);
+        return hash.result();
+    }
+
+    const std::uint64_t offsets[] = {
+        0,
+        size / 2 - FileHashSampleBlock / 2,
+        size - FileHashSampleBlock,
+    };
+    buffer.resize(static_cast<qsizetype>(FileHashSampleBlock));
+    for (const std::uint64_t offset : offsets) {
+        if (!readFully(fd.get(), buffer.data(), FileHashSampleBlock, offset)) {
+            if (error)
+                *error = QString("Read error: %1").arg(path);
+            return {};
+        }
+        hash.addData(buffer);
+    }
+    return hash.result();
+}
+
+QByteArray hashFileContents(const QString& path, const std::atomic_bool* cancel, QString* error)
+{
+    const ScopedFd fd(::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        if (error)
+            *error = QString("Failed to open: %1").arg(path);
+        return {};
+    }
+    ::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    QCryptographicHash hash(HashAlgorithm);
+    QByteArray buffer;
+    buffer.resize(ReadBufferSize);
+    for (;;) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) {
+            if (error)
+                *error = QStringLiteral("Operation cancelled.");
+            return {};
+        }
+        const ssize_t n = ::read(fd.get(), buffer.data(), static_cast<size_t>(buffer.size()));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            if (error)
+                *error = QString("Read error: %1").arg(path);
+            return {};
+        }
+        if (n == 0)
+            break;
+        hash.addData(QByteArrayView(buffer.constData(), n));
+    }
+    return hash.result();
+}
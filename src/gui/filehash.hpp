@@ -0,0 +1,19 @@
+#ifndef FILEHASH_HPP
+#define FILEHASH_HPP
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+
+// Bytes read from each of the head, middle and tail of a file for a sampled hash.
+constexpr std::uint64_t FileHashSampleBlock = 16 * 1024;
+
+// Files up to this size are hashed completely by hashFileSample().
+constexpr std::uint64_t FileHashSampleThreshold = 3 * FileHashSampleBlock;
+
+QByteArray hashFileSample(const QString& path, std::uint64_t size, QString* error);
+QByteArray hashFileContents(const QString& path, const std::atomic_bool* cancel, QString* error);
+
+#endif // FILEHASH_HPP
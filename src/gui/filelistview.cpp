@@ -0,0 +1,439 @@
+#include "filelistview.hpp"
+
+#include <QAbstractProxyModel>
+#include <QEvent>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <QSet>
+#include <QStyle>
+
+#include "listingmodel.hpp"
+#include "memorygovernor.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <utility>
+
+namespace {
+
+constexpr int RowPadding = 3;
+// Rough memory of a laid-out row, for the MemoryGovernor.
+constexpr std::int64_t RowBytes = 512;
+// dataChanged() over more rows than this drops the whole cache.
+constexpr int MaxInvalidatedRows = 256;
+// Room for a date and time, or a size with its unit.
+constexpr int DetailChars = 18;
+
+} // namespace
+
+FileListView::FileListView(QWidget* parent)
+    : QAbstractItemView(parent)
+{
+    setSelectionBehavior(SelectRows);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    viewport()->setAttribute(Qt::WA_OpaquePaintEvent);
+    resolveStyle();
+    // Rows are cheap to lay out again, so they go first.
+    memoryHandle_ = MemoryGovernor::instance().registerCache(QStringLiteral("List rows"), 1, [this](std::int64_t target) { trimRows(target); });
+}
+
+FileListView::~FileListView()
+{
+    MemoryGovernor::instance().unregisterCache(memoryHandle_);
+}
+
+void FileListView::setListingModel(const ListingModel* listing)
+{
+    listing_ = listing;
+    requestedFirst_ = -1;
+    clearRows();
+    viewport()->update();
+}
+
+void FileListView::setDetailColumns(const QList<int>& columns)
+{
+    detailColumns_ = columns;
+    viewport()->update();
+}
+
+QRect FileListView::visualRect(const QModelIndex& index) const
+{
+    if (!index.isValid() || index.parent() != rootIndex() || isIndexHidden(index))
+        return QRect();
+    return QRect(0, index.row() * rowHeight_ - verticalOffset(), viewport()->width(), rowHeight_);
+}
+
+void FileListView::scrollTo(const QModelIndex& index, ScrollHint hint)
+{
+    if (!index.isValid() || index.parent() != rootIndex())
+        return;
+    // The range may still be waiting for a delayed layout.
+    updateScrollRange();
+    const int top = index.row() * rowHeight_;
+    const int height = viewport()->height();
+    int value = verticalScrollBar()->value();
+    switch (hint) {
+    case EnsureVisible:
+        if (top < value)
+            value = top;
+        else if (top + rowHeight_ > value + height)
+            value = top + rowHeight_ - height;
+        break;
+    case PositionAtTop:
+        value = top;
+        break;
+    case PositionAtBottom:
+        value = top + rowHeight_ - height;
+        break;
+    case PositionAtCenter:
+        value = top - (height - rowHeight_) / 2;
+        break;
+    }
+    verticalScrollBar()->setValue(value);
+}
+
+QModelIndex FileListView::indexAt(const QPoint& point) const
+{
+    if (!model() || point.y() < 0)
+        return QModelIndex();
+    const int row = (point.y() + verticalOffset()) / rowHeight_;
+    return row < rowCount() ? model()->index(row, 0, rootIndex()) : QModelIndex();
+}
+
+void FileListView::reset()
+{
+    requestedFirst_ = -1;
+    clearRows();
+    QAbstractItemView::reset();
+}
+
+QModelIndex FileListView::moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers)
+{
+    const int rows = rowCount();
+    if (rows == 0)
+        return QModelIndex();
+    const QModelIndex current = currentIndex();
+    int row = current.isValid() ? current.row() : -1;
+    const int page = std::max(1, viewport()->height() / rowHeight_);
+    switch (cursorAction) {
+    case MoveUp:
+    case MovePrevious:
+        row = row < 0 ? 0 : row - 1;
+        break;
+    case MoveDown:
+    case MoveNext:
+        ++row;
+        break;
+    case MovePageUp:
+        row -= page;
+        break;
+    case MovePageDown:
+        row += page;
+        break;
+    case MoveHome:
+        row = 0;
+        break;
+    case MoveEnd:
+        row = rows - 1;
+        break;
+    default:
+        return current;
+    }
+    return model()->index(std::clamp(row, 0, rows - 1), 0, rootIndex());
+}
+
+int FileListView::horizontalOffset() const
+{
+    return 0;
+}
+
+int FileListView::verticalOffset() const
+{
+    return verticalScrollBar()->value();
+}
+
+bool FileListView::isIndexHidden(const QModelIndex& index) const
+{
+    return index.column() != 0;
+}
+
+void FileListView::setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command)
+{
+    const int rows = rowCount();
+    const int first = (std::max(rect.top(), 0) + verticalOffset()) / rowHeight_;
+    if (rows == 0 || first >= rows) {
+        selectionModel()->select(QItemSelection(), command);
+        return;
+    }
+    const int last = std::min((std::max(rect.bottom(), 0) + verticalOffset()) / rowHeight_, rows - 1);
+    const int lastColumn = model()->columnCount(rootIndex()) - 1;
+    selectionModel()->select(QItemSelection(model()->index(first, 0, rootIndex()), model()->index(last, lastColumn, rootIndex())),
+                             command);
+}
+
+QRegion FileListView::visualRegionForSelection(const QItemSelection& selection) const
+{
+    const int offset = verticalOffset();
+    const int height = viewport()->height();
+    QRegion region;
+    for (const QItemSelectionRange& range : selection) {
+        if (range.parent() != rootIndex())
+            continue;
+        const qint64 top = qint64(range.top()) * rowHeight_ - offset;
+        const qint64 bottom = qint64(range.bottom() + 1) * rowHeight_ - offset;
+        if (bottom <= 0 || top >= height)
+            continue;
+        const int clippedTop = static_cast<int>(std::max<qint64>(top, 0));
+        region += QRect(0, clippedTop, viewport()->width(), static_cast<int>(std::min<qint64>(bottom, height)) - clippedTop);
+    }
+    return region;
+}
+
+void FileListView::dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QList<int>& roles)
+{
+    // Other columns only show in the details, which aren't kept.
+    if (topLeft.column() > 0) {
+        for (const int column : std::as_const(detailColumns_)) {
+            if (column >= topLeft.column() && column <= bottomRight.column()) {
+                viewport()->update();
+                break;
+            }
+        }
+        QAbstractItemView::dataChanged(topLeft, bottomRight, roles);
+        return;
+    }
+    // A stat arriving can turn a link into a folder; lay those rows out again.
+    requestedFirst_ = -1;
+    if (bottomRight.row() - topLeft.row() >= MaxInvalidatedRows) {
+        clearRows();
+    } else if (!rows_.isEmpty()) {
+        const auto* proxy = qobject_cast<const QAbstractProxyModel*>(model());
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+            const QModelIndex index = model()->index(row, 0, rootIndex());
+            const QModelIndex source = proxy ? proxy->mapToSource(index) : index;
+            if (source.isValid() && source.model() == listing_)
+                rows_.remove(listing_->entries().id(listing_->entryAt(source)));
+        }
+        MemoryGovernor::instance().reportUsage(memoryHandle_, rows_.size() * RowBytes);
+    }
+    QAbstractItemView::dataChanged(topLeft, bottomRight, roles);
+}
+
+void FileListView::updateGeometries()
+{
+    updateScrollRange();
+    QAbstractItemView::updateGeometries();
+}
+
+void FileListView::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(viewport());
+    const QRect exposed = event->rect();
+    painter.fillRect(exposed, palette().color(QPalette::Base));
+    const int rows = rowCount();
+    if (rows == 0)
+        return;
+
+    const int width = viewport()->width();
+    const int detailCount = detailWidth_ > 0 ? std::min(int(detailColumns_.size()), width / 2 / detailWidth_) : 0;
+    const int nameRight = width - detailCount * detailWidth_;
+    const int textWidth = std::max(0, nameRight - iconSize_ - 3 * RowPadding);
+    const int badgeLeft = nameRight - RowPadding - badgeWidth_;
+    if (textWidth != textWidth_) {
+        textWidth_ = textWidth;
+        clearRows();
+    }
+
+    const int offset = verticalOffset();
+    const int first = std::max(0, (exposed.top() + offset) / rowHeight_);
+    const int last = std::min(rows - 1, (exposed.bottom() + offset) / rowHeight_);
+    requestMediaInfo(offset / rowHeight_, std::min(rows - 1, (offset + viewport()->height()) / rowHeight_));
+    const QModelIndex current = currentIndex();
+    const QItemSelectionModel* selection = selectionModel();
+    const int textTop = (rowHeight_ - fontMetrics().height()) / 2;
+    const int iconTop = (rowHeight_ - iconSize_) / 2;
+    for (int row = first; row <= last; ++row) {
+        const QModelIndex index = model()->index(row, 0, rootIndex());
+        const Row* cached = cachedRow(index);
+        const Row uncached = cached
+            ? Row()
+            : makeRow(index.data(Qt::DisplayRole).toString(),
+                      index.data(Qt::DecorationRole).value<QIcon>(),
+                      index.data(ListingModel::IsDirRole).toBool(),
+                      static_cast<GitStatus::State>(index.data(ListingModel::GitStatusRole).toInt()));
+        const Row& info = cached ? *cached : uncached;
+
+        const QRect rect(0, row * rowHeight_ - offset, width, rowHeight_);
+        const bool selected = selection && selection->isSelected(index);
+        if (selected)
+            painter.fillRect(rect, highlightColor_);
+        info.icon.paint(&painter, QRect(RowPadding, rect.top() + iconTop, iconSize_, iconSize_));
+        const bool ignored = info.gitState == GitStatus::State::Ignored;
+        painter.setPen(selected ? highlightedTextColor_ : ignored ? ignoredColor_ : info.isDir ? folderColor_ : textColor_);
+        painter.drawStaticText(iconSize_ + 2 * RowPadding, rect.top() + textTop, info.text);
+        if (info.gitState == GitStatus::State::Modified || info.gitState == GitStatus::State::Untracked) {
+            const bool modified = info.gitState == GitStatus::State::Modified;
+            painter.setPen(selected ? highlightedTextColor_ : modified ? modifiedColor_ : untrackedColor_);
+            painter.drawText(QRect(badgeLeft, rect.top(), badgeWidth_, rowHeight_), Qt::AlignCenter,
+                             modified ? QStringLiteral("M") : QStringLiteral("?"));
+        }
+        for (int i = 0; i < detailCount; ++i) {
+            const int column = detailColumns_[i];
+            const QString text = model()->index(row, column, rootIndex()).data(Qt::DisplayRole).toString();
+            if (text.isEmpty())
+                continue;
+            const int cellWidth = detailWidth_ - RowPadding;
+            painter.setPen(selected ? highlightedTextColor_ : textColor_);
+            painter.drawText(QRect(nameRight + i * detailWidth_, rect.top(), cellWidth, rowHeight_),
+                             Qt::AlignVCenter | (column == ListingModel::SizeColumn ? Qt::AlignRight : Qt::AlignLeft),
+                             fontMetrics().elidedText(text, Qt::ElideRight, cellWidth));
+        }
+        if (index == current && hasFocus()) {
+            painter.setPen(highlightColor_);
+            painter.drawRect(rect.adjusted(0, 0, -1, -1));
+        }
+    }
+}
+
+void FileListView::changeEvent(QEvent* event)
+{
+    if (event->type() == QEvent::PaletteChange || event->type() == QEvent::FontChange
+        || event->type() == QEvent::StyleChange) {
+        resolveStyle();
+        clearRows();
+        updateScrollRange();
+        viewport()->update();
+    }
+    QAbstractItemView::changeEvent(event);
+}
+
+void FileListView::resolveStyle()
+{
+    iconSize_ = style()->pixelMetric(QStyle::PM_SmallIconSize, nullptr, this);
+    rowHeight_ = std::max(fontMetrics().height(), iconSize_) + 2 * RowPadding;
+    badgeWidth_ = fontMetrics().horizontalAdvance(QStringLiteral("M")) + RowPadding;
+    detailWidth_ = fontMetrics().horizontalAdvance(QStringLiteral("0")) * DetailChars + RowPadding;
+    const QPalette colors = palette();
+    textColor_ = colors.color(QPalette::Text);
+    folderColor_ = QColor(0x4f, 0xc3, 0xf7);
+    ignoredColor_ = colors.color(QPalette::Disabled, QPalette::Text);
+    modifiedColor_ = QColor(0xff, 0xb7, 0x4d);
+    untrackedColor_ = QColor(0x81, 0xc7, 0x84);
+    highlightColor_ = colors.color(QPalette::Highlight);
+    highlightedTextColor_ = colors.color(QPalette::HighlightedText);
+}
+
+void FileListView::updateScrollRange()
+{
+    const qint64 content = qint64(rowCount()) * rowHeight_;
+    const int height = viewport()->height();
+    verticalScrollBar()->setRange(0, static_cast<int>(std::clamp<qint64>(content - height, 0, INT_MAX)));
+    verticalScrollBar()->setPageStep(height);
+    verticalScrollBar()->setSingleStep(rowHeight_);
+}
+
+int FileListView::rowCount() const
+{
+    return model() ? model()->rowCount(rootIndex()) : 0;
+}
+
+void FileListView::requestMediaInfo(int first, int last)
+{
+    if (first == requestedFirst_ && last == requestedLast_)
+        return;
+    requestedFirst_ = first;
+    requestedLast_ = last;
+    if (!listing_)
+        return;
+
+    const auto* proxy = qobject_cast<const QAbstractProxyModel*>(model());
+    const int rows = rowCount();
+    const int page = last - first + 1;
+    std::vector<std::uint32_t> entries;
+    const auto add = [&](int row) {
+        if (row < 0 || row >= rows)
+            return;
+        const QModelIndex index = model()->index(row, 0, rootIndex());
+        const QModelIndex source = proxy ? proxy->mapToSource(index) : index;
+        if (source.isValid() && source.model() == listing_)
+            entries.push_back(listing_->entryAt(source));
+    };
+    for (int row = first; row <= last; ++row)
+        add(row);
+    for (int row = last + 1; row <= last + page; ++row)
+        add(row);
+    for (int row = first - 1; row >= first - page; --row)
+        add(row);
+    listing_->requestMediaInfo(entries);
+}
+
+const FileListView::Row* FileListView::cachedRow(const QModelIndex& index)
+{
+    if (!listing_)
+        return nullptr;
+    const auto* proxy = qobject_cast<const QAbstractProxyModel*>(model());
+    const QModelIndex source = proxy ? proxy->mapToSource(index) : index;
+    if (!source.isValid() || source.model() != listing_)
+        return nullptr;
+
+    const EntryStore& entries = listing_->entries();
+    const std::uint32_t entry = listing_->entryAt(source);
+    const std::uint32_t id = entries.id(entry);
+    auto it = rows_.find(id);
+    if (it == rows_.end()) {
+        // Reported first: going over the budget may clear rows_.
+        MemoryGovernor::instance().reportUsage(memoryHandle_, (rows_.size() + 1) * RowBytes);
+        it = rows_.insert(id, makeRow(entries.name(entry), listing_->icon(entry), entries.isDir(entry), listing_->gitState(entry)));
+    }
+    return &it.value();
+}
+
+void FileListView::clearRows()
+{
+    rows_.clear();
+    MemoryGovernor::instance().reportUsage(memoryHandle_, 0);
+}
+
+// Rows off screen go first; those on it are laid out again at the next paint.
+void FileListView::trimRows(std::int64_t targetBytes)
+{
+    const qsizetype keep = qsizetype(std::max<std::int64_t>(targetBytes, 0) / RowBytes);
+    if (rows_.size() <= keep)
+        return;
+    QSet<std::uint32_t> visible;
+    if (listing_ && model() && rowHeight_ > 0) {
+        const auto* proxy = qobject_cast<const QAbstractProxyModel*>(model());
+        const int first = verticalOffset() / rowHeight_;
+        const int last = std::min(rowCount() - 1, (verticalOffset() + viewport()->height()) / rowHeight_);
+        for (int row = first; row <= last; ++row) {
+            const QModelIndex index = model()->index(row, 0, rootIndex());
+            const QModelIndex source = proxy ? proxy->mapToSource(index) : index;
+            if (source.isValid() && source.model() == listing_)
+                visible.insert(listing_->entries().id(listing_->entryAt(source)));
+        }
+    }
+    for (auto it = rows_.begin(); it != rows_.end() && rows_.size() > keep;) {
+        if (visible.contains(it.key()))
+            ++it;
+        else
+            it = rows_.erase(it);
+    }
+    if (rows_.size() > keep)
+        rows_.clear();
+    MemoryGovernor::instance().reportUsage(memoryHandle_, rows_.size() * RowBytes);
+}
+
+FileListView::Row FileListView::makeRow(const QString& name, const QIcon& icon, bool isDir, GitStatus::State gitState) const
+{
+    Row row;
+    // A badge takes its room from the name.
+    const bool badge = gitState == GitStatus::State::Modified || gitState == GitStatus::State::Untracked;
+    row.text.setTextFormat(Qt::PlainText);
+    row.text.setText(fontMetrics().elidedText(name, Qt::ElideMiddle, badge ? std::max(0, textWidth_ - badgeWidth_) : textWidth_));
+    row.text.prepare(QTransform(), font());
+    row.icon = icon;
+    row.isDir = isDir;
+    row.gitState = gitState;
+    return row;
+}
@@ -0,0 +1,106 @@
+#ifndef FILELISTVIEW_HPP
+#define FILELISTVIEW_HPP
+
+#include <QAbstractItemView>
+#include <QColor>
+#include <QHash>
+#include <QIcon>
+#include <QList>
+#include <QStaticText>
+
+#include "gitstatus.hpp"
+
+#include <cstdint>
+
+class ListingModel;
+
+// The file list: one row per entry, every row the same height, so where a
+// row is follows from its number. Scrolling, hit-testing and keyboard moves
+// cost the same with a million rows as with ten, and only the rows in the
+// viewport are painted.
+//
+// Rows of a ListingModel, directly or through a proxy, are painted here
+// rather than by a delegate: the name, icon and style of a row are read from
+// the EntryStore once and kept, by entry ID, with the name already elided
+// and laid out for the current width; the colors are resolved once per
+// palette. Rows of other models go through their data(). The kept rows are
+// a cache under the MemoryGovernor. In a git work tree a modified or
+// untracked file carries a letter at the right, and ignored ones are dimmed.
+//
+// setDetailColumns() adds other columns of the model, such as the size,
+// owner or date taken, in cells of one width at the right of each row, as
+// many as fit in half the width. They are read from the model as they are
+// painted.
+class FileListView : public QAbstractItemView
+{
+    Q_OBJECT
+
+public:
+    explicit FileListView(QWidget* parent = nullptr);
+    ~FileListView() override;
+
+    void setListingModel(const ListingModel* listing);
+    // Model columns, in the order shown.
+    void setDetailColumns(const QList<int>& columns);
+    const QList<int>& detailColumns() const { return detailColumns_; }
+
+    QRect visualRect(const QModelIndex& index) const override;
+    void scrollTo(const QModelIndex& index, ScrollHint hint = EnsureVisible) override;
+    QModelIndex indexAt(const QPoint& point) const override;
+    void reset() override;
+
+protected:
+    QModelIndex moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers) override;
+    int horizontalOffset() const override;
+    int verticalOffset() const override;
+    bool isIndexHidden(const QModelIndex& index) const override;
+    void setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command) override;
+    QRegion visualRegionForSelection(const QItemSelection& selection) const override;
+    void dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QList<int>& roles = QList<int>()) override;
+    void updateGeometries() override;
+    void paintEvent(QPaintEvent* event) override;
+    void changeEvent(QEvent* event) override;
+
+private:
+    struct Row
+    {
+        QStaticText text;
+        QIcon icon;
+        bool isDir = false;
+        GitStatus::State gitState = GitStatus::State::Unknown;
+    };
+
+    void resolveStyle();
+    void updateScrollRange();
+    int rowCount() const;
+    // Null for rows that aren't entries of the listing.
+    // For the rows from first to last, then a screen below and above.
+    void requestMediaInfo(int first, int last);
+    const Row* cachedRow(const QModelIndex& index);
+    Row makeRow(const QString& name, const QIcon& icon, bool isDir, GitStatus::State gitState) const;
+    void clearRows();
+    void trimRows(std::int64_t targetBytes);
+
+    const ListingModel* listing_ = nullptr;
+    int memoryHandle_ = 0;
+    int rowHeight_ = 0;
+    int iconSize_ = 0;
+    int textWidth_ = 0;
+    // Room kept at the right for a git status letter.
+    int badgeWidth_ = 0;
+    int detailWidth_ = 0;
+    QList<int> detailColumns_;
+    int requestedFirst_ = -1;
+    int requestedLast_ = -1;
+    QColor textColor_;
+    QColor folderColor_;
+    QColor ignoredColor_;
+    QColor modifiedColor_;
+    QColor untrackedColor_;
+    QColor highlightColor_;
+    QColor highlightedTextColor_;
+    // By entry ID, for textWidth_.
+    QHash<std::uint32_t, Row> rows_;
+};
+
+#endif // FILELISTVIEW_HPP
@@ -0,0 +1,590 @@
+#include "filepreview.hpp"
+
+#include <QContextMenuEvent>
+#include <QFile>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QInputDialog>
+#include <QKeyEvent>
+#include <QMenu>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QSocketNotifier>
+#include <QWheelEvent>
+
+#include "lineindex.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// A line longer than this is shown as several rows.
+constexpr std::uint64_t MaxLineBytes = 4096;
+// Read around the view at a time; a screenful of long rows fits.
+constexpr size_t WindowBytes = 256 * 1024;
+constexpr std::uint64_t HexRowBytes = 16;
+// A NUL in this many leading bytes makes a file binary.
+constexpr size_t SniffBytes = 8192;
+constexpr int TabWidth = 4;
+constexpr int ChangeIntervalMs = 100;
+constexpr std::uint64_t MaxScrollValue = 1 << 30;
+
+constexpr std::uint32_t FileEvents = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+constexpr std::uint32_t FolderEvents = IN_CREATE | IN_MOVED_TO;
+
+bool isContinuationByte(char c)
+{
+    return (static_cast<unsigned char>(c) & 0xc0) == 0x80;
+}
+
+std::uint64_t countLineBreaks(const char* data, size_t count)
+{
+    std::uint64_t breaks = 0;
+    for (const char* end = data + count; (data = static_cast<const char*>(std::memchr(data, '\n', size_t(end - data)))); ++data)
+        ++breaks;
+    return breaks;
+}
+
+// "0000001f40  48 65 6c 6c 6f 0a ...  Hello."
+QString hexRow(const char* data, size_t count, std::uint64_t offset)
+{
+    char buffer[128];
+    int length = std::snprintf(buffer, sizeof buffer, "%010llx ", static_cast<unsigned long long>(offset));
+    for (size_t i = 0; i < HexRowBytes; ++i) {
+        if (i % 8 == 0)
+            buffer[length++] = ' ';
+        if (i < count)
+            length += std::snprintf(buffer + length, sizeof buffer - size_t(length), "%02x ", static_cast<unsigned char>(data[i]));
+        else
+            length += std::snprintf(buffer + length, sizeof buffer - size_t(length), "   ");
+    }
+    buffer[length++] = ' ';
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char c = static_cast<unsigned char>(data[i]);
+        buffer[length++] = c >= 0x20 && c < 0x7f ? char(c) : '.';
+    }
+    return QString::fromLatin1(buffer, length);
+}
+
+} // namespace
+
+FilePreview::FilePreview(QWidget* parent)
+    : QAbstractScrollArea(parent)
+{
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setFocusPolicy(Qt::StrongFocus);
+    resolveStyle();
+
+    changeTimer_.setSingleShot(true);
+    changeTimer_.setInterval(ChangeIntervalMs);
+    connect(&changeTimer_, &QTimer::timeout, this, &FilePreview::checkFile);
+    inotify_.reset(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (inotify_.isValid()) {
+        notifier_ = new QSocketNotifier(inotify_.get(), QSocketNotifier::Read, this);
+        connect(notifier_, &QSocketNotifier::activated, this, &FilePreview::readNotifications);
+    }
+}
+
+FilePreview::~FilePreview()
+{
+    clear();
+    // Before the descriptor it watches is closed.
+    delete notifier_;
+}
+
+void FilePreview::setFile(const QString& path)
+{
+    if (path == path_ && fd_.isValid())
+        return;
+    clear();
+    if (!open(path))
+        return;
+    const char* data = nullptr;
+    const size_t count = read(0, SniffBytes, &data);
+    hex_ = count > 0 && std::memchr(data, 0, count);
+    if (!hex_)
+        startIndex();
+    updateScrollBar();
+    viewport()->update();
+}
+
+void FilePreview::clear()
+{
+    if (watch_ >= 0)
+        ::inotify_rm_watch(inotify_.get(), watch_);
+    if (folderWatch_ >= 0)
+        ::inotify_rm_watch(inotify_.get(), folderWatch_);
+    watch_ = folderWatch_ = -1;
+    changeTimer_.stop();
+    index_.reset();
+    window_.clear();
+    window_.shrink_to_fit();
+    windowStart_ = 0;
+    shortRead_ = false;
+    fd_.reset();
+    path_.clear();
+    inode_ = 0;
+    size_ = 0;
+    top_ = 0;
+    updateScrollBar();
+    viewport()->update();
+}
+
+void FilePreview::setHexMode(bool hex)
+{
+    if (hex_ == hex)
+        return;
+    hex_ = hex;
+    if (!hex_ && fd_.isValid())
+        startIndex();
+    setTop(top_);
+}
+
+bool FilePreview::goToLine(std::uint64_t line)
+{
+    LineIndex::Checkpoint checkpoint;
+    if (hex_ || !index_ || line == 0 || !index_->checkpointForLine(line - 1, &checkpoint))
+        return false;
+    std::uint64_t offset = checkpoint.offset;
+    for (std::uint64_t remaining = line - 1 - checkpoint.line; remaining > 0 && offset < size_;) {
+        const char* data = nullptr;
+        const size_t count = read(offset, WindowBytes, &data);
+        if (count == 0)
+            break;
+        const char* at = data;
+        for (; remaining > 0; --remaining) {
+            const void* found = std::memchr(at, '\n', size_t(data + count - at));
+            if (!found)
+                break;
+            at = static_cast<const char*>(found) + 1;
+        }
+        offset += remaining > 0 ? count : std::uint64_t(at - data);
+    }
+    setTop(offset);
+    return true;
+}
+
+bool FilePreview::open(const QString& path)
+{
+    const QByteArray encoded = QFile::encodeName(path);
+    // Non-blocking, so a FIFO or a device under the name can't hang the GUI
+    // in open(); anything but a regular file is turned down after fstat().
+    ScopedFd fd(::open(encoded.constData(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC));
+    struct stat st {};
+    if (!fd.isValid() || ::fstat(fd.get(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    fd_ = std::move(fd);
+    size_ = std::uint64_t(st.st_size);
+    path_ = path;
+    inode_ = std::uint64_t(st.st_ino);
+    if (inotify_.isValid()) {
+        watch_ = ::inotify_add_watch(inotify_.get(), encoded.constData(), FileEvents);
+        const QByteArray folder = QFile::encodeName(QFileInfo(path).absolutePath());
+        folderWatch_ = ::inotify_add_watch(inotify_.get(), folder.constData(), FolderEvents);
+    }
+    return true;
+}
+
+size_t FilePreview::read(std::uint64_t offset, size_t length, const char** data) const
+{
+    if (offset >= size_)
+        return 0;
+    length = size_t(std::min<std::uint64_t>(length, size_ - offset));
+    if (offset < windowStart_ || offset + length > windowStart_ + window_.size()) {
+        // Centred on what is asked for, as rows are looked for on both sides.
+        const size_t capacity = std::max(WindowBytes, length);
+        const std::uint64_t start = offset - std::min<std::uint64_t>(offset, (capacity - length) / 2);
+        const size_t want = size_t(std::min<std::uint64_t>(capacity, size_ - start));
+        window_.resize(want);
+        size_t got = 0;
+        while (got < want) {
+            const ssize_t n = ::pread(fd_.get(), window_.data() + got, want - got, static_cast<off_t>(start + got));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            got += size_t(n);
+        }
+        window_.resize(got);
+        windowStart_ = start;
+        if (got < want)
+            shortRead_ = true;
+    }
+    if (offset >= windowStart_ + window_.size())
+        return 0;
+    *data = window_.data() + (offset - windowStart_);
+    return size_t(std::min<std::uint64_t>(length, windowStart_ + window_.size() - offset));
+}
+
+void FilePreview::startIndex()
+{
+    if (index_)
+        return;
+    index_ = std::make_unique<LineIndex>(path_, size_);
+    connect(index_.get(), &LineIndex::progressed, this, [this] { viewport()->update(); });
+}
+
+void FilePreview::readNotifications()
+{
+    char buffer[4096];
+    while (::read(inotify_.get(), buffer, sizeof buffer) > 0) {
+    }
+    if (!changeTimer_.isActive())
+        changeTimer_.start();
+}
+
+void FilePreview::checkFile()
+{
+    if (!fd_.isValid())
+        return;
+    const QString path = path_;
+    struct stat atPath {};
+    const bool exists = ::stat(QFile::encodeName(path).constData(), &atPath) == 0;
+    struct stat st {};
+    if (::fstat(fd_.get(), &st) != 0)
+        return;
+    const std::uint64_t size = std::uint64_t(st.st_size);
+    // Where the end was is gone once truncated.
+    const bool following = size >= size_ && isAtEnd();
+
+    // Rotated or truncated: what was shown is gone, show what is there now.
+    if ((exists && std::uint64_t(atPath.st_ino) != inode_) || size < size_) {
+        const bool hex = hex_;
+        clear();
+        if (!exists || !open(path))
+            return;
+        hex_ = hex;
+        if (!hex_)
+            startIndex();
+        if (following)
+            scrollToEnd();
+        else
+            setTop(0);
+        return;
+    }
+    if (size == size_)
+        return;
+    const std::uint64_t top = top_;
+    size_ = size;
+    if (index_)
+        index_->extend(size_);
+    if (following) {
+        scrollToEnd();
+    } else {
+        top_ = top;
+        updateScrollBar();
+        viewport()->update();
+    }
+}
+
+void FilePreview::askGoToLine()
+{
+    if (hex_ || !index_)
+        return;
+    const std::uint64_t lines = index_->lineBreaks() + 1;
+    const qint64 current = lineNumberAt(top_);
+    QString label = QStringLiteral("Line (1 to %1):").arg(lines);
+    if (!index_->isComplete())
+        label = QStringLiteral("Line (1 to %1 so far, still counting):").arg(lines);
+    bool ok = false;
+    const int line = QInputDialog::getInt(this, "Go to Line", label, int(std::min<qint64>(current + 1, INT_MAX)), 1,
+                                          int(std::min<std::uint64_t>(lines, INT_MAX)), 1, &ok);
+    if (ok)
+        goToLine(std::uint64_t(line));
+}
+
+std::uint64_t FilePreview::rowStart(std::uint64_t offset) const
+{
+    offset = std::min(offset, size_);
+    if (hex_)
+        return offset - offset % HexRowBytes;
+    if (offset == 0)
+        return 0;
+    const std::uint64_t from = offset > MaxLineBytes ? offset - MaxLineBytes : 0;
+    const char* data = nullptr;
+    const size_t count = read(from, size_t(offset - from), &data);
+    const void* found = count > 0 ? ::memrchr(data, '\n', count) : nullptr;
+    if (found)
+        return from + std::uint64_t(static_cast<const char*>(found) - data) + 1;
+    // Inside a long line; start a row where a character starts.
+    size_t start = 0;
+    while (start < count && isContinuationByte(data[start]))
+        ++start;
+    return from + start;
+}
+
+std::uint64_t FilePreview::nextRow(std::uint64_t offset) const
+{
+    if (offset >= size_)
+        return size_;
+    if (hex_)
+        return std::min(size_, offset + HexRowBytes);
+    // One byte more than a row, to see whether a character goes on past it.
+    const char* data = nullptr;
+    const size_t count = read(offset, size_t(MaxLineBytes + 1), &data);
+    if (count == 0)
+        return size_;
+    const void* found = std::memchr(data, '\n', std::min<size_t>(count, MaxLineBytes));
+    if (found)
+        return offset + std::uint64_t(static_cast<const char*>(found) - data) + 1;
+    // The rest fits in a row.
+    if (count <= MaxLineBytes)
+        return offset + count;
+    size_t end = MaxLineBytes;
+    for (int i = 0; i < 3 && isContinuationByte(data[end]); ++i)
+        --end;
+    return offset + end;
+}
+
+std::uint64_t FilePreview::previousRow(std::uint64_t offset) const
+{
+    return offset == 0 ? 0 : rowStart(offset - 1);
+}
+
+qint64 FilePreview::lineNumberAt(std::uint64_t offset) const
+{
+    LineIndex::Checkpoint checkpoint;
+    if (!index_ || !index_->checkpointForOffset(offset, &checkpoint))
+        return -1;
+    std::uint64_t line = checkpoint.line;
+    for (std::uint64_t at = checkpoint.offset; at < offset;) {
+        const char* data = nullptr;
+        const size_t count = read(at, size_t(std::min<std::uint64_t>(offset - at, WindowBytes)), &data);
+        if (count == 0)
+            break;
+        line += countLineBreaks(data, count);
+        at += count;
+    }
+    return qint64(line);
+}
+
+int FilePreview::visibleRows() const
+{
+    return std::max(1, viewport()->height() / rowHeight_);
+}
+
+std::uint64_t FilePreview::endTop() const
+{
+    std::uint64_t top = size_;
+    for (int i = visibleRows(); i > 0 && top > 0; --i)
+        top = previousRow(top);
+    return top;
+}
+
+bool FilePreview::isAtEnd() const
+{
+    return top_ >= endTop();
+}
+
+void FilePreview::setTop(std::uint64_t offset)
+{
+    top_ = std::min(rowStart(offset), endTop());
+    updateScrollBar();
+    viewport()->update();
+}
+
+void FilePreview::scrollRows(qint64 rows)
+{
+    std::uint64_t offset = top_;
+    if (rows > 0) {
+        const std::uint64_t end = endTop();
+        for (; rows > 0 && offset < end; --rows)
+            offset = nextRow(offset);
+    } else {
+        for (; rows < 0 && offset > 0; ++rows)
+            offset = previousRow(offset);
+    }
+    setTop(offset);
+}
+
+void FilePreview::scrollToEnd()
+{
+    setTop(endTop());
+}
+
+void FilePreview::updateScrollBar()
+{
+    // An int can't count the bytes of a large file; the bar moves in steps.
+    scrollScale_ = size_ / MaxScrollValue + 1;
+    std::uint64_t shown = top_;
+    for (int i = visibleRows(); i > 0 && shown < size_; --i)
+        shown = nextRow(shown);
+
+    QScrollBar* bar = verticalScrollBar();
+    updatingScrollBar_ = true;
+    bar->setRange(0, int(endTop() / scrollScale_));
+    bar->setPageStep(std::max(1, int((shown - top_) / scrollScale_)));
+    bar->setSingleStep(std::max(1, int(std::uint64_t(charWidth_) / scrollScale_)));
+    bar->setValue(int(top_ / scrollScale_));
+    updatingScrollBar_ = false;
+}
+
+void FilePreview::resolveStyle()
+{
+    font_ = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    const QFontMetrics metrics(font_);
+    rowHeight_ = std::max(1, metrics.height());
+    ascent_ = metrics.ascent();
+    charWidth_ = std::max(1, metrics.horizontalAdvance(QStringLiteral("0")));
+}
+
+void FilePreview::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(viewport());
+    const QPalette colors = palette();
+    painter.fillRect(event->rect(), colors.color(QPalette::Base));
+    if (!fd_.isValid() || size_ == 0)
+        return;
+
+    painter.setFont(font_);
+    const QColor textColor = colors.color(QPalette::Text);
+    const QColor dimColor = colors.color(QPalette::Disabled, QPalette::Text);
+    qint64 line = hex_ ? -1 : lineNumberAt(top_);
+    const int digits = line < 0 ? 0 : int(QString::number(std::max<std::uint64_t>(index_->lineBreaks() + 1, 1000)).size());
+    const int left = line < 0 ? charWidth_ / 2 : (digits + 2) * charWidth_;
+    const int rows = viewport()->height() / rowHeight_ + 1;
+    const char* data = nullptr;
+    // Only the first row of a long line gets its number.
+    bool startsLine = top_ == 0 || (read(top_ - 1, 1, &data) == 1 && *data == '\n');
+    std::uint64_t offset = top_;
+    for (int row = 0; row < rows && offset < size_; ++row) {
+        const int baseline = row * rowHeight_ + ascent_;
+        const std::uint64_t next = nextRow(offset);
+        const size_t count = read(offset, size_t(next - offset), &data);
+        if (hex_) {
+            painter.setPen(textColor);
+            painter.drawText(left, baseline, hexRow(data, count, offset));
+            offset = next;
+            continue;
+        }
+        if (line >= 0 && startsLine) {
+            const QString number = QString::number(line + 1);
+            painter.setPen(dimColor);
+            painter.drawText((digits - int(number.size())) * charWidth_ + charWidth_ / 2, baseline, number);
+        }
+        const bool endsLine = count > 0 && data[count - 1] == '\n';
+        size_t length = endsLine ? count - 1 : count;
+        if (length > 0 && data[length - 1] == '\r')
+            --length;
+        QString text = QString::fromUtf8(data, qsizetype(length));
+        text.replace(QChar('\t'), QString(TabWidth, QChar(' ')));
+        painter.setPen(textColor);
+        painter.drawText(left, baseline, text);
+        if (line >= 0 && endsLine)
+            ++line;
+        startsLine = endsLine;
+        offset = next;
+    }
+
+    if (index_ && !hex_ && !index_->isComplete()) {
+        const std::uint64_t percent = index_->indexedBytes() * 100 / std::max<std::uint64_t>(index_->size(), 1);
+        painter.setPen(dimColor);
+        painter.drawText(viewport()->rect().adjusted(0, 0, -charWidth_, 0), Qt::AlignRight | Qt::AlignBottom,
+                         QStringLiteral("Counting lines… %1%").arg(percent));
+    }
+    // Every scroll and key ends in a paint, so a file cut short under any of
+    // them is noticed here.
+    if (shortRead_) {
+        shortRead_ = false;
+        QTimer::singleShot(0, this, &FilePreview::checkFile);
+    }
+}
+
+void FilePreview::resizeEvent(QResizeEvent* event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    setTop(top_);
+}
+
+void FilePreview::wheelEvent(QWheelEvent* event)
+{
+    // Three rows a notch.
+    const int rows = event->angleDelta().y() / 40;
+    if (rows != 0)
+        scrollRows(-rows);
+    event->accept();
+}
+
+void FilePreview::keyPressEvent(QKeyEvent* event)
+{
+    if (event->key() == Qt::Key_G && event->modifiers() == Qt::ControlModifier) {
+        askGoToLine();
+        return;
+    }
+    switch (event->key()) {
+    case Qt::Key_Up:
+        scrollRows(-1);
+        break;
+    case Qt::Key_Down:
+        scrollRows(1);
+        break;
+    case Qt::Key_PageUp:
+        scrollRows(-std::max(1, visibleRows() - 1));
+        break;
+    case Qt::Key_PageDown:
+        scrollRows(std::max(1, visibleRows() - 1));
+        break;
+    case Qt::Key_Home:
+        setTop(0);
+        break;
+    case Qt::Key_End:
+        scrollToEnd();
+        break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+    }
+}
+
+void FilePreview::contextMenuEvent(QContextMenuEvent* event)
+{
+    if (!fd_.isValid())
+        return;
+    QMenu menu(this);
+    QAction* hexAction = menu.addAction("Show as Hex");
+    hexAction->setCheckable(true);
+    hexAction->setChecked(hex_);
+    QAction* goToAction = menu.addAction("Go to Line…");
+    goToAction->setShortcut(QKeySequence("Ctrl+G"));
+    goToAction->setEnabled(!hex_ && index_);
+    QAction* endAction = menu.addAction("Go to End");
+    const QAction* chosen = menu.exec(event->globalPos());
+    if (chosen == hexAction)
+        setHexMode(!hex_);
+    else if (chosen == goToAction)
+        askGoToLine();
+    else if (chosen == endAction)
+        scrollToEnd();
+}
+
+void FilePreview::scrollContentsBy(int, int)
+{
+    if (updatingScrollBar_)
+        return;
+    const QScrollBar* bar = verticalScrollBar();
+    if (bar->value() >= bar->maximum())
+        scrollToEnd();
+    else
+        setTop(std::uint64_t(bar->value()) * scrollScale_);
+}
+
+void FilePreview::changeEvent(QEvent* event)
+{
+    if (event->type() == QEvent::PaletteChange || event->type() == QEvent::FontChange
+        || event->type() == QEvent::StyleChange) {
+        resolveStyle();
+        updateScrollBar();
+        viewport()->update();
+    }
+    QAbstractScrollArea::changeEvent(event);
+}
@@ -0,0 +1,116 @@
+#ifndef FILEPREVIEW_HPP
+#define FILEPREVIEW_HPP
+
+#include <QAbstractScrollArea>
+#include <QFont>
+#include <QString>
+#include <QTimer>
+
+#include "scopedfd.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class LineIndex;
+class QSocketNotifier;
+
+// A look into a file of any size, as text or as hex. Only the bytes around
+// the viewport are read, with pread() into a window of a few hundred KB, so a
+// 20 GB log opens at once and costs what the screen shows. Where the view is,
+// is a byte offset: scrolling steps from line break to line break near it,
+// and the scroll bar stands for the whole file. The file isn't mapped: a log
+// truncated while shown would fault on the pages it lost, where a read just
+// comes back short.
+//
+// Text files get a LineIndex, built in the background, for line numbers
+// and Ctrl+G. An inotify watch follows the file: appended data is mapped
+// and indexed as it arrives, and a view at the end stays there, like
+// tail -f. A file truncated or replaced, as a rotated log is, is opened
+// again.
+class FilePreview : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit FilePreview(QWidget* parent = nullptr);
+    ~FilePreview() override;
+
+    // Shows path from its start, as hex if it looks binary. Showing the
+    // file already shown keeps the position.
+    void setFile(const QString& path);
+    void clear();
+    const QString& path() const { return path_; }
+
+    void setHexMode(bool hex);
+    bool isHexMode() const { return hex_; }
+    // line counts from 1. False until the index has reached it.
+    bool goToLine(std::uint64_t line);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+    void contextMenuEvent(QContextMenuEvent* event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void changeEvent(QEvent* event) override;
+
+private:
+    bool open(const QString& path);
+    // Up to length bytes at offset, pointing into the window, which is read
+    // again around offset when it doesn't hold them. Valid until the next
+    // call. Fewer at the end of the file and after a short read.
+    size_t read(std::uint64_t offset, size_t length, const char** data) const;
+    void startIndex();
+    void readNotifications();
+    void checkFile();
+    void askGoToLine();
+
+    // Rows are lines up to MaxLineBytes long, or 16 bytes in hex.
+    std::uint64_t rowStart(std::uint64_t offset) const;
+    std::uint64_t nextRow(std::uint64_t offset) const;
+    std::uint64_t previousRow(std::uint64_t offset) const;
+    // 0-based; -1 while the index hasn't got there.
+    qint64 lineNumberAt(std::uint64_t offset) const;
+    int visibleRows() const;
+    // The top that shows the last rows.
+    std::uint64_t endTop() const;
+    bool isAtEnd() const;
+    void setTop(std::uint64_t offset);
+    void scrollRows(qint64 rows);
+    void scrollToEnd();
+    void updateScrollBar();
+    void resolveStyle();
+
+    QString path_;
+    ScopedFd fd_;
+    std::uint64_t inode_ = 0;
+    std::uint64_t size_ = 0;
+    mutable std::vector<char> window_;
+    mutable std::uint64_t windowStart_ = 0;
+    // The file had less than size_; checkFile() runs after the paint.
+    mutable bool shortRead_ = false;
+    // Of the first row shown.
+    std::uint64_t top_ = 0;
+    bool hex_ = false;
+    std::unique_ptr<LineIndex> index_;
+
+    ScopedFd inotify_;
+    QSocketNotifier* notifier_ = nullptr;
+    int watch_ = -1;
+    // The folder is watched too, for the new file of a rotated log.
+    int folderWatch_ = -1;
+    // A busy log is written many times a second; look once per interval.
+    QTimer changeTimer_;
+
+    // The file is scrolled in steps of this many bytes.
+    std::uint64_t scrollScale_ = 1;
+    bool updatingScrollBar_ = false;
+    QFont font_;
+    int rowHeight_ = 0;
+    int ascent_ = 0;
+    int charWidth_ = 0;
+};
+
+#endif // FILEPREVIEW_HPP
@@ -0,0 +1,188 @@
+#include "foldersizes.hpp"
+
+#include <QMetaObject>
+
+#include "memorygovernor.hpp"
+#include "mountprobe.hpp"
+#include "parallelwalker.hpp"
+#include "vfs.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <utility>
+
+namespace {
+
+constexpr auto ProgressInterval = std::chrono::milliseconds(250);
+// Rough memory of a cached total and its hash node, without the path.
+constexpr std::int64_t SizeBytes = 64;
+
+std::shared_ptr<const Vfs> nativeVfs()
+{
+    return std::shared_ptr<const Vfs>(&Vfs::native(), [](const Vfs*) {});
+}
+
+std::int64_t entryBytes(const QString& path)
+{
+    return SizeBytes + path.size() * std::int64_t(sizeof(QChar));
+}
+
+} // namespace
+
+FolderSizes::FolderSizes(QObject* parent)
+    : QObject(parent)
+    , vfs_(nativeVfs())
+    , walkVfs_(vfs_)
+{
+    // Each total is a whole walk to make again.
+    memoryHandle_ = MemoryGovernor::instance().registerCache(QStringLiteral("Folder sizes"), 16, [this](std::int64_t target) {
+        shrink(target);
+    });
+    thread_ = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+FolderSizes::~FolderSizes()
+{
+    thread_.request_stop();
+    thread_ = std::jthread();
+    MemoryGovernor::instance().unregisterCache(memoryHandle_);
+}
+
+void FolderSizes::setVfs(std::shared_ptr<const Vfs> vfs)
+{
+    vfs_ = vfs ? std::move(vfs) : nativeVfs();
+    cache_.clear();
+    cacheBytes_ = 0;
+    reportUsage();
+    std::lock_guard lock(mutex_);
+    walkVfs_ = vfs_;
+    ++generation_;
+    queue_.clear();
+    cancelWalk_ = true;
+}
+
+const FolderSize* FolderSizes::size(const QString& path, std::int64_t mtimeNs) const
+{
+    const auto it = cache_.constFind(Key(path, mtimeNs));
+    return it == cache_.constEnd() ? nullptr : &it.value();
+}
+
+void FolderSizes::request(const std::vector<Request>& requests)
+{
+    std::lock_guard lock(mutex_);
+    queue_.clear();
+    bool walkWanted = false;
+    for (const Request& request : requests) {
+        if (request.path == walking_) {
+            walkWanted = true;
+            continue;
+        }
+        if (!cache_.contains(Key(request.path, request.mtimeNs)))
+            queue_.push_back(request);
+    }
+    if (!walking_.isEmpty() && !walkWanted)
+        cancelWalk_ = true;
+    wake_.notify_one();
+}
+
+void FolderSizes::run(std::stop_token stop)
+{
+    const std::stop_callback cancelOnStop(stop, [this] { cancelWalk_ = true; });
+    for (;;) {
+        Request next;
+        std::shared_ptr<const Vfs> vfs;
+        std::uint64_t generation = 0;
+        {
+            std::unique_lock lock(mutex_);
+            walking_.clear();
+            if (!wake_.wait(lock, stop, [this] { return !queue_.empty(); }))
+                return;
+            next = std::move(queue_.front());
+            queue_.pop_front();
+            walking_ = next.path;
+            // Not false if the stop came first, or this walk would hold up the join.
+            cancelWalk_ = stop.stop_requested();
+            vfs = walkVfs_;
+            generation = generation_;
+        }
+
+        // Every directory there is a round trip or more.
+        if (MountProbe::isHighLatency(*vfs, next.path)) {
+            QMetaObject::invokeMethod(this, [this, generation, path = next.path] {
+                {
+                    std::lock_guard lock(mutex_);
+                    if (generation != generation_)
+                        return;
+                }
+                emit sizeUnavailable(path);
+            }, Qt::QueuedConnection);
+            continue;
+        }
+
+        // The walker calls back from its own threads.
+        std::mutex totalMutex;
+        FolderSize total;
+        // Files with more than one link, so each is counted once.
+        std::set<std::pair<std::uint64_t, std::uint64_t>> linkedFiles;
+        auto reportAt = std::chrono::steady_clock::now() + ProgressInterval;
+        ParallelWalker::Options options;
+        options.sameFilesystem = true;
+        options.vfs = vfs.get();
+        ParallelWalker(options).walk(next.path, [&](std::vector<WalkEntry>&& batch) {
+            std::lock_guard lock(totalMutex);
+            for (const WalkEntry& entry : batch) {
+                if (entry.isDir()) {
+                    ++total.folders;
+                } else if (entry.linkCount < 2 || linkedFiles.emplace(entry.device, entry.inode).second) {
+                    ++total.files;
+                    total.bytes += entry.size;
+                }
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (now >= reportAt) {
+                reportAt = now + ProgressInterval;
+                QMetaObject::invokeMethod(this, [this, generation, next, size = total] {
+                    deliver(generation, next, size, false);
+                }, Qt::QueuedConnection);
+            }
+        }, &cancelWalk_);
+        // A folder that can't be read is as big as what could be.
+        if (!cancelWalk_) {
+            QMetaObject::invokeMethod(this, [this, generation, next, size = total] {
+                deliver(generation, next, size, true);
+            }, Qt::QueuedConnection);
+        }
+    }
+}
+
+void FolderSizes::deliver(std::uint64_t generation, const Request& request, const FolderSize& size, bool complete)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (generation != generation_)
+            return;
+    }
+    if (complete) {
+        const Key key(request.path, request.mtimeNs);
+        if (!cache_.contains(key))
+            cacheBytes_ += entryBytes(request.path);
+        cache_.insert(key, size);
+        reportUsage();
+    }
+    emit sizeChanged(request.path, size, complete);
+}
+
+void FolderSizes::shrink(std::int64_t targetBytes)
+{
+    for (auto it = cache_.begin(); it != cache_.end() && cacheBytes_ > targetBytes;) {
+        cacheBytes_ -= entryBytes(it.key().first);
+        it = cache_.erase(it);
+    }
+    reportUsage();
+}
+
+void FolderSizes::reportUsage()
+{
+    MemoryGovernor::instance().reportUsage(memoryHandle_, cacheBytes_);
+}
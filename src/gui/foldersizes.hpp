@@ -0,0 +1,97 @@
+#ifndef FOLDERSIZES_HPP
+#define FOLDERSIZES_HPP
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class Vfs;
+
+// What a folder holds, all the way down.
+struct FolderSize
+{
+    std::uint64_t bytes = 0;
+    std::uint64_t files = 0;
+    std::uint64_t folders = 0;
+};
+
+// Adds up folders on a background thread, one folder at a time, each walked
+// by a ParallelWalker. Totals are kept by path and the folder's modification
+// time; a change deep inside a folder that leaves its own time alone is not
+// seen until the cache is cleared with setVfs().
+//
+// A walk stays on the folder's filesystem and counts a file with several
+// hard links once. Folders on high-latency mounts are not walked at all.
+//
+// A walk reports partial totals every few tenths of a second through
+// sizeChanged(), so a caller can show a large folder's size as it grows.
+// The totals are a cache of the MemoryGovernor's.
+class FolderSizes : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Request
+    {
+        QString path;
+        std::int64_t mtimeNs = 0;
+    };
+
+    explicit FolderSizes(QObject* parent = nullptr);
+    ~FolderSizes() override;
+
+    // Folders are walked through vfs from now on; forgets every total.
+    void setVfs(std::shared_ptr<const Vfs> vfs);
+    const std::shared_ptr<const Vfs>& vfs() const { return vfs_; }
+
+    // Null until the folder has been walked to the end.
+    const FolderSize* size(const QString& path, std::int64_t mtimeNs) const;
+    // Replaces the queue. A walk under way is given up unless its folder is
+    // still wanted.
+    void request(const std::vector<Request>& requests);
+
+signals:
+    // Partial totals while the walk goes on, then the total with complete set.
+    void sizeChanged(const QString& path, const FolderSize& size, bool complete);
+    // The folder is on a high-latency mount and was left alone.
+    void sizeUnavailable(const QString& path);
+
+private:
+    using Key = std::pair<QString, std::int64_t>;
+
+    void run(std::stop_token stop);
+    void deliver(std::uint64_t generation, const Request& request, const FolderSize& size, bool complete);
+    void shrink(std::int64_t targetBytes);
+    void reportUsage();
+
+    std::shared_ptr<const Vfs> vfs_;
+    QHash<Key, FolderSize> cache_;
+    // Of cache_, counting the paths.
+    std::int64_t cacheBytes_ = 0;
+    int memoryHandle_ = 0;
+
+    // Shared with the thread.
+    std::mutex mutex_;
+    std::condition_variable_any wake_;
+    std::deque<Request> queue_;
+    std::shared_ptr<const Vfs> walkVfs_;
+    // Bumped by setVfs(), so totals from the last backend are dropped.
+    std::uint64_t generation_ = 0;
+    QString walking_;
+    std::atomic_bool cancelWalk_ = false;
+
+    // Last, so it is joined before anything it uses goes away.
+    std::jthread thread_;
+};
+
+#endif // FOLDERSIZES_HPP
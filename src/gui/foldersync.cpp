@@ -0,0 +1,395 @@
+#include "foldersync.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThreadPool>
+
+#include "hashcache.hpp"
+#include "parallelwalker.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct TreeScan
+{
+    std::vector<WalkEntry> entries;
+    QStringList errors;
+    // Directories not listed in full; see ParallelWalker::walk().
+    QStringList incomplete;
+    bool ok = true;
+};
+
+bool entryType(const WalkEntry& entry, SyncEntryType* type)
+{
+    if (entry.isFile())
+        *type = SyncEntryType::File;
+    else if (entry.isDir())
+        *type = SyncEntryType::Directory;
+    else if (entry.isSymLink())
+        *type = SyncEntryType::SymLink;
+    else
+        return false;
+    return true;
+}
+
+QByteArray readLinkTarget(const QString& path)
+{
+    QByteArray target(4096, '\0');
+    const ssize_t n = ::readlink(QFile::encodeName(path).constData(), target.data(), static_cast<size_t>(target.size()));
+    if (n < 0)
+        return {};
+    target.resize(n);
+    return target;
+}
+
+bool hasRemovedAncestor(const std::set<QString>& removedDirs, const QString& relativePath)
+{
+    for (qsizetype slash = relativePath.lastIndexOf(QChar('/')); slash > 0; slash = relativePath.lastIndexOf(QChar('/'), slash - 1)) {
+        if (removedDirs.count(relativePath.left(slash)))
+            return true;
+    }
+    return false;
+}
+
+// Whether relativePath is dir or lies under it; "" holds everything.
+bool isWithin(const QString& relativePath, const QString& dir)
+{
+    return dir.isEmpty() || relativePath == dir || (relativePath.startsWith(dir) && relativePath.at(dir.size()) == QChar('/'));
+}
+
+bool removePath(const QString& path, QString* error)
+{
+    struct stat st {};
+    if (::lstat(QFile::encodeName(path).constData(), &st) != 0)
+        return true;
+    if (S_ISDIR(st.st_mode)) {
+        if (!QDir(path).removeRecursively()) {
+            if (error)
+                *error = QString("Failed to delete directory: %1").arg(path);
+            return false;
+        }
+        return true;
+    }
+    if (::unlink(QFile::encodeName(path).constData()) != 0) {
+        if (error)
+            *error = QString("Failed to delete file: %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::uint64_t SyncPlan::bytesToCopy() const
+{
+    std::uint64_t bytes = 0;
+    for (const SyncEntry& entry : entries) {
+        if (entry.change != SyncChange::Deleted && entry.type == SyncEntryType::File)
+            bytes += entry.sourceSize;
+    }
+    return bytes;
+}
+
+size_t SyncPlan::count(SyncChange change) const
+{
+    return static_cast<size_t>(std::count_if(entries.begin(), entries.end(), [change](const SyncEntry& entry) {
+        return entry.change == change;
+    }));
+}
+
+bool SyncPlan::isEmpty() const
+{
+    return entries.empty();
+}
+
+FolderSync::FolderSync() = default;
+
+FolderSync::FolderSync(Options options)
+    : options_(options)
+{
+}
+
+bool FolderSync::compare(const QString& source,
+                         const QString& target,
+                         SyncPlan* plan,
+                         const std::atomic_bool* cancel,
+                         QStringList* errors) const
+{
+    const auto isCancelled = [cancel] { return cancel && cancel->load(std::memory_order_relaxed); };
+    if (!plan)
+        return false;
+    plan->source = QDir::cleanPath(source);
+    plan->target = QDir::cleanPath(target);
+    plan->entries.clear();
+
+    if (plan->source == plan->target || plan->target.startsWith(plan->source + '/') || plan->source.startsWith(plan->target + '/')) {
+        if (errors)
+            errors->push_back(QString("Source and target must not contain each other:\n%1\n%2").arg(plan->source, plan->target));
+        return false;
+    }
+
+    ParallelWalker::Options walkOptions;
+    walkOptions.maxThreads = options_.maxThreads;
+    walkOptions.includeHidden = options_.includeHidden;
+    const ParallelWalker walker(walkOptions);
+
+    const auto scanTree = [&](const QString& root, TreeScan* scan) {
+        std::mutex mutex;
+        scan->ok = walker.walk(
+            root,
+            [&](std::vector<WalkEntry>&& batch) {
+                std::lock_guard lock(mutex);
+                scan->entries.insert(scan->entries.end(),
+                                     std::make_move_iterator(batch.begin()),
+                                     std::make_move_iterator(batch.end()));
+            },
+            cancel,
+            &scan->errors,
+            &scan->incomplete);
+        std::sort(scan->entries.begin(), scan->entries.end(), [](const WalkEntry& a, const WalkEntry& b) {
+            return a.relativePath < b.relativePath;
+        });
+    };
+
+    TreeScan sourceScan;
+    TreeScan targetScan;
+    const bool targetExists = QFileInfo(plan->target).isDir();
+    {
+        // Both trees usually live on different devices, so scan them at once.
+        std::jthread targetThread;
+        if (targetExists)
+            targetThread = std::jthread([&] { scanTree(plan->target, &targetScan); });
+        scanTree(plan->source, &sourceScan);
+    }
+    if (errors) {
+        errors->append(sourceScan.errors);
+        errors->append(targetScan.errors);
+    }
+    if (!sourceScan.ok || !targetScan.ok || isCancelled())
+        return false;
+    if (!targetExists && QFileInfo::exists(plan->target)) {
+        if (errors)
+            errors->push_back(QString("Target is not a directory: %1").arg(plan->target));
+        return false;
+    }
+
+    // A source directory that could not be read in full says nothing about
+    // what under it is gone, so nothing there is deleted from the target.
+    QStringList keptTargetDirs;
+    for (const QString& dir : std::as_const(sourceScan.incomplete)) {
+        if (options_.deleteExtraneous && errors)
+            errors->push_back(QString("Nothing is deleted under %1: the source could not be read in full.")
+                                  .arg(dir.isEmpty() ? plan->source : plan->source + '/' + dir));
+        keptTargetDirs.push_back(dir);
+    }
+    const auto isKept = [&keptTargetDirs](const QString& relativePath) {
+        return std::any_of(keptTargetDirs.cbegin(), keptTargetDirs.cend(), [&](const QString& dir) {
+            return relativePath != dir && isWithin(relativePath, dir);
+        });
+    };
+
+    std::set<QString> removedTargetDirs;
+    std::vector<std::pair<size_t, size_t>> hashPairs;
+    const std::vector<WalkEntry>& src = sourceScan.entries;
+    const std::vector<WalkEntry>& dst = targetScan.entries;
+
+    const auto addDeleted = [&](const WalkEntry& entry, SyncEntryType type) {
+        if (!options_.deleteExtraneous || hasRemovedAncestor(removedTargetDirs, entry.relativePath) || isKept(entry.relativePath))
+            return;
+        if (type == SyncEntryType::Directory)
+            removedTargetDirs.insert(entry.relativePath);
+        SyncEntry change;
+        change.relativePath = entry.relativePath;
+        change.change = SyncChange::Deleted;
+        change.type = type;
+        change.targetSize = entry.size;
+        change.targetMtimeNs = entry.mtimeNs;
+        plan->entries.push_back(std::move(change));
+    };
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < src.size() || j < dst.size()) {
+        const bool takeSource = j >= dst.size() || (i < src.size() && src[i].relativePath < dst[j].relativePath);
+        const bool takeTarget = i >= src.size() || (j < dst.size() && dst[j].relativePath < src[i].relativePath);
+
+        if (takeTarget) {
+            SyncEntryType type;
+            if (entryType(dst[j], &type))
+                addDeleted(dst[j], type);
+            ++j;
+            continue;
+        }
+
+        SyncEntryType sourceType;
+        if (!entryType(src[i], &sourceType)) {
+            if (!takeSource)
+                ++j;
+            ++i;
+            continue;
+        }
+
+        SyncEntry change;
+        change.relativePath = src[i].relativePath;
+        change.type = sourceType;
+        change.sourceSize = src[i].size;
+        change.sourceMtimeNs = src[i].mtimeNs;
+        change.sourceMode = src[i].mode;
+
+        if (takeSource) {
+            change.change = SyncChange::New;
+            plan->entries.push_back(std::move(change));
+            ++i;
+            continue;
+        }
+
+        SyncEntryType targetType;
+        const bool targetKnown = entryType(dst[j], &targetType);
+        change.targetSize = dst[j].size;
+        change.targetMtimeNs = dst[j].mtimeNs;
+        if (!targetKnown || targetType != sourceType) {
+            change.change = SyncChange::Changed;
+            change.replacesTargetType = true;
+            if (targetKnown && targetType == SyncEntryType::Directory)
+                removedTargetDirs.insert(change.relativePath);
+            plan->entries.push_back(std::move(change));
+        } else if (sourceType == SyncEntryType::File) {
+            const std::int64_t mtimeDelta = src[i].mtimeNs > dst[j].mtimeNs ? src[i].mtimeNs - dst[j].mtimeNs : dst[j].mtimeNs - src[i].mtimeNs;
+            if (src[i].size != dst[j].size) {
+                change.change = SyncChange::Changed;
+                plan->entries.push_back(std::move(change));
+            } else if (options_.compareContents) {
+                hashPairs.emplace_back(i, j);
+            } else if (mtimeDelta > options_.mtimeToleranceNs) {
+                change.change = SyncChange::Changed;
+                plan->entries.push_back(std::move(change));
+            }
+        } else if (sourceType == SyncEntryType::SymLink) {
+            if (readLinkTarget(src[i].path) != readLinkTarget(dst[j].path)) {
+                change.change = SyncChange::Changed;
+                plan->entries.push_back(std::move(change));
+            }
+        }
+        ++i;
+        ++j;
+    }
+
+    if (!hashPairs.empty()) {
+        std::mutex mutex;
+        QThreadPool pool;
+        const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+        pool.setMaxThreadCount(options_.maxThreads > 0 ? options_.maxThreads : static_cast<int>(hardware));
+        for (const auto& [sourceIndex, targetIndex] : hashPairs) {
+            pool.start([&, sourceIndex, targetIndex] {
+                if (isCancelled())
+                    return;
+                QString sourceError;
+                QString targetError;
+                const QByteArray sourceDigest = HashCache::instance().fileDigest(src[sourceIndex].path, cancel, &sourceError);
+                const QByteArray targetDigest = HashCache::instance().fileDigest(dst[targetIndex].path, cancel, &targetError);
+                if (!sourceError.isEmpty() && !isCancelled()) {
+                    std::lock_guard lock(mutex);
+                    if (errors)
+                        errors->push_back(sourceError);
+                    return;
+                }
+                if (!targetDigest.isEmpty() && sourceDigest == targetDigest)
+                    return;
+
+                SyncEntry change;
+                change.relativePath = src[sourceIndex].relativePath;
+                change.change = SyncChange::Changed;
+                change.sourceSize = src[sourceIndex].size;
+                change.targetSize = dst[targetIndex].size;
+                change.sourceMtimeNs = src[sourceIndex].mtimeNs;
+                change.targetMtimeNs = dst[targetIndex].mtimeNs;
+                change.sourceMode = src[sourceIndex].mode;
+                std::lock_guard lock(mutex);
+                plan->entries.push_back(std::move(change));
+            });
+        }
+        pool.waitForDone();
+        std::sort(plan->entries.begin(), plan->entries.end(), [](const SyncEntry& a, const SyncEntry& b) {
+            return a.relativePath < b.relativePath;
+        });
+    }
+    return !isCancelled();
+}
+
+bool FolderSync::apply(const SyncPlan& plan,
+                       const ParallelCopier::ProgressCallback& onProgress,
+                       const std::atomic_bool* cancel,
+                       QStringList* errors) const
+{
+    const auto isCancelled = [cancel] { return cancel && cancel->load(std::memory_order_relaxed); };
+    const auto fail = [errors](const QString& error) {
+        if (errors && !error.isEmpty())
+            errors->push_back(error);
+    };
+    const QDir sourceDir(plan.source);
+    const QDir targetDir(plan.target);
+    bool ok = true;
+
+    if (!QDir().mkpath(plan.target)) {
+        fail(QString("Failed to create directory: %1").arg(plan.target));
+        return false;
+    }
+
+    // Deepest paths first; entries are sorted so parents precede children.
+    for (auto it = plan.entries.rbegin(); it != plan.entries.rend() && !isCancelled(); ++it) {
+        if (!it->replacesTargetType && it->change != SyncChange::Deleted)
+            continue;
+        QString error;
+        if (!removePath(targetDir.filePath(it->relativePath), &error)) {
+            fail(error);
+            ok = false;
+        }
+    }
+
+    std::vector<CopyJob> jobs;
+    for (const SyncEntry& entry : plan.entries) {
+        if (isCancelled())
+            return false;
+        if (entry.change == SyncChange::Deleted)
+            continue;
+        const QString sourcePath = sourceDir.filePath(entry.relativePath);
+        const QString targetPath = targetDir.filePath(entry.relativePath);
+        switch (entry.type) {
+        case SyncEntryType::Directory:
+            if (::mkdir(QFile::encodeName(targetPath).constData(), entry.sourceMode & 07777) != 0 && errno != EEXIST) {
+                fail(QString("Failed to create directory: %1").arg(targetPath));
+                ok = false;
+            }
+            break;
+        case SyncEntryType::SymLink: {
+            const QByteArray linkTarget = readLinkTarget(sourcePath);
+            const QByteArray nativeTarget = QFile::encodeName(targetPath);
+            ::unlink(nativeTarget.constData());
+            if (linkTarget.isEmpty() || ::symlink(linkTarget.constData(), nativeTarget.constData()) != 0) {
+                fail(QString("Failed to create symbolic link: %1").arg(targetPath));
+                ok = false;
+            }
+            break;
+        }
+        case SyncEntryType::File:
+            jobs.push_back({sourcePath, targetPath, entry.sourceSize});
+            break;
+        }
+    }
+
+    ParallelCopier::Options copyOptions;
+    copyOptions.maxThreads = options_.maxThreads;
+    if (!ParallelCopier(copyOptions).run(jobs, onProgress, cancel, errors))
+        ok = false;
+    return ok && !isCancelled();
+}
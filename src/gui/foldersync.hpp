@@ -0,0 +1,89 @@
+#ifndef FOLDERSYNC_HPP
+#define FOLDERSYNC_HPP
+
+#include <QString>
+#include <QStringList>
+
+#include "parallelcopier.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+enum class SyncChange
+{
+    New,
+    Changed,
+    Deleted,
+};
+
+enum class SyncEntryType
+{
+    File,
+    Directory,
+    SymLink,
+};
+
+struct SyncEntry
+{
+    QString relativePath;
+    SyncChange change = SyncChange::New;
+    // Type on the source side; for deletions, the type on the target side.
+    SyncEntryType type = SyncEntryType::File;
+    std::uint64_t sourceSize = 0;
+    std::uint64_t targetSize = 0;
+    std::int64_t sourceMtimeNs = 0;
+    std::int64_t targetMtimeNs = 0;
+    std::uint32_t sourceMode = 0;
+    // The target has a different type at this path and must be removed first.
+    bool replacesTargetType = false;
+};
+
+struct SyncPlan
+{
+    QString source;
+    QString target;
+    std::vector<SyncEntry> entries;
+
+    std::uint64_t bytesToCopy() const;
+    size_t count(SyncChange change) const;
+    bool isEmpty() const;
+};
+
+// Mirrors one directory tree onto another. compare() walks both trees in
+// parallel and matches entries by relative path; apply() then removes what
+// the source no longer has, creates missing directories and copies only new
+// and changed files with ParallelCopier.
+class FolderSync
+{
+public:
+    struct Options
+    {
+        int maxThreads = 0;
+        bool includeHidden = true;
+        // Also hash files whose size and mtime match.
+        bool compareContents = false;
+        bool deleteExtraneous = true;
+        // Allowed mtime difference, for targets such as FAT with coarse timestamps.
+        std::int64_t mtimeToleranceNs = 0;
+    };
+
+    FolderSync();
+    explicit FolderSync(Options options);
+
+    bool compare(const QString& source,
+                 const QString& target,
+                 SyncPlan* plan,
+                 const std::atomic_bool* cancel,
+                 QStringList* errors) const;
+
+    bool apply(const SyncPlan& plan,
+               const ParallelCopier::ProgressCallback& onProgress,
+               const std::atomic_bool* cancel,
+               QStringList* errors) const;
+
+private:
+    Options options_;
+};
+
+#endif // FOLDERSYNC_HPP
@@ -0,0 +1,699 @@
+#include "gitstatus.hpp"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QRegularExpression>
+#include <QSet>
+#include <QStandardPaths>
+
+#include "scopedfd.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::uint16_t AssumeValidFlag = 0x8000;
+constexpr std::uint16_t ExtendedFlag = 0x4000;
+constexpr std::uint16_t SkipWorktreeFlag = 0x4000;
+constexpr std::uint32_t GitlinkMode = 0160000;
+constexpr std::uint32_t SymlinkMode = 0120000;
+// Bounds the digests kept for files whose stat alone was not conclusive.
+constexpr qsizetype MaxCachedDigests = 16384;
+// Larger files aren't read for a badge.
+constexpr std::uint64_t MaxHashedBytes = 64 * 1024 * 1024;
+
+std::uint32_t readBe32(const unsigned char* data)
+{
+    return (std::uint32_t(data[0]) << 24) | (std::uint32_t(data[1]) << 16) | (std::uint32_t(data[2]) << 8) | data[3];
+}
+
+std::uint16_t readBe16(const unsigned char* data)
+{
+    return static_cast<std::uint16_t>((data[0] << 8) | data[1]);
+}
+
+std::int64_t mtimeNsOf(const struct stat& st)
+{
+    return std::int64_t(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+QByteArray readSmallFile(const QString& path)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.read(64 * 1024) : QByteArray();
+}
+
+// A .gitignore, info/exclude or global excludes file, compiled.
+struct IgnoreFile
+{
+    enum class Kind
+    {
+        Exact,
+        Suffix,
+        Regex,
+    };
+
+    struct Pattern
+    {
+        Kind kind = Kind::Exact;
+        QString text;
+        QRegularExpression regex;
+        bool negate = false;
+        bool dirOnly = false;
+        // Matched against the path relative to the file's folder rather
+        // than the base name: the pattern has a slash in it.
+        bool anchored = false;
+    };
+
+    enum class Match
+    {
+        None,
+        Ignored,
+        Included,
+    };
+
+    std::int64_t mtimeNs = 0;
+    std::uint64_t size = 0;
+    std::vector<Pattern> patterns;
+
+    Match match(const QString& path, QStringView name, bool isDir) const
+    {
+        // The last matching pattern decides.
+        for (auto it = patterns.rbegin(); it != patterns.rend(); ++it) {
+            const Pattern& pattern = *it;
+            if (pattern.dirOnly && !isDir)
+                continue;
+            const QStringView subject = pattern.anchored ? QStringView(path) : name;
+            bool matched = false;
+            switch (pattern.kind) {
+            case Kind::Exact:
+                matched = subject == QStringView(pattern.text);
+                break;
+            case Kind::Suffix:
+                matched = subject.endsWith(pattern.text);
+                break;
+            case Kind::Regex:
+                matched = pattern.regex.matchView(subject).hasMatch();
+                break;
+            }
+            if (matched)
+                return pattern.negate ? Match::Included : Match::Ignored;
+        }
+        return Match::None;
+    }
+};
+
+// A glob as git reads it: "*" and "?" stop at slashes, "**" spans folders.
+QString globToRegex(const QString& glob)
+{
+    QString out;
+    const qsizetype size = glob.size();
+    for (qsizetype i = 0; i < size; ++i) {
+        const QChar c = glob.at(i);
+        if (c == '*') {
+            const bool doubleStar = i + 1 < size && glob.at(i + 1) == '*';
+            const bool atStart = i == 0 || glob.at(i - 1) == '/';
+            const bool atEnd = i + 2 >= size || glob.at(i + 2) == '/';
+            if (doubleStar && atStart && atEnd) {
+                if (i + 2 >= size) {
+                    out += ".*";
+                    ++i;
+                } else {
+                    out += "(?:.*/)?";
+                    i += 2;
+                }
+            } else {
+                out += "[^/]*";
+                if (doubleStar)
+                    ++i;
+            }
+        } else if (c == '?') {
+            out += "[^/]";
+        } else if (c == '[') {
+            qsizetype end = i + 1;
+            if (end < size && (glob.at(end) == '!' || glob.at(end) == '^'))
+                ++end;
+            if (end < size && glob.at(end) == ']')
+                ++end;
+            while (end < size && glob.at(end) != ']')
+                ++end;
+            if (end >= size) {
+                out += "\\[";
+                continue;
+            }
+            QString set = glob.mid(i + 1, end - i - 1);
+            if (set.startsWith('!'))
+                set[0] = '^';
+            set.replace("\\", "\\\\").replace("[", "\\[");
+            out += '[' + set + ']';
+            i = end;
+        } else if (c == '\\' && i + 1 < size) {
+            out += QRegularExpression::escape(glob.mid(++i, 1));
+        } else {
+            out += QRegularExpression::escape(QString(c));
+        }
+    }
+    return out;
+}
+
+std::shared_ptr<const IgnoreFile> compileIgnoreFile(const QByteArray& data, std::int64_t mtimeNs, std::uint64_t size)
+{
+    auto file = std::make_shared<IgnoreFile>();
+    file->mtimeNs = mtimeNs;
+    file->size = size;
+    for (QString line : QString::fromUtf8(data).split('\n')) {
+        if (line.endsWith('\r'))
+            line.chop(1);
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        while (line.endsWith(' ') && !line.endsWith("\\ "))
+            line.chop(1);
+
+        IgnoreFile::Pattern pattern;
+        if (line.startsWith('!')) {
+            pattern.negate = true;
+            line.remove(0, 1);
+        } else if (line.startsWith("\\!") || line.startsWith("\\#")) {
+            line.remove(0, 1);
+        }
+        if (line.endsWith('/')) {
+            pattern.dirOnly = true;
+            line.chop(1);
+        }
+        pattern.anchored = line.contains('/');
+        if (line.startsWith('/'))
+            line.remove(0, 1);
+        if (line.isEmpty())
+            continue;
+
+        const auto hasWildcard = [](QStringView text) {
+            return text.contains('*') || text.contains('?') || text.contains('[') || text.contains('\\');
+        };
+        if (!hasWildcard(line)) {
+            pattern.kind = IgnoreFile::Kind::Exact;
+            pattern.text = line;
+        } else if (!pattern.anchored && line.startsWith('*') && !hasWildcard(QStringView(line).sliced(1))) {
+            pattern.kind = IgnoreFile::Kind::Suffix;
+            pattern.text = line.sliced(1);
+        } else {
+            pattern.kind = IgnoreFile::Kind::Regex;
+            pattern.regex = QRegularExpression(QRegularExpression::anchoredPattern(globToRegex(line)));
+            if (!pattern.regex.isValid())
+                continue;
+        }
+        file->patterns.push_back(std::move(pattern));
+    }
+    return file;
+}
+
+// Compiled ignore files by path, shared by every listing; a file is compiled
+// again when its mtime or size changes.
+std::shared_ptr<const IgnoreFile> ignoreFileAt(const QString& path)
+{
+    static std::mutex mutex;
+    static QHash<QString, std::shared_ptr<const IgnoreFile>> cache;
+
+    struct stat st {};
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        std::lock_guard lock(mutex);
+        cache.remove(path);
+        return nullptr;
+    }
+    {
+        std::lock_guard lock(mutex);
+        const auto it = cache.constFind(path);
+        if (it != cache.constEnd() && it.value()->mtimeNs == mtimeNsOf(st) && it.value()->size == std::uint64_t(st.st_size))
+            return it.value();
+    }
+    std::shared_ptr<const IgnoreFile> file = compileIgnoreFile(readSmallFile(path), mtimeNsOf(st), std::uint64_t(st.st_size));
+    std::lock_guard lock(mutex);
+    cache.insert(path, file);
+    return file;
+}
+
+// Answers "is this path ignored?" for one states() call, reading each
+// folder's .gitignore once. Paths are relative to the work tree.
+class IgnoreMatcher
+{
+public:
+    IgnoreMatcher(const QString& workTree, const QString& commonDirectory)
+        : workTree_(workTree)
+    {
+        // Lowest precedence last.
+        if (auto file = ignoreFileAt(commonDirectory + "/info/exclude"))
+            globalFiles_.push_back(file);
+        QString config = QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation);
+        if (!config.isEmpty()) {
+            if (auto file = ignoreFileAt(config + "/git/ignore"))
+                globalFiles_.push_back(file);
+        }
+    }
+
+    bool isIgnored(const QString& path, bool isDir)
+    {
+        const qsizetype slash = path.lastIndexOf('/');
+        const QString folder = slash < 0 ? QString() : path.left(slash);
+        // Nothing under an ignored folder can be brought back.
+        if (!folder.isEmpty() && isFolderIgnored(folder))
+            return true;
+        return matches(path, isDir);
+    }
+
+private:
+    bool isFolderIgnored(const QString& folder)
+    {
+        const auto it = folders_.constFind(folder);
+        if (it != folders_.constEnd())
+            return it.value();
+        const bool ignored = isIgnored(folder, true);
+        folders_.insert(folder, ignored);
+        return ignored;
+    }
+
+    bool matches(const QString& path, bool isDir)
+    {
+        const QStringView name = QStringView(path).sliced(path.lastIndexOf('/') + 1);
+        // The .gitignore closest to the path decides first.
+        qsizetype end = path.lastIndexOf('/');
+        for (;;) {
+            const QString folder = end < 0 ? QString() : path.left(end);
+            if (const IgnoreFile* file = fileIn(folder)) {
+                const QString relative = end < 0 ? path : path.sliced(end + 1);
+                const IgnoreFile::Match match = file->match(relative, name, isDir);
+                if (match != IgnoreFile::Match::None)
+                    return match == IgnoreFile::Match::Ignored;
+            }
+            if (end < 0)
+                break;
+            end = path.lastIndexOf('/', end - 1);
+        }
+        for (const std::shared_ptr<const IgnoreFile>& file : globalFiles_) {
+            const IgnoreFile::Match match = file->match(path, name, isDir);
+            if (match != IgnoreFile::Match::None)
+                return match == IgnoreFile::Match::Ignored;
+        }
+        return false;
+    }
+
+    const IgnoreFile* fileIn(const QString& folder)
+    {
+        auto it = files_.find(folder);
+        if (it == files_.end())
+            it = files_.insert(folder, ignoreFileAt(workTree_ + '/' + (folder.isEmpty() ? QString() : folder + '/') + ".gitignore"));
+        return it.value().get();
+    }
+
+    QString workTree_;
+    std::vector<std::shared_ptr<const IgnoreFile>> globalFiles_;
+    QHash<QString, std::shared_ptr<const IgnoreFile>> files_;
+    QHash<QString, bool> folders_;
+};
+
+// The object ID git gives the file's content: a hash of "blob <size>\0"
+// and the bytes, or of the target for a symbolic link. Kept by path and
+// stat, so a file is read once per version.
+QByteArray blobDigest(const QString& path, const VfsStat& st, bool sha256, const std::atomic_bool* cancel)
+{
+    static std::mutex mutex;
+    static QHash<QString, QByteArray> cache;
+    const QString key = QString("%1\n%2\n%3\n%4\n%5").arg(path).arg(st.size).arg(st.mtimeNs).arg(st.inode).arg(sha256);
+    {
+        std::lock_guard lock(mutex);
+        const auto it = cache.constFind(key);
+        if (it != cache.constEnd())
+            return it.value();
+    }
+
+    QCryptographicHash hash(sha256 ? QCryptographicHash::Sha256 : QCryptographicHash::Sha1);
+    const QByteArray encoded = QFile::encodeName(path);
+    if (st.isSymLink()) {
+        std::vector<char> target(st.size + 1);
+        const ssize_t length = ::readlink(encoded.constData(), target.data(), target.size());
+        if (length < 0 || std::uint64_t(length) != st.size)
+            return QByteArray();
+        hash.addData(QByteArray("blob ") + QByteArray::number(qulonglong(length)) + '\0');
+        hash.addData(QByteArrayView(target.data(), length));
+    } else {
+        const ScopedFd fd(::open(encoded.constData(), O_RDONLY | O_CLOEXEC));
+        if (!fd.isValid())
+            return QByteArray();
+        hash.addData(QByteArray("blob ") + QByteArray::number(qulonglong(st.size)) + '\0');
+        std::vector<char> buffer(256 * 1024);
+        std::uint64_t total = 0;
+        for (;;) {
+            if (cancel && *cancel)
+                return QByteArray();
+            const ssize_t got = ::read(fd.get(), buffer.data(), buffer.size());
+            if (got < 0)
+                return QByteArray();
+            if (got == 0)
+                break;
+            hash.addData(QByteArrayView(buffer.data(), got));
+            total += std::uint64_t(got);
+        }
+        // Changed while it was read.
+        if (total != st.size)
+            return QByteArray();
+    }
+
+    const QByteArray digest = hash.result();
+    std::lock_guard lock(mutex);
+    if (cache.size() >= MaxCachedDigests)
+        cache.clear();
+    cache.insert(key, digest);
+    return digest;
+}
+
+} // namespace
+
+std::shared_ptr<const GitStatus> GitStatus::open(const QString& directory, const std::shared_ptr<const GitStatus>& previous)
+{
+    // The nearest folder up with a .git: a folder, or in linked work trees
+    // and submodules a file naming one.
+    QString workTree = QDir::cleanPath(directory);
+    QString gitDirectory;
+    for (;;) {
+        const QFileInfo dotGit(workTree + (workTree.endsWith('/') ? ".git" : "/.git"));
+        if (dotGit.isDir()) {
+            gitDirectory = dotGit.absoluteFilePath();
+            break;
+        }
+        if (dotGit.isFile()) {
+            const QByteArray line = readSmallFile(dotGit.absoluteFilePath()).trimmed();
+            if (line.startsWith("gitdir:")) {
+                gitDirectory = QDir::cleanPath(QDir(workTree).absoluteFilePath(QString::fromUtf8(line.mid(7).trimmed())));
+                break;
+            }
+        }
+        if (workTree == "/" || workTree.isEmpty())
+            return nullptr;
+        workTree = QFileInfo(workTree).absolutePath();
+    }
+
+    const QString indexPath = gitDirectory + "/index";
+    struct stat st {};
+    const bool hasIndex = ::stat(QFile::encodeName(indexPath).constData(), &st) == 0;
+    if (previous && previous->workTree_ == workTree && previous->indexPath_ == indexPath
+        && previous->indexMtimeNs_ == (hasIndex ? mtimeNsOf(st) : 0) && previous->indexSize_ == (hasIndex ? std::uint64_t(st.st_size) : 0)
+        && previous->indexInode_ == (hasIndex ? std::uint64_t(st.st_ino) : 0))
+        return previous;
+
+    std::shared_ptr<GitStatus> status(new GitStatus());
+    status->workTree_ = workTree;
+    status->gitDirectory_ = gitDirectory;
+    const QByteArray commonDirectory = readSmallFile(gitDirectory + "/commondir").trimmed();
+    status->commonDirectory_ = commonDirectory.isEmpty()
+        ? gitDirectory
+        : QDir::cleanPath(QDir(gitDirectory).absoluteFilePath(QString::fromUtf8(commonDirectory)));
+    status->indexPath_ = indexPath;
+    const QByteArray config = readSmallFile(status->commonDirectory_ + "/config").toLower();
+    status->sha256_ = QByteArray(config).replace(" ", "").replace("\t", "").contains("objectformat=sha256");
+    // A repository nothing was added to yet has no index.
+    if (hasIndex && !status->readIndex())
+        return nullptr;
+    return status;
+}
+
+GitStatus::~GitStatus()
+{
+    if (map_)
+        ::munmap(const_cast<unsigned char*>(map_), mapSize_);
+}
+
+bool GitStatus::readIndex()
+{
+    const ScopedFd fd(::open(QFile::encodeName(indexPath_).constData(), O_RDONLY | O_CLOEXEC));
+    struct stat st {};
+    if (!fd.isValid() || ::fstat(fd.get(), &st) != 0 || st.st_size < 12)
+        return false;
+    indexMtimeNs_ = mtimeNsOf(st);
+    indexSize_ = std::uint64_t(st.st_size);
+    indexInode_ = std::uint64_t(st.st_ino);
+    // git replaces the index by renaming a new one over it, so the mapping
+    // stays valid for as long as this object lives.
+    void* map = ::mmap(nullptr, indexSize_, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (map == MAP_FAILED)
+        return false;
+    map_ = static_cast<const unsigned char*>(map);
+    mapSize_ = indexSize_;
+
+    const std::uint32_t version = readBe32(map_ + 4);
+    if (std::memcmp(map_, "DIRC", 4) != 0 || version < 2 || version > 4)
+        return false;
+    const std::uint32_t count = readBe32(map_ + 8);
+    const size_t hashSize = sha256_ ? 32 : 20;
+    const size_t fixedSize = 40 + hashSize + 2;
+    if (count > mapSize_ / fixedSize)
+        return false;
+    entries_.reserve(count);
+    pathEnds_.reserve(count);
+    paths_.reserve(static_cast<size_t>(count) * 32);
+
+    size_t offset = 12;
+    QByteArray previousPath;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (offset + fixedSize > mapSize_)
+            return false;
+        const unsigned char* data = map_ + offset;
+        Entry entry;
+        entry.mtimeSec = readBe32(data + 8);
+        entry.mtimeNsec = readBe32(data + 12);
+        entry.inode = readBe32(data + 20);
+        entry.mode = readBe32(data + 24);
+        entry.size = readBe32(data + 36);
+        entry.oidOffset = offset + 40;
+        entry.flags = readBe16(data + 40 + hashSize);
+        size_t pos = offset + fixedSize;
+        if (entry.flags & ExtendedFlag) {
+            if (version < 3 || pos + 2 > mapSize_)
+                return false;
+            // A sparse checkout's files outside it are not compared.
+            if (readBe16(map_ + pos) & SkipWorktreeFlag)
+                entry.flags |= AssumeValidFlag;
+            pos += 2;
+        }
+
+        QByteArray path;
+        if (version == 4) {
+            // How much of the previous path to drop, then the rest of this one.
+            size_t strip = 0;
+            unsigned char byte = 0;
+            do {
+                if (pos >= mapSize_)
+                    return false;
+                byte = map_[pos++];
+                strip = (strip << 7) | (byte & 0x7f);
+                if (byte & 0x80)
+                    ++strip;
+            } while (byte & 0x80);
+            const void* nul = pos < mapSize_ ? std::memchr(map_ + pos, 0, mapSize_ - pos) : nullptr;
+            if (!nul || strip > size_t(previousPath.size()))
+                return false;
+            const size_t length = static_cast<const unsigned char*>(nul) - (map_ + pos);
+            path = previousPath.left(previousPath.size() - static_cast<qsizetype>(strip))
+                + QByteArray(reinterpret_cast<const char*>(map_ + pos), static_cast<qsizetype>(length));
+            pos += length + 1;
+            previousPath = path;
+        } else {
+            const void* nul = std::memchr(map_ + pos, 0, mapSize_ - pos);
+            if (!nul)
+                return false;
+            const size_t length = static_cast<const unsigned char*>(nul) - (map_ + pos);
+            path = QByteArray(reinterpret_cast<const char*>(map_ + pos), static_cast<qsizetype>(length));
+            // Padded with NULs to a multiple of eight bytes.
+            pos = offset + ((pos - offset + length + 8) & ~size_t(7));
+        }
+        offset = pos;
+
+        paths_.insert(paths_.end(), path.constBegin(), path.constEnd());
+        pathEnds_.push_back(static_cast<std::uint32_t>(paths_.size()));
+        entries_.push_back(entry);
+    }
+    return true;
+}
+
+int GitStatus::comparePath(size_t entry, const QByteArray& path) const
+{
+    const std::uint32_t begin = entry == 0 ? 0 : pathEnds_[entry - 1];
+    const size_t length = pathEnds_[entry] - begin;
+    const size_t common = std::min(length, size_t(path.size()));
+    const int result = common == 0 ? 0 : std::memcmp(paths_.data() + begin, path.constData(), common);
+    if (result != 0)
+        return result;
+    return length < size_t(path.size()) ? -1 : (length > size_t(path.size()) ? 1 : 0);
+}
+
+size_t GitStatus::lowerBound(const QByteArray& path) const
+{
+    // The index is sorted by path, byte by byte.
+    size_t low = 0;
+    size_t high = entries_.size();
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (comparePath(middle, path) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+qint64 GitStatus::find(const QByteArray& path) const
+{
+    const size_t entry = lowerBound(path);
+    return entry < entries_.size() && comparePath(entry, path) == 0 ? qint64(entry) : -1;
+}
+
+bool GitStatus::hasEntriesUnder(const QByteArray& folder) const
+{
+    const QByteArray prefix = folder + '/';
+    const size_t entry = lowerBound(prefix);
+    if (entry >= entries_.size())
+        return false;
+    const std::uint32_t begin = entry == 0 ? 0 : pathEnds_[entry - 1];
+    return pathEnds_[entry] - begin >= std::uint32_t(prefix.size())
+        && std::memcmp(paths_.data() + begin, prefix.constData(), size_t(prefix.size())) == 0;
+}
+
+GitStatus::State GitStatus::fileState(const Entry& entry, const QString& path, const VfsStat& st, const std::atomic_bool* cancel) const
+{
+    if (entry.flags & AssumeValidFlag)
+        return State::Clean;
+    // An unresolved merge conflict.
+    if ((entry.flags >> 12) & 3)
+        return State::Modified;
+    const std::uint32_t type = entry.mode & 0170000;
+    if (type == GitlinkMode)
+        return State::Clean;
+    if ((type == SymlinkMode) != st.isSymLink() || (type != SymlinkMode && !st.isFile()))
+        return State::Modified;
+    // The index keeps the low 32 bits.
+    if (std::uint32_t(st.size) != entry.size)
+        return State::Modified;
+
+    // Some builds of git record whole seconds only, leaving the nanoseconds 0.
+    const std::int64_t seconds = st.mtimeNs / 1000000000LL;
+    const std::int64_t nanoseconds = st.mtimeNs % 1000000000LL;
+    const bool statMatches = std::uint32_t(seconds) == entry.mtimeSec
+        && (entry.mtimeNsec == 0 || std::uint32_t(nanoseconds) == entry.mtimeNsec)
+        && (entry.inode == 0 || std::uint32_t(st.inode) == entry.inode);
+    // Modified in the same instant the index was written: the stat can't
+    // tell whether it changed after.
+    const std::int64_t entryMtimeNs = std::int64_t(entry.mtimeSec) * 1000000000LL + entry.mtimeNsec;
+    const bool racy = entryMtimeNs >= indexMtimeNs_ - (entry.mtimeNsec == 0 ? 1000000000LL : 0);
+    if (statMatches && !racy)
+        return State::Clean;
+
+    if (st.size > MaxHashedBytes)
+        return State::Unknown;
+    const QByteArray digest = blobDigest(path, st, sha256_, cancel);
+    if (digest.isEmpty())
+        return State::Unknown;
+    const size_t hashSize = sha256_ ? 32 : 20;
+    return std::memcmp(digest.constData(), map_ + entry.oidOffset, hashSize) == 0 ? State::Clean : State::Modified;
+}
+
+bool GitStatus::relativePath(const QString& directory, QString* relative) const
+{
+    const QString clean = QDir::cleanPath(directory);
+    relative->clear();
+    if (clean != workTree_) {
+        const QString prefix = workTree_.endsWith('/') ? workTree_ : workTree_ + '/';
+        if (!clean.startsWith(prefix))
+            return false;
+        *relative = clean.sliced(prefix.size());
+    }
+    return *relative != ".git" && !relative->startsWith(".git/");
+}
+
+std::vector<GitStatus::State> GitStatus::states(const QString& directory, const std::vector<Item>& items, const std::atomic_bool* cancel) const
+{
+    std::vector<State> states(items.size(), State::Unknown);
+    QString relative;
+    if (!relativePath(directory, &relative))
+        return states;
+
+    IgnoreMatcher ignores(workTree_, commonDirectory_);
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (cancel && *cancel)
+            break;
+        const Item& item = items[i];
+        const QString path = relative.isEmpty() ? item.name : relative + '/' + item.name;
+        if (path == ".git") {
+            states[i] = State::Ignored;
+            continue;
+        }
+        const QByteArray encoded = path.toUtf8();
+        const qint64 entry = find(encoded);
+        if (entry >= 0) {
+            states[i] = fileState(entries_[size_t(entry)], workTree_ + '/' + path, item.stat, cancel);
+        } else if (item.isDir && hasEntriesUnder(encoded)) {
+            states[i] = State::Clean;
+        } else {
+            states[i] = ignores.isIgnored(path, item.isDir) ? State::Ignored : State::Untracked;
+        }
+    }
+    return states;
+}
+
+bool GitStatus::modifiedFolders(const QString& directory,
+                                const std::vector<Item>& items,
+                                std::vector<State>* states,
+                                const std::atomic_bool* cancel) const
+{
+    QString relative;
+    if (!relativePath(directory, &relative))
+        return false;
+
+    // Every folder below the directory with a modified file under it, found
+    // in one pass over its part of the index.
+    const QByteArray prefix = relative.isEmpty() ? QByteArray() : relative.toUtf8() + '/';
+    QSet<QByteArray> modified;
+    for (size_t entry = lowerBound(prefix); entry < entries_.size(); ++entry) {
+        if (cancel && *cancel)
+            return false;
+        const std::uint32_t begin = entry == 0 ? 0 : pathEnds_[entry - 1];
+        const QByteArray path(paths_.data() + begin, qsizetype(pathEnds_[entry] - begin));
+        if (!path.startsWith(prefix))
+            break;
+        const qsizetype slash = path.lastIndexOf('/');
+        if (slash < prefix.size() || modified.contains(path.first(slash)))
+            continue;
+        const QString filePath = workTree_ + '/' + QString::fromUtf8(path);
+        VfsStat st;
+        const Entry& indexEntry = entries_[entry];
+        // Gone, unless the index says not to look.
+        const bool changed = Vfs::native().stat(filePath, &st, nullptr)
+            ? fileState(indexEntry, filePath, st, cancel) == State::Modified
+            : !(indexEntry.flags & AssumeValidFlag) && (indexEntry.mode & 0170000) != GitlinkMode;
+        if (!changed)
+            continue;
+        for (qsizetype end = slash; end >= prefix.size() && end > 0; end = path.lastIndexOf('/', end - 1)) {
+            if (modified.contains(path.first(end)))
+                break;
+            modified.insert(path.first(end));
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < items.size() && i < states->size(); ++i) {
+        if (!items[i].isDir || (*states)[i] != State::Clean)
+            continue;
+        const QByteArray path = prefix + items[i].name.toUtf8();
+        if (modified.contains(path)) {
+            (*states)[i] = State::Modified;
+            changed = true;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,119 @@
+#ifndef GITSTATUS_HPP
+#define GITSTATUS_HPP
+
+#include <QString>
+
+#include "vfs.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The status of files in a git work tree, for badges in the file views,
+// without running git. The index (.git/index, versions 2 to 4) is
+// memory-mapped and its entries compared with the stats a listing already
+// has, the way git itself decides a file is unchanged: mtime, size and
+// inode must match, and the index must have been written after the file
+// was last modified. A file fails that test only by its content when the
+// size is the same, so only then is it hashed, once per version of the file;
+// files too large to hash in passing stay Unknown.
+//
+// A tracked folder is Modified when a file anywhere under it is, which
+// modifiedFolders() works out with a stat per index entry below the listing.
+//
+// Files not in the index are matched against the .gitignore files from the
+// work tree down, .git/info/exclude and the user's global excludes. Each
+// file is compiled once into exact names, suffixes and regular expressions,
+// and compiled again only when it changes.
+//
+// Only the work tree against the index is compared: staged changes show as
+// clean. Read-only once open, so the listing threads can share one.
+class GitStatus
+{
+public:
+    enum class State : std::uint8_t
+    {
+        // Outside a work tree, or not worked out yet.
+        Unknown,
+        Clean,
+        Modified,
+        Untracked,
+        Ignored,
+    };
+
+    struct Item
+    {
+        // Relative to the directory; may hold '/', as a flat listing's do.
+        QString name;
+        VfsStat stat;
+        bool isDir = false;
+    };
+
+    // The work tree holding directory, with its index read. Null outside a
+    // work tree or when the index can't be read. previous is returned as it
+    // is when it is the same work tree and its index hasn't changed.
+    static std::shared_ptr<const GitStatus> open(const QString& directory, const std::shared_ptr<const GitStatus>& previous);
+
+    ~GitStatus();
+    GitStatus(const GitStatus&) = delete;
+    GitStatus& operator=(const GitStatus&) = delete;
+
+    const QString& workTree() const { return workTree_; }
+    const QString& gitDirectory() const { return gitDirectory_; }
+
+    // One state per item, in order. Once cancel is set, the rest are Unknown.
+    std::vector<State> states(const QString& directory, const std::vector<Item>& items, const std::atomic_bool* cancel = nullptr) const;
+    // Turns the Clean folders among items Modified that have a modified
+    // file under them. Returns whether any changed.
+    bool modifiedFolders(const QString& directory,
+                         const std::vector<Item>& items,
+                         std::vector<State>* states,
+                         const std::atomic_bool* cancel = nullptr) const;
+
+private:
+    struct Entry
+    {
+        std::uint32_t mtimeSec = 0;
+        std::uint32_t mtimeNsec = 0;
+        std::uint32_t inode = 0;
+        std::uint32_t size = 0;
+        std::uint32_t mode = 0;
+        std::uint16_t flags = 0;
+        // Of the object ID in the mapped index.
+        std::uint64_t oidOffset = 0;
+    };
+
+    GitStatus() = default;
+    bool readIndex();
+    // The directory relative to the work tree; false if it is outside it or
+    // inside .git.
+    bool relativePath(const QString& directory, QString* relative) const;
+    // Like memcmp, of the path of entry against path.
+    int comparePath(size_t entry, const QByteArray& path) const;
+    // The first entry whose path sorts at or after path.
+    size_t lowerBound(const QByteArray& path) const;
+    // Index of the entry for path, -1 if there is none.
+    qint64 find(const QByteArray& path) const;
+    bool hasEntriesUnder(const QByteArray& folder) const;
+    State fileState(const Entry& entry, const QString& path, const VfsStat& st, const std::atomic_bool* cancel) const;
+
+    QString workTree_;
+    QString gitDirectory_;
+    // Holds info/exclude; differs from gitDirectory_ in linked work trees.
+    QString commonDirectory_;
+    QString indexPath_;
+    std::int64_t indexMtimeNs_ = 0;
+    std::uint64_t indexSize_ = 0;
+    std::uint64_t indexInode_ = 0;
+    bool sha256_ = false;
+
+    const unsigned char* map_ = nullptr;
+    size_t mapSize_ = 0;
+    std::vector<Entry> entries_;
+    // The paths, UTF-8, back to back in index order.
+    std::vector<char> paths_;
+    std::vector<std::uint32_t> pathEnds_;
+};
+
+#endif // GITSTATUS_HPP
@@ -0,0 +1,366 @@
+#include "hashcache.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+
+#include "filehash.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr const char* XattrName = "user.kitaplik.hash";
+constexpr char XattrMagic[4] = {'K', 'H', '2', '\0'};
+constexpr char StoreMagic[8] = {'K', 'T', 'H', 'C', 'A', 'C', 'H', 'E'};
+constexpr std::uint32_t StoreVersion = 1;
+constexpr size_t DigestSize = 32;
+constexpr std::uint64_t InitialCapacity = 4096;
+// 2^20 slots is 80 MiB; past that the table starts over instead of growing.
+constexpr std::uint64_t MaxCapacity = 1ULL << 20;
+
+struct XattrRecord
+{
+    char magic[4];
+    std::uint8_t digestSize;
+    std::uint8_t reserved[3];
+    std::uint64_t device;
+    std::uint64_t inode;
+    std::uint64_t size;
+    std::int64_t mtimeNs;
+    unsigned char digest[DigestSize];
+};
+
+struct StoreHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t digestSize;
+    std::uint64_t capacity;
+    std::uint64_t count;
+};
+
+struct StoreSlot
+{
+    std::uint64_t device;
+    std::uint64_t inode;
+    std::uint64_t size;
+    std::int64_t mtimeNs;
+    std::int64_t ctimeNs;
+    // Guards against slots torn by a crash mid-write; zero marks an empty slot.
+    std::uint64_t check;
+    unsigned char digest[DigestSize];
+};
+
+std::int64_t toNanoseconds(const timespec& ts)
+{
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+std::uint64_t mix(std::uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+std::uint64_t slotIndex(std::uint64_t device, std::uint64_t inode, std::uint64_t capacity)
+{
+    return mix(inode ^ mix(device)) & (capacity - 1);
+}
+
+std::uint64_t slotCheck(const StoreSlot& slot)
+{
+    std::uint64_t check = mix(slot.device) ^ mix(slot.inode + 1) ^ mix(slot.size + 2)
+        ^ mix(static_cast<std::uint64_t>(slot.mtimeNs) + 3) ^ mix(static_cast<std::uint64_t>(slot.ctimeNs) + 4);
+    for (size_t i = 0; i < DigestSize; i += sizeof(std::uint64_t)) {
+        std::uint64_t word = 0;
+        std::memcpy(&word, slot.digest + i, sizeof(word));
+        check ^= mix(word + i + 5);
+    }
+    return check | 1;
+}
+
+size_t storeSize(std::uint64_t capacity)
+{
+    return sizeof(StoreHeader) + static_cast<size_t>(capacity) * sizeof(StoreSlot);
+}
+
+} // namespace
+
+bool FileHashKey::fromPath(const QString& path, FileHashKey* key)
+{
+    struct stat st {};
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    key->device = static_cast<std::uint64_t>(st.st_dev);
+    key->inode = static_cast<std::uint64_t>(st.st_ino);
+    key->size = static_cast<std::uint64_t>(st.st_size);
+    key->mtimeNs = toNanoseconds(st.st_mtim);
+    key->ctimeNs = toNanoseconds(st.st_ctim);
+    return true;
+}
+
+HashCache& HashCache::instance()
+{
+    static HashCache cache;
+    return cache;
+}
+
+HashCache::HashCache() = default;
+
+HashCache::~HashCache()
+{
+    unmapStore();
+    if (storeFd_ >= 0)
+        ::close(storeFd_);
+}
+
+QByteArray HashCache::lookup(const QString& path, const FileHashKey& key, Match match)
+{
+    {
+        std::lock_guard lock(mutex_);
+        bool known = false;
+        const QByteArray digest = lookupStore(key, &known);
+        // The table has this inode at another ctime: changed since, whatever
+        // the attribute says.
+        if (!digest.isEmpty() || known || match == Match::FullKey)
+            return digest;
+    }
+
+    // Not in the table, which may have been cleared or be held by another
+    // instance: the attribute is trusted on everything but the ctime.
+    XattrRecord record {};
+    const ssize_t n = ::getxattr(QFile::encodeName(path).constData(), XattrName, &record, sizeof(record));
+    if (n == static_cast<ssize_t>(sizeof(record))
+        && std::memcmp(record.magic, XattrMagic, sizeof(XattrMagic)) == 0
+        && record.digestSize == DigestSize
+        && record.device == key.device
+        && record.inode == key.inode
+        && record.size == key.size
+        && record.mtimeNs == key.mtimeNs) {
+        return QByteArray(reinterpret_cast<const char*>(record.digest), DigestSize);
+    }
+    return {};
+}
+
+void HashCache::store(const QString& path, const FileHashKey& key, const QByteArray& digest, Store where)
+{
+    if (digest.size() != static_cast<qsizetype>(DigestSize))
+        return;
+
+    XattrRecord record {};
+    std::memcpy(record.magic, XattrMagic, sizeof(XattrMagic));
+    record.digestSize = DigestSize;
+    record.device = key.device;
+    record.inode = key.inode;
+    record.size = key.size;
+    record.mtimeNs = key.mtimeNs;
+    std::memcpy(record.digest, digest.constData(), DigestSize);
+    FileHashKey stored = key;
+    // Setting the attribute bumps the ctime; the table gets the one after it,
+    // so the full key, ctime included, is checked while the table has it.
+    if (where == Store::Everywhere && ::setxattr(QFile::encodeName(path).constData(), XattrName, &record, sizeof(record), 0) == 0) {
+        FileHashKey after;
+        if (!FileHashKey::fromPath(path, &after) || after.device != key.device || after.inode != key.inode
+            || after.size != key.size || after.mtimeNs != key.mtimeNs)
+            return;
+        stored.ctimeNs = after.ctimeNs;
+    }
+
+    std::lock_guard lock(mutex_);
+    insertStore(stored, digest);
+}
+
+QByteArray HashCache::fileDigest(const QString& path, const std::atomic_bool* cancel, QString* error, Store where, Match match)
+{
+    FileHashKey before;
+    if (!FileHashKey::fromPath(path, &before))
+        return hashFileContents(path, cancel, error);
+
+    QByteArray digest = lookup(path, before, match);
+    if (!digest.isEmpty())
+        return digest;
+
+    digest = hashFileContents(path, cancel, error);
+    FileHashKey after;
+    // Only cache what was read from a file that held still while hashing.
+    if (!digest.isEmpty() && FileHashKey::fromPath(path, &after) && after == before)
+        store(path, before, digest, where);
+    return digest;
+}
+
+bool HashCache::openStore()
+{
+    if (map_)
+        return true;
+    if (storeFailed_)
+        return false;
+    storeFailed_ = true;
+
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dir.isEmpty() || !QDir().mkpath(dir))
+        return false;
+    storePath_ = QDir(dir).filePath("hashcache.bin");
+
+    const int fd = ::open(QFile::encodeName(storePath_).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return false;
+    // Another running instance owns the table; this one goes without.
+    if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    struct stat st {};
+    StoreHeader header {};
+    const bool valid = ::fstat(fd, &st) == 0
+        && static_cast<size_t>(st.st_size) >= sizeof(header)
+        && ::pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+        && std::memcmp(header.magic, StoreMagic, sizeof(StoreMagic)) == 0
+        && header.version == StoreVersion
+        && header.digestSize == DigestSize
+        && header.capacity >= InitialCapacity
+        && header.capacity <= MaxCapacity
+        && (header.capacity & (header.capacity - 1)) == 0
+        && static_cast<size_t>(st.st_size) == storeSize(header.capacity);
+    if (!valid) {
+        header = {};
+        std::memcpy(header.magic, StoreMagic, sizeof(StoreMagic));
+        header.version = StoreVersion;
+        header.digestSize = DigestSize;
+        header.capacity = InitialCapacity;
+        if (::ftruncate(fd, 0) != 0 || ::ftruncate(fd, static_cast<off_t>(storeSize(header.capacity))) != 0
+            || ::pwrite(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+            ::close(fd);
+            return false;
+        }
+    }
+
+    if (!mapStore(fd, header.capacity)) {
+        ::close(fd);
+        return false;
+    }
+    storeFd_ = fd;
+    storeFailed_ = false;
+    return true;
+}
+
+bool HashCache::mapStore(int fd, std::uint64_t capacity)
+{
+    const size_t size = storeSize(capacity);
+    void* map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return false;
+    map_ = static_cast<unsigned char*>(map);
+    mapSize_ = size;
+    return true;
+}
+
+void HashCache::unmapStore()
+{
+    if (map_)
+        ::munmap(map_, mapSize_);
+    map_ = nullptr;
+    mapSize_ = 0;
+}
+
+bool HashCache::growStore()
+{
+    auto* header = reinterpret_cast<StoreHeader*>(map_);
+    const std::uint64_t oldCapacity = header->capacity;
+    std::vector<StoreSlot> live;
+    live.reserve(static_cast<size_t>(header->count));
+    const auto* table = reinterpret_cast<const StoreSlot*>(map_ + sizeof(StoreHeader));
+    if (oldCapacity < MaxCapacity) {
+        for (std::uint64_t i = 0; i < oldCapacity; ++i) {
+            if (table[i].check != 0 && table[i].check == slotCheck(table[i]))
+                live.push_back(table[i]);
+        }
+    }
+
+    const std::uint64_t newCapacity = oldCapacity < MaxCapacity ? oldCapacity * 2 : oldCapacity;
+    unmapStore();
+    // Zero the slot area so every slot of the new table starts out empty.
+    if (::ftruncate(storeFd_, static_cast<off_t>(sizeof(StoreHeader))) != 0
+        || ::ftruncate(storeFd_, static_cast<off_t>(storeSize(newCapacity))) != 0
+        || !mapStore(storeFd_, newCapacity)) {
+        ::close(storeFd_);
+        storeFd_ = -1;
+        storeFailed_ = true;
+        return false;
+    }
+
+    header = reinterpret_cast<StoreHeader*>(map_);
+    header->capacity = newCapacity;
+    header->count = 0;
+    auto* newTable = reinterpret_cast<StoreSlot*>(map_ + sizeof(StoreHeader));
+    for (const StoreSlot& slot : live) {
+        std::uint64_t index = slotIndex(slot.device, slot.inode, newCapacity);
+        while (newTable[index].check != 0)
+            index = (index + 1) & (newCapacity - 1);
+        newTable[index] = slot;
+        ++header->count;
+    }
+    return true;
+}
+
+QByteArray HashCache::lookupStore(const FileHashKey& key, bool* known)
+{
+    *known = false;
+    if (!openStore())
+        return {};
+    const auto* header = reinterpret_cast<const StoreHeader*>(map_);
+    const auto* table = reinterpret_cast<const StoreSlot*>(map_ + sizeof(StoreHeader));
+    const std::uint64_t capacity = header->capacity;
+    for (std::uint64_t index = slotIndex(key.device, key.inode, capacity), probes = 0;
+         probes < capacity && table[index].check != 0;
+         index = (index + 1) & (capacity - 1), ++probes) {
+        const StoreSlot& slot = table[index];
+        if (slot.device != key.device || slot.inode != key.inode)
+            continue;
+        *known = slot.check == slotCheck(slot);
+        if (slot.size != key.size || slot.mtimeNs != key.mtimeNs || slot.ctimeNs != key.ctimeNs || slot.check != slotCheck(slot))
+            return {};
+        return QByteArray(reinterpret_cast<const char*>(slot.digest), DigestSize);
+    }
+    return {};
+}
+
+void HashCache::insertStore(const FileHashKey& key, const QByteArray& digest)
+{
+    if (!openStore())
+        return;
+    auto* header = reinterpret_cast<StoreHeader*>(map_);
+    if ((header->count + 1) * 10 > header->capacity * 7 && !growStore())
+        return;
+
+    header = reinterpret_cast<StoreHeader*>(map_);
+    auto* table = reinterpret_cast<StoreSlot*>(map_ + sizeof(StoreHeader));
+    const std::uint64_t capacity = header->capacity;
+    std::uint64_t index = slotIndex(key.device, key.inode, capacity);
+    while (table[index].check != 0 && (table[index].device != key.device || table[index].inode != key.inode))
+        index = (index + 1) & (capacity - 1);
+
+    StoreSlot& slot = table[index];
+    if (slot.check == 0)
+        ++header->count;
+    slot.device = key.device;
+    slot.inode = key.inode;
+    slot.size = key.size;
+    slot.mtimeNs = key.mtimeNs;
+    slot.ctimeNs = key.ctimeNs;
+    std::memcpy(slot.digest, digest.constData(), DigestSize);
+    slot.check = slotCheck(slot);
+}
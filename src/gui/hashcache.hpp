@@ -0,0 +1,92 @@
+#ifndef HASHCACHE_HPP
+#define HASHCACHE_HPP
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+struct FileHashKey
+{
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::uint64_t size = 0;
+    std::int64_t mtimeNs = 0;
+    std::int64_t ctimeNs = 0;
+
+    bool operator==(const FileHashKey&) const = default;
+
+    static bool fromPath(const QString& path, FileHashKey* key);
+};
+
+// Remembers full content hashes (hashFileContents()) of files across runs so
+// unchanged files are never read twice. A digest is valid only while the
+// file's key still matches.
+//
+// Every digest goes to a memory-mapped open-addressing table in the cache
+// directory that checks the full key, ctime included. Where the filesystem
+// and permissions allow it, it is also stored in a "user.kitaplik.hash"
+// extended attribute, which outlives the table. Setting an xattr itself
+// bumps the ctime, so the attribute records device, inode, size and mtime,
+// and the table records the ctime after the write. The attribute alone is
+// trusted only when the table knows nothing of the inode; a table entry at
+// another ctime overrules it. A file rewritten in place with its mtime kept
+// looks unchanged to the attribute, so callers that delete or replace files
+// on the strength of a digest ask for Match::FullKey.
+class HashCache
+{
+public:
+    static HashCache& instance();
+
+    HashCache(const HashCache&) = delete;
+    HashCache& operator=(const HashCache&) = delete;
+
+    enum class Store
+    {
+        Everywhere,
+        // Leaves the file alone, as on a drive being catalogued: the digest
+        // goes to the table only.
+        TableOnly,
+    };
+
+    enum class Match
+    {
+        // The attribute counts where the table doesn't know the inode.
+        Attribute,
+        // Only a table entry with the full key, ctime included.
+        FullKey,
+    };
+
+    QByteArray lookup(const QString& path, const FileHashKey& key, Match match = Match::Attribute);
+    void store(const QString& path, const FileHashKey& key, const QByteArray& digest, Store where = Store::Everywhere);
+
+    // Returns the cached digest of an unchanged file or hashes and caches it.
+    QByteArray fileDigest(const QString& path,
+                          const std::atomic_bool* cancel,
+                          QString* error,
+                          Store where = Store::Everywhere,
+                          Match match = Match::Attribute);
+
+private:
+    HashCache();
+    ~HashCache();
+
+    bool openStore();
+    bool mapStore(int fd, std::uint64_t capacity);
+    void unmapStore();
+    bool growStore();
+    // known is set when the table has the inode, matching or not.
+    QByteArray lookupStore(const FileHashKey& key, bool* known);
+    void insertStore(const FileHashKey& key, const QByteArray& digest);
+
+    std::mutex mutex_;
+    QString storePath_;
+    int storeFd_ = -1;
+    unsigned char* map_ = nullptr;
+    size_t mapSize_ = 0;
+    bool storeFailed_ = false;
+};
+
+#endif // HASHCACHE_HPP
@@ -5,15 +5,20 @@
 #include <QAbstractItemView>
 #include <QApplication>
 #include <QClipboard>
+#include <QCryptographicHash>
+#include <QCursor>
+#include <QDataStream>
 #include <QDateTime>
 #include <QDir>
 #include <QDesktopServices>
+#include <QDropEvent>
 #include <QFile>
 #include <QFileInfo>
-#include <QHeaderView>
 #include <QIcon>
 #include <QInputDialog>
 #include <QItemSelectionModel>
+#include <QKeySequence>
+#include <QLabel>
 #include <QLineEdit>
 #include <QStringList>
 #include <QLocale>
@@ -24,57 +29,65 @@
 #include <QMessageBox>
 #include <QMimeData>
 #include <QMetaObject>
-#include <QPainter>
 #include <QPointer>
 #include <QPushButton>
 #include <QResource>
 #include <QScrollBar>
+#include <QSet>
+#include <QSignalBlocker>
 #include <QStandardPaths>
 #include <QSortFilterProxyModel>
 #include <QStorageInfo>
-#include <QStyledItemDelegate>
 #include <QStyle>
+#include <QTemporaryDir>
 #include <QTimer>
 #include <QTextStream>
 #include <QUrl>
 
 #include "ui_kitaplik.h"
 
+#include "archiveextractor.hpp"
+#include "archiveindex.hpp"
+#include "archivemodel.hpp"
+#include "archivewriter.hpp"
+#include "catalogsearchdialog.hpp"
+#include "catalogvfs.hpp"
+#include "drivecatalog.hpp"
+#include "duplicatefinderdialog.hpp"
+#include "entryselectionmodel.hpp"
+#include "memorygovernor.hpp"
+#include "queryresults.hpp"
+#include "queryvfs.hpp"
+#include "selectionmimedata.hpp"
+#include "selectionsummary.hpp"
+#include "syncdialog.hpp"
+
 #include <algorithm>
 #include <chrono>
 #include <functional>
 #include <optional>
+#include <utility>
 
-namespace {
-
-class FileItemDelegate final : public QStyledItemDelegate
-{
-public:
-    explicit FileItemDelegate(QObject* parent = nullptr)
-        : QStyledItemDelegate(parent)
-    {
-    }
-
-    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override
-    {
-        QStyleOptionViewItem opt(option);
-        initStyleOption(&opt, index);
-
-        const auto* fsModel = qobject_cast<const QFileSystemModel*>(index.model());
-        const bool isDir = fsModel ? fsModel->isDir(index) : false;
-        if (isDir)
-            opt.palette.setColor(QPalette::Text, QColor("#4fc3f7"));
-
-        QStyledItemDelegate::paint(painter, opt, index);
-    }
-};
+#include <sys/stat.h>
 
+namespace {
 
 QString cleanPath(const QString& path)
 {
     if (path.trimmed().isEmpty())
         return QDir::homePath();
 
+    QString catalogUuid;
+    QString catalogInnerPath;
+    if (DriveCatalog::splitUrl(path.trimmed(), &catalogUuid, &catalogInnerPath)) {
+        const QString root = DriveCatalog::rootUrl(catalogUuid);
+        return catalogInnerPath.isEmpty() ? root : root + '/' + catalogInnerPath;
+    }
+    QString queryName;
+    QString queryInnerPath;
+    if (QueryVfs::splitUrl(path.trimmed(), &queryName, &queryInnerPath))
+        return QueryVfs::rootUrl(queryName);
+
     const QString trimmed = path.trimmed();
     if (trimmed == "~")
         return QDir::homePath();
@@ -86,7 +99,11 @@ QString cleanPath(const QString& path)
 
 constexpr int PinnedPathRole = Qt::UserRole + 1;
 constexpr int PinnedReadOnlyRole = Qt::UserRole + 2;
-constexpr const char* ClipboardCutMimeType = "application/x-kitaplik-cut";
+// Filesystem UUID of a mounted volume or an offline catalog.
+constexpr int PinnedVolumeUuidRole = Qt::UserRole + 3;
+constexpr int PinnedOfflineRole = Qt::UserRole + 4;
+// Name of a saved query.
+constexpr int PinnedQueryRole = Qt::UserRole + 5;
 
 bool removeRecursively(const QString& path, QString* error)
 {
@@ -133,6 +150,46 @@ QString normalizePathForFs(const QString& path)
     return clean;
 }
 
+// Splits a path that runs through an archive file, such as
+// "/data/photos.zip/2023/may", into the archive and the path inside it.
+// Only prefixes named like an archive are looked up, so an ordinary path
+// costs no filesystem calls; on a network mount each one is a round trip.
+bool splitArchivePath(const QString& path, QString* archivePath, QString* innerPath)
+{
+    for (qsizetype end = path.size(); end > 0; end = path.lastIndexOf('/', end - 1)) {
+        const QString prefix = path.left(end);
+        if (ArchiveIndex::formatForName(prefix) == ArchiveFormat::Unknown)
+            continue;
+        const QFileInfo info(prefix);
+        if (info.isFile()) {
+            if (ArchiveIndex::detectFormat(prefix) == ArchiveFormat::Unknown)
+                return false;
+            *archivePath = prefix;
+            *innerPath = path.mid(end + 1);
+            return true;
+        }
+        if (info.exists())
+            return false;
+    }
+    return false;
+}
+
+bool isBrowsablePath(const QString& path)
+{
+    QString catalogUuid;
+    QString catalogInnerPath;
+    if (DriveCatalog::splitUrl(path, &catalogUuid, &catalogInnerPath))
+        return QFileInfo::exists(DriveCatalog::catalogPath(catalogUuid));
+    QString queryName;
+    if (QueryVfs::splitUrl(path, &queryName, &catalogInnerPath))
+        return true;
+    if (QFileInfo(path).isDir())
+        return true;
+    QString archivePath;
+    QString innerPath;
+    return splitArchivePath(path, &archivePath, &innerPath);
+}
+
 QString nearestExistingPath(const QString& path)
 {
     QFileInfo cursor(path);
@@ -201,6 +258,43 @@ enum class ConflictChoice
 
 using ConflictResolver = std::function<ConflictChoice(const QString& sourcePath, const QString& destinationPath, bool isDirectory)>;
 
+ConflictChoice askConflictChoice(QWidget* parent, const QString& title, const QString& sourcePath, const QString& destinationPath, bool isDirectory)
+{
+    QMessageBox box(parent);
+    box.setIcon(QMessageBox::Question);
+    box.setWindowTitle(title);
+    box.setText(isDirectory
+        ? QString("A folder already exists at destination:\n%1").arg(destinationPath)
+        : QString("A file already exists at destination:\n%1").arg(destinationPath));
+    box.setInformativeText(QString("Source: %1").arg(sourcePath));
+
+    QPushButton* replaceButton = box.addButton("Replace", QMessageBox::AcceptRole);
+    QPushButton* skipButton = box.addButton("Skip", QMessageBox::DestructiveRole);
+    QPushButton* keepBothButton = box.addButton("Keep both", QMessageBox::ActionRole);
+    QPushButton* cancelButton = box.addButton(QMessageBox::Cancel);
+    box.setDefaultButton(skipButton);
+
+    box.exec();
+    if (box.clickedButton() == replaceButton)
+        return ConflictChoice::Replace;
+    if (box.clickedButton() == keepBothButton)
+        return ConflictChoice::KeepBoth;
+    if (box.clickedButton() == cancelButton)
+        return ConflictChoice::Cancel;
+    return ConflictChoice::Skip;
+}
+
+// "photos.tar.zst" -> "photos": the folder an archive is extracted into.
+QString archiveFolderName(const QString& archiveName)
+{
+    static const QStringList suffixes = {".tar.zst", ".tzst", ".tar", ".zip", ".jar"};
+    for (const QString& suffix : suffixes) {
+        if (archiveName.endsWith(suffix, Qt::CaseInsensitive) && archiveName.size() > suffix.size())
+            return archiveName.chopped(suffix.size());
+    }
+    return archiveName + " (extracted)";
+}
+
 QString makeUniqueKeepBothPath(const QString& destinationPath)
 {
     const QFileInfo destinationInfo(destinationPath);
@@ -504,6 +598,41 @@ bool copyRecursivelyWithProgress(const QString& sourcePath,
                                 error);
 }
 
+bool isMediaSortField(FileSortField field)
+{
+    return field == FileSortField::DateTaken || field == FileSortField::Dimensions || field == FileSortField::Duration;
+}
+
+// Bigger folders list quickly compared to writing them out on every exit.
+constexpr std::uint32_t MaxSnapshotEntries = 200000;
+// Folders of a flat listing watched at most, the shallowest first; inotify
+// watches are a per-user limit.
+constexpr qsizetype MaxWatchedFolders = 8192;
+
+QString listingSnapshotPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/listing.snapshot";
+}
+
+// The list view's detail columns as a bit per model column, for the snapshot.
+quint16 columnMask(const QList<int>& columns)
+{
+    quint16 mask = 0;
+    for (const int column : columns)
+        mask |= static_cast<quint16>(1u << column);
+    return mask;
+}
+
+QList<int> maskColumns(quint16 mask)
+{
+    QList<int> columns;
+    for (int column = ListingModel::NameColumn + 1; column < ListingModel::ColumnCount; ++column) {
+        if (mask & (1u << column))
+            columns.append(column);
+    }
+    return columns;
+}
+
 } // namespace
 
 class FileSortProxyModel : public QSortFilterProxyModel
@@ -523,33 +652,79 @@ public:
 protected:
     bool lessThan(const QModelIndex& left, const QModelIndex& right) const override
     {
-        const auto* fsModel = qobject_cast<const QFileSystemModel*>(sourceModel());
-        if (!fsModel)
+        if (const auto* archiveModel = qobject_cast<const ArchiveModel*>(sourceModel())) {
+            const ArchiveNode* leftNode = archiveModel->nodeAt(left);
+            const ArchiveNode* rightNode = archiveModel->nodeAt(right);
+            if (!leftNode || !rightNode)
+                return QSortFilterProxyModel::lessThan(left, right);
+            const ArchiveMember* leftMember = archiveModel->memberAt(left);
+            const ArchiveMember* rightMember = archiveModel->memberAt(right);
+            switch (sortField_) {
+            case FileSortField::Name:
+                return leftNode->name.toLower() < rightNode->name.toLower();
+            case FileSortField::Size:
+                return (leftMember ? leftMember->size : 0) < (rightMember ? rightMember->size : 0);
+            case FileSortField::Type:
+                return archiveModel->typeName(left).toLower() < archiveModel->typeName(right).toLower();
+            case FileSortField::Modified:
+            case FileSortField::Created:
+            case FileSortField::DateTaken:
+                return (leftMember ? leftMember->mtime : 0) < (rightMember ? rightMember->mtime : 0);
+            case FileSortField::Dimensions:
+            case FileSortField::Duration:
+                return leftNode->name.toLower() < rightNode->name.toLower();
+            }
             return QSortFilterProxyModel::lessThan(left, right);
+        }
 
-        const QFileInfo leftInfo = fsModel->fileInfo(left);
-        const QFileInfo rightInfo = fsModel->fileInfo(right);
+        const auto* listing = qobject_cast<const ListingModel*>(sourceModel());
+        if (!listing)
+            return QSortFilterProxyModel::lessThan(left, right);
 
+        // Straight from the entry store: no QFileInfo, and so no stat, per
+        // comparison.
+        const EntryStore& entries = listing->entries();
+        const std::uint32_t leftEntry = listing->entryAt(left);
+        const std::uint32_t rightEntry = listing->entryAt(right);
         switch (sortField_) {
         case FileSortField::Name:
-            return leftInfo.fileName().toLower() < rightInfo.fileName().toLower();
+            return entries.nameView(leftEntry).compare(entries.nameView(rightEntry), Qt::CaseInsensitive) < 0;
         case FileSortField::Size:
-            return leftInfo.size() < rightInfo.size();
-        case FileSortField::Type: {
-            const QString leftType = fsModel->type(left);
-            const QString rightType = fsModel->type(right);
-            return leftType.toLower() < rightType.toLower();
-        }
+            return entries.fileSize(leftEntry) < entries.fileSize(rightEntry);
+        case FileSortField::Type:
+            return listing->typeName(leftEntry).compare(listing->typeName(rightEntry), Qt::CaseInsensitive) < 0;
         case FileSortField::Modified:
-            return leftInfo.lastModified() < rightInfo.lastModified();
+            return entries.mtimeNs(leftEntry) < entries.mtimeNs(rightEntry);
         case FileSortField::Created:
-            return leftInfo.birthTime() < rightInfo.birthTime();
+            return entries.btimeNs(leftEntry) < entries.btimeNs(rightEntry);
+        case FileSortField::DateTaken:
+        case FileSortField::Dimensions:
+        case FileSortField::Duration:
+            return mediaLessThan(listing->mediaInfo(leftEntry), listing->mediaInfo(rightEntry));
         }
 
         return QSortFilterProxyModel::lessThan(left, right);
     }
 
 private:
+    bool mediaLessThan(const MediaInfo* left, const MediaInfo* right) const
+    {
+        const MediaInfo none;
+        const MediaInfo& a = left ? *left : none;
+        const MediaInfo& b = right ? *right : none;
+        switch (sortField_) {
+        case FileSortField::Dimensions:
+            // By pixel count, then the wider first.
+            if (std::uint64_t(a.width) * a.height != std::uint64_t(b.width) * b.height)
+                return std::uint64_t(a.width) * a.height < std::uint64_t(b.width) * b.height;
+            return a.width < b.width;
+        case FileSortField::Duration:
+            return a.durationMs < b.durationMs;
+        default:
+            return a.takenNs < b.takenNs;
+        }
+    }
+
     FileSortField sortField_ = FileSortField::Name;
 };
 
@@ -558,6 +733,15 @@ Kitaplik::Kitaplik(QWidget* parent)
 {
     ui = std::make_unique<Ui::Kitaplik>();
     ui->setupUi(this);
+    fileOpCancelButton = new QToolButton(this);
+    fileOpCancelButton->setText("Cancel");
+    fileOpCancelButton->setToolTip("Cancel the running operation");
+    ui->copy_paste_progress_layout->addWidget(fileOpCancelButton, 0, Qt::AlignHCenter);
+    connect(fileOpCancelButton, &QToolButton::clicked, this, [this] {
+        if (fileOpCancel)
+            fileOpCancel->store(true);
+        fileOpCancelButton->setEnabled(false);
+    });
     setCopyPasteProgressVisible(false);
     ui->pathLabel->setReadOnly(false);
     ui->pathLabel->setFocusPolicy(Qt::ClickFocus);
@@ -565,19 +749,36 @@ Kitaplik::Kitaplik(QWidget* parent)
     ui->btn_go_to_path->setIcon(QIcon(":/src/ui/icons/go_to_path.png"));
     ui->btn_go_to_path->setToolTip("Go to path");
 
+    archiveModel = new ArchiveModel(this);
     sortProxy = new FileSortProxyModel(this);
     sortProxy->setSourceModel(&model);
-    ui->treeView->setModel(sortProxy);
-    ui->treeView->setItemDelegate(new FileItemDelegate(ui->treeView));
-    ui->treeView->setSortingEnabled(true);
-    ui->treeView->header()->setSortIndicatorShown(true);
-    ui->treeView->sortByColumn(0, Qt::AscendingOrder);
-    for (int col = 1; col < model.columnCount(); ++col)
-        ui->treeView->setColumnHidden(col, true);
-    ui->treeView->setContextMenuPolicy(Qt::CustomContextMenu);
-    ui->treeView->setRootIsDecorated(false);
-    ui->treeView->setItemsExpandable(false);
-    ui->treeView->setExpandsOnDoubleClick(false);
+    fileSelection = new EntrySelectionModel(sortProxy, &model, this);
+    selectionSummary = new SelectionSummary(&model, fileSelection, this);
+    // The list and the grid show the same rows and share one selection.
+    QAbstractItemView* const fileViews[] = {ui->treeView, ui->gridView};
+    for (QAbstractItemView* view : fileViews) {
+        view->setModel(sortProxy);
+        QItemSelectionModel* defaultSelection = view->selectionModel();
+        view->setSelectionModel(fileSelection);
+        delete defaultSelection;
+        view->setSelectionMode(QAbstractItemView::ExtendedSelection);
+        view->setDragDropMode(QAbstractItemView::DragDrop);
+        view->viewport()->installEventFilter(this);
+        view->setContextMenuPolicy(Qt::CustomContextMenu);
+    }
+    ui->treeView->setListingModel(&model);
+    ui->gridView->setListingModel(&model);
+    ui->viewModeButton->setIcon(QIcon::fromTheme("view-grid"));
+    ui->viewModeButton->setToolTip("Grid view");
+    connect(ui->viewModeButton, &QToolButton::toggled, this, &Kitaplik::setGridView);
+    ui->flattenButton->setIcon(QIcon::fromTheme("view-list-tree"));
+    ui->flattenButton->setToolTip("List every file under this folder");
+    connect(ui->flattenButton, &QToolButton::toggled, this, &Kitaplik::setFlatView);
+
+    // The folder open at exit is shown as it was then, before anything is
+    // read from disk; navigating to it below lists it again and applies the
+    // differences.
+    const QString startPath = restoreListingSnapshot();
 
     QMenu* sortMenu = new QMenu(this);
     QActionGroup* fieldGroup = new QActionGroup(sortMenu);
@@ -592,6 +793,9 @@ Kitaplik::Kitaplik(QWidget* parent)
         {"Type", FileSortField::Type},
         {"Modified Date", FileSortField::Modified},
         {"Created Date", FileSortField::Created},
+        {"Date Taken", FileSortField::DateTaken},
+        {"Dimensions", FileSortField::Dimensions},
+        {"Duration", FileSortField::Duration},
     };
     for (const SortOption& option : sortOptions) {
         QAction* action = sortMenu->addAction(option.label);
@@ -612,9 +816,41 @@ Kitaplik::Kitaplik(QWidget* parent)
     descOrder->setCheckable(true);
     orderGroup->addAction(ascOrder);
     orderGroup->addAction(descOrder);
-    ascOrder->setChecked(true);
+    ascOrder->setChecked(currentSortOrder == Qt::AscendingOrder);
+    descOrder->setChecked(currentSortOrder == Qt::DescendingOrder);
     connect(ascOrder, &QAction::triggered, this, [this] { applySort(currentSortField, Qt::AscendingOrder); });
     connect(descOrder, &QAction::triggered, this, [this] { applySort(currentSortField, Qt::DescendingOrder); });
+    // Shown beside the name in the list view.
+    sortMenu->addSeparator();
+    QMenu* columnsMenu = sortMenu->addMenu("Columns");
+    struct ColumnOption {
+        const char* label;
+        ListingModel::Column column;
+    };
+    constexpr ColumnOption columnOptions[] = {
+        {"Size", ListingModel::SizeColumn},
+        {"Type", ListingModel::TypeColumn},
+        {"Modified Date", ListingModel::ModifiedColumn},
+        {"Owner", ListingModel::OwnerColumn},
+        {"Group", ListingModel::GroupColumn},
+        {"Date Taken", ListingModel::DateTakenColumn},
+        {"Dimensions", ListingModel::DimensionsColumn},
+        {"Duration", ListingModel::DurationColumn},
+        {"Folder", ListingModel::FolderColumn},
+    };
+    for (const ColumnOption& option : columnOptions) {
+        QAction* action = columnsMenu->addAction(option.label);
+        action->setCheckable(true);
+        action->setChecked(ui->treeView->detailColumns().contains(option.column));
+        connect(action, &QAction::toggled, this, [this, option](bool shown) {
+            QList<int> columns = ui->treeView->detailColumns();
+            columns.removeAll(option.column);
+            if (shown)
+                columns.append(option.column);
+            std::sort(columns.begin(), columns.end());
+            ui->treeView->setDetailColumns(columns);
+        });
+    }
     ui->sortButton->setMenu(sortMenu);
     ui->sortButton->setPopupMode(QToolButton::InstantPopup);
     ui->sortButton->setIcon(QIcon::fromTheme("view-sort-ascending"));
@@ -640,25 +876,81 @@ Kitaplik::Kitaplik(QWidget* parent)
     pinnedFoldersModel.setColumnCount(1);
     pinnedFoldersModel.setHeaderData(0, Qt::Horizontal, "Pinned");
     ui->listViewForPinnedFolders->setModel(&pinnedFoldersModel);
+    ui->listViewForPinnedFolders->setContextMenuPolicy(Qt::CustomContextMenu);
 
-    model.setFilter(QDir::AllEntries | QDir::NoDotAndDotDot);
-    model.setRootPath(QDir::homePath());
+    trashFilesCanonicalPath = normalizePathForFs(trashFilesPath());
+    connect(&model, &ListingModel::directoryLoadFailed, this, [this](const QString& path, const QString& error) {
+        if (path != currentPath())
+            return;
+        QMessageBox::warning(this, "Open Folder", error);
+        // Step back out of the folder that couldn't be listed.
+        if (historyIndex > 0 && history.at(static_cast<size_t>(historyIndex)) == path) {
+            history.erase(history.begin() + historyIndex);
+            historyIndex--;
+            refreshHistoryView();
+            navigateTo(history.at(static_cast<size_t>(historyIndex)), false);
+            updateNavButtons();
+        } else if (historyIndex == 0 && path != cleanPath(QDir::homePath())) {
+            // The folder restored at startup is gone.
+            history.clear();
+            historyIndex = -1;
+            setRootPath(QDir::homePath());
+        }
+    });
+    connect(&model, &ListingModel::directoryLoaded, this, [this](const QString& path) {
+        // Watch the folders the walk found.
+        if (model.isFlat() && path == currentPath())
+            updateDirectoryWatcher(path);
+    });
+    connect(fileSelection, &QItemSelectionModel::currentChanged, this, &Kitaplik::updateFileInfoView);
+    connect(fileSelection, &QItemSelectionModel::currentChanged, this, &Kitaplik::updatePreview);
+    connect(selectionSummary, &SelectionSummary::changed, this, [this] { updateFileInfoView(fileSelection->currentIndex()); });
+    connect(&model, &ListingModel::dataChanged, this, [this](const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+        // Stats arrive after the names on slow mounts.
+        const QModelIndex current = mapToSourceIndex(fileSelection->currentIndex());
+        if (current.isValid() && current.model() == &model && current.row() >= topLeft.row() && current.row() <= bottomRight.row())
+            updateFileInfoView(fileSelection->currentIndex());
+    });
 
-    refreshSidebarLocations();
-    setRootPath(QDir::homePath());
+    setRootPath(startPath.isEmpty() ? QDir::homePath() : startPath);
     updateNavButtons();
+    // Mounted volumes and catalogs can take a while to enumerate; let the
+    // file view paint first.
+    QTimer::singleShot(0, this, [this] { refreshSidebarLocations(); });
 
-    connect(ui->treeView, &QListView::doubleClicked, this, [this](const QModelIndex& idx) {
-        if (!idx.isValid())
-            return;
-        const QModelIndex sourceIndex = mapToSourceIndex(idx);
-        if (!sourceIndex.isValid())
-            return;
-        if (!model.isDir(sourceIndex))
-            return;
-        setRootPath(model.filePath(sourceIndex));
-    });
-    connect(ui->treeView, &QWidget::customContextMenuRequested, this, &Kitaplik::showFileMenu);
+    for (QAbstractItemView* view : fileViews) {
+        connect(view, &QAbstractItemView::doubleClicked, this, [this](const QModelIndex& idx) {
+            if (!idx.isValid())
+                return;
+            const QModelIndex sourceIndex = mapToSourceIndex(idx);
+            if (!sourceIndex.isValid())
+                return;
+            if (currentArchive) {
+                openArchiveEntry(sourceIndex);
+                return;
+            }
+            // A query result opens where it is on its drive.
+            if (currentQuery) {
+                const QString url = currentQuery->catalogUrl(model.filePath(sourceIndex));
+                if (!url.isEmpty())
+                    setRootPath(url);
+                return;
+            }
+            if (!model.isDir(sourceIndex)) {
+                // An offline drive has names only.
+                if (currentCatalog)
+                    return;
+                const QString filePath = model.filePath(sourceIndex);
+                if (model.isFileOrLink(sourceIndex) && ArchiveIndex::formatForName(filePath) != ArchiveFormat::Unknown
+                    && ArchiveIndex::detectFormat(filePath) != ArchiveFormat::Unknown)
+                    setRootPath(filePath);
+                return;
+            }
+            setRootPath(model.filePath(sourceIndex));
+        });
+        connect(view, &QWidget::customContextMenuRequested, this, &Kitaplik::showFileMenu);
+    }
+    connect(ui->listViewForPinnedFolders, &QWidget::customContextMenuRequested, this, &Kitaplik::showSidebarMenu);
     connect(ui->listViewForPinnedFolders, &QListView::doubleClicked, this, [this](const QModelIndex& idx) {
         if (!idx.isValid())
             return;
@@ -682,20 +974,159 @@ Kitaplik::Kitaplik(QWidget* parent)
     connect(&directoryWatcher, &QFileSystemWatcher::directoryChanged, this, &Kitaplik::scheduleWatchedRefresh);
     connect(&watchedRefreshDebounceTimer, &QTimer::timeout, this, &Kitaplik::refreshCurrentDirectoryPreservingView);
 
-    QTimer::singleShot(0, this, [this] { ui->treeView->setFocus(Qt::OtherFocusReason); });
+    // A catalog build writes several files; act once it is done.
+    catalogChangeTimer.setSingleShot(true);
+    catalogChangeTimer.setInterval(1000);
+    connect(&catalogWatcher, &QFileSystemWatcher::directoryChanged, this, [this] { catalogChangeTimer.start(); });
+    connect(&catalogChangeTimer, &QTimer::timeout, this, [this] {
+        updateQueryCounts();
+        if (currentQuery)
+            model.refresh();
+    });
+    mediaSortTimer.setSingleShot(true);
+    mediaSortTimer.setInterval(500);
+    connect(&model, &ListingModel::mediaInfoChanged, this, [this] {
+        if (isMediaSortField(currentSortField) && !mediaSortTimer.isActive())
+            mediaSortTimer.start();
+    });
+    connect(&mediaSortTimer, &QTimer::timeout, this, [this] {
+        if (isMediaSortField(currentSortField))
+            sortProxy->invalidate();
+    });
+    const QString catalogDirectory = DriveCatalog::catalogDirectory();
+    if (!catalogDirectory.isEmpty() && QDir().mkpath(catalogDirectory))
+        catalogWatcher.addPath(catalogDirectory);
+
+    memoryOverlay = new QLabel(ui->fileViews);
+    memoryOverlay->setAttribute(Qt::WA_TransparentForMouseEvents);
+    memoryOverlay->setStyleSheet("background: rgba(0, 0, 0, 160); color: white; padding: 6px;");
+    memoryOverlay->hide();
+    QAction* memoryAction = new QAction("Cache Memory", this);
+    memoryAction->setShortcut(QKeySequence("Ctrl+Shift+M"));
+    addAction(memoryAction);
+    connect(memoryAction, &QAction::triggered, this, [this] {
+        memoryOverlay->setVisible(!memoryOverlay->isVisible());
+        if (memoryOverlay->isVisible())
+            updateMemoryOverlay();
+    });
+    // Watches for memory pressure and keeps the overlay current.
+    memoryTimer.setInterval(2000);
+    connect(&memoryTimer, &QTimer::timeout, this, [this] {
+        MemoryGovernor::instance().checkPressure();
+        if (memoryOverlay->isVisible())
+            updateMemoryOverlay();
+    });
+    memoryTimer.start();
+
+    QTimer::singleShot(0, this, [this] { fileView()->setFocus(Qt::OtherFocusReason); });
+}
+
+Kitaplik::~Kitaplik()
+{
+    // fileOpThread joins on destruction; don't make it run to completion.
+    if (fileOpCancel)
+        fileOpCancel->store(true);
+    saveListingSnapshot();
+}
+
+// Returns the restored folder, or an empty string if there is no usable
+// snapshot. The view state holds the sort and the names of the top visible
+// and current entries, which stay valid however the rows move on refresh.
+QString Kitaplik::restoreListingSnapshot()
+{
+    QByteArray viewState;
+    if (!model.loadSnapshot(listingSnapshotPath(), &viewState))
+        return QString();
+
+    QDataStream in(viewState);
+    quint8 field = 0;
+    quint8 order = 0;
+    QString topName;
+    QString currentName;
+    quint8 grid = 0;
+    quint16 details = 0;
+    in >> field >> order >> topName >> currentName >> grid;
+    // Older snapshots end before the detail columns.
+    if (!in.atEnd())
+        in >> details;
+    if (in.status() == QDataStream::Ok && field <= static_cast<quint8>(FileSortField::Duration)) {
+        currentSortField = static_cast<FileSortField>(field);
+        currentSortOrder = order ? Qt::DescendingOrder : Qt::AscendingOrder;
+        ui->viewModeButton->setChecked(grid != 0);
+        ui->treeView->setDetailColumns(maskColumns(details));
+    }
+
+    const QString directory = model.directory();
+    QTimer::singleShot(0, this, [this, directory, topName, currentName] {
+        if (currentArchive || currentCatalog || currentQuery || model.directory() != directory)
+            return;
+        const QModelIndex current = sortProxy->mapFromSource(model.indexForPath(directory + '/' + currentName));
+        if (current.isValid())
+            fileSelection->setCurrentIndex(current, QItemSelectionModel::NoUpdate);
+        const QModelIndex top = sortProxy->mapFromSource(model.indexForPath(directory + '/' + topName));
+        if (top.isValid())
+            fileView()->scrollTo(top, QAbstractItemView::PositionAtTop);
+    });
+    return directory;
+}
+
+void Kitaplik::saveListingSnapshot()
+{
+    const QString file = listingSnapshotPath();
+    // A half-listed folder, a flat listing, or one not on the local
+    // filesystem, is better listed afresh.
+    if (currentArchive || currentCatalog || currentQuery || model.isLoading() || model.isFlat() || model.directory().isEmpty()
+        || model.entries().size() > MaxSnapshotEntries) {
+        QFile::remove(file);
+        return;
+    }
+
+    const QModelIndex top = mapToSourceIndex(fileView()->indexAt(QPoint(0, 0)));
+    const QModelIndex current = mapToSourceIndex(fileSelection->currentIndex());
+    QByteArray viewState;
+    QDataStream out(&viewState, QIODevice::WriteOnly);
+    out << static_cast<quint8>(currentSortField) << static_cast<quint8>(currentSortOrder == Qt::DescendingOrder)
+        << (top.isValid() ? model.fileName(top) : QString())
+        << (current.isValid() ? model.fileName(current) : QString())
+        << static_cast<quint8>(fileView() == ui->gridView)
+        << columnMask(ui->treeView->detailColumns());
+
+    QDir().mkpath(QFileInfo(file).absolutePath());
+    model.saveSnapshot(file, viewState, nullptr);
 }
 
-Kitaplik::~Kitaplik() = default;
+bool Kitaplik::eventFilter(QObject* watched, QEvent* event)
+{
+    if (watched == fileView()->viewport()) {
+        switch (event->type()) {
+        case QEvent::DragEnter:
+        case QEvent::DragMove:
+        case QEvent::DragLeave:
+        case QEvent::Drop:
+            return handleDragEvent(event);
+        default:
+            break;
+        }
+    }
+    return QWidget::eventFilter(watched, event);
+}
 
 QString Kitaplik::currentPath() const
 {
-    return model.rootPath();
+    if (currentArchive) {
+        return archiveInnerPath.isEmpty()
+            ? currentArchive->archivePath()
+            : currentArchive->archivePath() + '/' + archiveInnerPath;
+    }
+    return model.directory();
 }
 
 void Kitaplik::setCopyPasteProgressVisible(bool visible, const QString& text)
 {
     ui->label->setVisible(visible);
     ui->copyPasteProgressBar->setVisible(visible);
+    fileOpCancelButton->setVisible(visible && fileOpCancel);
+    fileOpCancelButton->setEnabled(true);
 
     if (!text.trimmed().isEmpty())
         ui->label->setText(text);
@@ -726,8 +1157,9 @@ void Kitaplik::updateCopyPasteProgress(std::uint64_t doneBytes, std::uint64_t to
         ui->label->setText(QString("%1 %2%").arg(pasteOpLabel, QString::number(std::clamp(percent, 0, 100))));
 }
 
-void Kitaplik::finishPasteOperation(const QString& errorText, bool clearClipboard)
+void Kitaplik::finishPasteOperation(const QString& errorText, bool clearClipboard, const QString& title)
 {
+    fileOpCancel.reset();
     setCopyPasteProgressVisible(false);
     pasteInProgress.store(false);
     pasteOpLabel.clear();
@@ -736,31 +1168,58 @@ void Kitaplik::finishPasteOperation(const QString& errorText, bool clearClipboar
         QApplication::clipboard()->clear();
 
     if (!errorText.trimmed().isEmpty())
-        QMessageBox::warning(this, "Paste", errorText);
+        QMessageBox::warning(this, title, errorText);
 
     navigateTo(currentPath(), false);
+    startNextTransfer();
 }
 
 void Kitaplik::showFileMenu(const QPoint& viewPos)
 {
+    QAbstractItemView* view = fileView();
+    if (currentArchive) {
+        const QModelIndex sourceIndex = mapToSourceIndex(view->indexAt(viewPos));
+        if (!sourceIndex.isValid())
+            return;
+        QMenu menu(view);
+        QAction* openAct = menu.addAction("Open");
+        if (menu.exec(view->viewport()->mapToGlobal(viewPos)) == openAct)
+            openArchiveEntry(sourceIndex);
+        return;
+    }
+    if (currentCatalog || currentQuery) {
+        QMenu menu(view);
+        QAction* searchAct = menu.addAction("Search Catalogs...");
+        if (menu.exec(view->viewport()->mapToGlobal(viewPos)) == searchAct)
+            onMenuSearchCatalogs();
+        return;
+    }
+
     const bool browsingTrashFiles = isInsideTrashFiles(currentPath());
-    const QModelIndex index = ui->treeView->indexAt(viewPos);
+    const QModelIndex index = view->indexAt(viewPos);
     if (!index.isValid()) {
-        QMenu menu(ui->treeView);
+        QMenu menu(view);
         QAction* newFolderAct = menu.addAction("New Folder");
         QAction* pasteAct = menu.addAction("Paste");
+        menu.addSeparator();
+        QAction* findDuplicatesAct = menu.addAction("Find Duplicates...");
+        QAction* compareSyncAct = menu.addAction("Compare && Sync...");
         QAction* emptyTrashAct = nullptr;
         if (browsingTrashFiles) {
             menu.addSeparator();
             emptyTrashAct = menu.addAction("Empty Trash");
         }
         const auto* mime = QApplication::clipboard()->mimeData();
-        pasteAct->setEnabled(mime && mime->hasUrls() && QFileInfo(currentPath()).isDir());
-        QAction* chosen = menu.exec(ui->treeView->viewport()->mapToGlobal(viewPos));
+        pasteAct->setEnabled(mime && mime->hasUrls());
+        QAction* chosen = menu.exec(view->viewport()->mapToGlobal(viewPos));
         if (chosen == newFolderAct) {
             onMenuNewFolder(currentPath());
         } else if (chosen == pasteAct) {
             onMenuPaste(currentPath());
+        } else if (chosen == findDuplicatesAct) {
+            onMenuFindDuplicates(currentPath());
+        } else if (chosen == compareSyncAct) {
+            onMenuCompareSync(currentPath());
         } else if (emptyTrashAct && chosen == emptyTrashAct) {
             onMenuEmptyTrash();
         }
@@ -771,20 +1230,39 @@ void Kitaplik::showFileMenu(const QPoint& viewPos)
     if (!sourceIndex.isValid())
         return;
     const QString targetPath = model.filePath(sourceIndex);
+    const bool targetIsDir = model.isDir(sourceIndex);
+
+    // Right-clicking one of several selected entries copies, cuts or deletes
+    // all of them.
+    const bool actOnSelection = fileSelection->isSelected(index)
+        && fileSelection->selectedIds().size() > 1;
 
-    QMenu menu(ui->treeView);
+    QMenu menu(view);
     QAction* openAct = menu.addAction("Open with default app");
     QAction* renameAct = menu.addAction("Rename");
     menu.addSeparator();
     QAction* copyAct = menu.addAction("Copy");
     QAction* cutAct = menu.addAction("Cut");
     menu.addSeparator();
+    QAction* compressAct = menu.addAction("Compress");
+    QAction* extractAct = nullptr;
+    if (model.isFileOrLink(sourceIndex) && ArchiveIndex::formatForName(targetPath) != ArchiveFormat::Unknown
+        && ArchiveIndex::detectFormat(targetPath) != ArchiveFormat::Unknown)
+        extractAct = menu.addAction("Extract Here");
+    menu.addSeparator();
+    QAction* findDuplicatesAct = nullptr;
+    QAction* compareSyncAct = nullptr;
+    if (targetIsDir) {
+        findDuplicatesAct = menu.addAction("Find Duplicates...");
+        compareSyncAct = menu.addAction("Compare && Sync...");
+        menu.addSeparator();
+    }
     QAction* restoreAct = nullptr;
     if (browsingTrashFiles)
         restoreAct = menu.addAction("Restore");
     QAction* deleteAct = menu.addAction(browsingTrashFiles ? "Delete Permanently" : "Delete");
 
-    QAction* chosen = menu.exec(ui->treeView->viewport()->mapToGlobal(viewPos));
+    QAction* chosen = menu.exec(view->viewport()->mapToGlobal(viewPos));
     if (!chosen)
         return;
 
@@ -792,12 +1270,26 @@ void Kitaplik::showFileMenu(const QPoint& viewPos)
         onMenuOpen(targetPath);
     else if (chosen == renameAct)
         onMenuRename(targetPath);
+    else if (chosen == copyAct && actOnSelection)
+        onMenuCopySelection(false);
     else if (chosen == copyAct)
         onMenuCopy(targetPath);
+    else if (chosen == cutAct && actOnSelection)
+        onMenuCopySelection(true);
     else if (chosen == cutAct)
         onMenuCut(targetPath);
+    else if (chosen == compressAct)
+        onMenuCompress(targetPath);
+    else if (extractAct && chosen == extractAct)
+        onMenuExtract(targetPath);
+    else if (findDuplicatesAct && chosen == findDuplicatesAct)
+        onMenuFindDuplicates(targetPath);
+    else if (compareSyncAct && chosen == compareSyncAct)
+        onMenuCompareSync(targetPath);
     else if (restoreAct && chosen == restoreAct)
         onMenuRestoreFromTrash(targetPath);
+    else if (chosen == deleteAct && actOnSelection)
+        onMenuDeleteSelection();
     else if (chosen == deleteAct)
         onMenuDelete(targetPath);
 }
@@ -854,53 +1346,163 @@ void Kitaplik::onMenuPaste(const QString& destDir)
         return;
     }
 
-    if (pasteInProgress.load()) {
-        QMessageBox::information(this, "Paste", "Another copy/move is already running.");
-        return;
-    }
-
     const auto* mime = QApplication::clipboard()->mimeData();
     if (!mime || !mime->hasUrls())
         return;
 
-    const bool isCut = mime->data(ClipboardCutMimeType) == QByteArray("1");
+    const bool isCut = mime->data(SelectionMimeData::CutMimeType) == QByteArray("1");
+
+    // A copy or cut from this window hands over its PathList; data from
+    // other applications is kept as the URL text and parsed by the job.
+    PendingTransfer transfer;
+    transfer.sources = SelectionMimeData::pathListFrom(mime);
+    if (!transfer.sources)
+        transfer.uriList = mime->data(QStringLiteral("text/uri-list"));
+    transfer.destDir = normalizedDestInput;
+    transfer.move = isCut;
+    transfer.fromClipboard = true;
+    queueTransfer(std::move(transfer));
+}
 
-    QStringList sourcePaths;
-    sourcePaths.reserve(mime->urls().size());
-    for (const QUrl& url : mime->urls()) {
-        if (!url.isLocalFile())
-            continue;
-        const QString srcPath = normalizePathForFs(url.toLocalFile());
-        QString readError;
-        if (!ensureReadableSource(srcPath, &readError))
-            continue;
-        sourcePaths.push_back(srcPath);
+// Drops are taken here rather than by the view, which would hand the data to
+// the model and wait for it. A drop only keeps its sources, as this process's
+// PathList or as the URL text, and queues a transfer; the job parses, checks
+// and copies or moves them on the worker thread.
+bool Kitaplik::handleDragEvent(QEvent* event)
+{
+    if (event->type() == QEvent::DragLeave) {
+        dropTargetPath.clear();
+        return true;
+    }
+    auto* drop = static_cast<QDropEvent*>(event);
+    const QMimeData* mime = drop->mimeData();
+    if (currentArchive || currentCatalog || currentQuery || !mime || !mime->hasUrls()) {
+        drop->ignore();
+        return true;
+    }
+
+    const std::shared_ptr<const PathList> paths = SelectionMimeData::pathListFrom(mime);
+    if (event->type() == QEvent::DragEnter) {
+        // One stat of the first source decides between move and copy.
+        QString first;
+        if (paths) {
+            first = paths->isEmpty() ? QString() : paths->path(0);
+        } else {
+            const QByteArray uriList = mime->data(QStringLiteral("text/uri-list"));
+            const qsizetype end = uriList.indexOf('\n');
+            first = QUrl::fromEncoded((end < 0 ? uriList : uriList.left(end)).trimmed()).toLocalFile();
+        }
+        VfsStat st;
+        dragSourceDevice = !first.isEmpty() && Vfs::native().stat(first, &st, nullptr) ? st.device : 0;
+        dropTargetPath.clear();
+    }
+
+    const QString target = dropTargetAt(drop);
+    const Qt::DropAction action = dropActionFor(drop, target);
+    drop->setDropAction(action);
+    drop->accept();
+    if (event->type() != QEvent::Drop)
+        return true;
+
+    PendingTransfer transfer;
+    transfer.sources = paths;
+    if (!transfer.sources)
+        transfer.uriList = mime->data(QStringLiteral("text/uri-list"));
+    transfer.destDir = target;
+    transfer.move = action == Qt::MoveAction;
+    queueTransfer(std::move(transfer));
+    dropTargetPath.clear();
+    return true;
+}
+
+// The folder under the cursor, or the current folder. A folder that is part
+// of this view's own drag is not a target.
+QString Kitaplik::dropTargetAt(const QDropEvent* event) const
+{
+    const QModelIndex proxyIndex = fileView()->indexAt(event->position().toPoint());
+    const QModelIndex index = mapToSourceIndex(proxyIndex);
+    if (!index.isValid() || index.model() != &model || !model.isDir(index))
+        return currentPath();
+    if (event->source() == fileView() && fileSelection->isSelected(proxyIndex))
+        return currentPath();
+    return model.filePath(index);
+}
+
+// Ctrl copies and Shift moves. Otherwise files move within a filesystem,
+// where that is a rename, and are copied across filesystems.
+Qt::DropAction Kitaplik::dropActionFor(const QDropEvent* event, const QString& targetDir)
+{
+    Qt::DropAction action = Qt::CopyAction;
+    if (event->modifiers() & Qt::ControlModifier) {
+        action = Qt::CopyAction;
+    } else if (event->modifiers() & Qt::ShiftModifier) {
+        action = Qt::MoveAction;
+    } else {
+        if (targetDir != dropTargetPath) {
+            dropTargetPath = targetDir;
+            VfsStat st;
+            dropTargetDevice = Vfs::native().statTarget(targetDir, &st, nullptr) ? st.device : 0;
+        }
+        if (dragSourceDevice != 0 && dragSourceDevice == dropTargetDevice)
+            action = Qt::MoveAction;
     }
-    if (sourcePaths.isEmpty())
+    return (event->possibleActions() & action) ? action : event->proposedAction();
+}
+
+// Copies and moves run one at a time on fileOpThread; ones requested while
+// another file operation runs wait their turn.
+void Kitaplik::queueTransfer(PendingTransfer transfer)
+{
+    pendingTransfers.push_back(std::move(transfer));
+    startNextTransfer();
+}
+
+void Kitaplik::startNextTransfer()
+{
+    if (pasteInProgress.load() || pendingTransfers.empty())
         return;
+    PendingTransfer transfer = std::move(pendingTransfers.front());
+    pendingTransfers.pop_front();
 
     pasteInProgress.store(true);
-    pasteOpLabel = isCut ? "Moving..." : "Copying...";
+    pasteOpLabel = transfer.move ? "Moving..." : "Copying...";
     setCopyPasteProgressVisible(true, pasteOpLabel);
 
     QPointer<Kitaplik> self(this);
-    fileOpThread = std::jthread([self, sourcePaths, normalizedDestInput, isCut] {
+    fileOpThread = std::jthread([self, transfer] {
         QStringList errors;
-
-        const QString normalizedDestDir = normalizePathForFs(normalizedDestInput);
-        std::vector<std::uint64_t> perSrcBytes;
-        perSrcBytes.reserve(static_cast<size_t>(sourcePaths.size()));
+        const bool isCut = transfer.move;
+        const std::shared_ptr<const PathList> sources = transfer.sources
+            ? transfer.sources
+            : std::make_shared<const PathList>(PathList::fromUriList(transfer.uriList));
+
+        const QString normalizedDestDir = normalizePathForFs(transfer.destDir);
+        QString destError;
+        // A drop isn't checked before it is queued.
+        if (!QFileInfo(normalizedDestDir).isDir())
+            destError = QString("Invalid directory:\n%1").arg(transfer.destDir);
+        else
+            ensureWritableTarget(normalizedDestDir, &destError);
+        const size_t sourceCount = destError.isEmpty() ? static_cast<size_t>(sources->size()) : 0;
+        if (!destError.isEmpty())
+            errors.push_back(destError);
+        std::vector<std::uint64_t> perSrcBytes(sourceCount, 0);
+        std::vector<bool> readable(sourceCount, false);
         std::uint64_t totalBytes = 0;
 
-        for (const QString& srcPath : sourcePaths) {
+        for (size_t i = 0; i < sourceCount; i++) {
+            const QString srcPath = normalizePathForFs(sources->path(static_cast<qsizetype>(i)));
+            QString readError;
+            if (!ensureReadableSource(srcPath, &readError))
+                continue;
+            readable[i] = true;
             QString sizeErr;
             const auto sizeOpt = totalBytesForPath(srcPath, &sizeErr);
             if (!sizeOpt.has_value()) {
                 errors.push_back(sizeErr.isEmpty() ? QString("Failed to scan: %1").arg(srcPath) : sizeErr);
-                perSrcBytes.push_back(0);
                 continue;
             }
-            perSrcBytes.push_back(*sizeOpt);
+            perSrcBytes[i] = *sizeOpt;
             totalBytes += *sizeOpt;
         }
 
@@ -947,34 +1549,9 @@ void Kitaplik::onMenuPaste(const QString& destDir)
             QMetaObject::invokeMethod(
                 self,
                 [self, sourcePath, destinationPath, isDirectory, &choice] {
-                    if (!self) {
-                        choice = ConflictChoice::Cancel;
-                        return;
-                    }
-
-                    QMessageBox box(self);
-                    box.setIcon(QMessageBox::Question);
-                    box.setWindowTitle("Paste conflict");
-                    box.setText(isDirectory
-                        ? QString("A folder already exists at destination:\n%1").arg(destinationPath)
-                        : QString("A file already exists at destination:\n%1").arg(destinationPath));
-                    box.setInformativeText(QString("Source: %1").arg(sourcePath));
-
-                    QPushButton* replaceButton = box.addButton("Replace", QMessageBox::AcceptRole);
-                    QPushButton* skipButton = box.addButton("Skip", QMessageBox::DestructiveRole);
-                    QPushButton* keepBothButton = box.addButton("Keep both", QMessageBox::ActionRole);
-                    QPushButton* cancelButton = box.addButton(QMessageBox::Cancel);
-                    box.setDefaultButton(skipButton);
-
-                    box.exec();
-                    if (box.clickedButton() == replaceButton)
-                        choice = ConflictChoice::Replace;
-                    else if (box.clickedButton() == keepBothButton)
-                        choice = ConflictChoice::KeepBoth;
-                    else if (box.clickedButton() == cancelButton)
-                        choice = ConflictChoice::Cancel;
-                    else
-                        choice = ConflictChoice::Skip;
+                    choice = self
+                        ? askConflictChoice(self, "Paste conflict", sourcePath, destinationPath, isDirectory)
+                        : ConflictChoice::Cancel;
                 },
                 Qt::BlockingQueuedConnection);
 
@@ -982,8 +1559,10 @@ void Kitaplik::onMenuPaste(const QString& destDir)
         };
 
         bool userCancelled = false;
-        for (int i = 0; i < sourcePaths.size(); i++) {
-            const QString& srcPath = sourcePaths.at(i);
+        for (size_t i = 0; i < sourceCount; i++) {
+            if (!readable[i])
+                continue;
+            const QString srcPath = normalizePathForFs(sources->path(static_cast<qsizetype>(i)));
             const QFileInfo srcInfo(srcPath);
             if (!srcInfo.exists())
                 continue;
@@ -1010,9 +1589,7 @@ void Kitaplik::onMenuPaste(const QString& destDir)
                 }
 
                 if (ok) {
-                    const auto idx = static_cast<size_t>(i);
-                    if (idx < perSrcBytes.size())
-                        doneBytes += perSrcBytes[idx];
+                    doneBytes += perSrcBytes[i];
                     progress(doneBytes, totalBytes);
                 } else {
                     // cross-device move fallback and destination-conflict handling
@@ -1063,7 +1640,7 @@ void Kitaplik::onMenuPaste(const QString& destDir)
             errorText += "Operation cancelled.";
         }
 
-        const bool clearClipboard = errorText.trimmed().isEmpty() && isCut;
+        const bool clearClipboard = errorText.trimmed().isEmpty() && isCut && transfer.fromClipboard;
 
         if (!self)
             return;
@@ -1078,6 +1655,141 @@ void Kitaplik::onMenuPaste(const QString& destDir)
     });
 }
 
+void Kitaplik::onMenuCompress(const QString& targetPath)
+{
+    const QString source = normalizePathForFs(targetPath);
+    QString readError;
+    if (!ensureReadableSource(source, &readError)) {
+        QMessageBox::warning(this, "Compress", readError);
+        return;
+    }
+    const QFileInfo sourceInfo(source);
+    QString writeError;
+    if (!ensureWritableTarget(sourceInfo.absolutePath(), &writeError)) {
+        QMessageBox::warning(this, "Compress", writeError);
+        return;
+    }
+    if (pasteInProgress.load()) {
+        QMessageBox::information(this, "Compress", "Another file operation is already running.");
+        return;
+    }
+
+    // Replace needs nothing more: the finished archive is renamed over the
+    // old one.
+    QString destination = QDir(sourceInfo.absolutePath()).filePath(sourceInfo.fileName() + ArchiveWriter::defaultSuffix());
+    if (QFileInfo::exists(destination)) {
+        const ConflictChoice choice = askConflictChoice(this, "Compress conflict", source, destination, QFileInfo(destination).isDir());
+        if (choice == ConflictChoice::Skip || choice == ConflictChoice::Cancel)
+            return;
+        if (choice == ConflictChoice::KeepBoth || QFileInfo(destination).isDir())
+            destination = makeUniqueKeepBothPath(destination);
+    }
+
+    startCancellableFileOperation("Compressing...", "Compress", [source, destination](const auto& onProgress, const std::atomic_bool* cancel) {
+        QStringList errors;
+        ArchiveWriter().run(QStringList{source}, destination, onProgress, cancel, &errors);
+        return errors;
+    });
+}
+
+void Kitaplik::onMenuExtract(const QString& archivePath)
+{
+    const QString source = normalizePathForFs(archivePath);
+    if (ArchiveIndex::detectFormat(source) == ArchiveFormat::Unknown) {
+        QMessageBox::warning(this, "Extract", QString("Not a supported archive:\n%1").arg(source));
+        return;
+    }
+    const QFileInfo sourceInfo(source);
+    QString writeError;
+    if (!ensureWritableTarget(sourceInfo.absolutePath(), &writeError)) {
+        QMessageBox::warning(this, "Extract", writeError);
+        return;
+    }
+    if (pasteInProgress.load()) {
+        QMessageBox::information(this, "Extract", "Another file operation is already running.");
+        return;
+    }
+
+    QString destination = QDir(sourceInfo.absolutePath()).filePath(archiveFolderName(sourceInfo.fileName()));
+    bool replace = false;
+    if (QFileInfo::exists(destination)) {
+        const ConflictChoice choice = askConflictChoice(this, "Extract conflict", source, destination, QFileInfo(destination).isDir());
+        if (choice == ConflictChoice::Skip || choice == ConflictChoice::Cancel)
+            return;
+        if (choice == ConflictChoice::KeepBoth)
+            destination = makeUniqueKeepBothPath(destination);
+        else
+            replace = true;
+    }
+
+    startCancellableFileOperation("Extracting...", "Extract", [source, destination, replace](const auto& onProgress, const std::atomic_bool* cancel) {
+        QString error;
+        if (replace && !removeRecursively(destination, &error))
+            return QStringList{error};
+        if (!QDir().mkpath(destination))
+            return QStringList{QString("Failed to create directory: %1").arg(destination)};
+
+        const std::shared_ptr<ArchiveIndex> archive = ArchiveIndex::open(source, cancel, &error);
+        if (!archive)
+            return cancel->load() ? QStringList() : QStringList{error};
+        QStringList errors;
+        ArchiveExtractor().run(*archive, destination, onProgress, cancel, &errors);
+        return errors;
+    });
+}
+
+void Kitaplik::startCancellableFileOperation(const QString& label, const QString& title, FileOperationWork work)
+{
+    pasteInProgress.store(true);
+    pasteOpLabel = label;
+    fileOpCancel = std::make_shared<std::atomic_bool>(false);
+    setCopyPasteProgressVisible(true, pasteOpLabel);
+
+    QPointer<Kitaplik> self(this);
+    fileOpThread = std::jthread([self, title, work = std::move(work), cancel = fileOpCancel] {
+        auto lastTick = std::chrono::steady_clock::now();
+        int lastPercent = -1;
+        const auto progress = [&](std::uint64_t done, std::uint64_t total) {
+            if (!self)
+                return;
+            const int percent = total == 0 ? 0 : static_cast<int>((done * 100u) / total);
+            const auto now = std::chrono::steady_clock::now();
+            const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTick).count();
+            if (percent == lastPercent && elapsedMs < 100)
+                return;
+            lastPercent = percent;
+            lastTick = now;
+
+            QMetaObject::invokeMethod(
+                self,
+                [self, done, total] {
+                    if (!self)
+                        return;
+                    self->updateCopyPasteProgress(done, total);
+                },
+                Qt::QueuedConnection);
+        };
+
+        QString errorText = work(progress, cancel.get()).join("\n\n");
+        if (cancel->load()) {
+            if (!errorText.trimmed().isEmpty())
+                errorText += "\n\n";
+            errorText += "Operation cancelled.";
+        }
+
+        if (!self)
+            return;
+        QMetaObject::invokeMethod(
+            self,
+            [self, errorText, title] {
+                if (!self)
+                    return;
+                self->finishPasteOperation(errorText, false, title);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
 void Kitaplik::onMenuOpen(const QString& targetPath)
 {
     const QString normalizedTargetPath = normalizePathForFs(targetPath);
@@ -1142,25 +1854,42 @@ void Kitaplik::onMenuRename(const QString& targetPath)
 
 void Kitaplik::onMenuCopy(const QString& targetPath)
 {
-    auto* mimeData = new QMimeData();
-    mimeData->setUrls({ QUrl::fromLocalFile(normalizePathForFs(targetPath)) });
-    mimeData->setData(ClipboardCutMimeType, QByteArray("0"));
-    QApplication::clipboard()->setMimeData(mimeData);
+    auto paths = std::make_shared<PathList>();
+    paths->append(normalizePathForFs(targetPath));
+    QApplication::clipboard()->setMimeData(new SelectionMimeData(std::move(paths), false));
 }
 
 void Kitaplik::onMenuCut(const QString& targetPath)
 {
-    auto* mimeData = new QMimeData();
-    mimeData->setUrls({ QUrl::fromLocalFile(normalizePathForFs(targetPath)) });
-    mimeData->setData(ClipboardCutMimeType, QByteArray("1"));
-    QApplication::clipboard()->setMimeData(mimeData);
+    auto paths = std::make_shared<PathList>();
+    paths->append(normalizePathForFs(targetPath));
+    QApplication::clipboard()->setMimeData(new SelectionMimeData(std::move(paths), true));
 }
 
-void Kitaplik::onMenuDelete(const QString& targetPath)
+void Kitaplik::onMenuCopySelection(bool cut)
 {
-    const QString normalizedTargetPath = normalizePathForFs(targetPath);
-    const QFileInfo info(normalizedTargetPath);
-    const QString label = info.fileName().trimmed().isEmpty() ? targetPath : info.fileName();
+    QApplication::clipboard()->setMimeData(new SelectionMimeData(selectedPathList(), cut));
+}
+
+// The selected names, read straight from the listing; no path or URL is made
+// until something asks for one.
+std::shared_ptr<const PathList> Kitaplik::selectedPathList() const
+{
+    auto paths = std::make_shared<PathList>(normalizePathForFs(currentPath()));
+    const EntryStore& entries = model.entries();
+    fileSelection->selectedIds().forEach([&](std::uint32_t id) {
+        const std::uint32_t entry = entries.indexOfId(id);
+        if (entry != EntryStore::NoEntry)
+            paths->append(entries.nameView(entry));
+    });
+    return paths;
+}
+
+void Kitaplik::onMenuDelete(const QString& targetPath)
+{
+    const QString normalizedTargetPath = normalizePathForFs(targetPath);
+    const QFileInfo info(normalizedTargetPath);
+    const QString label = info.fileName().trimmed().isEmpty() ? targetPath : info.fileName();
     const bool permanentDelete = isInsideTrashFiles(normalizedTargetPath);
 
     const auto choice = QMessageBox::question(this,
@@ -1190,18 +1919,259 @@ void Kitaplik::onMenuDelete(const QString& targetPath)
     navigateTo(currentPath(), false);
 }
 
+void Kitaplik::onMenuDeleteSelection()
+{
+    const EntrySelection selected = fileSelection->selectedIds();
+    const bool permanentDelete = isInsideTrashFiles(currentPath());
+    const auto choice = QMessageBox::question(this,
+                                              "Delete",
+                                              permanentDelete
+                                                  ? QString("Permanently delete %1 items?").arg(selected.size())
+                                                  : QString("Move %1 items to trash?").arg(selected.size()),
+                                              QMessageBox::Yes | QMessageBox::No);
+    if (choice != QMessageBox::Yes)
+        return;
+
+    // Paths are made one at a time from the IDs, never as a list.
+    QStringList errors;
+    selected.forEach([&](std::uint32_t id) {
+        const QString path = model.filePathForId(id);
+        if (path.isEmpty())
+            return;
+        const QString normalizedPath = normalizePathForFs(path);
+        QString error;
+        const bool ok = ensureWritableTarget(normalizedPath, &error)
+            && (permanentDelete ? removeRecursively(normalizedPath, &error) : moveToTrash(normalizedPath, &error));
+        if (!ok)
+            errors.append(error.isEmpty() ? QString("Failed to delete: %1").arg(path) : error);
+    });
+    constexpr qsizetype MaxShownErrors = 20;
+    if (errors.size() > MaxShownErrors) {
+        const qsizetype more = errors.size() - MaxShownErrors;
+        errors.erase(errors.begin() + MaxShownErrors, errors.end());
+        errors.append(QString("%1 more not deleted.").arg(more));
+    }
+    if (!errors.isEmpty())
+        QMessageBox::warning(this, "Delete", errors.join("\n\n"));
+
+    navigateTo(currentPath(), false);
+}
+
+void Kitaplik::onMenuFindDuplicates(const QString& rootDir)
+{
+    const QString normalizedRoot = normalizePathForFs(rootDir);
+    const QFileInfo rootInfo(normalizedRoot);
+    if (!rootInfo.exists() || !rootInfo.isDir()) {
+        QMessageBox::warning(this, "Find Duplicates", QString("Invalid directory:\n%1").arg(rootDir));
+        return;
+    }
+
+    auto* dialog = new DuplicateFinderDialog(
+        normalizedRoot,
+        [this](const QString& path, QString* error) { return moveToTrash(path, error); },
+        this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
+void Kitaplik::onMenuCompareSync(const QString& sourceDir)
+{
+    const QString normalizedSource = normalizePathForFs(sourceDir);
+    const QFileInfo sourceInfo(normalizedSource);
+    if (!sourceInfo.exists() || !sourceInfo.isDir()) {
+        QMessageBox::warning(this, "Compare & Sync", QString("Invalid directory:\n%1").arg(sourceDir));
+        return;
+    }
+
+    auto* dialog = new SyncDialog(normalizedSource, this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
+void Kitaplik::showSidebarMenu(const QPoint& viewPos)
+{
+    const QModelIndex index = ui->listViewForPinnedFolders->indexAt(viewPos);
+    const QString uuid = index.data(PinnedVolumeUuidRole).toString();
+    const bool offline = index.data(PinnedOfflineRole).toBool();
+    const QString queryName = index.data(PinnedQueryRole).toString();
+
+    QMenu menu(ui->listViewForPinnedFolders);
+    QAction* catalogAct = nullptr;
+    QAction* forgetAct = nullptr;
+    if (!uuid.isEmpty() && !offline)
+        catalogAct = menu.addAction(QFileInfo::exists(DriveCatalog::catalogPath(uuid)) ? "Update Catalog" : "Catalog Drive");
+    if (!uuid.isEmpty() && offline)
+        forgetAct = menu.addAction("Forget Catalog");
+    if (catalogAct || forgetAct)
+        menu.addSeparator();
+    QAction* searchAct = menu.addAction("Search Catalogs...");
+    QAction* newQueryAct = menu.addAction("New Query...");
+    QAction* editQueryAct = nullptr;
+    QAction* deleteQueryAct = nullptr;
+    if (!queryName.isEmpty()) {
+        editQueryAct = menu.addAction("Edit Query...");
+        deleteQueryAct = menu.addAction("Delete Query");
+    }
+
+    QAction* chosen = menu.exec(ui->listViewForPinnedFolders->viewport()->mapToGlobal(viewPos));
+    if (!chosen)
+        return;
+    if (catalogAct && chosen == catalogAct)
+        onMenuCatalogDrive(index.data(PinnedPathRole).toString(), uuid);
+    else if (forgetAct && chosen == forgetAct)
+        onMenuForgetCatalog(uuid);
+    else if (chosen == searchAct)
+        onMenuSearchCatalogs();
+    else if (chosen == newQueryAct)
+        onMenuEditQuery(QString());
+    else if (editQueryAct && chosen == editQueryAct)
+        onMenuEditQuery(queryName);
+    else if (deleteQueryAct && chosen == deleteQueryAct)
+        onMenuDeleteQuery(queryName);
+}
+
+void Kitaplik::onMenuCatalogDrive(const QString& rootPath, const QString& uuid)
+{
+    if (pasteInProgress.load()) {
+        QMessageBox::information(this, "Catalog Drive", "Another file operation is already running.");
+        return;
+    }
+    const auto choice = QMessageBox::question(
+        this,
+        "Catalog Drive",
+        QString("Also record a content hash of every file on\n%1?\n\nHashing reads every file and takes much longer.").arg(rootPath),
+        QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel,
+        QMessageBox::No);
+    if (choice == QMessageBox::Cancel)
+        return;
+
+    DriveCatalog::Options options;
+    options.withHashes = choice == QMessageBox::Yes;
+    QString label = QStorageInfo(rootPath).displayName().trimmed();
+    if (label.isEmpty())
+        label = QFileInfo(rootPath).fileName();
+    if (label.isEmpty())
+        label = rootPath;
+
+    QPointer<Kitaplik> self(this);
+    startCancellableFileOperation("Cataloging...", "Catalog Drive", [self, rootPath, uuid, label, options](const auto& onProgress, const std::atomic_bool* cancel) {
+        QStringList errors;
+        if (DriveCatalog::build(rootPath, uuid, label, options, onProgress, cancel, &errors) && self) {
+            QMetaObject::invokeMethod(
+                self,
+                [self] {
+                    if (self)
+                        self->refreshSidebarLocations();
+                },
+                Qt::QueuedConnection);
+        }
+        return errors;
+    });
+}
+
+void Kitaplik::onMenuForgetCatalog(const QString& uuid)
+{
+    const auto choice = QMessageBox::question(this, "Forget Catalog", "Delete the catalog of this drive?\nThe drive itself is not touched.");
+    if (choice != QMessageBox::Yes)
+        return;
+    if (currentCatalog && currentCatalog->uuid() == uuid)
+        goHome();
+    QString error;
+    if (!DriveCatalog::remove(uuid, &error))
+        QMessageBox::warning(this, "Forget Catalog", error);
+    refreshSidebarLocations();
+}
+
+void Kitaplik::onMenuSearchCatalogs()
+{
+    auto* dialog = new CatalogSearchDialog([this](const QString& folderUrl) { setRootPath(folderUrl); }, this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
+void Kitaplik::onMenuEditQuery(const QString& name)
+{
+    std::vector<SavedQuery> saved = MetadataQuery::loadSaved();
+    auto it = std::find_if(saved.begin(), saved.end(), [&name](const SavedQuery& entry) { return entry.name == name; });
+    const QString title = name.isEmpty() ? "New Query" : "Edit Query";
+
+    QString text = it == saved.end() ? QString("size > 1G and age > 180d") : it->text;
+    MetadataQuery query;
+    for (;;) {
+        bool ok = false;
+        text = QInputDialog::getText(this,
+                                     title,
+                                     "Find in the drive catalogs, e.g.\n"
+                                     "size > 1G and age > 180d under /data\n"
+                                     "type = image or type = video\n"
+                                     "owner = alice and name ~ report",
+                                     QLineEdit::Normal,
+                                     text,
+                                     &ok);
+        if (!ok)
+            return;
+        QString error;
+        if (query.parse(text, &error))
+            break;
+        QMessageBox::warning(this, title, error);
+    }
+
+    QString newName = name;
+    if (name.isEmpty()) {
+        bool ok = false;
+        newName = QInputDialog::getText(this, title, "Name:", QLineEdit::Normal, QString(), &ok).trimmed();
+        if (!ok)
+            return;
+        if (!MetadataQuery::isValidName(newName)) {
+            QMessageBox::warning(this, title, "A query name can't be empty or contain '/'.");
+            return;
+        }
+        it = std::find_if(saved.begin(), saved.end(), [&newName](const SavedQuery& entry) { return entry.name == newName; });
+    }
+    if (it == saved.end())
+        saved.push_back({newName, query.text()});
+    else
+        it->text = query.text();
+
+    QString error;
+    if (!MetadataQuery::saveSaved(saved, &error)) {
+        QMessageBox::warning(this, title, error);
+        return;
+    }
+    refreshSidebarLocations();
+    if (currentQuery && currentQuery->name() == newName)
+        leaveQuery();
+    setRootPath(QueryVfs::rootUrl(newName));
+}
+
+void Kitaplik::onMenuDeleteQuery(const QString& name)
+{
+    const auto choice = QMessageBox::question(this, "Delete Query", QString("Delete the query \"%1\"?").arg(name));
+    if (choice != QMessageBox::Yes)
+        return;
+    std::vector<SavedQuery> saved = MetadataQuery::loadSaved();
+    saved.erase(std::remove_if(saved.begin(), saved.end(), [&name](const SavedQuery& entry) { return entry.name == name; }), saved.end());
+    QString error;
+    if (!MetadataQuery::saveSaved(saved, &error))
+        QMessageBox::warning(this, "Delete Query", error);
+    QueryResults::remove(name);
+    if (currentQuery && currentQuery->name() == name)
+        goHome();
+    refreshSidebarLocations();
+}
+
 void Kitaplik::updateGoToPathButton()
 {
     const QString normalized = cleanPath(ui->pathLabel->text());
-    const QFileInfo info(normalized);
-    ui->btn_go_to_path->setEnabled(normalized != currentPath() && info.exists() && info.isDir());
+    // Runs on every keystroke, so it doesn't touch the filesystem; the path is
+    // checked when it is submitted.
+    ui->btn_go_to_path->setEnabled(normalized != currentPath());
 }
 
 void Kitaplik::goToPathFromPathLabel()
 {
     const QString normalized = cleanPath(ui->pathLabel->text());
-    const QFileInfo info(normalized);
-    if (!info.exists() || !info.isDir()) {
+    if (!isBrowsablePath(normalized)) {
         QMessageBox::warning(this, "Invalid path", QString("No such directory:\n%1").arg(normalized));
         ui->pathLabel->setText(currentPath());
         updateGoToPathButton();
@@ -1222,7 +2192,19 @@ void Kitaplik::goHome()
 
 void Kitaplik::goUp()
 {
-    const QDir dir(model.rootPath());
+    if (currentQuery)
+        return;
+    QString catalogUuid;
+    QString catalogInnerPath;
+    if (DriveCatalog::splitUrl(currentPath(), &catalogUuid, &catalogInnerPath)) {
+        if (catalogInnerPath.isEmpty())
+            return;
+        const qsizetype slash = catalogInnerPath.lastIndexOf('/');
+        const QString root = DriveCatalog::rootUrl(catalogUuid);
+        setRootPath(slash < 0 ? root : root + '/' + catalogInnerPath.left(slash));
+        return;
+    }
+    const QDir dir(currentPath());
     const QString parent = dir.absolutePath() == "/" ? "/" : dir.absoluteFilePath("..");
     setRootPath(parent);
 }
@@ -1249,13 +2231,48 @@ void Kitaplik::goForward()
 
 void Kitaplik::navigateTo(const QString& path, bool recordHistory)
 {
-    const QString normalized = cleanPath(path);
-    const QModelIndex rootIndex = model.setRootPath(normalized);
-    if (!rootIndex.isValid())
-        return;
+    QString normalized = cleanPath(path);
+    QString archivePath;
+    QString innerPath;
+    QString catalogUuid;
+    QString queryName;
+    if (DriveCatalog::splitUrl(normalized, &catalogUuid, &innerPath)) {
+        stopArchiveOpen();
+        if (!showCatalogDirectory(catalogUuid, innerPath))
+            return;
+        normalized = currentPath();
+    } else if (QueryVfs::splitUrl(normalized, &queryName, &innerPath)) {
+        stopArchiveOpen();
+        if (!showQueryResults(queryName))
+            return;
+        normalized = currentPath();
+    } else if (splitArchivePath(normalized, &archivePath, &innerPath)) {
+        // Indexing a large archive takes a while; this comes back here once
+        // it is open.
+        if ((!currentArchive || currentArchive->archivePath() != archivePath)
+            && (!openedArchive || openedArchive->archivePath() != archivePath)) {
+            openArchive(archivePath, normalized, recordHistory);
+            return;
+        }
+        stopArchiveOpen();
+        if (!showArchiveDirectory(archivePath, innerPath))
+            return;
+        leaveCatalog();
+        leaveQuery();
+        normalized = currentPath();
+    } else {
+        // Listed in the background; a folder that can't be read is reported
+        // by directoryLoadFailed.
+        stopArchiveOpen();
+        leaveArchive();
+        leaveCatalog();
+        leaveQuery();
+        if (model.directory() == normalized)
+            model.refresh();
+        else
+            model.setDirectory(normalized);
+    }
 
-    const QModelIndex proxyRootIndex = sortProxy ? sortProxy->mapFromSource(rootIndex) : rootIndex;
-    ui->treeView->setRootIndex(proxyRootIndex);
     ui->pathLabel->setText(normalized);
     updateGoToPathButton();
     updateWindowTitle(normalized);
@@ -1273,10 +2290,318 @@ void Kitaplik::navigateTo(const QString& path, bool recordHistory)
         }
     }
 
+    {
+        const QSignalBlocker blocker(ui->flattenButton);
+        ui->flattenButton->setChecked(model.isFlat());
+    }
+    ui->flattenButton->setEnabled(!currentArchive && !currentCatalog && !currentQuery);
     updateDirectoryWatcher(normalized);
     emit currentPathChanged(normalized);
 }
 
+bool Kitaplik::showArchiveDirectory(const QString& archivePath, const QString& innerPath)
+{
+    std::shared_ptr<ArchiveIndex> archive = currentArchive;
+    if (!archive || archive->archivePath() != archivePath)
+        archive = openedArchive;
+    openedArchive.reset();
+    if (!archive || archive->archivePath() != archivePath)
+        return false;
+
+    const int node = archive->findNode(innerPath);
+    if (node < 0) {
+        QMessageBox::warning(this, "Open Archive", QString("No such folder in archive:\n%1").arg(innerPath));
+        return false;
+    }
+
+    currentArchive = archive;
+    archiveInnerPath = archive->nodePath(node);
+    archiveModel->setDirectory(archive, node);
+    setFileViewSourceModel(archiveModel);
+    ui->treeView->setRootIndex(QModelIndex());
+    ui->gridView->setRootIndex(QModelIndex());
+    return true;
+}
+
+void Kitaplik::openArchive(const QString& archivePath, const QString& target, bool recordHistory)
+{
+    archiveOpenTarget = target;
+    archiveOpenRecordHistory = recordHistory;
+    if (archiveOpenPath == archivePath)
+        return;
+    if (archiveOpenPath.isEmpty())
+        QApplication::setOverrideCursor(Qt::BusyCursor);
+    archiveOpenPath = archivePath;
+    if (!archiveOpenThread.joinable())
+        archiveOpenThread = std::jthread([this](std::stop_token stop) { openArchives(stop); });
+    std::lock_guard lock(archiveOpenMutex);
+    pendingArchiveOpen = archivePath;
+    cancelArchiveOpen = true;
+    archiveOpenWake.notify_one();
+}
+
+void Kitaplik::stopArchiveOpen()
+{
+    if (archiveOpenPath.isEmpty())
+        return;
+    archiveOpenPath.clear();
+    archiveOpenTarget.clear();
+    QApplication::restoreOverrideCursor();
+    std::lock_guard lock(archiveOpenMutex);
+    pendingArchiveOpen.clear();
+    cancelArchiveOpen = true;
+}
+
+void Kitaplik::openArchives(std::stop_token stop)
+{
+    const std::stop_callback cancelOnStop(stop, [this] { cancelArchiveOpen = true; });
+    for (;;) {
+        QString path;
+        {
+            std::unique_lock lock(archiveOpenMutex);
+            if (!archiveOpenWake.wait(lock, stop, [this] { return !pendingArchiveOpen.isEmpty(); }))
+                return;
+            path = std::exchange(pendingArchiveOpen, QString());
+            // Not false if the stop came first, or this open would hold up the join.
+            cancelArchiveOpen = stop.stop_requested();
+        }
+        QString error;
+        std::shared_ptr<ArchiveIndex> archive = ArchiveIndex::open(path, &cancelArchiveOpen, &error);
+        if (cancelArchiveOpen)
+            continue;
+        QMetaObject::invokeMethod(this, [this, path, archive = std::move(archive), error] {
+            finishArchiveOpen(path, archive, error);
+        }, Qt::QueuedConnection);
+    }
+}
+
+// Results for an archive no longer wanted are dropped.
+void Kitaplik::finishArchiveOpen(const QString& archivePath, const std::shared_ptr<ArchiveIndex>& archive, const QString& error)
+{
+    if (archivePath != archiveOpenPath)
+        return;
+    const QString target = archiveOpenTarget;
+    const bool recordHistory = archiveOpenRecordHistory;
+    stopArchiveOpen();
+    if (!archive) {
+        QMessageBox::warning(this, "Open Archive", error);
+        return;
+    }
+    openedArchive = archive;
+    navigateTo(target, recordHistory);
+}
+
+void Kitaplik::leaveArchive()
+{
+    if (!currentArchive)
+        return;
+    currentArchive.reset();
+    archiveInnerPath.clear();
+    setFileViewSourceModel(&model);
+    archiveModel->clear();
+}
+
+bool Kitaplik::showCatalogDirectory(const QString& uuid, const QString& innerPath)
+{
+    std::shared_ptr<const DriveCatalog> catalog = currentCatalog;
+    if (!catalog || catalog->uuid() != uuid) {
+        QString error;
+        catalog = DriveCatalog::open(uuid, &error);
+        if (!catalog) {
+            QMessageBox::warning(this, "Open Catalog", error);
+            return false;
+        }
+    }
+
+    const qint64 entry = catalog->findEntry(innerPath);
+    if (entry < 0 || !catalog->isDir(static_cast<std::uint32_t>(entry))) {
+        QMessageBox::warning(this, "Open Catalog", QString("No such folder in catalog:\n%1").arg(innerPath));
+        return false;
+    }
+
+    leaveArchive();
+    leaveQuery();
+    if (catalog != currentCatalog) {
+        currentCatalog = catalog;
+        model.setVfs(std::make_shared<CatalogVfs>(catalog));
+    }
+    const QString url = innerPath.isEmpty() ? DriveCatalog::rootUrl(uuid) : DriveCatalog::rootUrl(uuid) + '/' + innerPath;
+    if (model.directory() == url)
+        model.refresh();
+    else
+        model.setDirectory(url);
+    return true;
+}
+
+void Kitaplik::leaveCatalog()
+{
+    if (!currentCatalog)
+        return;
+    currentCatalog.reset();
+    model.setVfs(nullptr);
+}
+
+// Listing the query's folder runs it, so a refresh picks up catalogs built
+// since.
+bool Kitaplik::showQueryResults(const QString& name)
+{
+    std::shared_ptr<const QueryVfs> query = currentQuery;
+    if (!query || query->name() != name) {
+        const std::vector<SavedQuery> saved = MetadataQuery::loadSaved();
+        const auto it = std::find_if(saved.begin(), saved.end(), [&name](const SavedQuery& entry) { return entry.name == name; });
+        MetadataQuery parsed;
+        QString error = QString("No such query: %1").arg(name);
+        if (it == saved.end() || !parsed.parse(it->text, &error)) {
+            QMessageBox::warning(this, "Open Query", error);
+            return false;
+        }
+        query = std::make_shared<QueryVfs>(name, std::move(parsed));
+    }
+
+    leaveArchive();
+    leaveCatalog();
+    if (query != currentQuery) {
+        currentQuery = query;
+        model.setVfs(query);
+    }
+    const QString url = QueryVfs::rootUrl(name);
+    if (model.directory() == url)
+        model.refresh();
+    else
+        model.setDirectory(url);
+    return true;
+}
+
+void Kitaplik::leaveQuery()
+{
+    if (!currentQuery)
+        return;
+    currentQuery.reset();
+    model.setVfs(nullptr);
+}
+
+void Kitaplik::openArchiveEntry(const QModelIndex& sourceIndex)
+{
+    const ArchiveNode* node = archiveModel->nodeAt(sourceIndex);
+    if (!node || !currentArchive)
+        return;
+    const QString entryPath = archiveInnerPath.isEmpty() ? node->name : archiveInnerPath + '/' + node->name;
+    if (node->isDir) {
+        setRootPath(currentArchive->archivePath() + '/' + entryPath);
+        return;
+    }
+
+    const ArchiveMember* member = archiveModel->memberAt(sourceIndex);
+    if (!member || member->type != ArchiveMember::Type::File)
+        return;
+    if (pasteInProgress.load()) {
+        QMessageBox::information(this, "Open", "Another file operation is already running.");
+        return;
+    }
+    if (!archiveOpenDir)
+        archiveOpenDir = std::make_unique<QTemporaryDir>();
+    if (!archiveOpenDir->isValid()) {
+        QMessageBox::warning(this, "Open", "Failed to create a temporary folder for extracted files.");
+        return;
+    }
+
+    // One folder per archive member keeps equal names from different
+    // archives apart while preserving the file name for the opening app.
+    const QByteArray key = QCryptographicHash::hash((currentArchive->archivePath() + '/' + entryPath).toUtf8(),
+                                                    QCryptographicHash::Sha1)
+                               .toHex()
+                               .left(16);
+    const QString folder = QDir(archiveOpenDir->path()).filePath(QString::fromLatin1(key));
+    const QString destination = QDir(folder).filePath(node->name);
+
+    // A large member, or any member of a .tar.zst without a seek table, takes
+    // a while to decode; the file opens once it is out.
+    QPointer<Kitaplik> self(this);
+    startCancellableFileOperation(
+        "Extracting...",
+        "Open",
+        [self, archive = currentArchive, member = *member, folder, destination, entryPath](const auto& onProgress,
+                                                                                          const std::atomic_bool* cancel) {
+            if (!QDir().mkpath(folder))
+                return QStringList{QString("Failed to create directory: %1").arg(folder)};
+            QString error;
+            std::uint64_t done = 0;
+            const auto onBytes = [&](std::uint64_t bytes) {
+                done += bytes;
+                onProgress(done, member.size);
+            };
+            if (!archive->extractToFile(member, destination, onBytes, cancel, &error)) {
+                if (cancel->load())
+                    return QStringList();
+                return QStringList{error.isEmpty() ? QString("Failed to extract:\n%1").arg(entryPath) : error};
+            }
+            if (!self)
+                return QStringList();
+            QMetaObject::invokeMethod(
+                self,
+                [self, destination, entryPath] {
+                    if (self && !QDesktopServices::openUrl(QUrl::fromLocalFile(destination)))
+                        QMessageBox::warning(self, "Open", QString("Failed to open:\n%1").arg(entryPath));
+                },
+                Qt::QueuedConnection);
+            return QStringList();
+        });
+}
+
+void Kitaplik::setFileViewSourceModel(QAbstractItemModel* sourceModel)
+{
+    if (!sortProxy || sortProxy->sourceModel() == sourceModel)
+        return;
+    sortProxy->setSourceModel(sourceModel);
+    applySort(currentSortField, currentSortOrder);
+}
+
+QAbstractItemView* Kitaplik::fileView() const
+{
+    if (ui->fileViews->currentWidget() == ui->gridView)
+        return ui->gridView;
+    return ui->treeView;
+}
+
+void Kitaplik::setGridView(bool grid)
+{
+    QAbstractItemView* previous = fileView();
+    QAbstractItemView* next = grid ? static_cast<QAbstractItemView*>(ui->gridView) : ui->treeView;
+    if (next == previous)
+        return;
+    // Open the other view where this one was.
+    const QModelIndex top = previous->indexAt(QPoint(0, 0));
+    const bool focused = previous->hasFocus();
+    ui->fileViews->setCurrentWidget(next);
+    ui->viewModeButton->setChecked(grid);
+    if (top.isValid())
+        next->scrollTo(top, QAbstractItemView::PositionAtTop);
+    if (focused)
+        next->setFocus(Qt::OtherFocusReason);
+}
+
+void Kitaplik::setFlatView(bool flat)
+{
+    if (currentArchive || currentCatalog || currentQuery || model.directory().isEmpty() || model.isFlat() == flat)
+        return;
+    model.setDirectory(model.directory(), flat);
+    updateDirectoryWatcher(model.directory());
+}
+
+void Kitaplik::updateMemoryOverlay()
+{
+    const MemoryGovernor& governor = MemoryGovernor::instance();
+    const QLocale locale = QLocale::system();
+    QStringList lines;
+    lines << QString("Caches: %1 of %2").arg(locale.formattedDataSize(governor.usage()), locale.formattedDataSize(governor.budget()));
+    for (const MemoryGovernor::CacheUsage& cache : governor.cacheUsage())
+        lines << QString("%1: %2").arg(cache.name, locale.formattedDataSize(cache.bytes));
+    memoryOverlay->setText(lines.join('\n'));
+    memoryOverlay->adjustSize();
+    memoryOverlay->move(ui->fileViews->width() - memoryOverlay->width() - 8, 8);
+    memoryOverlay->raise();
+}
+
 void Kitaplik::updateWindowTitle(const QString& path)
 {
     QFileInfo info(path);
@@ -1306,6 +2631,8 @@ void Kitaplik::applySort(FileSortField field, Qt::SortOrder order)
     currentSortOrder = order;
     sortProxy->setSortField(field);
     sortProxy->sort(0, order);
+    // Read every photo and video in the folder, not only those in view.
+    model.setMediaInfoWanted(isMediaSortField(field));
 }
 
 void Kitaplik::refreshHistoryView()
@@ -1320,16 +2647,6 @@ void Kitaplik::refreshHistoryView()
 void Kitaplik::updateFileInfoView(const QModelIndex& index)
 {
     fileInfoModel.removeRows(0, fileInfoModel.rowCount());
-    if (!index.isValid())
-        return;
-
-    if (!sortProxy)
-        return;
-    const QModelIndex sourceIndex = sortProxy->mapToSource(index);
-    if (!sourceIndex.isValid())
-        return;
-
-    const QFileInfo info = model.fileInfo(sourceIndex);
     auto addRow = [this](const QString& label, const QString& value) {
         const int row = fileInfoModel.rowCount();
         fileInfoModel.insertRow(row);
@@ -1337,21 +2654,85 @@ void Kitaplik::updateFileInfoView(const QModelIndex& index)
         fileInfoModel.setData(fileInfoModel.index(row, 1), value);
     };
 
-    const auto formatDate = [](const QDateTime& dt) {
-        return dt.isValid()
-            ? QLocale::system().toString(dt, QLocale::ShortFormat)
+    // Several entries: what they add up to instead.
+    const SelectionSummary::Totals& totals = selectionSummary->totals();
+    if (totals.items() > 1) {
+        const QLocale locale = QLocale::system();
+        addRow("Selected", QString("%1 items").arg(locale.toString(qulonglong(totals.items()))));
+        if (totals.files > 0)
+            addRow("Files", locale.toString(qulonglong(totals.files)));
+        if (totals.folders > 0)
+            addRow("Folders", locale.toString(qulonglong(totals.folders)));
+        QString size = locale.formattedDataSize(static_cast<qint64>(totals.bytes));
+        if (totals.countingFolders > 0)
+            size = QString("%1 so far, counting %2 folders").arg(size, locale.toString(qulonglong(totals.countingFolders)));
+        if (totals.uncountedFolders > 0)
+            size = QString("%1, not counting %2 folders on slow mounts").arg(size, locale.toString(qulonglong(totals.uncountedFolders)));
+        addRow("Size", size);
+        if (totals.folders > 0)
+            addRow("Contains", QString("%1 items").arg(locale.toString(qulonglong(totals.contents))));
+        return;
+    }
+
+    if (!index.isValid() || currentArchive)
+        return;
+
+    const QModelIndex sourceIndex = mapToSourceIndex(index);
+    if (!sourceIndex.isValid())
+        return;
+
+    const EntryStore& entries = model.entries();
+    const std::uint32_t entry = model.entryAt(sourceIndex);
+
+    const auto formatDate = [](std::int64_t ns) {
+        return ns > 0
+            ? QLocale::system().toString(QDateTime::fromMSecsSinceEpoch(ns / 1000000), QLocale::ShortFormat)
             : QStringLiteral("<unknown>");
     };
 
-    const QString itemName = info.fileName().trimmed().isEmpty() ? info.absoluteFilePath() : info.fileName();
-    addRow("Name", itemName);
-    addRow("Path", info.absoluteFilePath());
-    addRow("Type", info.isDir() ? "Folder" : "File");
-    if (info.isFile())
-        addRow("Size", QLocale::system().formattedDataSize(info.size()));
-    addRow("Modified", formatDate(info.lastModified()));
-    addRow("Created", formatDate(info.birthTime()));
-    addRow("Permissions", info.permissions() == QFileDevice::Permissions() ? "None" : "Readable");
+    addRow("Name", entries.name(entry));
+    addRow("Path", model.filePath(sourceIndex));
+    addRow("Type", entries.isDir(entry) ? "Folder" : "File");
+    // The rest arrives with the entry's stat.
+    if (!entries.hasStat(entry))
+        return;
+    if (!entries.isDir(entry))
+        addRow("Size", QLocale::system().formattedDataSize(static_cast<qint64>(entries.fileSize(entry))));
+    addRow("Modified", formatDate(entries.mtimeNs(entry)));
+    addRow("Created", formatDate(entries.btimeNs(entry)));
+    // Photos and videos, once their headers are read.
+    const auto addMediaRow = [&](const QString& label, int column) {
+        const QString value = model.index(sourceIndex.row(), column).data().toString();
+        if (!value.isEmpty())
+            addRow(label, value);
+    };
+    addMediaRow("Date Taken", ListingModel::DateTakenColumn);
+    addMediaRow("Dimensions", ListingModel::DimensionsColumn);
+    addMediaRow("Duration", ListingModel::DurationColumn);
+    const QString owner = model.ownerName(entry);
+    if (!owner.isEmpty()) {
+        addRow("Owner", owner);
+        addRow("Group", model.groupName(entry));
+    }
+    addRow("Permissions", (entries.mode(entry) & 07777) == 0 ? "None" : "Readable");
+}
+
+void Kitaplik::updatePreview(const QModelIndex& index)
+{
+    const QModelIndex sourceIndex = mapToSourceIndex(index);
+    // Only regular files on disk; catalogs and query results may be offline,
+    // and opening a FIFO or a device can block or have side effects. A link
+    // is left to the preview, which checks what it opened.
+    const auto isPreviewable = [this](std::uint32_t entry) {
+        const std::uint32_t mode = model.entries().mode(entry);
+        return model.entries().hasStat(entry) && (S_ISREG(mode) || S_ISLNK(mode));
+    };
+    if (!sourceIndex.isValid() || sourceIndex.model() != &model || currentArchive || currentCatalog || currentQuery
+        || !isPreviewable(model.entryAt(sourceIndex))) {
+        ui->previewView->clear();
+        return;
+    }
+    ui->previewView->setFile(model.filePath(sourceIndex));
 }
 
 void Kitaplik::addPinnedFolder(const QString& label, const QString& path)
@@ -1402,11 +2783,110 @@ void Kitaplik::addMountedDrivesReadOnly()
         QStandardItem* item = new QStandardItem(label);
         item->setData(rootPath, PinnedPathRole);
         item->setData(volume.isReadOnly(), PinnedReadOnlyRole);
+        item->setData(DriveCatalog::filesystemUuid(QString::fromLocal8Bit(volume.device())), PinnedVolumeUuidRole);
         item->setToolTip(QString("%1\nDevice: %2").arg(rootPath, volume.device()));
         pinnedFoldersModel.appendRow(item);
     }
 }
 
+void Kitaplik::addOfflineCatalogs()
+{
+    QSet<QString> mountedUuids;
+    for (int row = 0; row < pinnedFoldersModel.rowCount(); ++row) {
+        const QString uuid = pinnedFoldersModel.index(row, 0).data(PinnedVolumeUuidRole).toString();
+        if (!uuid.isEmpty())
+            mountedUuids.insert(uuid);
+    }
+
+    for (const QString& uuid : DriveCatalog::catalogUuids()) {
+        if (mountedUuids.contains(uuid))
+            continue;
+        const std::shared_ptr<DriveCatalog> catalog = DriveCatalog::open(uuid, nullptr);
+        if (!catalog)
+            continue;
+        const QString label = catalog->label().trimmed().isEmpty() ? uuid : catalog->label().trimmed();
+        const QString scanned = QLocale::system().toString(QDateTime::fromMSecsSinceEpoch(catalog->createdNs() / 1000000), QLocale::ShortFormat);
+
+        QStandardItem* item = new QStandardItem(label + " [offline]");
+        item->setData(DriveCatalog::rootUrl(uuid), PinnedPathRole);
+        item->setData(true, PinnedReadOnlyRole);
+        item->setData(uuid, PinnedVolumeUuidRole);
+        item->setData(true, PinnedOfflineRole);
+        item->setToolTip(QString("Catalog of %1\nScanned %2\n%3 items, %4")
+                             .arg(catalog->rootPath(), scanned)
+                             .arg(catalog->entryCount() - 1)
+                             .arg(QLocale::system().formattedDataSize(static_cast<qint64>(catalog->totalBytes()))));
+        pinnedFoldersModel.appendRow(item);
+    }
+}
+
+void Kitaplik::addSavedQueries()
+{
+    for (const SavedQuery& query : MetadataQuery::loadSaved()) {
+        QStandardItem* item = new QStandardItem(query.name + " [query]");
+        item->setData(QueryVfs::rootUrl(query.name), PinnedPathRole);
+        item->setData(true, PinnedReadOnlyRole);
+        item->setData(query.name, PinnedQueryRole);
+        item->setToolTip(query.text);
+        pinnedFoldersModel.appendRow(item);
+    }
+    updateQueryCounts();
+}
+
+void Kitaplik::updateQueryCounts()
+{
+    std::vector<SavedQuery> saved = MetadataQuery::loadSaved();
+    if (saved.empty())
+        return;
+    if (!queryCountThread.joinable())
+        queryCountThread = std::jthread([this](std::stop_token stop) { countQueries(stop); });
+    std::lock_guard lock(queryCountMutex);
+    pendingQueryCounts = std::move(saved);
+    cancelQueryCounts = true;
+    queryCountWake.notify_one();
+}
+
+void Kitaplik::countQueries(std::stop_token stop)
+{
+    const std::stop_callback cancelOnStop(stop, [this] { cancelQueryCounts = true; });
+    for (;;) {
+        std::vector<SavedQuery> saved;
+        {
+            std::unique_lock lock(queryCountMutex);
+            if (!queryCountWake.wait(lock, stop, [this] { return !pendingQueryCounts.empty(); }))
+                return;
+            saved = std::move(pendingQueryCounts);
+            pendingQueryCounts.clear();
+            // Not false if the stop came first, or this round would hold up the join.
+            cancelQueryCounts = stop.stop_requested();
+        }
+        for (const SavedQuery& entry : saved) {
+            if (cancelQueryCounts)
+                break;
+            MetadataQuery query;
+            if (!query.parse(entry.text, nullptr))
+                continue;
+            QueryResults results = QueryResults::load(entry.name, query.text());
+            if (results.refresh(query, QDateTime::currentMSecsSinceEpoch() * 1000000LL, nullptr, &cancelQueryCounts))
+                results.save(entry.name);
+            if (cancelQueryCounts)
+                break;
+            QMetaObject::invokeMethod(this, [this, name = entry.name, count = results.count()] {
+                showQueryCount(name, count);
+            }, Qt::QueuedConnection);
+        }
+    }
+}
+
+void Kitaplik::showQueryCount(const QString& name, std::uint64_t count)
+{
+    for (int row = 0; row < pinnedFoldersModel.rowCount(); ++row) {
+        QStandardItem* item = pinnedFoldersModel.item(row);
+        if (item->data(PinnedQueryRole).toString() == name)
+            item->setText(QString("%1 [%2]").arg(name, QLocale::system().toString(static_cast<qulonglong>(count))));
+    }
+}
+
 void Kitaplik::refreshSidebarLocations()
 {
     pinnedFoldersModel.clear();
@@ -1426,6 +2906,8 @@ void Kitaplik::refreshSidebarLocations()
     addPinnedFolder("Trash", trashFilesPath());
 
     addMountedDrivesReadOnly();
+    addOfflineCatalogs();
+    addSavedQueries();
 }
 
 QModelIndex Kitaplik::mapToSourceIndex(const QModelIndex& proxyIndex) const
@@ -1437,87 +2919,82 @@ QModelIndex Kitaplik::mapToSourceIndex(const QModelIndex& proxyIndex) const
     return sortProxy->mapToSource(proxyIndex);
 }
 
+// Only the paths that differ are added or removed, since a flat listing
+// watches its folders again every time one of them is listed.
 void Kitaplik::updateDirectoryWatcher(const QString& path)
 {
-    const QString normalized = normalizePathForFs(path);
+    QStringList wanted;
+    if (!currentArchive && !currentCatalog && !currentQuery) {
+        wanted.push_back(path);
+        if (model.isFlat() && model.directory() == path) {
+            QStringList folders = model.folderPaths();
+            if (folders.size() >= MaxWatchedFolders) {
+                std::sort(folders.begin(), folders.end(), [](const QString& left, const QString& right) {
+                    return left.count('/') < right.count('/');
+                });
+                folders.resize(MaxWatchedFolders - 1);
+            }
+            wanted += folders;
+        }
+    }
     const QStringList watchedPaths = directoryWatcher.directories();
-    if (!watchedPaths.isEmpty())
-        directoryWatcher.removePaths(watchedPaths);
-    if (QFileInfo(normalized).exists() && QFileInfo(normalized).isDir())
-        directoryWatcher.addPath(normalized);
+    const QSet<QString> watched(watchedPaths.begin(), watchedPaths.end());
+    const QSet<QString> wantedSet(wanted.begin(), wanted.end());
+    QStringList removed;
+    for (const QString& watchedPath : watchedPaths) {
+        if (!wantedSet.contains(watchedPath))
+            removed.push_back(watchedPath);
+    }
+    QStringList added;
+    for (const QString& wantedPath : wanted) {
+        if (!watched.contains(wantedPath))
+            added.push_back(wantedPath);
+    }
+    if (!removed.isEmpty())
+        directoryWatcher.removePaths(removed);
+    if (!added.isEmpty())
+        directoryWatcher.addPaths(added);
 }
 
 void Kitaplik::scheduleWatchedRefresh(const QString& changedPath)
 {
-    const QString normalized = normalizePathForFs(changedPath);
-    if (normalizePathForFs(currentPath()) != normalized)
+    const QString changed = QDir::cleanPath(changedPath);
+    const QString active = QDir::cleanPath(currentPath());
+    // A flat listing lists again only the folders that changed.
+    if (model.isFlat() && !currentArchive && (changed == active || changed.startsWith(active.endsWith('/') ? active : active + '/'))) {
+        pendingWatchedFolders.insert(changed);
+        watchedRefreshDebounceTimer.start();
+        return;
+    }
+    if (active != changed)
         return;
 
-    pendingWatchedPath = normalized;
+    pendingWatchedPath = changed;
     watchedRefreshDebounceTimer.start();
 }
 
 void Kitaplik::refreshCurrentDirectoryPreservingView()
 {
-    const QString activePath = normalizePathForFs(currentPath());
-    if (pendingWatchedPath.trimmed().isEmpty())
-        pendingWatchedPath = activePath;
-    if (normalizePathForFs(pendingWatchedPath) != activePath)
+    if (currentArchive)
         return;
-    pendingWatchedPath.clear();
-
-    QStringList selectedPaths;
-    if (const QItemSelectionModel* selection = ui->treeView->selectionModel()) {
-        const QModelIndexList indexes = selection->selectedRows(0);
-        selectedPaths.reserve(indexes.size());
-        for (const QModelIndex& proxyIndex : indexes) {
-            const QModelIndex sourceIndex = mapToSourceIndex(proxyIndex);
-            if (!sourceIndex.isValid())
-                continue;
-            selectedPaths.push_back(model.filePath(sourceIndex));
-        }
-    }
-
-    const int scrollValue = ui->treeView->verticalScrollBar() ? ui->treeView->verticalScrollBar()->value() : 0;
-    const QModelIndex existingCurrentProxy = ui->treeView->currentIndex();
-    QString currentItemPath;
-    if (existingCurrentProxy.isValid()) {
-        const QModelIndex currentSource = mapToSourceIndex(existingCurrentProxy);
-        if (currentSource.isValid())
-            currentItemPath = model.filePath(currentSource);
-    }
-
-    const QModelIndex rootIndex = model.setRootPath(activePath);
-    if (!rootIndex.isValid())
+    if (model.isFlat()) {
+        for (const QString& folder : pendingWatchedFolders)
+            model.refreshFolder(folder);
+        pendingWatchedFolders.clear();
         return;
-    const QModelIndex proxyRootIndex = sortProxy ? sortProxy->mapFromSource(rootIndex) : rootIndex;
-    ui->treeView->setRootIndex(proxyRootIndex);
-
-    if (QItemSelectionModel* selection = ui->treeView->selectionModel()) {
-        selection->clearSelection();
-        for (const QString& itemPath : selectedPaths) {
-            const QModelIndex sourceIndex = model.index(itemPath);
-            if (!sourceIndex.isValid())
-                continue;
-            const QModelIndex proxyIndex = sortProxy ? sortProxy->mapFromSource(sourceIndex) : sourceIndex;
-            if (proxyIndex.isValid())
-                selection->select(proxyIndex, QItemSelectionModel::Select | QItemSelectionModel::Rows);
-        }
     }
+    pendingWatchedFolders.clear();
 
-    if (!currentItemPath.trimmed().isEmpty()) {
-        const QModelIndex sourceCurrent = model.index(currentItemPath);
-        if (sourceCurrent.isValid()) {
-            const QModelIndex proxyCurrent = sortProxy ? sortProxy->mapFromSource(sourceCurrent) : sourceCurrent;
-            if (proxyCurrent.isValid())
-                ui->treeView->setCurrentIndex(proxyCurrent);
-        }
-    }
+    const QString activePath = QDir::cleanPath(currentPath());
+    if (pendingWatchedPath.trimmed().isEmpty())
+        pendingWatchedPath = activePath;
+    if (pendingWatchedPath != activePath)
+        return;
+    pendingWatchedPath.clear();
 
-    QTimer::singleShot(0, this, [this, scrollValue] {
-        if (ui->treeView->verticalScrollBar())
-            ui->treeView->verticalScrollBar()->setValue(scrollValue);
-    });
+    // The model applies only the differences, so selection, current item
+    // and scroll position stay where they are.
+    model.refresh();
 }
 
 QString Kitaplik::trashFilesPath() const
@@ -1534,11 +3011,14 @@ QString Kitaplik::trashInfoPath() const
 
 bool Kitaplik::isInsideTrashFiles(const QString& path) const
 {
-    const QString normalized = normalizePathForFs(path);
-    const QString trashRoot = normalizePathForFs(trashFilesPath());
-    if (normalized == trashRoot)
-        return true;
-    return normalized.startsWith(trashRoot + QDir::separator());
+    // Compares strings only. Callers pass either the path as browsed or its
+    // canonical form, so both forms of the trash root are checked.
+    const QString clean = QDir::cleanPath(path);
+    for (const QString& trashRoot : {trashFilesPath(), trashFilesCanonicalPath}) {
+        if (!trashRoot.isEmpty() && (clean == trashRoot || clean.startsWith(trashRoot + '/')))
+            return true;
+    }
+    return false;
 }
 
 QString Kitaplik::buildUniquePath(const QString& destinationPath) const
@@ -1,17 +1,24 @@
 #ifndef KITAPLIK_HPP
 #define KITAPLIK_HPP
 
-#include <QFileSystemModel>
+#include <QByteArray>
 #include <QFileSystemWatcher>
 #include <QPoint>
+#include <QSet>
 #include <QStandardItemModel>
 #include <QStringListModel>
 #include <QTimer>
 #include <QWidget>
 
+#include "listingmodel.hpp"
+
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -22,9 +29,26 @@ enum class FileSortField
     Type,
     Modified,
     Created,
+    // Photos and videos, from MediaInfo; other files sort first.
+    DateTaken,
+    Dimensions,
+    Duration,
 };
 
+class ArchiveIndex;
+class ArchiveModel;
+class DriveCatalog;
+class EntrySelectionModel;
 class FileSortProxyModel;
+class PathList;
+class QAbstractItemView;
+class QDropEvent;
+class QLabel;
+class QueryVfs;
+class SelectionSummary;
+struct SavedQuery;
+class QTemporaryDir;
+class QToolButton;
 
 namespace Ui {
 class Kitaplik;
@@ -51,34 +75,105 @@ public slots:
 signals:
     void currentPathChanged(const QString& path);
 
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
 private:
+    // A copy or move waiting for fileOpThread. The sources are a PathList
+    // from this process, or another application's text/uri-list that the
+    // job parses itself.
+    struct PendingTransfer
+    {
+        std::shared_ptr<const PathList> sources;
+        QByteArray uriList;
+        QString destDir;
+        bool move = false;
+        bool fromClipboard = false;
+    };
+
     void showFileMenu(const QPoint& viewPos);
     void onMenuOpen(const QString& targetPath);
     void onMenuRename(const QString& targetPath);
     void onMenuCopy(const QString& targetPath);
     void onMenuCut(const QString& targetPath);
+    void onMenuCopySelection(bool cut);
     void onMenuDelete(const QString& targetPath);
+    void onMenuDeleteSelection();
     void onMenuRestoreFromTrash(const QString& trashPath);
     void onMenuEmptyTrash();
     void onMenuNewFolder(const QString& parentDir);
     void onMenuPaste(const QString& destDir);
+    void queueTransfer(PendingTransfer transfer);
+    void startNextTransfer();
+    void onMenuFindDuplicates(const QString& rootDir);
+    void onMenuCompareSync(const QString& sourceDir);
+    void onMenuCompress(const QString& targetPath);
+    void onMenuExtract(const QString& archivePath);
+    void showSidebarMenu(const QPoint& viewPos);
+    void onMenuCatalogDrive(const QString& rootPath, const QString& uuid);
+    void onMenuForgetCatalog(const QString& uuid);
+    void onMenuSearchCatalogs();
+    // Adds a saved query, or edits the one named name.
+    void onMenuEditQuery(const QString& name);
+    void onMenuDeleteQuery(const QString& name);
+
+    // Background work for the shared file-operation slot. It gets a progress
+    // callback and the cancel flag of the Cancel button, and returns the
+    // errors to show when it finishes.
+    using FileOperationWork = std::function<QStringList(const std::function<void(std::uint64_t done, std::uint64_t total)>& onProgress,
+                                                        const std::atomic_bool* cancel)>;
+    void startCancellableFileOperation(const QString& label, const QString& title, FileOperationWork work);
 
     void setCopyPasteProgressVisible(bool visible, const QString& text = QString());
     void updateCopyPasteProgress(std::uint64_t doneBytes, std::uint64_t totalBytes);
-    void finishPasteOperation(const QString& errorText, bool clearClipboard);
+    void finishPasteOperation(const QString& errorText, bool clearClipboard, const QString& title = QStringLiteral("Paste"));
 
     void updateGoToPathButton();
     void goToPathFromPathLabel();
 
     void navigateTo(const QString& path, bool recordHistory);
+    bool showArchiveDirectory(const QString& archivePath, const QString& innerPath);
+    // Indexes the archive in the background and goes on to target once it
+    // is open; a later navigation gives it up.
+    void openArchive(const QString& archivePath, const QString& target, bool recordHistory);
+    void stopArchiveOpen();
+    void openArchives(std::stop_token stop);
+    void finishArchiveOpen(const QString& archivePath, const std::shared_ptr<ArchiveIndex>& archive, const QString& error);
+    void leaveArchive();
+    bool showCatalogDirectory(const QString& uuid, const QString& innerPath);
+    void leaveCatalog();
+    bool showQueryResults(const QString& name);
+    void leaveQuery();
+    void openArchiveEntry(const QModelIndex& sourceIndex);
+    void setFileViewSourceModel(QAbstractItemModel* sourceModel);
+    // The list or the grid, whichever is shown.
+    QAbstractItemView* fileView() const;
+    void setGridView(bool grid);
+    // Lists every file under the current folder, or just the folder.
+    void setFlatView(bool flat);
+    void updateMemoryOverlay();
+    std::shared_ptr<const PathList> selectedPathList() const;
+    QString dropTargetAt(const QDropEvent* event) const;
+    Qt::DropAction dropActionFor(const QDropEvent* event, const QString& targetDir);
+    bool handleDragEvent(QEvent* event);
+    QString restoreListingSnapshot();
+    void saveListingSnapshot();
     void updateWindowTitle(const QString& path);
     void updateNavButtons();
     void applySort(FileSortField field, Qt::SortOrder order);
     void refreshHistoryView();
     void updateFileInfoView(const QModelIndex& index);
+    void updatePreview(const QModelIndex& index);
     void addPinnedFolder(const QString& label, const QString& path);
     void refreshSidebarLocations();
     void addMountedDrivesReadOnly();
+    void addOfflineCatalogs();
+    void addSavedQueries();
+    // Brings every saved query's results up to date in the background, and
+    // shows their counts in the sidebar.
+    void updateQueryCounts();
+    void countQueries(std::stop_token stop);
+    void showQueryCount(const QString& name, std::uint64_t count);
     QModelIndex mapToSourceIndex(const QModelIndex& proxyIndex) const;
     void updateDirectoryWatcher(const QString& path);
     void scheduleWatchedRefresh(const QString& changedPath);
@@ -91,7 +186,7 @@ private:
     bool restoreFromTrash(const QString& trashPath, QString* error);
     bool emptyTrash(QString* error);
 
-    QFileSystemModel model;
+    ListingModel model;
     QStandardItemModel pinnedFoldersModel;
     std::vector<QString> history;
     int historyIndex = -1;
@@ -100,15 +195,63 @@ private:
     QStringListModel historyListModel;
     QStandardItemModel fileInfoModel;
     FileSortProxyModel* sortProxy = nullptr;
+    EntrySelectionModel* fileSelection = nullptr;
+    SelectionSummary* selectionSummary = nullptr;
+    ArchiveModel* archiveModel = nullptr;
+    std::shared_ptr<ArchiveIndex> currentArchive;
+    QString archiveInnerPath;
+    // Opened in the background, until navigateTo() shows it.
+    std::shared_ptr<ArchiveIndex> openedArchive;
+    // The archive being opened and where to go in it; empty when none is.
+    QString archiveOpenPath;
+    QString archiveOpenTarget;
+    bool archiveOpenRecordHistory = false;
+    std::shared_ptr<const DriveCatalog> currentCatalog;
+    std::shared_ptr<const QueryVfs> currentQuery;
+    std::unique_ptr<QTemporaryDir> archiveOpenDir;
     FileSortField currentSortField = FileSortField::Name;
     Qt::SortOrder currentSortOrder = Qt::AscendingOrder;
 
     std::jthread fileOpThread;
+    std::deque<PendingTransfer> pendingTransfers;
+    // Devices of the dragged files and of the folder under the cursor, for
+    // the default drop action; 0 when unknown.
+    std::uint64_t dragSourceDevice = 0;
+    QString dropTargetPath;
+    std::uint64_t dropTargetDevice = 0;
     std::atomic_bool pasteInProgress = false;
     QString pasteOpLabel;
+    std::shared_ptr<std::atomic_bool> fileOpCancel;
+    QToolButton* fileOpCancelButton = nullptr;
     QFileSystemWatcher directoryWatcher;
     QTimer watchedRefreshDebounceTimer;
     QString pendingWatchedPath;
+    // Changed folders of a flat listing, each listed again on its own.
+    QSet<QString> pendingWatchedFolders;
+    // The catalog directory, so saved queries follow catalogs as they are
+    // built or forgotten.
+    QFileSystemWatcher catalogWatcher;
+    QTimer catalogChangeTimer;
+    // Sorting by date taken or the like follows the media info as it is read.
+    QTimer mediaSortTimer;
+    // Saved queries counted on a thread of their own. A new round gives up
+    // the one under way instead of waiting for it.
+    std::mutex queryCountMutex;
+    std::condition_variable_any queryCountWake;
+    std::vector<SavedQuery> pendingQueryCounts;
+    std::atomic_bool cancelQueryCounts = false;
+    std::jthread queryCountThread;
+    // Archives indexed on a thread of their own, like the query counts.
+    std::mutex archiveOpenMutex;
+    std::condition_variable_any archiveOpenWake;
+    QString pendingArchiveOpen;
+    std::atomic_bool cancelArchiveOpen = false;
+    std::jthread archiveOpenThread;
+    QTimer memoryTimer;
+    // Per-cache memory use over the file view; Ctrl+Shift+M.
+    QLabel* memoryOverlay = nullptr;
+    // The trash root as resolved through symbolic links, for isInsideTrashFiles.
+    QString trashFilesCanonicalPath;
 };
 
 #endif // KITAPLIK_HPP
@@ -0,0 +1,198 @@
+#include "latencyvfs.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+std::uint64_t splitMix64(std::uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+class LatencyVfs::File final : public VfsFile
+{
+public:
+    File(const LatencyVfs* owner, std::unique_ptr<VfsFile> inner)
+        : owner_(owner)
+        , inner_(std::move(inner))
+    {
+    }
+
+    qint64 read(std::uint64_t offset, char* data, size_t size) override
+    {
+        if (!owner_->enter(owner_->options_.dataLatency, size))
+            return -1;
+        return inner_->read(offset, data, size);
+    }
+
+    qint64 write(std::uint64_t offset, const char* data, size_t size) override
+    {
+        if (!owner_->enter(owner_->options_.dataLatency, size))
+            return -1;
+        return inner_->write(offset, data, size);
+    }
+
+    bool stat(VfsStat* st) const override
+    {
+        return owner_->enter(owner_->options_.metadataLatency, 0) && inner_->stat(st);
+    }
+
+    bool close() override
+    {
+        // Always closes the wrapped file, so a fault can't leak it.
+        const bool ok = owner_->enter(owner_->options_.metadataLatency, 0);
+        return inner_->close() && ok;
+    }
+
+private:
+    const LatencyVfs* owner_;
+    std::unique_ptr<VfsFile> inner_;
+};
+
+LatencyVfs::LatencyVfs(const Vfs& inner)
+    : inner_(inner)
+{
+}
+
+LatencyVfs::LatencyVfs(const Vfs& inner, Options options)
+    : inner_(inner)
+    , options_(options)
+{
+}
+
+double LatencyVfs::random() const
+{
+    const std::uint64_t bits = splitMix64(options_.seed + sequence_.fetch_add(1, std::memory_order_relaxed));
+    return static_cast<double>(bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+bool LatencyVfs::enter(std::chrono::microseconds latency, size_t bytes) const
+{
+    calls_.fetch_add(1, std::memory_order_relaxed);
+
+    double delayNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    if (options_.jitter > 0.0)
+        delayNs *= std::max(0.0, 1.0 + options_.jitter * (2.0 * random() - 1.0));
+    if (options_.bytesPerSecond > 0)
+        delayNs += static_cast<double>(bytes) * 1e9 / static_cast<double>(options_.bytesPerSecond);
+    if (delayNs >= 1.0) {
+        const std::chrono::nanoseconds delay(static_cast<std::int64_t>(delayNs));
+        std::this_thread::sleep_for(delay);
+        delayNs_.fetch_add(delay.count(), std::memory_order_relaxed);
+    }
+
+    if (options_.faultRate > 0.0 && random() < options_.faultRate) {
+        faults_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+LatencyVfs::Counters LatencyVfs::counters() const
+{
+    Counters result;
+    result.calls = calls_.load(std::memory_order_relaxed);
+    result.faults = faults_.load(std::memory_order_relaxed);
+    result.delay = std::chrono::nanoseconds(delayNs_.load(std::memory_order_relaxed));
+    return result;
+}
+
+std::unique_ptr<VfsFile> LatencyVfs::open(const QString& path, OpenMode mode, std::uint32_t permissions, QString* error) const
+{
+    if (!enter(options_.metadataLatency, 0)) {
+        if (error)
+            *error = QString("Injected fault: %1").arg(path);
+        return nullptr;
+    }
+    std::unique_ptr<VfsFile> file = inner_.open(path, mode, permissions, error);
+    if (!file)
+        return nullptr;
+    return std::make_unique<File>(this, std::move(file));
+}
+
+bool LatencyVfs::stat(const QString& path, VfsStat* st, QString* error) const
+{
+    if (!enter(options_.metadataLatency, 0)) {
+        if (error)
+            *error = QString("Injected fault: %1").arg(path);
+        return false;
+    }
+    return inner_.stat(path, st, error);
+}
+
+bool LatencyVfs::statTarget(const QString& path, VfsStat* st, QString* error) const
+{
+    if (!enter(options_.metadataLatency, 0)) {
+        if (error)
+            *error = QString("Injected fault: %1").arg(path);
+        return false;
+    }
+    return inner_.statTarget(path, st, error);
+}
+
+bool LatencyVfs::list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    // A full listing pays a round trip per entry, as stat-heavy listings do
+    // on network filesystems.
+    if (!enter(options_.metadataLatency, 0)) {
+        if (error)
+            *error = QString("Injected fault: %1").arg(path);
+        return false;
+    }
+    if (!inner_.list(path, entries, error))
+        return false;
+    for (size_t i = 0; i < entries->size(); ++i) {
+        if (!enter(options_.metadataLatency, 0)) {
+            if (error)
+                *error = QString("Injected fault: %1").arg(path);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LatencyVfs::listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    if (!enter(options_.metadataLatency, 0)) {
+        if (error)
+            *error = QString("Injected fault: %1").arg(path);
+        return false;
+    }
+    return inner_.listNames(path, entries, error);
+}
+
+bool LatencyVfs::makeDirectory(const QString& path, std::uint32_t permissions, QString* error) const
+{
+    if (!enter(options_.metadataLatency, 0)) {
+        if (error)
+            *error = QString("Injected fault: %1").arg(path);
+        return false;
+    }
+    return inner_.makeDirectory(path, permissions, error);
+}
+
+bool LatencyVfs::rename(const QString& from, const QString& to, QString* error) const
+{
+    if (!enter(options_.metadataLatency, 0)) {
+        if (error)
+            *error = QString("Injected fault: %1").arg(from);
+        return false;
+    }
+    return inner_.rename(from, to, error);
+}
+
+bool LatencyVfs::unlink(const QString& path, QString* error) const
+{
+    if (!enter(options_.metadataLatency, 0)) {
+        if (error)
+            *error = QString("Injected fault: %1").arg(path);
+        return false;
+    }
+    return inner_.unlink(path, error);
+}
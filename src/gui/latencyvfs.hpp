@@ -0,0 +1,69 @@
+#ifndef LATENCYVFS_HPP
+#define LATENCYVFS_HPP
+
+#include "vfs.hpp"
+
+#include <atomic>
+#include <chrono>
+
+// Wraps another Vfs and makes it behave like a slow or flaky mount: every call
+// first sleeps for a configurable latency, data calls additionally pay for
+// their size at a configured bandwidth, and a fraction of calls fail outright.
+// The delays are spent in the calling thread, so an engine only gets faster on
+// it by overlapping calls, the same as on a real network filesystem.
+class LatencyVfs final : public Vfs
+{
+public:
+    struct Options
+    {
+        // stat, list, open, makeDirectory, rename and unlink.
+        std::chrono::microseconds metadataLatency{0};
+        // Each read or write on an open file.
+        std::chrono::microseconds dataLatency{0};
+        // 0 for unlimited.
+        std::uint64_t bytesPerSecond = 0;
+        // Each delay is drawn uniformly from latency * [1 - jitter, 1 + jitter].
+        double jitter = 0.0;
+        // Chance in [0, 1] that a call fails without reaching the wrapped Vfs.
+        double faultRate = 0.0;
+        std::uint64_t seed = 0;
+    };
+
+    struct Counters
+    {
+        std::uint64_t calls = 0;
+        std::uint64_t faults = 0;
+        std::chrono::nanoseconds delay{0};
+    };
+
+    explicit LatencyVfs(const Vfs& inner);
+    LatencyVfs(const Vfs& inner, Options options);
+
+    std::unique_ptr<VfsFile> open(const QString& path, OpenMode mode, std::uint32_t permissions, QString* error) const override;
+    bool stat(const QString& path, VfsStat* st, QString* error) const override;
+    bool statTarget(const QString& path, VfsStat* st, QString* error) const override;
+    bool list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool makeDirectory(const QString& path, std::uint32_t permissions, QString* error) const override;
+    bool rename(const QString& from, const QString& to, QString* error) const override;
+    bool unlink(const QString& path, QString* error) const override;
+
+    // Totals since construction, summed over all threads.
+    Counters counters() const;
+
+private:
+    class File;
+
+    // Sleeps for one call and returns false if the call should fail.
+    bool enter(std::chrono::microseconds latency, size_t bytes) const;
+    double random() const;
+
+    const Vfs& inner_;
+    Options options_;
+    mutable std::atomic<std::uint64_t> sequence_ = 0;
+    mutable std::atomic<std::uint64_t> calls_ = 0;
+    mutable std::atomic<std::uint64_t> faults_ = 0;
+    mutable std::atomic<std::int64_t> delayNs_ = 0;
+};
+
+#endif // LATENCYVFS_HPP
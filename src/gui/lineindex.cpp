@@ -0,0 +1,130 @@
+#include "lineindex.hpp"
+
+#include <QFile>
+#include <QMetaObject>
+
+#include "scopedfd.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+
+namespace {
+
+constexpr size_t ChunkBytes = 1 << 20;
+constexpr auto ProgressInterval = std::chrono::milliseconds(250);
+
+} // namespace
+
+LineIndex::LineIndex(const QString& path, std::uint64_t size, QObject* parent)
+    : QObject(parent)
+    , size_(size)
+{
+    checkpoints_.push_back(0);
+    thread_ = std::jthread([this, path](std::stop_token stop) { run(stop, path); });
+}
+
+LineIndex::~LineIndex()
+{
+    thread_.request_stop();
+    thread_ = std::jthread();
+}
+
+void LineIndex::extend(std::uint64_t size)
+{
+    std::lock_guard lock(mutex_);
+    size_ = std::max(size_, size);
+    wake_.notify_one();
+}
+
+std::uint64_t LineIndex::size() const
+{
+    std::lock_guard lock(mutex_);
+    return size_;
+}
+
+std::uint64_t LineIndex::indexedBytes() const
+{
+    std::lock_guard lock(mutex_);
+    return indexedBytes_;
+}
+
+std::uint64_t LineIndex::lineBreaks() const
+{
+    std::lock_guard lock(mutex_);
+    return lineBreaks_;
+}
+
+bool LineIndex::checkpointForLine(std::uint64_t line, Checkpoint* checkpoint) const
+{
+    std::lock_guard lock(mutex_);
+    if (line > lineBreaks_)
+        return false;
+    const std::uint64_t kept = std::min<std::uint64_t>(line / Step, checkpoints_.size() - 1);
+    *checkpoint = {kept * Step, checkpoints_[kept]};
+    return true;
+}
+
+bool LineIndex::checkpointForOffset(std::uint64_t offset, Checkpoint* checkpoint) const
+{
+    std::lock_guard lock(mutex_);
+    if (offset > indexedBytes_)
+        return false;
+    const auto it = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), offset);
+    const std::uint64_t kept = static_cast<std::uint64_t>(it - checkpoints_.begin()) - 1;
+    *checkpoint = {kept * Step, checkpoints_[kept]};
+    return true;
+}
+
+void LineIndex::run(std::stop_token stop, const QString& path)
+{
+    const ScopedFd fd(::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC));
+    if (!fd.isValid())
+        return;
+    ::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::vector<char> buffer(ChunkBytes);
+    std::vector<std::uint64_t> found;
+    std::uint64_t offset = 0;
+    std::uint64_t lineBreaks = 0;
+    auto reportAt = std::chrono::steady_clock::now();
+    for (;;) {
+        std::uint64_t size = 0;
+        {
+            std::unique_lock lock(mutex_);
+            if (!wake_.wait(lock, stop, [this, offset] { return size_ > offset; }))
+                return;
+            size = size_;
+        }
+        while (offset < size && !stop.stop_requested()) {
+            const size_t want = static_cast<size_t>(std::min<std::uint64_t>(buffer.size(), size - offset));
+            const ssize_t got = ::pread(fd.get(), buffer.data(), want, static_cast<off_t>(offset));
+            // Truncated under us; the preview opens it again.
+            if (got <= 0)
+                return;
+            found.clear();
+            const char* const begin = buffer.data();
+            const char* const end = begin + got;
+            for (const char* p = begin; (p = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)))); ++p) {
+                if (++lineBreaks % Step == 0)
+                    found.push_back(offset + std::uint64_t(p - begin) + 1);
+            }
+            // A 20 GB scan shouldn't push everything else out of the page cache.
+            ::posix_fadvise(fd.get(), static_cast<off_t>(offset), static_cast<off_t>(got), POSIX_FADV_DONTNEED);
+            offset += std::uint64_t(got);
+            {
+                std::lock_guard lock(mutex_);
+                checkpoints_.insert(checkpoints_.end(), found.begin(), found.end());
+                indexedBytes_ = offset;
+                lineBreaks_ = lineBreaks;
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (now >= reportAt || offset >= size) {
+                reportAt = now + ProgressInterval;
+                QMetaObject::invokeMethod(this, [this] { emit progressed(); }, Qt::QueuedConnection);
+            }
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef LINEINDEX_HPP
+#define LINEINDEX_HPP
+
+#include <QObject>
+#include <QString>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Where the lines of a text file start, found on a background thread so a
+// preview can jump to line N without reading up to it.
+//
+// Every Step-th line start is kept, not every one: 8 bytes per 256 lines,
+// about 6 MB for a 20 GB log. Line N is then the kept start before it plus
+// at most Step - 1 line breaks, a short scan whatever N is. The file is
+// read with its own descriptor, a megabyte at a time, and those pages are
+// dropped from the page cache once counted. extend() carries on into data
+// appended since, for logs that grow while shown.
+class LineIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr std::uint64_t Step = 256;
+
+    // Lines are counted from 0.
+    struct Checkpoint
+    {
+        std::uint64_t line = 0;
+        std::uint64_t offset = 0;
+    };
+
+    // Starts indexing the first size bytes of path.
+    LineIndex(const QString& path, std::uint64_t size, QObject* parent = nullptr);
+    ~LineIndex() override;
+
+    // The file now has size bytes.
+    void extend(std::uint64_t size);
+
+    std::uint64_t size() const;
+    std::uint64_t indexedBytes() const;
+    // Line breaks in the indexed bytes.
+    std::uint64_t lineBreaks() const;
+    bool isComplete() const { return indexedBytes() >= size(); }
+
+    // The kept line start at or before line; false if line starts past the
+    // indexed bytes.
+    bool checkpointForLine(std::uint64_t line, Checkpoint* checkpoint) const;
+    // The kept line start at or before offset; false if offset is past the
+    // indexed bytes.
+    bool checkpointForOffset(std::uint64_t offset, Checkpoint* checkpoint) const;
+
+signals:
+    // At most every few tenths of a second while indexing, and when done.
+    void progressed();
+
+private:
+    void run(std::stop_token stop, const QString& path);
+
+    // Shared with the thread.
+    mutable std::mutex mutex_;
+    std::condition_variable_any wake_;
+    std::uint64_t size_ = 0;
+    std::uint64_t indexedBytes_ = 0;
+    std::uint64_t lineBreaks_ = 0;
+    // Offsets of lines 0, Step, 2 * Step and so on.
+    std::vector<std::uint64_t> checkpoints_;
+
+    // Last, so it is joined before anything it uses goes away.
+    std::jthread thread_;
+};
+
+#endif // LINEINDEX_HPP
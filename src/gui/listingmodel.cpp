@@ -0,0 +1,1127 @@
+#include "listingmodel.hpp"
+
+#include <QDateTime>
+#include <QFile>
+#include <QLocale>
+#include <QMetaObject>
+#include <QMimeDatabase>
+#include <QPointer>
+#include <QSaveFile>
+#include <QThread>
+
+#include "mountprobe.hpp"
+#include "parallelwalker.hpp"
+#include "scopedfd.hpp"
+#include "selectionmimedata.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+// Stats in flight at once on a high-latency mount. NFS and SMB clients
+// pipeline this many requests without trouble.
+constexpr int HighLatencyConcurrency = 32;
+constexpr auto StatFlushInterval = std::chrono::milliseconds(50);
+constexpr size_t StatFlushBatch = 512;
+// A flat listing streams its files in batches of about this many, or
+// whatever was found in this time.
+constexpr size_t FlatFlushBatch = 8192;
+constexpr auto FlatFlushInterval = std::chrono::milliseconds(100);
+// Beyond this many separate runs of removed rows a reset is cheaper than
+// removing them one run at a time.
+constexpr int MaxRemovedRuns = 64;
+constexpr int GitRefreshDelayMs = 200;
+
+constexpr char SnapshotMagic[8] = {'K', 'T', 'L', 'S', 'N', 'A', 'P', '\0'};
+constexpr std::uint32_t SnapshotVersion = 2;
+
+// Followed by the directory in UTF-16, the view state and EntryStore::serialize().
+struct SnapshotHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t directoryUnits;
+    std::uint32_t viewStateSize;
+    std::uint32_t reserved;
+};
+
+QString childPath(const QString& parent, const QString& name)
+{
+    return parent.endsWith('/') ? parent + name : parent + '/' + name;
+}
+
+// The file name of a flat listing's entry name, which holds its folder.
+QStringView baseName(QStringView name)
+{
+    return name.sliced(name.lastIndexOf('/') + 1);
+}
+
+// Empty for entries directly in the directory.
+QStringView folderOf(QStringView name)
+{
+    const qsizetype slash = name.lastIndexOf('/');
+    return slash < 0 ? QStringView() : name.left(slash);
+}
+
+VfsStat statOf(const WalkEntry& entry)
+{
+    VfsStat st;
+    st.device = entry.device;
+    st.inode = entry.inode;
+    st.size = entry.size;
+    st.mtimeNs = entry.mtimeNs;
+    st.ctimeNs = entry.ctimeNs;
+    st.mode = entry.mode;
+    st.linkCount = entry.linkCount;
+    st.uid = entry.uid;
+    st.gid = entry.gid;
+    return st;
+}
+
+// "1:02:03", or "2:03" under an hour.
+QString formatDuration(std::int64_t ms)
+{
+    const std::int64_t seconds = ms / 1000;
+    const std::int64_t hours = seconds / 3600;
+    const std::int64_t minutes = hours > 0 ? seconds / 60 % 60 : seconds / 60;
+    const QString minutesAndSeconds = QString("%1:%2").arg(minutes, hours > 0 ? 2 : 0, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+    return hours > 0 ? QString::number(hours) + ':' + minutesAndSeconds : minutesAndSeconds;
+}
+
+std::shared_ptr<const Vfs> nativeVfs()
+{
+    return std::shared_ptr<const Vfs>(&Vfs::native(), [](const Vfs*) {});
+}
+
+} // namespace
+
+struct ListingModel::Job
+{
+    QPointer<ListingModel> model;
+    std::shared_ptr<const Vfs> vfs;
+    QString directory;
+    std::uint64_t generation = 0;
+    LatencyMode latencyMode = LatencyMode::Auto;
+    bool reconcile = false;
+    bool flat = false;
+    // Lists folder alone, and walks only those of its subfolders that are
+    // not in knownFolders.
+    bool folderOnly = false;
+    QString folder;
+    QSet<QString> knownFolders;
+    std::atomic_bool cancelled = false;
+};
+
+ListingModel::ListingModel(QObject* parent)
+    : QAbstractTableModel(parent)
+    , vfs_(nativeVfs())
+{
+    // A listing stuck on an unresponsive mount must not hold up the next one.
+    pool_.setMaxThreadCount(4);
+    gitPool_.setMaxThreadCount(1);
+    gitPool_.setThreadPriority(QThread::LowPriority);
+    connect(&accountNames_, &AccountNames::namesResolved, this, &ListingModel::updateAccountNames);
+    connect(&mediaInfo_, &MediaInfoLoader::infoReady, this, &ListingModel::updateMediaInfo);
+    gitRefreshTimer_.setSingleShot(true);
+    gitRefreshTimer_.setInterval(GitRefreshDelayMs);
+    connect(&gitRefreshTimer_, &QTimer::timeout, this, &ListingModel::startGitStatusJob);
+    connect(&gitWatcher_, &QFileSystemWatcher::directoryChanged, this, [this] { gitRefreshTimer_.start(); });
+}
+
+ListingModel::~ListingModel()
+{
+    cancelJob();
+    cancelGitStatusJob();
+}
+
+void ListingModel::setVfs(std::shared_ptr<const Vfs> vfs)
+{
+    vfs_ = vfs ? std::move(vfs) : nativeVfs();
+}
+
+void ListingModel::setLatencyMode(LatencyMode mode)
+{
+    latencyMode_ = mode;
+}
+
+void ListingModel::setDirectory(const QString& path, bool flat)
+{
+    cancelJob();
+    beginResetModel();
+    directory_ = path;
+    flat_ = flat;
+    folders_.clear();
+    store_.clear();
+    entryByName_.clear();
+    gitStates_.clear();
+    cancelGitStatusJob();
+    gitRefreshTimer_.stop();
+    mediaInfo_.request({});
+    mediaInfo_.requestBackground({});
+    endResetModel();
+    if (!directory_.isEmpty())
+        startJob(false);
+}
+
+void ListingModel::refresh()
+{
+    if (directory_.isEmpty())
+        return;
+    // A listing in progress may already have passed the change; list again
+    // once it is done.
+    if (loading_) {
+        refreshPending_ = true;
+        return;
+    }
+    startJob(true);
+}
+
+void ListingModel::refreshFolder(const QString& path)
+{
+    if (!flat_)
+        return;
+    const QString prefix = directory_.endsWith('/') ? directory_ : directory_ + '/';
+    QString folder;
+    if (path != directory_) {
+        if (!path.startsWith(prefix))
+            return;
+        folder = path.sliced(prefix.size());
+    }
+    if (loading_) {
+        if (!refreshPending_)
+            pendingFolders_.insert(folder);
+        return;
+    }
+    startFolderJob(folder);
+}
+
+QStringList ListingModel::folderPaths() const
+{
+    QStringList paths;
+    paths.reserve(folders_.size());
+    for (const QString& folder : folders_)
+        paths.push_back(childPath(directory_, folder));
+    return paths;
+}
+
+bool ListingModel::saveSnapshot(const QString& file, const QByteArray& viewState, QString* error) const
+{
+    SnapshotHeader header {};
+    std::memcpy(header.magic, SnapshotMagic, sizeof(header.magic));
+    header.version = SnapshotVersion;
+    header.directoryUnits = static_cast<std::uint32_t>(directory_.size());
+    header.viewStateSize = static_cast<std::uint32_t>(viewState.size());
+
+    QSaveFile out(file);
+    if (!out.open(QIODevice::WriteOnly)) {
+        if (error)
+            *error = QString("Failed to write: %1").arg(file);
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(directory_.utf16()), directory_.size() * static_cast<qsizetype>(sizeof(char16_t)));
+    out.write(viewState);
+    out.write(store_.serialize());
+    if (!out.commit()) {
+        if (error)
+            *error = QString("Failed to write: %1").arg(file);
+        return false;
+    }
+    return true;
+}
+
+bool ListingModel::loadSnapshot(const QString& file, QByteArray* viewState)
+{
+    ScopedFd fd(::open(QFile::encodeName(file).constData(), O_RDONLY | O_CLOEXEC));
+    struct stat st {};
+    if (!fd.isValid() || ::fstat(fd.get(), &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader))
+        return false;
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (map == MAP_FAILED)
+        return false;
+    const char* data = static_cast<const char*>(map);
+
+    SnapshotHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const size_t directoryBytes = size_t(header.directoryUnits) * sizeof(char16_t);
+    const size_t prefix = sizeof(header) + directoryBytes + header.viewStateSize;
+    bool loaded = std::memcmp(header.magic, SnapshotMagic, sizeof(header.magic)) == 0
+        && header.version == SnapshotVersion && header.directoryUnits > 0 && prefix <= size;
+    if (loaded) {
+        cancelJob();
+        beginResetModel();
+        std::vector<char16_t> directory(header.directoryUnits);
+        std::memcpy(directory.data(), data + sizeof(header), directoryBytes);
+        directory_ = QString::fromUtf16(directory.data(), static_cast<qsizetype>(directory.size()));
+        flat_ = false;
+        folders_.clear();
+        entryByName_.clear();
+        loaded = store_.readFrom(data + prefix, size - prefix);
+        if (loaded) {
+            entryByName_.reserve(static_cast<qsizetype>(store_.size()));
+            for (std::uint32_t i = 0; i < store_.size(); ++i)
+                entryByName_.insert(store_.name(i), store_.id(i));
+            if (viewState)
+                *viewState = QByteArray(data + sizeof(header) + directoryBytes, static_cast<qsizetype>(header.viewStateSize));
+        } else {
+            directory_.clear();
+        }
+        endResetModel();
+    }
+    ::munmap(map, size);
+    return loaded;
+}
+
+std::shared_ptr<ListingModel::Job> ListingModel::makeJob(bool reconcile)
+{
+    auto job = std::make_shared<Job>();
+    job->model = this;
+    job->vfs = vfs_;
+    job->directory = directory_;
+    job->generation = ++generation_;
+    job->latencyMode = latencyMode_;
+    job->reconcile = reconcile;
+    job->flat = flat_;
+    return job;
+}
+
+void ListingModel::startJob(bool reconcile)
+{
+    launchJob(makeJob(reconcile));
+}
+
+void ListingModel::startFolderJob(const QString& folder)
+{
+    std::shared_ptr<Job> job = makeJob(true);
+    job->folderOnly = true;
+    job->folder = folder;
+    for (const QString& known : folders_) {
+        if (folderOf(known) == folder)
+            job->knownFolders.insert(known);
+    }
+    launchJob(job);
+}
+
+void ListingModel::launchJob(const std::shared_ptr<Job>& job)
+{
+    job_ = job;
+    loading_ = true;
+    pool_.start([job] { job->flat ? runFlatJob(job) : runJob(job); });
+}
+
+void ListingModel::cancelJob()
+{
+    if (job_)
+        job_->cancelled = true;
+    job_.reset();
+    ++generation_;
+    loading_ = false;
+    refreshPending_ = false;
+    pendingFolders_.clear();
+}
+
+// Runs call on the model in the GUI thread, unless the job was cancelled or
+// the model is gone by then.
+template<typename Call>
+void ListingModel::post(const std::shared_ptr<Job>& job, Call call)
+{
+    if (job->cancelled)
+        return;
+    const QPointer<ListingModel> model = job->model;
+    QMetaObject::invokeMethod(
+        model.data(),
+        [model, call = std::move(call)]() mutable {
+            if (model)
+                call(model.data());
+        },
+        Qt::QueuedConnection);
+}
+
+void ListingModel::runJob(const std::shared_ptr<Job>& job)
+{
+    const auto post = [&job](auto call) { ListingModel::post(job, std::move(call)); };
+    const std::uint64_t generation = job->generation;
+    const auto finish = [&](const QString& error) {
+        post([generation, error](ListingModel* model) { model->finishJob(generation, error); });
+    };
+
+    const bool highLatency = job->latencyMode == LatencyMode::HighLatency
+        || (job->latencyMode == LatencyMode::Auto && MountProbe::isHighLatency(*job->vfs, job->directory));
+
+    std::vector<VfsDirEntry> listed;
+    QString error;
+    const bool listedOk = highLatency ? job->vfs->listNames(job->directory, &listed, &error)
+                                      : job->vfs->list(job->directory, &listed, &error);
+    if (!listedOk) {
+        finish(error.isEmpty() ? QString("Failed to read directory: %1").arg(job->directory) : error);
+        return;
+    }
+
+    std::vector<Record> records(listed.size());
+    for (size_t i = 0; i < listed.size(); ++i) {
+        records[i].name = std::move(listed[i].name);
+        records[i].stat = listed[i].stat;
+        records[i].flags = EntryStore::flagsFor(records[i].stat, !highLatency, nullptr);
+    }
+    listed = {};
+
+    if (!highLatency) {
+        // Symbolic links need their target to know whether they open as folders.
+        for (Record& record : records) {
+            if (job->cancelled)
+                return;
+            VfsStat target;
+            if (record.stat.isSymLink() && job->vfs->statTarget(childPath(job->directory, record.name), &target, nullptr))
+                record.flags = EntryStore::flagsFor(record.stat, true, &target);
+        }
+    } else {
+        // Show the names right away, then fetch the stats with many requests
+        // in flight so their round trips overlap.
+        if (!job->reconcile) {
+            post([generation, names = records](ListingModel* model) mutable {
+                model->appendRecords(generation, names);
+            });
+        }
+
+        std::atomic<size_t> next = 0;
+        const auto worker = [&] {
+            std::vector<StatUpdate> pending;
+            auto lastFlush = std::chrono::steady_clock::now();
+            const auto flush = [&] {
+                if (!pending.empty())
+                    post([generation, updates = std::move(pending)](ListingModel* model) { model->applyStats(generation, updates); });
+                pending.clear();
+                lastFlush = std::chrono::steady_clock::now();
+            };
+
+            for (;;) {
+                if (job->cancelled)
+                    return;
+                const size_t index = next.fetch_add(1);
+                if (index >= records.size())
+                    break;
+                Record& record = records[index];
+                const QString path = childPath(job->directory, record.name);
+                VfsStat st;
+                // An entry gone by now keeps its name only; the next refresh drops it.
+                if (!job->vfs->stat(path, &st, nullptr))
+                    continue;
+                VfsStat target;
+                const bool hasTarget = st.isSymLink() && job->vfs->statTarget(path, &target, nullptr);
+                record.stat = st;
+                record.flags = EntryStore::flagsFor(st, true, hasTarget ? &target : nullptr);
+                if (job->reconcile)
+                    continue;
+                pending.push_back({static_cast<std::uint32_t>(index), record.stat, record.flags});
+                if (pending.size() >= StatFlushBatch || std::chrono::steady_clock::now() - lastFlush >= StatFlushInterval)
+                    flush();
+            }
+            flush();
+        };
+
+        const int threads = static_cast<int>(std::min<size_t>(HighLatencyConcurrency, records.size() / 4 + 1));
+        std::vector<std::jthread> workers;
+        for (int i = 1; i < threads; ++i)
+            workers.emplace_back(worker);
+        worker();
+        workers.clear();
+        if (job->cancelled)
+            return;
+    }
+
+    if (job->reconcile) {
+        post([generation, records = std::move(records)](ListingModel* model) mutable {
+            model->reconcile(generation, records);
+        });
+    } else if (!highLatency) {
+        post([generation, records = std::move(records)](ListingModel* model) mutable {
+            model->appendRecords(generation, records);
+        });
+    }
+    finish(QString());
+}
+
+// Folders are walked into but not listed; the job reports them so the
+// model knows what to watch and what went away.
+void ListingModel::runFlatJob(const std::shared_ptr<Job>& job)
+{
+    const std::uint64_t generation = job->generation;
+    const auto finish = [&](const QString& error) {
+        post(job, [generation, error](ListingModel* model) { model->finishJob(generation, error); });
+    };
+
+    // A first listing is streamed in as it is found; the sort proxy puts
+    // each batch in place, so the view stays sorted while it fills.
+    const bool stream = !job->reconcile;
+    std::mutex mutex;
+    std::vector<Record> records;
+    QStringList folders;
+    auto lastFlush = std::chrono::steady_clock::now();
+    const auto flush = [&] {
+        if (!records.empty())
+            post(job, [generation, batch = std::move(records)](ListingModel* model) mutable { model->appendRecords(generation, batch); });
+        records.clear();
+        lastFlush = std::chrono::steady_clock::now();
+    };
+    const auto add = [&](QString name, const VfsStat& st) {
+        if (st.isDir()) {
+            folders.push_back(std::move(name));
+            return;
+        }
+        Record record;
+        record.name = std::move(name);
+        record.stat = st;
+        record.flags = EntryStore::flagsFor(st, true, nullptr);
+        records.push_back(std::move(record));
+    };
+    const auto addBatch = [&](const QString& prefix, std::vector<WalkEntry>&& batch) {
+        std::lock_guard lock(mutex);
+        for (WalkEntry& entry : batch)
+            add(prefix.isEmpty() ? std::move(entry.relativePath) : prefix + '/' + entry.relativePath, statOf(entry));
+        if (stream && (records.size() >= FlatFlushBatch || std::chrono::steady_clock::now() - lastFlush >= FlatFlushInterval))
+            flush();
+    };
+
+    ParallelWalker::Options options;
+    options.vfs = job->vfs.get();
+    const ParallelWalker walker(options);
+    const auto walk = [&](const QString& prefix, QStringList* errors) {
+        const QString root = prefix.isEmpty() ? job->directory : childPath(job->directory, prefix);
+        return walker.walk(root, [&](std::vector<WalkEntry>&& batch) { addBatch(prefix, std::move(batch)); }, &job->cancelled, errors);
+    };
+
+    if (!job->folderOnly) {
+        QStringList errors;
+        if (!walk(QString(), &errors)) {
+            if (!job->cancelled)
+                finish(errors.isEmpty() ? QString("Failed to read directory: %1").arg(job->directory) : errors.front());
+            return;
+        }
+    } else {
+        const QString root = job->folder.isEmpty() ? job->directory : childPath(job->directory, job->folder);
+        // A folder that went away lists as empty, which drops its files; one
+        // that is still there but can't be read fails like a first listing.
+        const auto failed = [&](const QString& path, const QString& error) {
+            VfsStat st;
+            if (!job->vfs->stat(path, &st, nullptr))
+                return false;
+            finish(error.isEmpty() ? QString("Failed to read directory: %1").arg(path) : error);
+            return true;
+        };
+        std::vector<VfsDirEntry> listed;
+        QString error;
+        if (!job->vfs->list(root, &listed, &error) && failed(root, error))
+            return;
+        QStringList added;
+        for (VfsDirEntry& entry : listed) {
+            QString name = job->folder.isEmpty() ? std::move(entry.name) : job->folder + '/' + entry.name;
+            if (entry.stat.isDir() && !job->knownFolders.contains(name))
+                added.push_back(name);
+            add(std::move(name), entry.stat);
+        }
+        for (const QString& folder : added) {
+            if (job->cancelled)
+                return;
+            QStringList errors;
+            if (!walk(folder, &errors) && !job->cancelled && failed(childPath(job->directory, folder), errors.value(0)))
+                return;
+        }
+    }
+    if (job->cancelled)
+        return;
+
+    if (stream) {
+        flush();
+        post(job, [generation, folders = std::move(folders)](ListingModel* model) {
+            if (generation == model->generation_)
+                model->folders_ = QSet<QString>(folders.begin(), folders.end());
+        });
+    } else {
+        post(job, [generation, records = std::move(records), folders = std::move(folders), folderOnly = job->folderOnly, folder = job->folder](ListingModel* model) mutable {
+            model->reconcileFlat(generation, records, folders, folderOnly, folder);
+        });
+    }
+    finish(QString());
+}
+
+void ListingModel::appendRecords(std::uint64_t generation, std::vector<Record>& records)
+{
+    if (generation != generation_ || records.empty())
+        return;
+    const std::uint32_t first = store_.size();
+    beginInsertRows(QModelIndex(), static_cast<int>(first), static_cast<int>(first + records.size() - 1));
+    // A streamed listing arrives in many batches; reserving for each would
+    // copy the columns every time.
+    if (first == 0) {
+        store_.reserve(static_cast<std::uint32_t>(records.size()));
+        entryByName_.reserve(static_cast<qsizetype>(records.size()));
+    }
+    for (const Record& record : records)
+        entryByName_.insert(record.name, store_.id(store_.append(record.name, record.stat, record.flags)));
+    endInsertRows();
+}
+
+void ListingModel::applyStats(std::uint64_t generation, const std::vector<StatUpdate>& updates)
+{
+    if (generation != generation_)
+        return;
+    std::uint32_t top = UINT_MAX;
+    std::uint32_t bottom = 0;
+    for (const StatUpdate& update : updates) {
+        if (update.entry >= store_.size())
+            continue;
+        store_.setStat(update.entry, update.stat, update.flags);
+        top = std::min(top, update.entry);
+        bottom = std::max(bottom, update.entry);
+    }
+    if (top <= bottom)
+        emit dataChanged(index(static_cast<int>(top), 0), index(static_cast<int>(bottom), ColumnCount - 1));
+}
+
+void ListingModel::reconcile(std::uint64_t generation, std::vector<Record>& records, const std::function<bool(QStringView name)>& inScope)
+{
+    if (generation != generation_)
+        return;
+
+    std::vector<bool> keep(store_.size(), false);
+    if (inScope) {
+        for (std::uint32_t i = 0; i < store_.size(); ++i)
+            keep[i] = !inScope(store_.nameView(i));
+    }
+    std::vector<const Record*> added;
+    std::uint32_t top = UINT_MAX;
+    std::uint32_t bottom = 0;
+    for (const Record& record : records) {
+        const auto it = entryByName_.constFind(record.name);
+        if (it == entryByName_.constEnd()) {
+            added.push_back(&record);
+            continue;
+        }
+        const std::uint32_t entry = store_.indexOfId(it.value());
+        keep[entry] = true;
+        if (store_.flags(entry) == record.flags && store_.fileSize(entry) == record.stat.size
+            && store_.mtimeNs(entry) == record.stat.mtimeNs && store_.inode(entry) == record.stat.inode
+            && store_.mode(entry) == record.stat.mode && store_.uid(entry) == record.stat.uid
+            && store_.gid(entry) == record.stat.gid)
+            continue;
+        store_.setStat(entry, record.stat, record.flags);
+        top = std::min(top, entry);
+        bottom = std::max(bottom, entry);
+    }
+    if (top <= bottom)
+        emit dataChanged(index(static_cast<int>(top), 0), index(static_cast<int>(bottom), ColumnCount - 1));
+
+    // Remove from the back, one run of adjacent rows at a time, so rows
+    // before each run keep their numbers.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> removedRuns;
+    for (std::uint32_t row = store_.size(); row > 0;) {
+        if (keep[--row])
+            continue;
+        const std::uint32_t last = row;
+        while (row > 0 && !keep[row - 1])
+            --row;
+        removedRuns.emplace_back(row, last);
+    }
+    if (!removedRuns.empty()) {
+        for (const auto& [first, last] : removedRuns) {
+            for (std::uint32_t row = first; row <= last; ++row)
+                entryByName_.remove(store_.name(row));
+        }
+        if (removedRuns.size() > static_cast<size_t>(MaxRemovedRuns)) {
+            beginResetModel();
+            store_.compact(keep);
+            endResetModel();
+        } else {
+            for (const auto& [first, last] : removedRuns) {
+                beginRemoveRows(QModelIndex(), static_cast<int>(first), static_cast<int>(last));
+                store_.erase(first, last - first + 1);
+                endRemoveRows();
+            }
+        }
+    }
+
+    if (!added.empty()) {
+        const std::uint32_t first = store_.size();
+        beginInsertRows(QModelIndex(), static_cast<int>(first), static_cast<int>(first + added.size() - 1));
+        for (const Record* record : added)
+            entryByName_.insert(record->name, store_.id(store_.append(record->name, record->stat, record->flags)));
+        endInsertRows();
+    }
+}
+
+void ListingModel::reconcileFlat(std::uint64_t generation, std::vector<Record>& records, const QStringList& folders, bool folderOnly, const QString& folder)
+{
+    if (generation != generation_)
+        return;
+    if (!folderOnly) {
+        folders_ = QSet<QString>(folders.begin(), folders.end());
+        reconcile(generation, records);
+        return;
+    }
+
+    // Subfolders of folder that are gone take everything under them along.
+    const QSet<QString> listed(folders.begin(), folders.end());
+    QStringList vanished;
+    for (const QString& known : folders_) {
+        if (folderOf(known) == folder && !listed.contains(known))
+            vanished.push_back(known + '/');
+    }
+    const auto isVanished = [&vanished](QStringView name) {
+        return std::any_of(vanished.cbegin(), vanished.cend(), [name](const QString& prefix) { return name.startsWith(prefix); });
+    };
+    if (!vanished.isEmpty()) {
+        for (auto it = folders_.begin(); it != folders_.end();) {
+            if (isVanished(QString(*it + '/')))
+                it = folders_.erase(it);
+            else
+                ++it;
+        }
+    }
+    folders_.unite(listed);
+    reconcile(generation, records, [&](QStringView name) { return folderOf(name) == folder || isVanished(name); });
+}
+
+void ListingModel::finishJob(std::uint64_t generation, const QString& error)
+{
+    if (generation != generation_)
+        return;
+    job_.reset();
+    loading_ = false;
+    if (!error.isEmpty()) {
+        refreshPending_ = false;
+        pendingFolders_.clear();
+        emit directoryLoadFailed(directory_, error);
+        return;
+    }
+    emit directoryLoaded(directory_);
+    startGitStatusJob();
+    if (mediaInfoWanted_)
+        requestAllMediaInfo();
+    if (refreshPending_) {
+        refreshPending_ = false;
+        pendingFolders_.clear();
+        startJob(true);
+    } else if (!pendingFolders_.isEmpty()) {
+        const QString folder = *pendingFolders_.cbegin();
+        pendingFolders_.remove(folder);
+        startFolderJob(folder);
+    }
+}
+
+QString ListingModel::fileName(const QModelIndex& index) const
+{
+    if (!index.isValid() || index.row() >= static_cast<int>(store_.size()))
+        return QString();
+    return baseName(store_.nameView(entryAt(index))).toString();
+}
+
+QString ListingModel::filePath(const QModelIndex& index) const
+{
+    if (!index.isValid() || index.row() >= static_cast<int>(store_.size()))
+        return QString();
+    return childPath(directory_, store_.name(entryAt(index)));
+}
+
+QModelIndex ListingModel::indexForId(std::uint32_t id) const
+{
+    const std::uint32_t entry = store_.indexOfId(id);
+    return entry == EntryStore::NoEntry ? QModelIndex() : index(static_cast<int>(entry), 0);
+}
+
+QString ListingModel::filePathForId(std::uint32_t id) const
+{
+    const std::uint32_t entry = store_.indexOfId(id);
+    return entry == EntryStore::NoEntry ? QString() : childPath(directory_, store_.name(entry));
+}
+
+bool ListingModel::isDir(const QModelIndex& index) const
+{
+    return index.isValid() && index.row() < static_cast<int>(store_.size()) && store_.isDir(entryAt(index));
+}
+
+bool ListingModel::isFileOrLink(const QModelIndex& index) const
+{
+    if (!index.isValid() || index.row() >= static_cast<int>(store_.size()))
+        return false;
+    const std::uint32_t entry = entryAt(index);
+    return !store_.isDir(entry) && (S_ISREG(store_.mode(entry)) || store_.isSymLink(entry));
+}
+
+QModelIndex ListingModel::indexForPath(const QString& path) const
+{
+    const QString prefix = directory_.endsWith('/') ? directory_ : directory_ + '/';
+    if (directory_.isEmpty() || !path.startsWith(prefix))
+        return QModelIndex();
+    const QString name = path.sliced(prefix.size());
+    if (!flat_ && name.contains('/'))
+        return QModelIndex();
+    const auto it = entryByName_.constFind(name);
+    return it == entryByName_.constEnd() ? QModelIndex() : index(static_cast<int>(store_.indexOfId(it.value())), 0);
+}
+
+const ListingModel::TypeInfo& ListingModel::typeInfo(std::uint32_t entry) const
+{
+    // Files with the same suffix share type name and icon, so the MIME
+    // database is asked once per suffix rather than once per row.
+    const QStringView name = baseName(store_.nameView(entry));
+    const qsizetype dot = name.lastIndexOf('.');
+    const QString key = store_.isDir(entry) ? QStringLiteral("/") : (dot > 0 ? name.mid(dot) : name).toString().toLower();
+    auto it = typeByKey_.find(key);
+    if (it != typeByKey_.end())
+        return it.value();
+
+    TypeInfo info;
+    if (store_.isDir(entry)) {
+        info.name = QStringLiteral("Folder");
+        info.icon = iconProvider_.icon(QFileIconProvider::Folder);
+    } else {
+        const QMimeType mime = QMimeDatabase().mimeTypeForFile(name.toString(), QMimeDatabase::MatchExtension);
+        info.name = mime.comment();
+        info.icon = QIcon::fromTheme(mime.iconName(), QIcon::fromTheme(mime.genericIconName(), iconProvider_.icon(QFileIconProvider::File)));
+    }
+    return typeByKey_.insert(key, info).value();
+}
+
+QString ListingModel::accountName(AccountNames::Kind kind, std::uint32_t entry) const
+{
+    // Catalogs, archives and queries have no owners to show.
+    if (!store_.hasStat(entry) || vfs_.get() != &Vfs::native())
+        return QString();
+    const std::uint32_t id = kind == AccountNames::Kind::User ? store_.uid(entry) : store_.gid(entry);
+    const QString name = accountNames_.name(kind, id);
+    return name.isNull() ? QString::number(id) : name;
+}
+
+QString ListingModel::ownerName(std::uint32_t entry) const
+{
+    return accountName(AccountNames::Kind::User, entry);
+}
+
+QString ListingModel::groupName(std::uint32_t entry) const
+{
+    return accountName(AccountNames::Kind::Group, entry);
+}
+
+void ListingModel::updateAccountNames(const QSet<std::uint32_t>& users, const QSet<std::uint32_t>& groups)
+{
+    int first = -1;
+    int last = -1;
+    for (std::uint32_t entry = 0; entry < store_.size(); ++entry) {
+        if (!users.contains(store_.uid(entry)) && !groups.contains(store_.gid(entry)))
+            continue;
+        if (first < 0)
+            first = static_cast<int>(entry);
+        last = static_cast<int>(entry);
+    }
+    if (first >= 0)
+        emit dataChanged(index(first, OwnerColumn), index(last, GroupColumn), {Qt::DisplayRole});
+}
+
+GitStatus::State ListingModel::gitState(std::uint32_t entry) const
+{
+    const auto it = gitStates_.constFind(store_.id(entry));
+    return it == gitStates_.constEnd() ? GitStatus::State::Unknown : it.value();
+}
+
+bool ListingModel::hasMediaInfo(std::uint32_t entry) const
+{
+    // Only files on disk can be read, and their stat is the cache key.
+    return vfs_.get() == &Vfs::native() && store_.hasStat(entry) && !store_.isDir(entry)
+        && MediaInfo::canRead(baseName(store_.nameView(entry)));
+}
+
+MediaInfoLoader::Request ListingModel::mediaInfoRequest(std::uint32_t entry) const
+{
+    return {store_.id(entry), store_.device(entry), store_.inode(entry), store_.mtimeNs(entry), childPath(directory_, store_.name(entry))};
+}
+
+const MediaInfo* ListingModel::mediaInfo(std::uint32_t entry) const
+{
+    return hasMediaInfo(entry) ? mediaInfo_.info(store_.device(entry), store_.inode(entry), store_.mtimeNs(entry)) : nullptr;
+}
+
+void ListingModel::requestMediaInfo(const std::vector<std::uint32_t>& entries) const
+{
+    std::vector<MediaInfoLoader::Request> requests;
+    for (std::uint32_t entry : entries) {
+        if (entry < store_.size() && hasMediaInfo(entry) && !mediaInfo_.info(store_.device(entry), store_.inode(entry), store_.mtimeNs(entry)))
+            requests.push_back(mediaInfoRequest(entry));
+    }
+    mediaInfo_.request(requests);
+}
+
+void ListingModel::setMediaInfoWanted(bool wanted)
+{
+    if (wanted == mediaInfoWanted_)
+        return;
+    mediaInfoWanted_ = wanted;
+    if (wanted)
+        requestAllMediaInfo();
+    else
+        mediaInfo_.requestBackground({});
+}
+
+void ListingModel::requestAllMediaInfo()
+{
+    std::vector<MediaInfoLoader::Request> requests;
+    for (std::uint32_t entry = 0; entry < store_.size(); ++entry) {
+        if (hasMediaInfo(entry) && !mediaInfo_.info(store_.device(entry), store_.inode(entry), store_.mtimeNs(entry)))
+            requests.push_back(mediaInfoRequest(entry));
+    }
+    mediaInfo_.requestBackground(requests);
+}
+
+void ListingModel::updateMediaInfo(const QList<std::uint32_t>& ids)
+{
+    int first = -1;
+    int last = -1;
+    for (std::uint32_t id : ids) {
+        const std::uint32_t entry = store_.indexOfId(id);
+        if (entry == EntryStore::NoEntry)
+            continue;
+        first = first < 0 ? static_cast<int>(entry) : std::min(first, static_cast<int>(entry));
+        last = std::max(last, static_cast<int>(entry));
+    }
+    if (first < 0)
+        return;
+    emit dataChanged(index(first, DateTakenColumn), index(last, DurationColumn), {Qt::DisplayRole});
+    emit mediaInfoChanged();
+}
+
+void ListingModel::cancelGitStatusJob()
+{
+    ++gitGeneration_;
+    if (gitCancel_)
+        *gitCancel_ = true;
+    gitCancel_.reset();
+}
+
+void ListingModel::startGitStatusJob()
+{
+    cancelGitStatusJob();
+    const std::uint64_t generation = gitGeneration_;
+    gitRefreshTimer_.stop();
+    if (directory_.isEmpty() || vfs_.get() != &Vfs::native()) {
+        applyGitStates(generation, nullptr, {}, {});
+        return;
+    }
+
+    // Entries still waiting for a stat have nothing to compare yet.
+    std::vector<GitStatus::Item> items;
+    std::vector<std::uint32_t> ids;
+    items.reserve(store_.size());
+    ids.reserve(store_.size());
+    for (std::uint32_t entry = 0; entry < store_.size(); ++entry) {
+        if (!store_.hasStat(entry))
+            continue;
+        items.push_back({store_.name(entry), store_.stat(entry), store_.isDir(entry)});
+        ids.push_back(store_.id(entry));
+    }
+    gitCancel_ = std::make_shared<std::atomic_bool>(false);
+    const QPointer<ListingModel> model(this);
+    gitPool_.start([model, generation, cancel = gitCancel_, directory = directory_, previous = git_, items = std::move(items), ids = std::move(ids)] {
+        const std::shared_ptr<const GitStatus> git = GitStatus::open(directory, previous);
+        std::vector<GitStatus::State> states = git ? git->states(directory, items, cancel.get()) : std::vector<GitStatus::State>();
+        const auto deliver = [&] {
+            QMetaObject::invokeMethod(
+                model.data(),
+                [model, generation, git, ids, states] {
+                    if (model)
+                        model->applyGitStates(generation, git, ids, states);
+                },
+                Qt::QueuedConnection);
+        };
+        // The files first, then the folders, which take a stat per file under them.
+        deliver();
+        if (git && !*cancel && git->modifiedFolders(directory, items, &states, cancel.get()))
+            deliver();
+    });
+}
+
+void ListingModel::applyGitStates(std::uint64_t generation,
+                                  const std::shared_ptr<const GitStatus>& git,
+                                  const std::vector<std::uint32_t>& ids,
+                                  const std::vector<GitStatus::State>& states)
+{
+    if (generation != gitGeneration_)
+        return;
+    git_ = git;
+    // The index is replaced by a rename, which changes the git directory.
+    const QStringList watched = gitWatcher_.directories();
+    const QString gitDirectory = git ? git->gitDirectory() : QString();
+    if (watched.size() != (gitDirectory.isEmpty() ? 0 : 1) || (!watched.isEmpty() && watched.front() != gitDirectory)) {
+        if (!watched.isEmpty())
+            gitWatcher_.removePaths(watched);
+        if (!gitDirectory.isEmpty())
+            gitWatcher_.addPath(gitDirectory);
+    }
+
+    QHash<std::uint32_t, GitStatus::State> next;
+    next.reserve(static_cast<qsizetype>(states.size()));
+    for (size_t i = 0; i < states.size() && i < ids.size(); ++i) {
+        if (states[i] != GitStatus::State::Unknown)
+            next.insert(ids[i], states[i]);
+    }
+    int first = -1;
+    int last = -1;
+    for (std::uint32_t entry = 0; entry < store_.size(); ++entry) {
+        const std::uint32_t id = store_.id(entry);
+        if (gitStates_.value(id, GitStatus::State::Unknown) == next.value(id, GitStatus::State::Unknown))
+            continue;
+        if (first < 0)
+            first = static_cast<int>(entry);
+        last = static_cast<int>(entry);
+    }
+    gitStates_.swap(next);
+    if (first >= 0)
+        emit dataChanged(index(first, NameColumn), index(last, NameColumn), {GitStatusRole});
+}
+
+QString ListingModel::typeName(std::uint32_t entry) const
+{
+    return typeInfo(entry).name;
+}
+
+QIcon ListingModel::icon(std::uint32_t entry) const
+{
+    return typeInfo(entry).icon;
+}
+
+int ListingModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : static_cast<int>(store_.size());
+}
+
+int ListingModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant ListingModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= static_cast<int>(store_.size()))
+        return QVariant();
+    const std::uint32_t entry = entryAt(index);
+
+    if (role == IsDirRole)
+        return store_.isDir(entry);
+    if (role == GitStatusRole)
+        return static_cast<int>(gitState(entry));
+    if (role == Qt::DecorationRole && index.column() == NameColumn)
+        return typeInfo(entry).icon;
+    if (role == Qt::TextAlignmentRole && (index.column() == SizeColumn || index.column() == DurationColumn))
+        return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+    if (role != Qt::DisplayRole && role != Qt::ToolTipRole)
+        return QVariant();
+
+    // Until its stat arrives an entry shows only its name, type and icon.
+    switch (index.column()) {
+    case NameColumn:
+        return baseName(store_.nameView(entry)).toString();
+    case SizeColumn:
+        return store_.isDir(entry) || !store_.hasStat(entry)
+            ? QString()
+            : QLocale::system().formattedDataSize(static_cast<qint64>(store_.fileSize(entry)));
+    case TypeColumn:
+        return typeName(entry);
+    case ModifiedColumn:
+        return store_.hasStat(entry)
+            ? QLocale::system().toString(QDateTime::fromMSecsSinceEpoch(store_.mtimeNs(entry) / 1000000), QLocale::ShortFormat)
+            : QString();
+    case OwnerColumn:
+        return ownerName(entry);
+    case GroupColumn:
+        return groupName(entry);
+    case DateTakenColumn: {
+        const MediaInfo* info = mediaInfo(entry);
+        return info && info->takenNs != 0
+            ? QLocale::system().toString(QDateTime::fromMSecsSinceEpoch(info->takenNs / 1000000), QLocale::ShortFormat)
+            : QString();
+    }
+    case DimensionsColumn: {
+        const MediaInfo* info = mediaInfo(entry);
+        return info && info->width != 0 ? QString("%1 × %2").arg(info->width).arg(info->height) : QString();
+    }
+    case DurationColumn: {
+        const MediaInfo* info = mediaInfo(entry);
+        return info && info->durationMs > 0 ? formatDuration(info->durationMs) : QString();
+    }
+    case FolderColumn:
+        return folderOf(store_.nameView(entry)).toString();
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+QVariant ListingModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+    switch (section) {
+    case NameColumn:
+        return QStringLiteral("Name");
+    case SizeColumn:
+        return QStringLiteral("Size");
+    case TypeColumn:
+        return QStringLiteral("Type");
+    case ModifiedColumn:
+        return QStringLiteral("Date Modified");
+    case OwnerColumn:
+        return QStringLiteral("Owner");
+    case GroupColumn:
+        return QStringLiteral("Group");
+    case DateTakenColumn:
+        return QStringLiteral("Date Taken");
+    case DimensionsColumn:
+        return QStringLiteral("Dimensions");
+    case DurationColumn:
+        return QStringLiteral("Duration");
+    case FolderColumn:
+        return QStringLiteral("Folder");
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags ListingModel::flags(const QModelIndex& index) const
+{
+    Qt::ItemFlags result = QAbstractTableModel::flags(index);
+    if (index.isValid())
+        result |= Qt::ItemIsDragEnabled;
+    return result;
+}
+
+QStringList ListingModel::mimeTypes() const
+{
+    return {QStringLiteral("text/uri-list")};
+}
+
+QMimeData* ListingModel::mimeData(const QModelIndexList& indexes) const
+{
+    // Only local folders can be dragged out; a catalog has no files to hand over.
+    if (!directory_.startsWith('/'))
+        return nullptr;
+    auto paths = std::make_shared<PathList>(directory_);
+    for (const QModelIndex& index : indexes) {
+        if (index.isValid() && index.column() == NameColumn && index.row() < static_cast<int>(store_.size()))
+            paths->append(store_.nameView(entryAt(index)));
+    }
+    return paths->isEmpty() ? nullptr : new SelectionMimeData(std::move(paths), false);
+}
+
+Qt::DropActions ListingModel::supportedDragActions() const
+{
+    return Qt::CopyAction | Qt::MoveAction;
+}
@@ -0,0 +1,248 @@
+#ifndef LISTINGMODEL_HPP
+#define LISTINGMODEL_HPP
+
+#include <QAbstractTableModel>
+#include <QFileIconProvider>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QIcon>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+
+#include "accountnames.hpp"
+#include "entrystore.hpp"
+#include "gitstatus.hpp"
+#include "mediainfoloader.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// The entries of one directory for the file views, listed in the background
+// through a Vfs into an EntryStore.
+//
+// On local disks a directory is listed with its stats in one pass. On
+// high-latency mounts (see MountProbe) the names are listed first and shown
+// at once; the stats are then fetched by many concurrent requests and filled
+// in as they arrive, so the round trips overlap instead of adding up.
+// refresh() lists the directory again and applies only the differences, so
+// selection, current item and scroll position survive it.
+//
+// A flat listing holds every file under the directory instead, walked by a
+// ParallelWalker and streamed in as it is found. Its entry names are paths
+// relative to the directory, so the same store, name lookup and refresh
+// serve it; FolderColumn shows where each file is. refreshFolder() lists
+// one folder of the tree again, for a watcher that saw it change.
+//
+// In a git work tree each listing is followed by a GitStatus pass on the
+// pool, and again whenever the repository's git directory changes; the
+// states arrive as one dataChanged() with GitStatusRole.
+//
+// Photos and videos get DateTakenColumn, DimensionsColumn and
+// DurationColumn from a MediaInfoLoader: the views ask for the rows they
+// show, and setMediaInfoWanted() has the rest of the directory read behind
+// them, for sorting.
+class ListingModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column
+    {
+        NameColumn,
+        SizeColumn,
+        TypeColumn,
+        ModifiedColumn,
+        // Names once AccountNames has them, numeric IDs until then.
+        OwnerColumn,
+        GroupColumn,
+        // Empty until the MediaInfoLoader has read the file.
+        DateTakenColumn,
+        DimensionsColumn,
+        DurationColumn,
+        // The folder of the entry relative to the directory; flat listings only.
+        FolderColumn,
+        ColumnCount,
+    };
+
+    enum Role
+    {
+        IsDirRole = Qt::UserRole + 100,
+        // A GitStatus::State, as int.
+        GitStatusRole,
+    };
+
+    enum class LatencyMode
+    {
+        Auto,
+        Local,
+        HighLatency,
+    };
+
+    explicit ListingModel(QObject* parent = nullptr);
+    ~ListingModel() override;
+
+    // Vfs::native() when null. Running listings keep their Vfs alive.
+    void setVfs(std::shared_ptr<const Vfs> vfs);
+    const std::shared_ptr<const Vfs>& vfs() const { return vfs_; }
+    void setLatencyMode(LatencyMode mode);
+
+    // Clears the model and starts listing path, or everything under it when
+    // flat; rows arrive in batches.
+    void setDirectory(const QString& path, bool flat = false);
+    void refresh();
+    // Lists path, a folder of a flat listing, again.
+    void refreshFolder(const QString& path);
+    QString directory() const { return directory_; }
+    bool isFlat() const { return flat_; }
+    // The folders under a flat listing, as full paths.
+    QStringList folderPaths() const;
+    bool isLoading() const { return loading_; }
+
+    // A snapshot holds the directory, its entries and an opaque blob for the
+    // caller's view state. loadSnapshot() memory-maps it and shows the
+    // entries at once, with no job running; refresh() then revalidates them
+    // against the disk and applies only the differences.
+    bool saveSnapshot(const QString& file, const QByteArray& viewState, QString* error) const;
+    bool loadSnapshot(const QString& file, QByteArray* viewState);
+
+    const EntryStore& entries() const { return store_; }
+    std::uint32_t entryAt(const QModelIndex& index) const { return static_cast<std::uint32_t>(index.row()); }
+    QString fileName(const QModelIndex& index) const;
+    QString filePath(const QModelIndex& index) const;
+    bool isDir(const QModelIndex& index) const;
+    // A regular file, or a symbolic link that may lead to one: worth opening
+    // to look inside. False for FIFOs, devices, sockets and unknown types.
+    bool isFileOrLink(const QModelIndex& index) const;
+    // An invalid index unless path is a listed entry of the directory.
+    QModelIndex indexForPath(const QString& path) const;
+    // Entries by EntryStore::id(), which survives refreshes; invalid or
+    // empty once the entry is gone.
+    QModelIndex indexForId(std::uint32_t id) const;
+    QString filePathForId(std::uint32_t id) const;
+    QString typeName(std::uint32_t entry) const;
+    QIcon icon(std::uint32_t entry) const;
+    // The user or group name, or the ID while the name is looked up; empty
+    // without a stat or off the local filesystem.
+    QString ownerName(std::uint32_t entry) const;
+    QString groupName(std::uint32_t entry) const;
+    // Unknown outside a work tree and until the status pass has run.
+    GitStatus::State gitState(std::uint32_t entry) const;
+    // Null for files that aren't photos or videos, and until read.
+    const MediaInfo* mediaInfo(std::uint32_t entry) const;
+    // Entries a view shows, most urgent first; replaces the last request.
+    void requestMediaInfo(const std::vector<std::uint32_t>& entries) const;
+    // Whether every photo and video of the directory is to be read, such as
+    // for a sort, now and after each load.
+    void setMediaInfoWanted(bool wanted);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
+    QStringList mimeTypes() const override;
+    // A SelectionMimeData over the dragged names; see there.
+    QMimeData* mimeData(const QModelIndexList& indexes) const override;
+    Qt::DropActions supportedDragActions() const override;
+
+signals:
+    void directoryLoaded(const QString& path);
+    // After the dataChanged() for the media columns of a batch.
+    void mediaInfoChanged();
+    void directoryLoadFailed(const QString& path, const QString& error);
+
+private:
+    struct Job;
+
+    struct Record
+    {
+        QString name;
+        VfsStat stat;
+        std::uint8_t flags = 0;
+    };
+
+    struct StatUpdate
+    {
+        std::uint32_t entry = 0;
+        VfsStat stat;
+        std::uint8_t flags = 0;
+    };
+
+    struct TypeInfo
+    {
+        QString name;
+        QIcon icon;
+    };
+
+    std::shared_ptr<Job> makeJob(bool reconcile);
+    void startJob(bool reconcile);
+    // A flat refresh of folder, relative to the directory, alone.
+    void startFolderJob(const QString& folder);
+    void launchJob(const std::shared_ptr<Job>& job);
+    void cancelJob();
+    template<typename Call>
+    static void post(const std::shared_ptr<Job>& job, Call call);
+    static void runJob(const std::shared_ptr<Job>& job);
+    static void runFlatJob(const std::shared_ptr<Job>& job);
+    void appendRecords(std::uint64_t generation, std::vector<Record>& records);
+    void applyStats(std::uint64_t generation, const std::vector<StatUpdate>& updates);
+    // Entries for which inScope is false are kept even when not in records.
+    void reconcile(std::uint64_t generation, std::vector<Record>& records, const std::function<bool(QStringView name)>& inScope = {});
+    void reconcileFlat(std::uint64_t generation, std::vector<Record>& records, const QStringList& folders, bool folderOnly, const QString& folder);
+    void finishJob(std::uint64_t generation, const QString& error);
+    const TypeInfo& typeInfo(std::uint32_t entry) const;
+    QString accountName(AccountNames::Kind kind, std::uint32_t entry) const;
+    // One dataChanged over the rows owned by any of the IDs.
+    void updateAccountNames(const QSet<std::uint32_t>& users, const QSet<std::uint32_t>& groups);
+    MediaInfoLoader::Request mediaInfoRequest(std::uint32_t entry) const;
+    bool hasMediaInfo(std::uint32_t entry) const;
+    void requestAllMediaInfo();
+    void updateMediaInfo(const QList<std::uint32_t>& ids);
+    void cancelGitStatusJob();
+    void startGitStatusJob();
+    void applyGitStates(std::uint64_t generation,
+                        const std::shared_ptr<const GitStatus>& git,
+                        const std::vector<std::uint32_t>& ids,
+                        const std::vector<GitStatus::State>& states);
+
+    std::shared_ptr<const Vfs> vfs_;
+    LatencyMode latencyMode_ = LatencyMode::Auto;
+    QString directory_;
+    bool flat_ = false;
+    // Relative to directory_.
+    QSet<QString> folders_;
+    QSet<QString> pendingFolders_;
+    EntryStore store_;
+    // Entry IDs by name within directory_, the only parent a listing has
+    // (a flat listing's names hold their folder). IDs outlive removals, so
+    // only the names removed need erasing.
+    QHash<QString, std::uint32_t> entryByName_;
+    std::uint64_t generation_ = 0;
+    std::shared_ptr<Job> job_;
+    bool loading_ = false;
+    bool refreshPending_ = false;
+    QFileIconProvider iconProvider_;
+    mutable QHash<QString, TypeInfo> typeByKey_;
+    mutable AccountNames accountNames_;
+    mutable MediaInfoLoader mediaInfo_;
+    bool mediaInfoWanted_ = false;
+    // The last work tree opened, reused while its index is unchanged.
+    std::shared_ptr<const GitStatus> git_;
+    // By entry ID; entries missing are Unknown.
+    QHash<std::uint32_t, GitStatus::State> gitStates_;
+    std::uint64_t gitGeneration_ = 0;
+    // Set to give up the git job under way.
+    std::shared_ptr<std::atomic_bool> gitCancel_;
+    QFileSystemWatcher gitWatcher_;
+    // git rewrites several files per command; one pass after the last.
+    QTimer gitRefreshTimer_;
+    // Git status reads files to hash them; kept off the listing threads.
+    QThreadPool gitPool_;
+    // Last, so it is destroyed first: its destructor waits for running jobs.
+    QThreadPool pool_;
+};
+
+#endif // LISTINGMODEL_HPP
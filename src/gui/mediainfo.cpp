@@ -0,0 +1,610 @@
+#include "mediainfo.hpp"
+
+#include <QDate>
+#include <QDateTime>
+#include <QFile>
+#include <QSet>
+#include <QTime>
+
+#include "scopedfd.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace {
+
+// An EXIF block is at most one JPEG segment.
+constexpr size_t MaxExifBytes = 64 * 1024;
+constexpr std::uint64_t MaxMetaBytes = 1 << 20;
+// A moov box grows with the length of the video; hours of it fit in this.
+constexpr std::uint64_t MaxMoovBytes = 32 << 20;
+constexpr int MaxTopLevelBoxes = 1024;
+constexpr int MaxPngChunks = 256;
+// Segments and fill bytes before the frame header.
+constexpr int MaxJpegMarkers = 1024;
+// MP4 times count seconds from 1904.
+constexpr std::int64_t Mp4EpochOffset = 2082844800;
+
+constexpr std::uint32_t fourCc(const char (&text)[5])
+{
+    return (std::uint32_t(std::uint8_t(text[0])) << 24) | (std::uint32_t(std::uint8_t(text[1])) << 16)
+        | (std::uint32_t(std::uint8_t(text[2])) << 8) | std::uint8_t(text[3]);
+}
+
+std::uint16_t readBe16(const unsigned char* data)
+{
+    return static_cast<std::uint16_t>((data[0] << 8) | data[1]);
+}
+
+std::uint32_t readBe32(const unsigned char* data)
+{
+    return (std::uint32_t(data[0]) << 24) | (std::uint32_t(data[1]) << 16) | (std::uint32_t(data[2]) << 8) | data[3];
+}
+
+class File
+{
+public:
+    explicit File(const QString& path)
+        // Non-blocking, so a FIFO named like a photo can't hang the loader.
+        : fd_(::open(QFile::encodeName(path).constData(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC))
+    {
+        struct stat st {};
+        if (fd_.isValid() && ::fstat(fd_.get(), &st) == 0 && S_ISREG(st.st_mode))
+            size_ = std::uint64_t(st.st_size);
+    }
+
+    std::uint64_t size() const { return size_; }
+
+    bool read(std::uint64_t offset, void* data, size_t size) const
+    {
+        if (offset > size_ || size > size_ - offset)
+            return false;
+        auto* out = static_cast<char*>(data);
+        while (size > 0) {
+            const ssize_t got = ::pread(fd_.get(), out, size, static_cast<off_t>(offset));
+            if (got <= 0)
+                return false;
+            out += got;
+            offset += std::uint64_t(got);
+            size -= size_t(got);
+        }
+        return true;
+    }
+
+    // Empty when the range isn't in the file.
+    std::vector<unsigned char> read(std::uint64_t offset, std::uint64_t size) const
+    {
+        std::vector<unsigned char> data(size);
+        if (!read(offset, data.data(), data.size()))
+            data.clear();
+        return data;
+    }
+
+private:
+    ScopedFd fd_;
+    std::uint64_t size_ = 0;
+};
+
+// Big-endian fields off a buffer; reading past the end leaves ok false.
+struct Cursor
+{
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    bool ok = true;
+
+    std::uint64_t read(int bytes)
+    {
+        if (size - pos < size_t(bytes)) {
+            ok = false;
+            return 0;
+        }
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value = (value << 8) | data[pos++];
+        return value;
+    }
+
+    void skip(size_t bytes)
+    {
+        if (size - pos < bytes)
+            ok = false;
+        else
+            pos += bytes;
+    }
+};
+
+// The boxes of an ISO base media buffer: type, payload, payload size.
+template<typename Visit>
+void forEachBox(const unsigned char* data, size_t size, Visit visit)
+{
+    size_t pos = 0;
+    while (size - pos >= 8) {
+        std::uint64_t boxSize = readBe32(data + pos);
+        const std::uint32_t type = readBe32(data + pos + 4);
+        size_t header = 8;
+        if (boxSize == 1) {
+            if (size - pos < 16)
+                return;
+            boxSize = (std::uint64_t(readBe32(data + pos + 8)) << 32) | readBe32(data + pos + 12);
+            header = 16;
+        } else if (boxSize == 0) {
+            boxSize = size - pos;
+        }
+        if (boxSize < header || boxSize > size - pos)
+            return;
+        visit(type, data + pos + header, size_t(boxSize) - header);
+        pos += size_t(boxSize);
+    }
+}
+
+struct Exif
+{
+    std::int64_t takenNs = 0;
+    int orientation = 1;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+};
+
+// "2024:05:17 14:03:59", with an offset such as "+02:00" if one was recorded.
+std::int64_t parseExifDate(const QByteArray& text, const QByteArray& offset)
+{
+    if (text.size() < 19)
+        return 0;
+    const auto number = [&text](int pos, int length) {
+        int value = 0;
+        for (int i = pos; i < pos + length; ++i) {
+            if (text.at(i) < '0' || text.at(i) > '9')
+                return -1;
+            value = value * 10 + (text.at(i) - '0');
+        }
+        return value;
+    };
+    const int year = number(0, 4);
+    const int month = number(5, 2);
+    const int day = number(8, 2);
+    const int hour = number(11, 2);
+    const int minute = number(14, 2);
+    const int second = number(17, 2);
+    const QDate date(year, month, day);
+    const QTime time(hour, minute, second);
+    // Cameras without a clock write zeros.
+    if (year <= 0 || !date.isValid() || !time.isValid())
+        return 0;
+
+    if (offset.size() >= 6 && (offset.at(0) == '+' || offset.at(0) == '-') && offset.at(3) == ':') {
+        const int offsetHours = (offset.at(1) - '0') * 10 + (offset.at(2) - '0');
+        const int offsetMinutes = (offset.at(4) - '0') * 10 + (offset.at(5) - '0');
+        const int sign = offset.at(0) == '-' ? -1 : 1;
+        const std::chrono::sys_days days = std::chrono::year(year) / std::chrono::month(unsigned(month)) / std::chrono::day(unsigned(day));
+        const std::int64_t seconds = std::int64_t(days.time_since_epoch().count()) * 86400 + hour * 3600 + minute * 60 + second
+            - sign * (offsetHours * 3600 + offsetMinutes * 60);
+        return seconds * 1000000000LL;
+    }
+    return QDateTime(date, time).toMSecsSinceEpoch() * 1000000LL;
+}
+
+// data starts at the TIFF header: "II*\0" or "MM\0*".
+void readExif(const unsigned char* data, size_t size, Exif* exif)
+{
+    if (size < 8)
+        return;
+    const bool little = data[0] == 'I' && data[1] == 'I';
+    if (!little && !(data[0] == 'M' && data[1] == 'M'))
+        return;
+    const auto u16 = [&](size_t pos) -> std::uint32_t {
+        if (pos + 2 > size)
+            return 0;
+        return little ? data[pos] | (data[pos + 1] << 8) : readBe16(data + pos);
+    };
+    const auto u32 = [&](size_t pos) -> std::uint32_t {
+        if (pos + 4 > size)
+            return 0;
+        return little ? data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16) | (std::uint32_t(data[pos + 3]) << 24)
+                      : readBe32(data + pos);
+    };
+    if (u16(2) != 42)
+        return;
+
+    enum : std::uint16_t
+    {
+        ShortType = 3,
+        LongType = 4,
+    };
+    const auto integer = [&](std::uint32_t type, size_t value) {
+        return type == ShortType ? u16(value) : type == LongType ? u32(value) : 0;
+    };
+    const auto ascii = [&](std::uint32_t count, size_t value) {
+        const size_t pos = count <= 4 ? value : u32(value);
+        if (count == 0 || pos >= size || count > size - pos)
+            return QByteArray();
+        return QByteArray(reinterpret_cast<const char*>(data + pos), qsizetype(count)).trimmed();
+    };
+    const auto forEachTag = [&](std::uint32_t ifd, auto visit) {
+        const std::uint32_t count = u16(ifd);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            const size_t entry = size_t(ifd) + 2 + 12 * size_t(i);
+            if (entry + 12 > size)
+                return;
+            visit(u16(entry), u16(entry + 2), u32(entry + 4), entry + 8);
+        }
+    };
+
+    QByteArray dateTime;
+    QByteArray dateTimeOriginal;
+    QByteArray offsetTimeOriginal;
+    std::uint32_t exifIfd = 0;
+    forEachTag(u32(4), [&](std::uint32_t tag, std::uint32_t type, std::uint32_t count, size_t value) {
+        if (tag == 0x0112)
+            exif->orientation = int(integer(type, value));
+        else if (tag == 0x0132)
+            dateTime = ascii(count, value);
+        else if (tag == 0x8769)
+            exifIfd = integer(type, value);
+    });
+    if (exifIfd != 0) {
+        forEachTag(exifIfd, [&](std::uint32_t tag, std::uint32_t type, std::uint32_t count, size_t value) {
+            if (tag == 0x9003)
+                dateTimeOriginal = ascii(count, value);
+            else if (tag == 0x9011)
+                offsetTimeOriginal = ascii(count, value);
+            else if (tag == 0xa002)
+                exif->width = integer(type, value);
+            else if (tag == 0xa003)
+                exif->height = integer(type, value);
+        });
+    }
+    exif->takenNs = dateTimeOriginal.isEmpty() ? parseExifDate(dateTime, QByteArray()) : parseExifDate(dateTimeOriginal, offsetTimeOriginal);
+}
+
+void setImage(MediaInfo* info, std::uint32_t width, std::uint32_t height, const Exif& exif, bool rotated)
+{
+    if (width == 0 || height == 0) {
+        width = exif.width;
+        height = exif.height;
+    }
+    // Orientations 5 to 8 turn the image on its side.
+    if (rotated || (exif.orientation >= 5 && exif.orientation <= 8))
+        std::swap(width, height);
+    info->width = width;
+    info->height = height;
+    info->takenNs = exif.takenNs;
+}
+
+bool readJpeg(const File& file, MediaInfo* info)
+{
+    unsigned char head[6];
+    if (!file.read(0, head, 2) || head[0] != 0xff || head[1] != 0xd8)
+        return false;
+
+    Exif exif;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::uint64_t offset = 2;
+    // EXIF comes before the frame header, and both before the image data.
+    for (int i = 0; i < MaxJpegMarkers && file.read(offset, head, 4) && head[0] == 0xff; ++i) {
+        const unsigned char marker = head[1];
+        if (marker == 0xff) {
+            ++offset;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8)) {
+            offset += 2;
+            continue;
+        }
+        if (marker == 0xd9 || marker == 0xda)
+            break;
+        const std::uint16_t length = readBe16(head + 2);
+        if (length < 2)
+            break;
+        if (marker == 0xe1 && exif.takenNs == 0 && length > 8 && file.read(offset + 4, head, 6)
+            && std::memcmp(head, "Exif\0\0", 6) == 0) {
+            const std::vector<unsigned char> data = file.read(offset + 10, length - 8);
+            readExif(data.data(), data.size(), &exif);
+        } else if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+            unsigned char frame[5];
+            if (file.read(offset + 4, frame, sizeof(frame))) {
+                height = readBe16(frame + 1);
+                width = readBe16(frame + 3);
+            }
+            break;
+        }
+        offset += 2 + std::uint64_t(length);
+    }
+    setImage(info, width, height, exif, false);
+    return true;
+}
+
+bool readPng(const File& file, MediaInfo* info)
+{
+    static constexpr unsigned char Signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    unsigned char head[24];
+    if (!file.read(0, head, sizeof(head)) || std::memcmp(head, Signature, 8) != 0 || readBe32(head + 12) != fourCc("IHDR"))
+        return false;
+    const std::uint32_t width = readBe32(head + 16);
+    const std::uint32_t height = readBe32(head + 20);
+
+    Exif exif;
+    std::uint64_t offset = 8 + 8 + std::uint64_t(readBe32(head + 8)) + 4;
+    for (int i = 0; i < MaxPngChunks && file.read(offset, head, 8); ++i) {
+        const std::uint32_t length = readBe32(head);
+        const std::uint32_t type = readBe32(head + 4);
+        if (type == fourCc("IDAT") || type == fourCc("IEND"))
+            break;
+        if (type == fourCc("eXIf") && length <= MaxExifBytes) {
+            const std::vector<unsigned char> data = file.read(offset + 8, length);
+            readExif(data.data(), data.size(), &exif);
+            break;
+        }
+        offset += 12 + std::uint64_t(length);
+    }
+    setImage(info, width, height, exif, false);
+    return true;
+}
+
+// The payload of an image file's meta box.
+void readHeif(const File& file, const std::vector<unsigned char>& meta, MediaInfo* info)
+{
+    if (meta.size() < 4)
+        return;
+    const unsigned char* data = meta.data() + 4;
+    const size_t size = meta.size() - 4;
+
+    std::uint32_t primary = 0;
+    std::uint32_t exifItem = 0;
+    const unsigned char* iloc = nullptr;
+    size_t ilocSize = 0;
+    // Of the ipco properties, in order; ipma counts them from 1.
+    std::vector<std::pair<const unsigned char*, size_t>> properties;
+    std::vector<std::uint32_t> propertyTypes;
+    std::vector<std::uint16_t> primaryProperties;
+    forEachBox(data, size, [&](std::uint32_t type, const unsigned char* payload, size_t payloadSize) {
+        Cursor box{payload, payloadSize};
+        if (type == fourCc("pitm")) {
+            const int version = int(box.read(1));
+            box.skip(3);
+            primary = std::uint32_t(box.read(version == 0 ? 2 : 4));
+        } else if (type == fourCc("iinf")) {
+            const int version = int(box.read(1));
+            box.skip(3);
+            box.skip(version == 0 ? 2 : 4);
+            if (!box.ok)
+                return;
+            forEachBox(payload + box.pos, payloadSize - box.pos, [&](std::uint32_t entryType, const unsigned char* entry, size_t entrySize) {
+                Cursor infe{entry, entrySize};
+                const int infeVersion = int(infe.read(1));
+                infe.skip(3);
+                if (entryType != fourCc("infe") || infeVersion < 2)
+                    return;
+                const std::uint32_t id = std::uint32_t(infe.read(infeVersion == 2 ? 2 : 4));
+                infe.skip(2);
+                if (infe.read(4) == fourCc("Exif") && infe.ok && exifItem == 0)
+                    exifItem = id;
+            });
+        } else if (type == fourCc("iloc")) {
+            iloc = payload;
+            ilocSize = payloadSize;
+        } else if (type == fourCc("iprp")) {
+            forEachBox(payload, payloadSize, [&](std::uint32_t childType, const unsigned char* child, size_t childSize) {
+                if (childType == fourCc("ipco")) {
+                    forEachBox(child, childSize, [&](std::uint32_t propertyType, const unsigned char* property, size_t propertySize) {
+                        propertyTypes.push_back(propertyType);
+                        properties.emplace_back(property, propertySize);
+                    });
+                } else if (childType == fourCc("ipma")) {
+                    Cursor ipma{child, childSize};
+                    const int version = int(ipma.read(1));
+                    const bool wide = ipma.read(3) & 1;
+                    const std::uint64_t count = ipma.read(4);
+                    for (std::uint64_t i = 0; i < count && ipma.ok; ++i) {
+                        const std::uint32_t id = std::uint32_t(ipma.read(version < 1 ? 2 : 4));
+                        const int associations = int(ipma.read(1));
+                        for (int j = 0; j < associations && ipma.ok; ++j) {
+                            const std::uint16_t index = wide ? std::uint16_t(ipma.read(2) & 0x7fff) : std::uint16_t(ipma.read(1) & 0x7f);
+                            if (id == primary)
+                                primaryProperties.push_back(index);
+                        }
+                    }
+                }
+            });
+        }
+    });
+
+    // The primary item's size, or failing that the first one given.
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    bool rotated = false;
+    const auto useProperty = [&](size_t index) {
+        Cursor property{properties[index].first, properties[index].second};
+        if (propertyTypes[index] == fourCc("ispe") && width == 0) {
+            property.skip(4);
+            width = std::uint32_t(property.read(4));
+            height = std::uint32_t(property.read(4));
+            if (!property.ok)
+                width = height = 0;
+        } else if (propertyTypes[index] == fourCc("irot")) {
+            const int angle = int(property.read(1) & 3);
+            rotated = angle == 1 || angle == 3;
+        }
+    };
+    for (std::uint16_t index : primaryProperties) {
+        if (index > 0 && index <= properties.size())
+            useProperty(index - 1);
+    }
+    for (size_t i = 0; i < properties.size() && width == 0; ++i) {
+        if (propertyTypes[i] == fourCc("ispe"))
+            useProperty(i);
+    }
+
+    // Where the Exif item is in the file: its first extent.
+    Exif exif;
+    if (exifItem != 0 && iloc) {
+        Cursor box{iloc, ilocSize};
+        const int version = int(box.read(1));
+        box.skip(3);
+        const std::uint64_t sizes = box.read(2);
+        const int offsetSize = int(sizes >> 12) & 0xf;
+        const int lengthSize = int(sizes >> 8) & 0xf;
+        const int baseOffsetSize = int(sizes >> 4) & 0xf;
+        const int indexSize = version >= 1 ? int(sizes & 0xf) : 0;
+        const std::uint64_t count = box.read(version < 2 ? 2 : 4);
+        for (std::uint64_t i = 0; i < count && box.ok; ++i) {
+            const std::uint32_t id = std::uint32_t(box.read(version < 2 ? 2 : 4));
+            const int method = version >= 1 ? int(box.read(2) & 0xf) : 0;
+            box.skip(2);
+            const std::uint64_t baseOffset = box.read(baseOffsetSize);
+            const std::uint64_t extents = box.read(2);
+            for (std::uint64_t j = 0; j < extents && box.ok; ++j) {
+                box.read(indexSize);
+                const std::uint64_t offset = box.read(offsetSize);
+                const std::uint64_t length = box.read(lengthSize);
+                // Only data in the file itself, not in an idat box.
+                if (id != exifItem || j != 0 || method != 0 || !box.ok)
+                    continue;
+                const std::vector<unsigned char> item = file.read(baseOffset + offset, std::min<std::uint64_t>(length, MaxExifBytes));
+                // Prefixed with the offset of the TIFF header.
+                if (item.size() > 4) {
+                    const std::uint32_t header = readBe32(item.data());
+                    if (header < item.size() - 4)
+                        readExif(item.data() + 4 + header, item.size() - 4 - header, &exif);
+                }
+            }
+        }
+    }
+    setImage(info, width, height, exif, rotated);
+}
+
+// The payload of a moov box.
+void readMovie(const std::vector<unsigned char>& moov, MediaInfo* info)
+{
+    forEachBox(moov.data(), moov.size(), [&](std::uint32_t type, const unsigned char* payload, size_t payloadSize) {
+        Cursor box{payload, payloadSize};
+        if (type == fourCc("mvhd")) {
+            const int bytes = box.read(1) == 1 ? 8 : 4;
+            box.skip(3);
+            const std::uint64_t created = box.read(bytes);
+            box.read(bytes);
+            const std::uint64_t timescale = box.read(4);
+            const std::uint64_t duration = box.read(bytes);
+            if (!box.ok)
+                return;
+            if (created > std::uint64_t(Mp4EpochOffset))
+                info->takenNs = (std::int64_t(created) - Mp4EpochOffset) * 1000000000LL;
+            // All ones for "unknown".
+            if (timescale != 0 && duration != (bytes == 8 ? ~std::uint64_t(0) : 0xffffffffu))
+                info->durationMs = std::int64_t(duration / timescale * 1000 + duration % timescale * 1000 / timescale);
+        } else if (type == fourCc("trak") && info->width == 0) {
+            // The first track with a picture: audio tracks have no size.
+            forEachBox(payload, payloadSize, [&](std::uint32_t childType, const unsigned char* child, size_t childSize) {
+                if (childType != fourCc("tkhd"))
+                    return;
+                Cursor tkhd{child, childSize};
+                const int bytes = tkhd.read(1) == 1 ? 8 : 4;
+                tkhd.skip(3);
+                tkhd.skip(size_t(bytes) * 2 + 8 + size_t(bytes) + 16);
+                const std::int32_t a = std::int32_t(tkhd.read(4));
+                const std::int32_t b = std::int32_t(tkhd.read(4));
+                tkhd.skip(28);
+                // 16.16 fixed point.
+                std::uint32_t width = std::uint32_t(tkhd.read(4) >> 16);
+                std::uint32_t height = std::uint32_t(tkhd.read(4) >> 16);
+                if (!tkhd.ok || width == 0 || height == 0)
+                    return;
+                // Turned a quarter either way.
+                if (a == 0 && b != 0)
+                    std::swap(width, height);
+                info->width = width;
+                info->height = height;
+            });
+        }
+    });
+}
+
+bool readIsoMedia(const File& file, MediaInfo* info)
+{
+    bool isImage = false;
+    bool found = false;
+    std::uint64_t metaOffset = 0;
+    std::uint64_t metaSize = 0;
+    std::uint64_t moovOffset = 0;
+    std::uint64_t moovSize = 0;
+    std::uint64_t offset = 0;
+    unsigned char head[16];
+    for (int i = 0; i < MaxTopLevelBoxes && file.read(offset, head, 8); ++i) {
+        std::uint64_t size = readBe32(head);
+        const std::uint32_t type = readBe32(head + 4);
+        std::uint64_t header = 8;
+        if (size == 1) {
+            if (!file.read(offset + 8, head + 8, 8))
+                break;
+            size = (std::uint64_t(readBe32(head + 8)) << 32) | readBe32(head + 12);
+            header = 16;
+        } else if (size == 0) {
+            size = file.size() - offset;
+        }
+        if (size < header || size > file.size() - offset)
+            break;
+        if (i == 0 && type != fourCc("ftyp") && type != fourCc("moov") && type != fourCc("mdat") && type != fourCc("wide")
+            && type != fourCc("free") && type != fourCc("skip"))
+            return false;
+
+        if (type == fourCc("ftyp") && size - header <= 256) {
+            // The major brand, minor version and compatible brands.
+            const std::vector<unsigned char> brands = file.read(offset + header, size - header);
+            for (size_t pos = 0; pos + 4 <= brands.size(); pos += 4) {
+                const std::uint32_t brand = readBe32(brands.data() + pos);
+                if (pos != 4 && (brand == fourCc("mif1") || brand == fourCc("heic") || brand == fourCc("heix") || brand == fourCc("avif")))
+                    isImage = true;
+            }
+        } else if (type == fourCc("meta")) {
+            metaOffset = offset + header;
+            metaSize = size - header;
+        } else if (type == fourCc("moov")) {
+            moovOffset = offset + header;
+            moovSize = size - header;
+        }
+        offset += size;
+    }
+
+    if (isImage && metaSize > 0 && metaSize <= MaxMetaBytes) {
+        readHeif(file, file.read(metaOffset, metaSize), info);
+        found = true;
+    } else if (moovSize > 0 && moovSize <= MaxMoovBytes) {
+        readMovie(file.read(moovOffset, moovSize), info);
+        found = true;
+    }
+    return found;
+}
+
+} // namespace
+
+bool MediaInfo::canRead(QStringView name)
+{
+    static const QSet<QString> suffixes = {
+        QStringLiteral("jpg"), QStringLiteral("jpeg"), QStringLiteral("jpe"), QStringLiteral("jfif"), QStringLiteral("png"),
+        QStringLiteral("heic"), QStringLiteral("heif"), QStringLiteral("hif"), QStringLiteral("avif"), QStringLiteral("mp4"),
+        QStringLiteral("m4v"), QStringLiteral("mov"), QStringLiteral("3gp"),
+    };
+    const qsizetype dot = name.lastIndexOf('.');
+    return dot > 0 && suffixes.contains(name.sliced(dot + 1).toString().toLower());
+}
+
+bool MediaInfo::read(const QString& path, MediaInfo* info)
+{
+    *info = MediaInfo();
+    const File file(path);
+    unsigned char magic[4];
+    if (!file.read(0, magic, sizeof(magic)))
+        return false;
+    // By content rather than suffix: phones save HEIF as .jpg and the like.
+    if (magic[0] == 0xff && magic[1] == 0xd8)
+        return readJpeg(file, info);
+    if (magic[0] == 0x89 && magic[1] == 'P')
+        return readPng(file, info);
+    return readIsoMedia(file, info);
+}
@@ -0,0 +1,36 @@
+#ifndef MEDIAINFO_HPP
+#define MEDIAINFO_HPP
+
+#include <QString>
+#include <QStringView>
+
+#include <cstdint>
+
+// Capture date, pixel size and duration of a photo or video, read from its
+// headers alone: nothing is decoded, and a read takes a few small preads.
+//
+//     JPEG   the SOF segment, and EXIF from APP1
+//     PNG    IHDR, and EXIF from an eXIf chunk before the image data
+//     HEIF   the primary item's ispe and irot, and its Exif item (also AVIF)
+//     MP4    mvhd and the first video track's tkhd (also MOV and 3GP)
+//
+// Width and height are as displayed, after the EXIF orientation or the
+// rotation of the track.
+struct MediaInfo
+{
+    // Since the epoch; 0 when unknown. EXIF dates without an offset are
+    // taken as local time.
+    std::int64_t takenNs = 0;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::int64_t durationMs = 0;
+
+    bool isEmpty() const { return takenNs == 0 && width == 0 && height == 0 && durationMs == 0; }
+
+    // Whether name has the suffix of a format read() understands.
+    static bool canRead(QStringView name);
+    // False when path can't be opened or isn't in one of the formats.
+    static bool read(const QString& path, MediaInfo* info);
+};
+
+#endif // MEDIAINFO_HPP
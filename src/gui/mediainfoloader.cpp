@@ -0,0 +1,135 @@
+#include "mediainfoloader.hpp"
+
+#include <QMetaObject>
+
+#include "memorygovernor.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// Results go to the GUI thread in batches of this many, or whatever was
+// read in this time.
+constexpr size_t FlushBatch = 256;
+constexpr auto FlushInterval = std::chrono::milliseconds(100);
+// Rough memory of a cached entry with its hash node, for the MemoryGovernor.
+constexpr std::int64_t InfoBytes = 64;
+
+} // namespace
+
+MediaInfoLoader::MediaInfoLoader(QObject* parent)
+    : QObject(parent)
+{
+    // Reading them again opens every file, but only reads its header.
+    memoryHandle_ = MemoryGovernor::instance().registerCache(QStringLiteral("Media info"), 4, [this](std::int64_t target) {
+        shrink(target);
+    });
+    // Mostly waiting on small reads; a few in flight hide the latency.
+    const int threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) / 2, 1, 4);
+    for (int i = 0; i < threads; ++i)
+        threads_.emplace_back([this](std::stop_token stop) { run(stop); });
+}
+
+MediaInfoLoader::~MediaInfoLoader()
+{
+    for (std::jthread& thread : threads_)
+        thread.request_stop();
+    threads_.clear();
+    MemoryGovernor::instance().unregisterCache(memoryHandle_);
+}
+
+const MediaInfo* MediaInfoLoader::info(std::uint64_t device, std::uint64_t inode, std::int64_t mtimeNs) const
+{
+    const auto it = cache_.constFind(Key{device, inode, mtimeNs});
+    return it == cache_.constEnd() ? nullptr : &it.value();
+}
+
+void MediaInfoLoader::request(const std::vector<Request>& requests)
+{
+    std::lock_guard lock(mutex_);
+    urgent_.clear();
+    for (const Request& request : requests) {
+        const Key key{request.device, request.inode, request.mtimeNs};
+        if (!cache_.contains(key) && !read_.contains(key))
+            urgent_.push_back(request);
+    }
+    wake_.notify_all();
+}
+
+void MediaInfoLoader::requestBackground(const std::vector<Request>& requests)
+{
+    std::lock_guard lock(mutex_);
+    background_.clear();
+    read_.clear();
+    for (const Request& request : requests) {
+        if (!cache_.contains(Key{request.device, request.inode, request.mtimeNs}))
+            background_.push_back(request);
+    }
+    wake_.notify_all();
+}
+
+void MediaInfoLoader::run(std::stop_token stop)
+{
+    std::vector<Result> batch;
+    auto flushAt = std::chrono::steady_clock::now() + FlushInterval;
+    const auto flush = [this, &batch, &flushAt] {
+        QMetaObject::invokeMethod(this, [this, results = std::move(batch)] { deliver(results); }, Qt::QueuedConnection);
+        batch.clear();
+        flushAt = std::chrono::steady_clock::now() + FlushInterval;
+    };
+    for (;;) {
+        Request next;
+        {
+            std::unique_lock lock(mutex_);
+            // Hand over what there is before waiting for more.
+            if (!batch.empty() && urgent_.empty() && background_.empty()) {
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+            if (!wake_.wait(lock, stop, [this] { return !urgent_.empty() || !background_.empty(); }))
+                return;
+            std::deque<Request>& queue = urgent_.empty() ? background_ : urgent_;
+            next = std::move(queue.front());
+            queue.pop_front();
+            if (!read_.insert(Key{next.device, next.inode, next.mtimeNs}).second)
+                continue;
+        }
+        Result result{next.id, Key{next.device, next.inode, next.mtimeNs}, MediaInfo()};
+        MediaInfo::read(next.path, &result.info);
+        batch.push_back(result);
+        if (batch.size() >= FlushBatch || std::chrono::steady_clock::now() >= flushAt)
+            flush();
+    }
+}
+
+void MediaInfoLoader::deliver(const std::vector<Result>& results)
+{
+    QList<std::uint32_t> ids;
+    ids.reserve(qsizetype(results.size()));
+    for (const Result& result : results) {
+        cache_.insert(result.key, result.info);
+        ids.append(result.id);
+    }
+    reportUsage();
+    emit infoReady(ids);
+}
+
+void MediaInfoLoader::shrink(std::int64_t targetBytes)
+{
+    const qsizetype keep = qsizetype(std::max<std::int64_t>(targetBytes, 0) / InfoBytes);
+    if (cache_.size() > keep) {
+        for (auto it = cache_.begin(); it != cache_.end() && cache_.size() > keep;)
+            it = cache_.erase(it);
+        // So what was dropped is read again when asked for.
+        std::lock_guard lock(mutex_);
+        read_.clear();
+    }
+    reportUsage();
+}
+
+void MediaInfoLoader::reportUsage()
+{
+    MemoryGovernor::instance().reportUsage(memoryHandle_, cache_.size() * InfoBytes);
+}
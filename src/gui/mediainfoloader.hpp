@@ -0,0 +1,95 @@
+#ifndef MEDIAINFOLOADER_HPP
+#define MEDIAINFOLOADER_HPP
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include "mediainfo.hpp"
+
+#include <compare>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+// Reads MediaInfo on a few background threads and keeps it by device, inode
+// and modification time, so a file is read again only once it changes.
+//
+// Like the ThumbnailLoader's, the urgent queue is a priority list that
+// request() replaces with what the view shows now. Behind it is a
+// background list, such as every file of a folder sorted by date taken,
+// read only while nothing is urgent. Results arrive in batches through
+// infoReady(). The cache is one of the MemoryGovernor's.
+class MediaInfoLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Request
+    {
+        std::uint32_t id = 0;
+        std::uint64_t device = 0;
+        std::uint64_t inode = 0;
+        std::int64_t mtimeNs = 0;
+        QString path;
+    };
+
+    explicit MediaInfoLoader(QObject* parent = nullptr);
+    ~MediaInfoLoader() override;
+
+    // Null until read for this file and modification time; empty when the
+    // file had nothing to read.
+    const MediaInfo* info(std::uint64_t device, std::uint64_t inode, std::int64_t mtimeNs) const;
+    // Most urgent first.
+    void request(const std::vector<Request>& requests);
+    void requestBackground(const std::vector<Request>& requests);
+
+signals:
+    void infoReady(const QList<std::uint32_t>& ids);
+
+private:
+    // Inode numbers repeat across filesystems, so the device is part of it.
+    struct Key
+    {
+        std::uint64_t device = 0;
+        std::uint64_t inode = 0;
+        std::int64_t mtimeNs = 0;
+
+        auto operator<=>(const Key&) const = default;
+        friend size_t qHash(const Key& key, size_t seed = 0) { return qHashMulti(seed, key.device, key.inode, key.mtimeNs); }
+    };
+
+    struct Result
+    {
+        std::uint32_t id = 0;
+        Key key;
+        MediaInfo info;
+    };
+
+    void run(std::stop_token stop);
+    void deliver(const std::vector<Result>& results);
+    void shrink(std::int64_t targetBytes);
+    void reportUsage();
+
+    QHash<Key, MediaInfo> cache_;
+    int memoryHandle_ = 0;
+
+    // Shared with the threads.
+    std::mutex mutex_;
+    std::condition_variable_any wake_;
+    std::deque<Request> urgent_;
+    std::deque<Request> background_;
+    // Read since the background list was last set, so a file in both
+    // lists is read once.
+    std::set<Key> read_;
+
+    // Last, so they are joined before anything they use goes away.
+    std::vector<std::jthread> threads_;
+};
+
+#endif // MEDIAINFOLOADER_HPP
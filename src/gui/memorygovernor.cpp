@@ -0,0 +1,161 @@
+#include "memorygovernor.hpp"
+
+#include <QByteArray>
+#include <QFile>
+
+#include <algorithm>
+
+#include <unistd.h>
+
+namespace {
+
+constexpr std::int64_t MaxDefaultBudget = std::int64_t(512) * 1024 * 1024;
+constexpr std::int64_t MinDefaultBudget = std::int64_t(64) * 1024 * 1024;
+// Over budget, caches are cut to this share of it, so they don't shrink
+// again with every entry added.
+constexpr std::int64_t ShrinkPercent = 90;
+// Percent of the last 10 seconds in which some task stalled on memory.
+constexpr double PressureThreshold = 10.0;
+
+} // namespace
+
+MemoryGovernor& MemoryGovernor::instance()
+{
+    static MemoryGovernor governor;
+    return governor;
+}
+
+MemoryGovernor::MemoryGovernor()
+{
+    // An eighth of the machine's memory, within sane limits.
+    const long pages = ::sysconf(_SC_PHYS_PAGES);
+    const long pageSize = ::sysconf(_SC_PAGESIZE);
+    const std::int64_t physical = pages > 0 && pageSize > 0 ? std::int64_t(pages) * pageSize : 0;
+    budget_ = std::clamp(physical / 8, MinDefaultBudget, MaxDefaultBudget);
+}
+
+MemoryGovernor::Handle MemoryGovernor::registerCache(const QString& name, int rebuildCost, ShrinkFunction shrink)
+{
+    Cache cache;
+    cache.handle = nextHandle_++;
+    cache.name = name;
+    cache.rebuildCost = std::max(rebuildCost, 1);
+    cache.shrink = std::move(shrink);
+    caches_.push_back(std::move(cache));
+    return caches_.back().handle;
+}
+
+void MemoryGovernor::unregisterCache(Handle handle)
+{
+    const auto it = std::find_if(caches_.begin(), caches_.end(), [handle](const Cache& cache) { return cache.handle == handle; });
+    if (it == caches_.end())
+        return;
+    usage_ -= it->bytes;
+    caches_.erase(it);
+}
+
+void MemoryGovernor::reportUsage(Handle handle, std::int64_t bytes)
+{
+    const auto it = std::find_if(caches_.begin(), caches_.end(), [handle](const Cache& cache) { return cache.handle == handle; });
+    if (it == caches_.end())
+        return;
+    usage_ += bytes - it->bytes;
+    it->bytes = bytes;
+    if (usage_ > budget_)
+        shrinkTo(budget_ * ShrinkPercent / 100);
+}
+
+void MemoryGovernor::setBudget(std::int64_t bytes)
+{
+    budget_ = std::max<std::int64_t>(bytes, 0);
+    if (usage_ > budget_)
+        shrinkTo(budget_ * ShrinkPercent / 100);
+}
+
+std::vector<MemoryGovernor::CacheUsage> MemoryGovernor::cacheUsage() const
+{
+    std::vector<CacheUsage> result;
+    result.reserve(caches_.size());
+    for (const Cache& cache : caches_)
+        result.push_back({cache.name, cache.bytes});
+    return result;
+}
+
+void MemoryGovernor::checkPressure()
+{
+    if (pressureUnavailable_)
+        return;
+    QFile file(QStringLiteral("/proc/pressure/memory"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        // No PSI: not Linux, or a kernel built without it.
+        pressureUnavailable_ = true;
+        return;
+    }
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    const QByteArray line = file.readLine();
+    const qsizetype begin = line.indexOf("avg10=");
+    if (begin < 0)
+        return;
+    const qsizetype valueBegin = begin + 6;
+    const qsizetype end = line.indexOf(' ', valueBegin);
+    bool ok = false;
+    const double avg10 = line.mid(valueBegin, end < 0 ? -1 : end - valueBegin).toDouble(&ok);
+    if (ok && avg10 >= PressureThreshold)
+        shrinkTo(usage_ / 2);
+}
+
+// Takes usage_ - target from the caches, each giving up a share in
+// proportion to its bytes over its rebuild cost. A share larger than the
+// cache is capped, and what it couldn't give is spread over the others.
+void MemoryGovernor::shrinkTo(std::int64_t target)
+{
+    if (shrinking_ || usage_ <= target)
+        return;
+    shrinking_ = true;
+
+    struct Plan
+    {
+        Handle handle = 0;
+        std::int64_t bytes = 0;
+        std::int64_t take = 0;
+        int rebuildCost = 1;
+    };
+    std::vector<Plan> plans;
+    for (const Cache& cache : caches_) {
+        if (cache.bytes > 0)
+            plans.push_back({cache.handle, cache.bytes, 0, cache.rebuildCost});
+    }
+    std::int64_t remaining = usage_ - target;
+    while (remaining > 0) {
+        double weights = 0;
+        for (const Plan& plan : plans) {
+            if (plan.take < plan.bytes)
+                weights += double(plan.bytes - plan.take) / plan.rebuildCost;
+        }
+        if (weights <= 0)
+            break;
+        std::int64_t taken = 0;
+        for (Plan& plan : plans) {
+            const std::int64_t left = plan.bytes - plan.take;
+            if (left <= 0)
+                continue;
+            const double weight = double(left) / plan.rebuildCost;
+            const std::int64_t share = std::min(left, std::max<std::int64_t>(1, std::int64_t(double(remaining) * weight / weights)));
+            plan.take += share;
+            taken += share;
+        }
+        remaining -= taken;
+    }
+
+    // The callbacks report back through reportUsage(), which edits caches_.
+    for (const Plan& plan : plans) {
+        if (plan.take <= 0)
+            continue;
+        const auto it = std::find_if(caches_.begin(), caches_.end(), [&plan](const Cache& cache) { return cache.handle == plan.handle; });
+        if (it == caches_.end())
+            continue;
+        const ShrinkFunction shrink = it->shrink;
+        shrink(plan.bytes - plan.take);
+    }
+    shrinking_ = false;
+}
@@ -0,0 +1,73 @@
+#ifndef MEMORYGOVERNOR_HPP
+#define MEMORYGOVERNOR_HPP
+
+#include <QString>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// One memory budget for every in-process cache. Each cache registers with a
+// callback that shrinks it to a byte target, reports its size as it
+// changes, and says how costly its contents are to rebuild. When the total
+// goes over the budget, or the system reports memory pressure, the excess is
+// taken from all caches in proportion to their size over their rebuild
+// cost, so a cache of cheap entries gives up more than one of expensive ones.
+//
+// GUI thread only.
+class MemoryGovernor
+{
+public:
+    using Handle = int;
+    // Shrinks the cache to at most targetBytes, then reports the new size.
+    using ShrinkFunction = std::function<void(std::int64_t targetBytes)>;
+
+    struct CacheUsage
+    {
+        QString name;
+        std::int64_t bytes = 0;
+    };
+
+    static MemoryGovernor& instance();
+
+    MemoryGovernor(const MemoryGovernor&) = delete;
+    MemoryGovernor& operator=(const MemoryGovernor&) = delete;
+
+    // rebuildCost is relative: 1 for entries that are cheap to make again.
+    Handle registerCache(const QString& name, int rebuildCost, ShrinkFunction shrink);
+    void unregisterCache(Handle handle);
+    void reportUsage(Handle handle, std::int64_t bytes);
+
+    void setBudget(std::int64_t bytes);
+    std::int64_t budget() const { return budget_; }
+    std::int64_t usage() const { return usage_; }
+    std::vector<CacheUsage> cacheUsage() const;
+
+    // Reads Linux pressure stall information (/proc/pressure/memory) and
+    // halves the caches while tasks are stalling on memory. Meant to be
+    // called every few seconds.
+    void checkPressure();
+
+private:
+    struct Cache
+    {
+        Handle handle = 0;
+        QString name;
+        int rebuildCost = 1;
+        ShrinkFunction shrink;
+        std::int64_t bytes = 0;
+    };
+
+    MemoryGovernor();
+
+    void shrinkTo(std::int64_t target);
+
+    std::vector<Cache> caches_;
+    Handle nextHandle_ = 1;
+    std::int64_t budget_ = 0;
+    std::int64_t usage_ = 0;
+    bool shrinking_ = false;
+    bool pressureUnavailable_ = false;
+};
+
+#endif // MEMORYGOVERNOR_HPP
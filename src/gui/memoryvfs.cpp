@@ -0,0 +1,323 @@
+#include "memoryvfs.hpp"
+
+#include <QDir>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+#include <sys/stat.h>
+
+namespace {
+
+QString cleanPath(const QString& path)
+{
+    return QDir::cleanPath(path);
+}
+
+bool isAbsolute(const QString& path)
+{
+    return path.startsWith('/');
+}
+
+QString parentOf(const QString& path)
+{
+    const qsizetype slash = path.lastIndexOf('/');
+    return slash <= 0 ? QStringLiteral("/") : path.left(slash);
+}
+
+QString nameOf(const QString& path)
+{
+    return path.mid(path.lastIndexOf('/') + 1);
+}
+
+QString childPath(const QString& parent, const QString& name)
+{
+    return parent == QLatin1String("/") ? parent + name : parent + '/' + name;
+}
+
+std::int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+struct MemoryVfs::Inode
+{
+    VfsStat stat;
+    QByteArray data;
+    std::set<QString> children;
+};
+
+class MemoryVfs::File final : public VfsFile
+{
+public:
+    File(const MemoryVfs* owner, std::shared_ptr<Inode> inode, bool writable)
+        : owner_(owner)
+        , inode_(std::move(inode))
+        , writable_(writable)
+    {
+    }
+
+    qint64 read(std::uint64_t offset, char* data, size_t size) override
+    {
+        std::shared_lock lock(owner_->mutex_);
+        const auto length = static_cast<std::uint64_t>(inode_->data.size());
+        if (offset >= length)
+            return 0;
+        const size_t n = static_cast<size_t>(std::min<std::uint64_t>(size, length - offset));
+        std::memcpy(data, inode_->data.constData() + offset, n);
+        return static_cast<qint64>(n);
+    }
+
+    qint64 write(std::uint64_t offset, const char* data, size_t size) override
+    {
+        if (!writable_)
+            return -1;
+        std::unique_lock lock(owner_->mutex_);
+        const std::uint64_t end = offset + size;
+        if (end > static_cast<std::uint64_t>(inode_->data.size()))
+            inode_->data.resize(static_cast<qsizetype>(end));
+        std::memcpy(inode_->data.data() + offset, data, size);
+        inode_->stat.size = static_cast<std::uint64_t>(inode_->data.size());
+        inode_->stat.mtimeNs = inode_->stat.ctimeNs = nowNs();
+        return static_cast<qint64>(size);
+    }
+
+    bool stat(VfsStat* st) const override
+    {
+        std::shared_lock lock(owner_->mutex_);
+        *st = inode_->stat;
+        return true;
+    }
+
+    bool close() override
+    {
+        return true;
+    }
+
+private:
+    const MemoryVfs* owner_;
+    std::shared_ptr<Inode> inode_;
+    bool writable_;
+};
+
+MemoryVfs::MemoryVfs()
+{
+    nodes_.insert(QStringLiteral("/"), makeInodeLocked(S_IFDIR | 0755));
+}
+
+MemoryVfs::~MemoryVfs() = default;
+
+std::shared_ptr<MemoryVfs::Inode> MemoryVfs::findLocked(const QString& path) const
+{
+    const auto it = nodes_.constFind(path);
+    return it == nodes_.constEnd() ? nullptr : it.value();
+}
+
+std::shared_ptr<MemoryVfs::Inode> MemoryVfs::makeInodeLocked(std::uint32_t mode) const
+{
+    auto inode = std::make_shared<Inode>();
+    inode->stat.inode = nextInode_.fetch_add(1, std::memory_order_relaxed);
+    inode->stat.mode = mode;
+    inode->stat.linkCount = 1;
+    inode->stat.mtimeNs = inode->stat.ctimeNs = nowNs();
+    return inode;
+}
+
+std::unique_ptr<VfsFile> MemoryVfs::open(const QString& path, OpenMode mode, std::uint32_t permissions, QString* error) const
+{
+    const QString clean = cleanPath(path);
+    const auto fail = [&](const QString& message) -> std::unique_ptr<VfsFile> {
+        if (error)
+            *error = message.arg(path);
+        return nullptr;
+    };
+    if (!isAbsolute(clean))
+        return fail(QStringLiteral("Failed to open: %1"));
+
+    std::unique_lock lock(mutex_);
+    std::shared_ptr<Inode> inode = findLocked(clean);
+    if (mode == OpenMode::Read) {
+        if (!inode || !inode->stat.isFile())
+            return fail(QStringLiteral("Failed to open: %1"));
+        return std::make_unique<File>(this, std::move(inode), false);
+    }
+
+    if (inode) {
+        if (mode == OpenMode::CreateNew || !inode->stat.isFile())
+            return fail(QStringLiteral("Already exists: %1"));
+        inode->data.clear();
+        inode->stat.size = 0;
+        inode->stat.mtimeNs = inode->stat.ctimeNs = nowNs();
+        return std::make_unique<File>(this, std::move(inode), true);
+    }
+
+    const std::shared_ptr<Inode> parent = findLocked(parentOf(clean));
+    if (!parent || !parent->stat.isDir())
+        return fail(QStringLiteral("Failed to open: %1"));
+    inode = makeInodeLocked(S_IFREG | (permissions & 07777));
+    nodes_.insert(clean, inode);
+    parent->children.insert(nameOf(clean));
+    parent->stat.mtimeNs = inode->stat.mtimeNs;
+    return std::make_unique<File>(this, std::move(inode), true);
+}
+
+bool MemoryVfs::stat(const QString& path, VfsStat* st, QString* error) const
+{
+    std::shared_lock lock(mutex_);
+    const std::shared_ptr<Inode> inode = findLocked(cleanPath(path));
+    if (!inode) {
+        if (error)
+            *error = QString("Failed to read: %1").arg(path);
+        return false;
+    }
+    *st = inode->stat;
+    return true;
+}
+
+bool MemoryVfs::statTarget(const QString& path, VfsStat* st, QString* error) const
+{
+    return stat(path, st, error);
+}
+
+bool MemoryVfs::listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    return list(path, entries, error);
+}
+
+bool MemoryVfs::list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    const QString clean = cleanPath(path);
+    std::shared_lock lock(mutex_);
+    const std::shared_ptr<Inode> inode = findLocked(clean);
+    if (!inode || !inode->stat.isDir()) {
+        if (error)
+            *error = QString("Failed to read directory: %1").arg(path);
+        return false;
+    }
+
+    entries->clear();
+    entries->reserve(inode->children.size());
+    for (const QString& name : inode->children) {
+        if (const std::shared_ptr<Inode> child = findLocked(childPath(clean, name)))
+            entries->push_back({name, child->stat});
+    }
+    return true;
+}
+
+bool MemoryVfs::makeDirectory(const QString& path, std::uint32_t permissions, QString* error) const
+{
+    const QString clean = cleanPath(path);
+    std::unique_lock lock(mutex_);
+    const std::shared_ptr<Inode> parent = findLocked(parentOf(clean));
+    if (!isAbsolute(clean) || findLocked(clean) || !parent || !parent->stat.isDir()) {
+        if (error)
+            *error = QString("Failed to create directory: %1").arg(path);
+        return false;
+    }
+    const std::shared_ptr<Inode> inode = makeInodeLocked(S_IFDIR | (permissions & 07777));
+    nodes_.insert(clean, inode);
+    parent->children.insert(nameOf(clean));
+    parent->stat.mtimeNs = inode->stat.mtimeNs;
+    return true;
+}
+
+void MemoryVfs::moveSubtreeLocked(const QString& from, const QString& to) const
+{
+    const std::shared_ptr<Inode> inode = nodes_.take(from);
+    nodes_.insert(to, inode);
+    for (const QString& name : inode->children)
+        moveSubtreeLocked(childPath(from, name), childPath(to, name));
+}
+
+bool MemoryVfs::rename(const QString& from, const QString& to, QString* error) const
+{
+    const QString cleanFrom = cleanPath(from);
+    const QString cleanTo = cleanPath(to);
+    const auto fail = [&] {
+        if (error)
+            *error = QString("Failed to rename:\n%1\n→ %2").arg(from, to);
+        return false;
+    };
+    if (cleanFrom == cleanTo)
+        return true;
+    if (cleanFrom == QLatin1String("/") || cleanTo.startsWith(cleanFrom + '/'))
+        return fail();
+
+    std::unique_lock lock(mutex_);
+    const std::shared_ptr<Inode> source = findLocked(cleanFrom);
+    const std::shared_ptr<Inode> targetParent = findLocked(parentOf(cleanTo));
+    if (!source || !targetParent || !targetParent->stat.isDir())
+        return fail();
+    if (const std::shared_ptr<Inode> existing = findLocked(cleanTo)) {
+        // Same rules as rename(2): a file replaces a file, a folder only an
+        // empty folder.
+        if (existing->stat.isDir() != source->stat.isDir() || !existing->children.empty())
+            return fail();
+        nodes_.remove(cleanTo);
+    }
+
+    const std::shared_ptr<Inode> sourceParent = findLocked(parentOf(cleanFrom));
+    sourceParent->children.erase(nameOf(cleanFrom));
+    targetParent->children.insert(nameOf(cleanTo));
+    moveSubtreeLocked(cleanFrom, cleanTo);
+    sourceParent->stat.mtimeNs = targetParent->stat.mtimeNs = source->stat.ctimeNs = nowNs();
+    return true;
+}
+
+bool MemoryVfs::unlink(const QString& path, QString* error) const
+{
+    const QString clean = cleanPath(path);
+    std::unique_lock lock(mutex_);
+    const std::shared_ptr<Inode> inode = findLocked(clean);
+    if (!inode || clean == QLatin1String("/") || !inode->children.empty()) {
+        if (error)
+            *error = QString("Failed to delete: %1").arg(path);
+        return false;
+    }
+    nodes_.remove(clean);
+    const std::shared_ptr<Inode> parent = findLocked(parentOf(clean));
+    parent->children.erase(nameOf(clean));
+    parent->stat.mtimeNs = nowNs();
+    return true;
+}
+
+bool MemoryVfs::addFile(const QString& path, const QByteArray& contents, std::int64_t mtimeNs)
+{
+    const QString clean = cleanPath(path);
+    if (!isAbsolute(clean) || clean == QLatin1String("/"))
+        return false;
+
+    std::unique_lock lock(mutex_);
+    QString parent = QStringLiteral("/");
+    const QStringList parts = clean.mid(1).split('/');
+    for (qsizetype i = 0; i + 1 < parts.size(); ++i) {
+        const QString dirPath = childPath(parent, parts.at(i));
+        std::shared_ptr<Inode> dir = findLocked(dirPath);
+        if (!dir) {
+            dir = makeInodeLocked(S_IFDIR | 0755);
+            nodes_.insert(dirPath, dir);
+            findLocked(parent)->children.insert(parts.at(i));
+        } else if (!dir->stat.isDir()) {
+            return false;
+        }
+        parent = dirPath;
+    }
+
+    std::shared_ptr<Inode> inode = findLocked(clean);
+    if (inode && !inode->stat.isFile())
+        return false;
+    if (!inode) {
+        inode = makeInodeLocked(S_IFREG | 0644);
+        nodes_.insert(clean, inode);
+        findLocked(parent)->children.insert(parts.last());
+    }
+    inode->data = contents;
+    inode->stat.size = static_cast<std::uint64_t>(contents.size());
+    if (mtimeNs > 0)
+        inode->stat.mtimeNs = mtimeNs;
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef MEMORYVFS_HPP
+#define MEMORYVFS_HPP
+
+#include <QByteArray>
+#include <QHash>
+
+#include "vfs.hpp"
+
+#include <atomic>
+#include <set>
+#include <shared_mutex>
+
+// A filesystem held entirely in memory, for deterministic benchmarks of the
+// engines. It starts with an empty root directory and has no symbolic links.
+// Open files keep their contents alive across rename and unlink, as on POSIX.
+class MemoryVfs final : public Vfs
+{
+public:
+    MemoryVfs();
+    ~MemoryVfs() override;
+
+    std::unique_ptr<VfsFile> open(const QString& path, OpenMode mode, std::uint32_t permissions, QString* error) const override;
+    bool stat(const QString& path, VfsStat* st, QString* error) const override;
+    bool statTarget(const QString& path, VfsStat* st, QString* error) const override;
+    bool list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool makeDirectory(const QString& path, std::uint32_t permissions, QString* error) const override;
+    bool rename(const QString& from, const QString& to, QString* error) const override;
+    bool unlink(const QString& path, QString* error) const override;
+
+    // Creates the file and any missing parent directories in one step, for
+    // building fixtures.
+    bool addFile(const QString& path, const QByteArray& contents, std::int64_t mtimeNs = 0);
+
+private:
+    struct Inode;
+    class File;
+
+    std::shared_ptr<Inode> findLocked(const QString& path) const;
+    std::shared_ptr<Inode> makeInodeLocked(std::uint32_t mode) const;
+    void moveSubtreeLocked(const QString& from, const QString& to) const;
+
+    mutable std::shared_mutex mutex_;
+    mutable QHash<QString, std::shared_ptr<Inode>> nodes_;
+    mutable std::atomic<std::uint64_t> nextInode_ = 1;
+};
+
+#endif // MEMORYVFS_HPP
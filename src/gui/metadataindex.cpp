@@ -0,0 +1,171 @@
+#include "metadataindex.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include "drivecatalog.hpp"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char IndexMagic[8] = {'K', 'T', 'M', 'I', 'N', 'D', 'E', 'X'};
+constexpr std::uint32_t IndexVersion = 1;
+constexpr const char* IndexSuffix = ".kidx";
+
+// Followed by the columns, each starting on an 8-byte boundary, in the order
+// sizes, mtimes, uids, parents, types, then the type names as UTF-8, one per
+// line.
+struct IndexHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t entryCount;
+    std::uint32_t typeNamesSize;
+    std::uint32_t reserved;
+    std::int64_t catalogCreatedNs;
+};
+
+std::uint64_t alignTo8(std::uint64_t offset)
+{
+    return (offset + 7) & ~static_cast<std::uint64_t>(7);
+}
+
+struct Layout
+{
+    std::uint64_t sizes = 0;
+    std::uint64_t mtimes = 0;
+    std::uint64_t uids = 0;
+    std::uint64_t parents = 0;
+    std::uint64_t types = 0;
+    std::uint64_t typeNames = 0;
+};
+
+Layout layoutFor(std::uint64_t count)
+{
+    Layout layout;
+    layout.sizes = alignTo8(sizeof(IndexHeader));
+    layout.mtimes = layout.sizes + count * sizeof(std::uint64_t);
+    layout.uids = layout.mtimes + count * sizeof(std::int64_t);
+    layout.parents = alignTo8(layout.uids + count * sizeof(std::uint32_t));
+    layout.types = alignTo8(layout.parents + count * sizeof(std::uint32_t));
+    layout.typeNames = alignTo8(layout.types + count * sizeof(std::uint16_t));
+    return layout;
+}
+
+} // namespace
+
+QString MetadataIndex::indexPath(const QString& uuid)
+{
+    const QString catalog = DriveCatalog::catalogPath(uuid);
+    return catalog.isEmpty() ? QString() : QFileInfo(catalog).absolutePath() + '/' + uuid + IndexSuffix;
+}
+
+bool MetadataIndex::write(const QString& uuid, std::int64_t catalogCreatedNs, const Columns& columns, QString* error)
+{
+    const QString path = indexPath(uuid);
+    const std::uint64_t count = columns.sizes.size();
+    if (path.isEmpty() || columns.mtimesNs.size() != count || columns.uids.size() != count || columns.parents.size() != count
+        || columns.types.size() != count) {
+        if (error)
+            *error = QString("Failed to write index: %1").arg(uuid);
+        return false;
+    }
+
+    const QByteArray typeNames = columns.typeNames.join('\n').toUtf8();
+    IndexHeader header {};
+    std::memcpy(header.magic, IndexMagic, sizeof(IndexMagic));
+    header.version = IndexVersion;
+    header.entryCount = static_cast<std::uint32_t>(count);
+    header.typeNamesSize = static_cast<std::uint32_t>(typeNames.size());
+    header.catalogCreatedNs = catalogCreatedNs;
+    const Layout layout = layoutFor(count);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error)
+            *error = QString("Failed to write index: %1").arg(path);
+        return false;
+    }
+    const QByteArray padding(8, '\0');
+    const auto writeColumn = [&file, &padding](std::uint64_t offset, const void* data, std::uint64_t size) {
+        const qint64 pad = static_cast<qint64>(offset) - file.pos();
+        return pad >= 0 && pad < 8 && file.write(padding.constData(), pad) == pad
+            && file.write(static_cast<const char*>(data), static_cast<qint64>(size)) == static_cast<qint64>(size);
+    };
+    const bool ok = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == static_cast<qint64>(sizeof(header))
+        && writeColumn(layout.sizes, columns.sizes.data(), count * sizeof(std::uint64_t))
+        && writeColumn(layout.mtimes, columns.mtimesNs.data(), count * sizeof(std::int64_t))
+        && writeColumn(layout.uids, columns.uids.data(), count * sizeof(std::uint32_t))
+        && writeColumn(layout.parents, columns.parents.data(), count * sizeof(std::uint32_t))
+        && writeColumn(layout.types, columns.types.data(), count * sizeof(std::uint16_t))
+        && writeColumn(layout.typeNames, typeNames.constData(), static_cast<std::uint64_t>(typeNames.size()));
+    if (!ok || !file.commit()) {
+        if (error)
+            *error = QString("Failed to write index: %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<MetadataIndex> MetadataIndex::open(const QString& uuid, std::int64_t catalogCreatedNs, QString* error)
+{
+    const auto fail = [&](const QString& reason) {
+        if (error)
+            *error = QString("%1: %2").arg(reason, uuid);
+        return nullptr;
+    };
+    const QString path = indexPath(uuid);
+    const int fd = path.isEmpty() ? -1 : ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return fail("No index for drive");
+    struct stat st {};
+    void* map = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(IndexHeader))
+        map = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return fail("Failed to read index");
+
+    std::shared_ptr<MetadataIndex> index(new MetadataIndex());
+    index->map_ = static_cast<const unsigned char*>(map);
+    index->mapSize_ = static_cast<size_t>(st.st_size);
+
+    IndexHeader header;
+    std::memcpy(&header, index->map_, sizeof(header));
+    const Layout layout = layoutFor(header.entryCount);
+    const bool valid = std::memcmp(header.magic, IndexMagic, sizeof(IndexMagic)) == 0 && header.version == IndexVersion
+        && layout.typeNames + header.typeNamesSize <= index->mapSize_;
+    if (!valid)
+        return fail("Corrupt index");
+    // Built with an earlier catalog of the drive.
+    if (header.catalogCreatedNs != catalogCreatedNs)
+        return fail("Outdated index");
+
+    index->entryCount_ = header.entryCount;
+    index->sizes_ = reinterpret_cast<const std::uint64_t*>(index->map_ + layout.sizes);
+    index->mtimesNs_ = reinterpret_cast<const std::int64_t*>(index->map_ + layout.mtimes);
+    index->uids_ = reinterpret_cast<const std::uint32_t*>(index->map_ + layout.uids);
+    index->parents_ = reinterpret_cast<const std::uint32_t*>(index->map_ + layout.parents);
+    index->types_ = reinterpret_cast<const std::uint16_t*>(index->map_ + layout.types);
+    index->typeNames_ = QString::fromUtf8(reinterpret_cast<const char*>(index->map_ + layout.typeNames), header.typeNamesSize).split('\n');
+    return index;
+}
+
+bool MetadataIndex::remove(const QString& uuid)
+{
+    const QString path = indexPath(uuid);
+    return !path.isEmpty() && QFile::remove(path);
+}
+
+MetadataIndex::~MetadataIndex()
+{
+    if (map_)
+        ::munmap(const_cast<unsigned char*>(map_), mapSize_);
+}
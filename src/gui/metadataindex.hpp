@@ -0,0 +1,72 @@
+#ifndef METADATAINDEX_HPP
+#define METADATAINDEX_HPP
+
+#include <QString>
+#include <QStringList>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The metadata of a drive catalog's entries as columns, one array per field
+// in catalog order, written next to the catalog when it is built. Queries
+// (see MetadataQuery) scan a column at a time, so a predicate over tens of
+// millions of entries is a tight loop over one contiguous array instead of a
+// walk over records or a tree.
+//
+// Types are IDs into a dictionary of lowercase name suffixes, so "type = jpg"
+// is an integer compare per entry.
+class MetadataIndex
+{
+public:
+    static constexpr std::uint16_t FolderType = 0;
+    static constexpr std::uint16_t NoSuffixType = 1;
+
+    struct Columns
+    {
+        std::vector<std::uint64_t> sizes;
+        std::vector<std::int64_t> mtimesNs;
+        std::vector<std::uint32_t> uids;
+        // The entry's folder; the root is its own parent.
+        std::vector<std::uint32_t> parents;
+        std::vector<std::uint16_t> types;
+        // Indexed by type ID; the first two are placeholders.
+        QStringList typeNames = {QString(), QString()};
+    };
+
+    static QString indexPath(const QString& uuid);
+    // catalogCreatedNs ties the index to the catalog it was built with.
+    static bool write(const QString& uuid, std::int64_t catalogCreatedNs, const Columns& columns, QString* error);
+    // Null when there is no index for that very catalog.
+    static std::shared_ptr<MetadataIndex> open(const QString& uuid, std::int64_t catalogCreatedNs, QString* error);
+    static bool remove(const QString& uuid);
+
+    ~MetadataIndex();
+    MetadataIndex(const MetadataIndex&) = delete;
+    MetadataIndex& operator=(const MetadataIndex&) = delete;
+
+    // The columns are as read from disk: a damaged file can hold type IDs
+    // past typeNames() and parents past entryCount().
+    std::uint32_t entryCount() const { return entryCount_; }
+    const std::uint64_t* sizes() const { return sizes_; }
+    const std::int64_t* mtimesNs() const { return mtimesNs_; }
+    const std::uint32_t* uids() const { return uids_; }
+    const std::uint32_t* parents() const { return parents_; }
+    const std::uint16_t* types() const { return types_; }
+    const QStringList& typeNames() const { return typeNames_; }
+
+private:
+    MetadataIndex() = default;
+
+    std::uint32_t entryCount_ = 0;
+    const unsigned char* map_ = nullptr;
+    size_t mapSize_ = 0;
+    const std::uint64_t* sizes_ = nullptr;
+    const std::int64_t* mtimesNs_ = nullptr;
+    const std::uint32_t* uids_ = nullptr;
+    const std::uint32_t* parents_ = nullptr;
+    const std::uint16_t* types_ = nullptr;
+    QStringList typeNames_;
+};
+
+#endif // METADATAINDEX_HPP
@@ -0,0 +1,404 @@
+#include "metadataquery.hpp"
+
+#include <QDate>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMimeDatabase>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStringList>
+
+#include "drivecatalog.hpp"
+#include "metadataindex.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <pwd.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::int64_t NsPerSecond = 1000000000LL;
+constexpr size_t TypeTableSize = 0x10000;
+
+bool isOperatorChar(QChar c)
+{
+    return c == '<' || c == '>' || c == '=' || c == '!' || c == '~';
+}
+
+// Words, quoted strings and operators.
+QStringList tokenize(const QString& text, QString* error)
+{
+    QStringList tokens;
+    qsizetype pos = 0;
+    while (pos < text.size()) {
+        const QChar c = text.at(pos);
+        if (c.isSpace()) {
+            ++pos;
+        } else if (c == '"') {
+            const qsizetype end = text.indexOf('"', pos + 1);
+            if (end < 0) {
+                *error = "Unterminated quote.";
+                return {};
+            }
+            tokens.push_back(text.mid(pos + 1, end - pos - 1));
+            pos = end + 1;
+        } else if (isOperatorChar(c)) {
+            const bool twoChars = pos + 1 < text.size() && text.at(pos + 1) == '=' && c != '=' && c != '~';
+            tokens.push_back(text.mid(pos, twoChars ? 2 : 1));
+            pos += twoChars ? 2 : 1;
+        } else {
+            const qsizetype start = pos;
+            while (pos < text.size() && !text.at(pos).isSpace() && !isOperatorChar(text.at(pos)) && text.at(pos) != '"')
+                ++pos;
+            tokens.push_back(text.mid(start, pos - start));
+        }
+    }
+    return tokens;
+}
+
+// A number followed by a unit from units, scaled by its factor; the first
+// unit is the default.
+bool parseScaled(const QString& value, const std::vector<std::pair<QString, double>>& units, std::int64_t* result)
+{
+    qsizetype split = 0;
+    while (split < value.size() && (value.at(split).isDigit() || value.at(split) == '.'))
+        ++split;
+    bool ok = false;
+    const double number = value.left(split).toDouble(&ok);
+    if (!ok)
+        return false;
+    const QString unit = value.mid(split).toLower();
+    for (const auto& [name, factor] : units) {
+        if (unit == name || (unit.isEmpty() && name == units.front().first)) {
+            *result = static_cast<std::int64_t>(std::llround(number * factor));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool lookupUid(const QString& name, std::int64_t* uid)
+{
+    bool numeric = false;
+    const std::int64_t number = name.toLongLong(&numeric);
+    if (numeric) {
+        *uid = number;
+        return true;
+    }
+    std::vector<char> buffer(16384);
+    passwd entry {};
+    passwd* found = nullptr;
+    if (::getpwnam_r(name.toLocal8Bit().constData(), &entry, buffer.data(), buffer.size(), &found) != 0 || !found)
+        return false;
+    *uid = found->pw_uid;
+    return true;
+}
+
+bool typeMatches(const QString& wanted, const QString& suffix)
+{
+    static const QStringList groups = {"application", "audio", "font", "image", "model", "text", "video"};
+    if (!groups.contains(wanted) && !wanted.contains('/'))
+        return suffix == wanted;
+    const QString mime = QMimeDatabase().mimeTypeForFile("file." + suffix, QMimeDatabase::MatchExtension).name();
+    return wanted.contains('/') ? mime == wanted : mime.startsWith(wanted + '/');
+}
+
+QString savedQueriesPath()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    return dir.isEmpty() ? QString() : QDir(dir).filePath("queries");
+}
+
+} // namespace
+
+std::vector<SavedQuery> MetadataQuery::loadSaved()
+{
+    std::vector<SavedQuery> queries;
+    QFile file(savedQueriesPath());
+    if (!file.open(QIODevice::ReadOnly))
+        return queries;
+    for (const QString& line : QString::fromUtf8(file.readAll()).split('\n', Qt::SkipEmptyParts)) {
+        const qsizetype tab = line.indexOf('\t');
+        if (tab > 0 && isValidName(line.left(tab)))
+            queries.push_back({line.left(tab), line.mid(tab + 1)});
+    }
+    return queries;
+}
+
+bool MetadataQuery::saveSaved(const std::vector<SavedQuery>& queries, QString* error)
+{
+    const QString path = savedQueriesPath();
+    QByteArray data;
+    for (const SavedQuery& query : queries)
+        data += (query.name + '\t' + QString(query.text).replace('\n', ' ') + '\n').toUtf8();
+    QSaveFile file(path);
+    if (path.isEmpty() || !QDir().mkpath(QFileInfo(path).absolutePath()) || !file.open(QIODevice::WriteOnly)
+        || file.write(data) != data.size() || !file.commit()) {
+        if (error)
+            *error = QString("Failed to save queries: %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+bool MetadataQuery::isValidName(const QString& name)
+{
+    return !name.trimmed().isEmpty() && !name.contains('\t') && !name.contains('\n') && !name.contains('/');
+}
+
+bool MetadataQuery::parse(const QString& text, QString* error)
+{
+    QString tokenError;
+    const QStringList tokens = tokenize(text, &tokenError);
+    const auto fail = [error](const QString& reason) {
+        if (error)
+            *error = reason;
+        return false;
+    };
+    if (!tokenError.isEmpty())
+        return fail(tokenError);
+
+    std::vector<std::vector<Term>> groups(1);
+    bool expectTerm = true;
+    for (qsizetype pos = 0; pos < tokens.size();) {
+        const QString word = tokens.at(pos++).toLower();
+        if (word == "and" || word == "or") {
+            if (expectTerm)
+                return fail(QString("Expected a term before \"%1\".").arg(word));
+            if (word == "or")
+                groups.emplace_back();
+            expectTerm = true;
+            continue;
+        }
+        // "and" may be left out.
+        Term term;
+        if (word == "under") {
+            if (pos >= tokens.size())
+                return fail("Expected a path after \"under\".");
+            term.field = Field::Under;
+            term.text = QDir::cleanPath(tokens.at(pos++));
+            groups.back().push_back(term);
+            expectTerm = false;
+            continue;
+        }
+
+        static const std::vector<std::pair<QString, Op>> operators = {
+            {"=", Op::Equal},
+            {"!=", Op::NotEqual},
+            {"<", Op::Less},
+            {"<=", Op::LessEqual},
+            {">", Op::Greater},
+            {">=", Op::GreaterEqual},
+            {"~", Op::Contains},
+        };
+        if (pos + 1 >= tokens.size())
+            return fail(QString("Expected an operator and a value after \"%1\".").arg(word));
+        const QString opText = tokens.at(pos++);
+        const QString value = tokens.at(pos++);
+        const auto op = std::find_if(operators.begin(), operators.end(), [&opText](const auto& entry) { return entry.first == opText; });
+        if (op == operators.end())
+            return fail(QString("Unknown operator \"%1\".").arg(opText));
+        term.op = op->second;
+        const bool ordered = term.op != Op::Contains;
+        const bool equality = term.op == Op::Equal || term.op == Op::NotEqual;
+
+        if (word == "size" && ordered) {
+            term.field = Field::Size;
+            if (!parseScaled(value, {{"", 1}, {"b", 1}, {"k", 1024.0}, {"kb", 1024.0}, {"m", 1048576.0}, {"mb", 1048576.0},
+                                     {"g", 1073741824.0}, {"gb", 1073741824.0}, {"t", 1099511627776.0}, {"tb", 1099511627776.0}},
+                             &term.number))
+                return fail(QString("Not a size: %1").arg(value));
+        } else if (word == "age" && ordered) {
+            // Older than a day is modified before a day ago.
+            term.field = Field::Modified;
+            term.relativeToNow = true;
+            if (!parseScaled(value, {{"d", 86400.0}, {"s", 1}, {"min", 60.0}, {"h", 3600.0}, {"w", 604800.0}, {"y", 31557600.0}}, &term.number))
+                return fail(QString("Not an age: %1").arg(value));
+            term.number *= NsPerSecond;
+            switch (term.op) {
+            case Op::Less:
+                term.op = Op::Greater;
+                break;
+            case Op::LessEqual:
+                term.op = Op::GreaterEqual;
+                break;
+            case Op::Greater:
+                term.op = Op::Less;
+                break;
+            case Op::GreaterEqual:
+                term.op = Op::LessEqual;
+                break;
+            default:
+                break;
+            }
+        } else if ((word == "modified" || word == "mtime") && ordered) {
+            term.field = Field::Modified;
+            const QDate date = QDate::fromString(value, Qt::ISODate);
+            if (!date.isValid())
+                return fail(QString("Not a date (yyyy-MM-dd): %1").arg(value));
+            term.number = date.startOfDay().toMSecsSinceEpoch() * 1000000LL;
+        } else if (word == "type" && equality) {
+            term.field = Field::Type;
+            term.text = value.toLower();
+            if (term.text.startsWith('.'))
+                term.text.remove(0, 1);
+        } else if ((word == "owner" || word == "user") && equality) {
+            term.field = Field::Owner;
+            if (!lookupUid(value, &term.number))
+                return fail(QString("No such user: %1").arg(value));
+        } else if (word == "name" && (term.op == Op::Contains || equality)) {
+            term.field = Field::Name;
+            term.text = value;
+        } else {
+            return fail(QString("Can't compare \"%1\" with \"%2\".").arg(word, opText));
+        }
+        groups.back().push_back(term);
+        expectTerm = false;
+    }
+    if (expectTerm)
+        return fail(groups.size() == 1 && groups.front().empty() ? QString("The query is empty.") : QString("Expected a term at the end."));
+
+    // Name terms are checked per entry; let the column scans thin things out first.
+    for (std::vector<Term>& group : groups)
+        std::stable_partition(group.begin(), group.end(), [](const Term& term) { return term.field != Field::Name; });
+    groups_ = std::move(groups);
+    text_ = text.trimmed();
+    return true;
+}
+
+bool MetadataQuery::isRelativeToNow() const
+{
+    for (const std::vector<Term>& group : groups_) {
+        for (const Term& term : group) {
+            if (term.relativeToNow)
+                return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::uint32_t> MetadataQuery::run(const DriveCatalog& catalog, const MetadataIndex& index, std::int64_t nowNs) const
+{
+    std::vector<std::uint32_t> matches;
+    const std::uint32_t count = index.entryCount();
+    if (groups_.empty() || count != catalog.entryCount() || count == 0)
+        return matches;
+
+    std::vector<std::uint8_t> matched(count, 0);
+    std::vector<std::uint8_t> mask(count);
+    for (const std::vector<Term>& group : groups_) {
+        std::fill(mask.begin(), mask.end(), 1);
+        mask[0] = 0;
+        for (const Term& term : group)
+            applyTerm(term, catalog, index, nowNs, &mask);
+        for (std::uint32_t entry = 0; entry < count; ++entry)
+            matched[entry] |= mask[entry];
+    }
+    for (std::uint32_t entry = 1; entry < count; ++entry) {
+        if (matched[entry])
+            matches.push_back(entry);
+    }
+    return matches;
+}
+
+void MetadataQuery::applyTerm(const Term& term, const DriveCatalog& catalog, const MetadataIndex& index, std::int64_t nowNs,
+                              std::vector<std::uint8_t>* mask) const
+{
+    std::uint8_t* bits = mask->data();
+    const std::uint32_t count = index.entryCount();
+    // One pass over a column; each case is a loop without branches.
+    const auto compare = [&](const auto* column, auto value) {
+        switch (term.op) {
+        case Op::Equal:
+            for (std::uint32_t i = 0; i < count; ++i)
+                bits[i] &= column[i] == value;
+            break;
+        case Op::NotEqual:
+            for (std::uint32_t i = 0; i < count; ++i)
+                bits[i] &= column[i] != value;
+            break;
+        case Op::Less:
+            for (std::uint32_t i = 0; i < count; ++i)
+                bits[i] &= column[i] < value;
+            break;
+        case Op::LessEqual:
+            for (std::uint32_t i = 0; i < count; ++i)
+                bits[i] &= column[i] <= value;
+            break;
+        case Op::Greater:
+            for (std::uint32_t i = 0; i < count; ++i)
+                bits[i] &= column[i] > value;
+            break;
+        case Op::GreaterEqual:
+            for (std::uint32_t i = 0; i < count; ++i)
+                bits[i] &= column[i] >= value;
+            break;
+        case Op::Contains:
+            break;
+        }
+    };
+
+    switch (term.field) {
+    case Field::Size:
+        compare(index.sizes(), static_cast<std::uint64_t>(std::max<std::int64_t>(term.number, 0)));
+        break;
+    case Field::Modified:
+        compare(index.mtimesNs(), term.relativeToNow ? nowNs - term.number : term.number);
+        break;
+    case Field::Owner:
+        compare(index.uids(), static_cast<std::uint32_t>(term.number));
+        break;
+    case Field::Type: {
+        // Resolved against this index's suffixes once, then one lookup per entry.
+        std::vector<std::uint8_t> table(TypeTableSize, 0);
+        const QStringList& names = index.typeNames();
+        if (term.text == "folder" || term.text == "file") {
+            table[MetadataIndex::FolderType] = 1;
+        } else {
+            for (qsizetype type = MetadataIndex::NoSuffixType + 1; type < names.size() && type < qsizetype(TypeTableSize); ++type)
+                table[static_cast<size_t>(type)] = typeMatches(term.text, names.at(type));
+        }
+        const bool invert = (term.op == Op::NotEqual) != (term.text == "file");
+        const std::uint16_t* types = index.types();
+        for (std::uint32_t i = 0; i < count; ++i)
+            bits[i] &= table[types[i]] ^ static_cast<std::uint8_t>(invert);
+        break;
+    }
+    case Field::Under: {
+        const QString root = QDir::cleanPath(catalog.rootPath());
+        const QString prefix = term.text.endsWith('/') ? term.text : term.text + '/';
+        if (root == term.text || root.startsWith(prefix))
+            break;
+        const QString rootPrefix = root.endsWith('/') ? root : root + '/';
+        const qint64 top = term.text.startsWith(rootPrefix) ? catalog.findEntry(term.text.mid(rootPrefix.size())) : -1;
+        if (top < 0 || !catalog.isDir(static_cast<std::uint32_t>(top))) {
+            std::fill(bits, bits + count, 0);
+            break;
+        }
+        // Folders come before their contents in catalog order, so one pass
+        // from the top folder on marks its whole subtree.
+        std::vector<std::uint8_t> inside(count, 0);
+        inside[static_cast<size_t>(top)] = 1;
+        const std::uint32_t* parents = index.parents();
+        for (std::uint32_t i = static_cast<std::uint32_t>(top) + 1; i < count; ++i)
+            inside[i] = parents[i] < count ? inside[parents[i]] : 0;
+        for (std::uint32_t i = 0; i < count; ++i)
+            bits[i] &= inside[i];
+        bits[top] = 0;
+        break;
+    }
+    case Field::Name:
+        for (std::uint32_t i = 0; i < count; ++i) {
+            if (!bits[i])
+                continue;
+            const QString name = catalog.name(i);
+            bits[i] = term.op == Op::Contains ? name.contains(term.text, Qt::CaseInsensitive)
+                                              : (name.compare(term.text, Qt::CaseInsensitive) == 0) == (term.op == Op::Equal);
+        }
+        break;
+    }
+}
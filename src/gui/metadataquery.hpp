@@ -0,0 +1,99 @@
+#ifndef METADATAQUERY_HPP
+#define METADATAQUERY_HPP
+
+#include <QString>
+
+#include <cstdint>
+#include <vector>
+
+class DriveCatalog;
+class MetadataIndex;
+
+struct SavedQuery
+{
+    QString name;
+    QString text;
+};
+
+// A filter over the drive catalogs' metadata, such as
+//
+//     size > 1G and age > 180d under /data
+//     type = image or type = video
+//
+// Terms are "field op value" or "under path", joined by "and" and "or";
+// "and" binds tighter. The fields:
+//
+//     size      bytes, with an optional K, M, G or T (powers of 1024)
+//     age       time since last modified, in s, min, h, d, w or y
+//     modified  a date, yyyy-MM-dd
+//     type      folder, file, a suffix such as jpg, or a MIME group such as
+//               image, video, audio or text
+//     owner     a user name or uid
+//     name      "~" matches names that contain the text, ignoring case
+//
+// and op is one of = != < <= > >=, or ~ for names. "under" takes a path as
+// mounted when the drive was cataloged.
+//
+// run() evaluates each "and" group as a pass per term over the
+// MetadataIndex columns into a byte mask: a loop the compiler vectorizes,
+// with no branch per entry. Name terms go last, and only look at entries
+// the other terms left.
+class MetadataQuery
+{
+public:
+    bool parse(const QString& text, QString* error);
+    const QString& text() const { return text_; }
+    bool isEmpty() const { return groups_.empty(); }
+    // Whether results depend on the time of the run, through an age.
+    bool isRelativeToNow() const;
+
+    // Kept in the app data directory, one "name<TAB>text" line each. Names
+    // have no tabs, line breaks or slashes.
+    static std::vector<SavedQuery> loadSaved();
+    static bool saveSaved(const std::vector<SavedQuery>& queries, QString* error);
+    static bool isValidName(const QString& name);
+
+    // Matching entries of catalog, in catalog order; never the root.
+    std::vector<std::uint32_t> run(const DriveCatalog& catalog, const MetadataIndex& index, std::int64_t nowNs) const;
+
+private:
+    enum class Field
+    {
+        Size,
+        Modified,
+        Type,
+        Owner,
+        Name,
+        Under,
+    };
+
+    enum class Op
+    {
+        Equal,
+        NotEqual,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Contains,
+    };
+
+    struct Term
+    {
+        Field field = Field::Size;
+        Op op = Op::Equal;
+        std::int64_t number = 0;
+        // Ages are relative to the time of the run.
+        bool relativeToNow = false;
+        QString text;
+    };
+
+    void applyTerm(const Term& term, const DriveCatalog& catalog, const MetadataIndex& index, std::int64_t nowNs,
+                   std::vector<std::uint8_t>* mask) const;
+
+    QString text_;
+    // Any group matches when all its terms do.
+    std::vector<std::vector<Term>> groups_;
+};
+
+#endif // METADATAQUERY_HPP
@@ -0,0 +1,74 @@
+#include "mountprobe.hpp"
+
+#include <QFile>
+#include <QHash>
+
+#include "vfs.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <mutex>
+
+#include <sys/vfs.h>
+
+namespace {
+
+constexpr int RttSamples = 3;
+// A median stat slower than this makes a mount high-latency. Local disks
+// answer from the inode cache in microseconds.
+constexpr std::chrono::microseconds HighLatencyRtt(1000);
+
+bool isRemoteFilesystemType(long type)
+{
+    switch (static_cast<unsigned long>(type)) {
+    case 0x6969:     // NFS
+    case 0x517B:     // SMB
+    case 0xFF534D42: // CIFS
+    case 0xFE534D42: // SMB2
+    case 0x65735546: // FUSE (sshfs, rclone, ...)
+    case 0x01021997: // 9P
+    case 0x00C36400: // Ceph
+    case 0x5346414F: // AFS
+    case 0x0BD00BD0: // Lustre
+    case 0x47504653: // GPFS
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::mutex cacheMutex;
+QHash<std::uint64_t, bool> cacheByDevice;
+
+} // namespace
+
+bool MountProbe::isHighLatency(const Vfs& vfs, const QString& path)
+{
+    const bool native = &vfs == &Vfs::native();
+    std::array<std::chrono::steady_clock::duration, RttSamples> samples {};
+    VfsStat st;
+    for (auto& sample : samples) {
+        const auto start = std::chrono::steady_clock::now();
+        if (!vfs.stat(path, &st, nullptr))
+            return false;
+        sample = std::chrono::steady_clock::now() - start;
+        if (native && &sample == &samples.front()) {
+            std::lock_guard lock(cacheMutex);
+            const auto it = cacheByDevice.constFind(st.device);
+            if (it != cacheByDevice.constEnd())
+                return it.value();
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+    bool highLatency = samples[RttSamples / 2] > HighLatencyRtt;
+
+    if (native) {
+        struct statfs fs {};
+        if (!highLatency && ::statfs(QFile::encodeName(path).constData(), &fs) == 0)
+            highLatency = isRemoteFilesystemType(static_cast<long>(fs.f_type));
+        std::lock_guard lock(cacheMutex);
+        cacheByDevice.insert(st.device, highLatency);
+    }
+    return highLatency;
+}
@@ -0,0 +1,19 @@
+#ifndef MOUNTPROBE_HPP
+#define MOUNTPROBE_HPP
+
+#include <QString>
+
+class Vfs;
+
+// Decides whether a directory lives on a high-latency mount, where every
+// metadata call is a network round trip. Network and FUSE filesystem types
+// count as high-latency outright; for anything else the round trip of a few
+// stat calls is measured. Results for the native filesystem are cached per
+// device. Blocks on I/O, so call it off the GUI thread.
+class MountProbe
+{
+public:
+    static bool isHighLatency(const Vfs& vfs, const QString& path);
+};
+
+#endif // MOUNTPROBE_HPP
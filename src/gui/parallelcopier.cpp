@@ -0,0 +1,280 @@
+#include "parallelcopier.hpp"
+
+#include <QDateTime>
+#include <QFile>
+#include <QThreadPool>
+
+#include "scopedfd.hpp"
+#include "vfs.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t CopyChunkSize = 8 * 1024 * 1024;
+constexpr size_t FallbackBufferSize = 1024 * 1024;
+constexpr int ProgressIntervalMs = 100;
+
+std::atomic<std::uint64_t> tempCounter = 0;
+
+bool writeFully(int fd, const char* data, size_t length)
+{
+    while (length > 0) {
+        const ssize_t n = ::write(fd, data, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Copies with read/write for filesystem pairs copy_file_range refuses.
+bool copyWithBuffer(int in, int out, std::uint64_t offset, const std::function<void(std::uint64_t)>& onBytes, const std::atomic_bool* cancel)
+{
+    if (::lseek(in, static_cast<off_t>(offset), SEEK_SET) < 0 || ::lseek(out, static_cast<off_t>(offset), SEEK_SET) < 0)
+        return false;
+    std::vector<char> buffer(FallbackBufferSize);
+    for (;;) {
+        if (cancel && cancel->load(std::memory_order_relaxed))
+            return false;
+        const ssize_t n = ::read(in, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        if (n == 0)
+            return true;
+        if (!writeFully(out, buffer.data(), static_cast<size_t>(n)))
+            return false;
+        if (onBytes)
+            onBytes(static_cast<std::uint64_t>(n));
+    }
+}
+
+} // namespace
+
+bool copyFileAtomically(const QString& source,
+                        const QString& destination,
+                        bool preserveTimes,
+                        const std::function<void(std::uint64_t bytes)>& onBytes,
+                        const std::atomic_bool* cancel,
+                        QString* error)
+{
+    const ScopedFd in(::open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC));
+    struct stat st {};
+    if (!in.isValid() || ::fstat(in.get(), &st) != 0) {
+        if (error)
+            *error = QString("Failed to open source: %1").arg(source);
+        return false;
+    }
+
+    const QString tempPath = QString("%1.kitaplik-tmp-%2-%3")
+                                 .arg(destination,
+                                      QString::number(QDateTime::currentMSecsSinceEpoch()),
+                                      QString::number(tempCounter.fetch_add(1, std::memory_order_relaxed)));
+    const QByteArray nativeTemp = QFile::encodeName(tempPath);
+    ScopedFd out(::open(nativeTemp.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777));
+    if (!out.isValid()) {
+        if (error)
+            *error = QString("Failed to create temporary file: %1").arg(tempPath);
+        return false;
+    }
+    ::posix_fadvise(in.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    const auto fail = [&](const QString& message) {
+        out.reset();
+        ::unlink(nativeTemp.constData());
+        if (error)
+            *error = message;
+        return false;
+    };
+
+    std::uint64_t copied = 0;
+    bool useBuffer = false;
+    for (;;) {
+        if (cancel && cancel->load(std::memory_order_relaxed))
+            return fail(QStringLiteral("Operation cancelled."));
+        const ssize_t n = ::copy_file_range(in.get(), nullptr, out.get(), nullptr, CopyChunkSize, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP || errno == EIO)) {
+            useBuffer = true;
+            break;
+        }
+        if (n < 0)
+            return fail(QString("Write error: %1").arg(tempPath));
+        if (n == 0)
+            break;
+        copied += static_cast<std::uint64_t>(n);
+        if (onBytes)
+            onBytes(static_cast<std::uint64_t>(n));
+    }
+    if (useBuffer && !copyWithBuffer(in.get(), out.get(), copied, onBytes, cancel)) {
+        if (cancel && cancel->load(std::memory_order_relaxed))
+            return fail(QStringLiteral("Operation cancelled."));
+        return fail(QString("Failed to copy %1 to %2").arg(source, tempPath));
+    }
+
+    if (preserveTimes) {
+        const timespec times[2] = {st.st_atim, st.st_mtim};
+        ::futimens(out.get(), times);
+    }
+    if (::close(out.release()) != 0) {
+        ::unlink(nativeTemp.constData());
+        if (error)
+            *error = QString("Write error: %1").arg(tempPath);
+        return false;
+    }
+    if (::rename(nativeTemp.constData(), QFile::encodeName(destination).constData()) != 0) {
+        ::unlink(nativeTemp.constData());
+        if (error)
+            *error = QString("Failed to finalize destination: %1").arg(destination);
+        return false;
+    }
+    return true;
+}
+
+bool copyFileAtomically(const Vfs& vfs,
+                        const QString& source,
+                        const QString& destination,
+                        const std::function<void(std::uint64_t bytes)>& onBytes,
+                        const std::atomic_bool* cancel,
+                        QString* error)
+{
+    const std::unique_ptr<VfsFile> in = vfs.open(source, Vfs::OpenMode::Read, 0, error);
+    VfsStat st;
+    if (!in || !in->stat(&st)) {
+        if (error && in)
+            *error = QString("Failed to open source: %1").arg(source);
+        return false;
+    }
+
+    const QString tempPath = QString("%1.kitaplik-tmp-%2-%3")
+                                 .arg(destination,
+                                      QString::number(QDateTime::currentMSecsSinceEpoch()),
+                                      QString::number(tempCounter.fetch_add(1, std::memory_order_relaxed)));
+    std::unique_ptr<VfsFile> out = vfs.open(tempPath, Vfs::OpenMode::CreateNew, st.mode & 07777, error);
+    if (!out)
+        return false;
+
+    const auto fail = [&](const QString& message) {
+        out->close();
+        vfs.unlink(tempPath, nullptr);
+        if (error)
+            *error = message;
+        return false;
+    };
+
+    std::vector<char> buffer(FallbackBufferSize);
+    std::uint64_t offset = 0;
+    for (;;) {
+        if (cancel && cancel->load(std::memory_order_relaxed))
+            return fail(QStringLiteral("Operation cancelled."));
+        const qint64 n = in->read(offset, buffer.data(), buffer.size());
+        if (n < 0)
+            return fail(QString("Failed to copy %1 to %2").arg(source, tempPath));
+        if (n == 0)
+            break;
+        if (out->write(offset, buffer.data(), static_cast<size_t>(n)) != n)
+            return fail(QString("Write error: %1").arg(tempPath));
+        offset += static_cast<std::uint64_t>(n);
+        if (onBytes)
+            onBytes(static_cast<std::uint64_t>(n));
+    }
+
+    if (!out->close()) {
+        vfs.unlink(tempPath, nullptr);
+        if (error)
+            *error = QString("Write error: %1").arg(tempPath);
+        return false;
+    }
+    if (!vfs.rename(tempPath, destination, nullptr)) {
+        vfs.unlink(tempPath, nullptr);
+        if (error)
+            *error = QString("Failed to finalize destination: %1").arg(destination);
+        return false;
+    }
+    return true;
+}
+
+ParallelCopier::ParallelCopier() = default;
+
+ParallelCopier::ParallelCopier(Options options)
+    : options_(options)
+{
+}
+
+bool ParallelCopier::run(const std::vector<CopyJob>& jobs,
+                         const ProgressCallback& onProgress,
+                         const std::atomic_bool* cancel,
+                         QStringList* errors) const
+{
+    std::mutex mutex;
+    Progress progress;
+    progress.filesTotal = jobs.size();
+    for (const CopyJob& job : jobs)
+        progress.bytesTotal += job.size;
+    bool failed = false;
+    auto lastReport = std::chrono::steady_clock::now();
+
+    const auto reportLocked = [&](bool force) {
+        const auto now = std::chrono::steady_clock::now();
+        if (!force && now - lastReport < std::chrono::milliseconds(ProgressIntervalMs))
+            return;
+        lastReport = now;
+        if (onProgress)
+            onProgress(progress);
+    };
+
+    QThreadPool pool;
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    pool.setMaxThreadCount(options_.maxThreads > 0 ? options_.maxThreads : static_cast<int>(hardware));
+
+    // Larger files first, so a big one doesn't start last and run alone.
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return jobs[a].size > jobs[b].size; });
+
+    for (const size_t index : order) {
+        pool.start([&, index] {
+            const CopyJob& job = jobs[index];
+            const bool cancelled = cancel && cancel->load(std::memory_order_relaxed);
+            QString error;
+            const auto onBytes = [&](std::uint64_t bytes) {
+                std::lock_guard lock(mutex);
+                progress.bytesDone += bytes;
+                reportLocked(false);
+            };
+            const bool ok = !cancelled
+                && (options_.vfs
+                        ? copyFileAtomically(*options_.vfs, job.source, job.destination, onBytes, cancel, &error)
+                        : copyFileAtomically(job.source, job.destination, options_.preserveTimes, onBytes, cancel, &error));
+
+            std::lock_guard lock(mutex);
+            ++progress.filesDone;
+            if (!ok) {
+                failed = true;
+                if (errors && !error.isEmpty() && !(cancel && cancel->load(std::memory_order_relaxed)))
+                    errors->push_back(error);
+            }
+            reportLocked(false);
+        });
+    }
+    pool.waitForDone();
+
+    std::lock_guard lock(mutex);
+    reportLocked(true);
+    return !failed;
+}
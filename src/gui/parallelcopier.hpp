@@ -0,0 +1,77 @@
+#ifndef PARALLELCOPIER_HPP
+#define PARALLELCOPIER_HPP
+
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class Vfs;
+
+struct CopyJob
+{
+    QString source;
+    QString destination;
+    std::uint64_t size = 0;
+};
+
+// Copies many independent files at once on a bounded thread pool. Each file
+// goes through copy_file_range, so the kernel can reflink or copy server-side
+// where the filesystem allows it, into a temporary file next to the
+// destination that replaces it only once complete. Permissions and
+// modification times are carried over.
+class ParallelCopier
+{
+public:
+    struct Options
+    {
+        int maxThreads = 0;
+        bool preserveTimes = true;
+        // Copies through this backend instead of copy_file_range.
+        const Vfs* vfs = nullptr;
+    };
+
+    struct Progress
+    {
+        std::uint64_t bytesDone = 0;
+        std::uint64_t bytesTotal = 0;
+        size_t filesDone = 0;
+        size_t filesTotal = 0;
+    };
+
+    using ProgressCallback = std::function<void(const Progress& progress)>;
+
+    ParallelCopier();
+    explicit ParallelCopier(Options options);
+
+    // Destination directories must exist. Returns false if any file failed
+    // or the copy was cancelled; the remaining files are still attempted.
+    bool run(const std::vector<CopyJob>& jobs,
+             const ProgressCallback& onProgress,
+             const std::atomic_bool* cancel,
+             QStringList* errors) const;
+
+private:
+    Options options_;
+};
+
+bool copyFileAtomically(const QString& source,
+                        const QString& destination,
+                        bool preserveTimes,
+                        const std::function<void(std::uint64_t bytes)>& onBytes,
+                        const std::atomic_bool* cancel,
+                        QString* error);
+
+// The same through any Vfs backend, with plain reads and writes. Permissions
+// carry over; times don't, since Vfs has no call to set them.
+bool copyFileAtomically(const Vfs& vfs,
+                        const QString& source,
+                        const QString& destination,
+                        const std::function<void(std::uint64_t bytes)>& onBytes,
+                        const std::atomic_bool* cancel,
+                        QString* error);
+
+#endif // PARALLELCOPIER_HPP
@@ -0,0 +1,242 @@
+#include "parallelwalker.hpp"
+
+#include <QDir>
+#include <QFile>
+
+#include "vfs.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct DirectoryTask
+{
+    QByteArray nativePath;
+    QString relativePath;
+};
+
+std::int64_t toNanoseconds(const timespec& ts)
+{
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void fillEntry(WalkEntry* entry, const VfsStat& st)
+{
+    entry->device = st.device;
+    entry->inode = st.inode;
+    entry->size = st.size;
+    entry->mtimeNs = st.mtimeNs;
+    entry->ctimeNs = st.ctimeNs;
+    entry->mode = st.mode;
+    entry->linkCount = st.linkCount;
+    entry->uid = st.uid;
+    entry->gid = st.gid;
+}
+
+} // namespace
+
+bool WalkEntry::isDir() const
+{
+    return S_ISDIR(mode);
+}
+
+bool WalkEntry::isFile() const
+{
+    return S_ISREG(mode);
+}
+
+bool WalkEntry::isSymLink() const
+{
+    return S_ISLNK(mode);
+}
+
+ParallelWalker::ParallelWalker() = default;
+
+ParallelWalker::ParallelWalker(Options options)
+    : options_(options)
+{
+}
+
+bool ParallelWalker::walk(const QString& root,
+                          const BatchCallback& onBatch,
+                          const std::atomic_bool* cancel,
+                          QStringList* errors,
+                          QStringList* incomplete) const
+{
+    const QString cleanRoot = QDir::cleanPath(root);
+    const QByteArray nativeRoot = QFile::encodeName(cleanRoot);
+
+    struct stat rootStat {};
+    VfsStat rootVfsStat;
+    const bool rootIsDir = options_.vfs
+        ? options_.vfs->stat(cleanRoot, &rootVfsStat, nullptr) && rootVfsStat.isDir()
+        : ::stat(nativeRoot.constData(), &rootStat) == 0 && S_ISDIR(rootStat.st_mode);
+    if (!rootIsDir) {
+        if (errors)
+            errors->push_back(QString("Not a directory: %1").arg(cleanRoot));
+        return false;
+    }
+    const std::uint64_t rootDevice = options_.vfs ? rootVfsStat.device : static_cast<std::uint64_t>(rootStat.st_dev);
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<DirectoryTask> queue;
+    int active = 0;
+    queue.push_back({nativeRoot, QString()});
+
+    const auto isCancelled = [cancel] { return cancel && cancel->load(std::memory_order_relaxed); };
+    // Called with the mutex held.
+    const auto markIncomplete = [incomplete](const DirectoryTask& task) {
+        if (incomplete)
+            incomplete->push_back(task.relativePath);
+    };
+
+    const auto scanVfsDirectory = [&](const DirectoryTask& task, std::vector<DirectoryTask>* subdirs) {
+        const QString parentPath = QFile::decodeName(task.nativePath);
+        std::vector<VfsDirEntry> listed;
+        QString error;
+        if (!options_.vfs->list(parentPath, &listed, &error)) {
+            std::lock_guard lock(mutex);
+            if (errors)
+                errors->push_back(error);
+            markIncomplete(task);
+            return;
+        }
+
+        std::vector<WalkEntry> batch;
+        batch.reserve(listed.size());
+        for (const VfsDirEntry& listedEntry : listed) {
+            if (!options_.includeHidden && listedEntry.name.startsWith('.'))
+                continue;
+            WalkEntry entry;
+            entry.path = parentPath == QLatin1String("/") ? parentPath + listedEntry.name : parentPath + '/' + listedEntry.name;
+            entry.relativePath = task.relativePath.isEmpty() ? listedEntry.name : task.relativePath + '/' + listedEntry.name;
+            fillEntry(&entry, listedEntry.stat);
+            if (entry.isDir() && (!options_.sameFilesystem || entry.device == rootDevice))
+                subdirs->push_back({QFile::encodeName(entry.path), entry.relativePath});
+            batch.push_back(std::move(entry));
+        }
+        if (!batch.empty())
+            onBatch(std::move(batch));
+    };
+
+    const auto scanDirectory = [&](const DirectoryTask& task, std::vector<DirectoryTask>* subdirs) {
+        if (options_.vfs) {
+            scanVfsDirectory(task, subdirs);
+            return;
+        }
+        const int fd = ::open(task.nativePath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR* dir = fd >= 0 ? ::fdopendir(fd) : nullptr;
+        if (!dir) {
+            if (fd >= 0)
+                ::close(fd);
+            std::lock_guard lock(mutex);
+            if (errors)
+                errors->push_back(QString("Failed to read directory: %1").arg(QFile::decodeName(task.nativePath)));
+            markIncomplete(task);
+            return;
+        }
+
+        std::vector<WalkEntry> batch;
+        const QString parentPath = QFile::decodeName(task.nativePath);
+        bool complete = true;
+        for (;;) {
+            errno = 0;
+            const dirent* ent = ::readdir(dir);
+            if (!ent) {
+                complete = errno == 0;
+                break;
+            }
+            const char* name = ent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+            if (!options_.includeHidden && name[0] == '.')
+                continue;
+
+            struct stat st {};
+            if (::fstatat(::dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                // Gone since readdir() is fine; anything else leaves a hole.
+                if (errno != ENOENT)
+                    complete = false;
+                continue;
+            }
+
+            const QString fileName = QFile::decodeName(name);
+            WalkEntry entry;
+            entry.path = parentPath == QLatin1String("/") ? parentPath + fileName : parentPath + '/' + fileName;
+            entry.relativePath = task.relativePath.isEmpty() ? fileName : task.relativePath + '/' + fileName;
+            entry.device = static_cast<std::uint64_t>(st.st_dev);
+            entry.inode = static_cast<std::uint64_t>(st.st_ino);
+            entry.size = static_cast<std::uint64_t>(st.st_size);
+            entry.mtimeNs = toNanoseconds(st.st_mtim);
+            entry.ctimeNs = toNanoseconds(st.st_ctim);
+            entry.mode = st.st_mode;
+            entry.linkCount = static_cast<std::uint32_t>(st.st_nlink);
+            entry.uid = st.st_uid;
+            entry.gid = st.st_gid;
+
+            if (S_ISDIR(st.st_mode) && (!options_.sameFilesystem || static_cast<std::uint64_t>(st.st_dev) == rootDevice))
+                subdirs->push_back({QFile::encodeName(entry.path), entry.relativePath});
+
+            batch.push_back(std::move(entry));
+        }
+        ::closedir(dir);
+        if (!complete) {
+            std::lock_guard lock(mutex);
+            if (errors)
+                errors->push_back(QString("Failed to read all of directory: %1").arg(parentPath));
+            markIncomplete(task);
+        }
+
+        if (!batch.empty())
+            onBatch(std::move(batch));
+    };
+
+    const auto worker = [&] {
+        std::vector<DirectoryTask> subdirs;
+        for (;;) {
+            DirectoryTask task;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [&] { return !queue.empty() || active == 0 || isCancelled(); });
+                if (queue.empty() || isCancelled())
+                    return;
+                task = std::move(queue.front());
+                queue.pop_front();
+                ++active;
+            }
+
+            subdirs.clear();
+            scanDirectory(task, &subdirs);
+
+            {
+                std::lock_guard lock(mutex);
+                for (DirectoryTask& subdir : subdirs)
+                    queue.push_back(std::move(subdir));
+                --active;
+            }
+            wake.notify_all();
+        }
+    };
+
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    const int threadCount = options_.maxThreads > 0 ? options_.maxThreads : static_cast<int>(std::max(4u, hardware));
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(static_cast<size_t>(threadCount));
+        for (int i = 0; i < threadCount; ++i)
+            threads.emplace_back(worker);
+    }
+
+    return !isCancelled();
+}
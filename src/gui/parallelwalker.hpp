@@ -0,0 +1,67 @@
+#ifndef PARALLELWALKER_HPP
+#define PARALLELWALKER_HPP
+
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class Vfs;
+
+struct WalkEntry
+{
+    QString path;
+    QString relativePath;
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::uint64_t size = 0;
+    std::int64_t mtimeNs = 0;
+    std::int64_t ctimeNs = 0;
+    std::uint32_t mode = 0;
+    std::uint32_t linkCount = 0;
+    std::uint32_t uid = 0;
+    std::uint32_t gid = 0;
+
+    bool isDir() const;
+    bool isFile() const;
+    bool isSymLink() const;
+};
+
+// Walks a directory tree with several threads, one directory per work item.
+// Entries are delivered in per-directory batches from the worker threads, so
+// the callback must be thread-safe.
+class ParallelWalker
+{
+public:
+    struct Options
+    {
+        int maxThreads = 0;
+        bool includeHidden = true;
+        bool sameFilesystem = false;
+        // Walks through this backend instead of calling the kernel directly,
+        // e.g. to measure the walker against a simulated slow mount.
+        const Vfs* vfs = nullptr;
+    };
+
+    using BatchCallback = std::function<void(std::vector<WalkEntry>&& batch)>;
+
+    ParallelWalker();
+    explicit ParallelWalker(Options options);
+
+    // incomplete gets the relative paths of the directories that could not
+    // be listed in full, "" for the root: what is missing under them was not
+    // seen, not found absent.
+    bool walk(const QString& root,
+              const BatchCallback& onBatch,
+              const std::atomic_bool* cancel = nullptr,
+              QStringList* errors = nullptr,
+              QStringList* incomplete = nullptr) const;
+
+private:
+    Options options_;
+};
+
+#endif // PARALLELWALKER_HPP
@@ -0,0 +1,145 @@
+#include "queryresults.hpp"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "drivecatalog.hpp"
+#include "metadataindex.hpp"
+#include "metadataquery.hpp"
+
+#include <algorithm>
+
+namespace {
+
+constexpr quint32 ResultsMagic = 0x4b545152; // "KTQR"
+constexpr quint32 ResultsVersion = 1;
+constexpr std::int64_t RelativeRerunNs = 3600LL * 1000000000LL;
+
+QString resultsPath(const QString& name)
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dir.isEmpty())
+        return QString();
+    const QByteArray key = QCryptographicHash::hash(name.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(dir).filePath(QString("query-results/%1.results").arg(QString::fromLatin1(key)));
+}
+
+} // namespace
+
+QueryResults QueryResults::load(const QString& name, const QString& text)
+{
+    QueryResults results;
+    results.text_ = text;
+    QFile file(resultsPath(name));
+    if (!file.open(QIODevice::ReadOnly))
+        return results;
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QString savedText;
+    quint32 driveCount = 0;
+    in >> magic >> version >> savedText >> driveCount;
+    if (in.status() != QDataStream::Ok || magic != ResultsMagic || version != ResultsVersion || savedText != text)
+        return results;
+
+    std::vector<Drive> drives;
+    for (quint32 i = 0; i < driveCount && in.status() == QDataStream::Ok; ++i) {
+        Drive drive;
+        qint64 createdNs = 0;
+        qint64 runNs = 0;
+        quint32 count = 0;
+        in >> drive.uuid >> createdNs >> runNs >> count;
+        drive.catalogCreatedNs = createdNs;
+        drive.runNs = runNs;
+        // The entries are raw, in host byte order, so a large result set
+        // loads with one read.
+        if (in.status() != QDataStream::Ok || count > file.size() / sizeof(std::uint32_t))
+            return results;
+        drive.entries.resize(count);
+        const int bytes = static_cast<int>(count * sizeof(std::uint32_t));
+        if (in.readRawData(reinterpret_cast<char*>(drive.entries.data()), bytes) != bytes)
+            return results;
+        drives.push_back(std::move(drive));
+    }
+    if (in.status() == QDataStream::Ok)
+        results.drives_ = std::move(drives);
+    return results;
+}
+
+bool QueryResults::remove(const QString& name)
+{
+    const QString path = resultsPath(name);
+    return !path.isEmpty() && QFile::remove(path);
+}
+
+bool QueryResults::save(const QString& name) const
+{
+    const QString path = resultsPath(name);
+    if (path.isEmpty() || !QDir().mkpath(QFileInfo(path).absolutePath()))
+        return false;
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream out(&file);
+    out << ResultsMagic << ResultsVersion << text_ << static_cast<quint32>(drives_.size());
+    for (const Drive& drive : drives_) {
+        out << drive.uuid << static_cast<qint64>(drive.catalogCreatedNs) << static_cast<qint64>(drive.runNs)
+            << static_cast<quint32>(drive.entries.size());
+        out.writeRawData(reinterpret_cast<const char*>(drive.entries.data()), static_cast<int>(drive.entries.size() * sizeof(std::uint32_t)));
+    }
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool QueryResults::refresh(const MetadataQuery& query, std::int64_t nowNs, int* unindexed, const std::atomic_bool* cancel)
+{
+    const bool relative = query.isRelativeToNow();
+    bool changed = false;
+    std::vector<Drive> drives;
+    for (const QString& uuid : DriveCatalog::catalogUuids()) {
+        if (cancel && *cancel)
+            return false;
+        const std::shared_ptr<const DriveCatalog> catalog = DriveCatalog::open(uuid, nullptr);
+        if (!catalog)
+            continue;
+        const auto cached = std::find_if(drives_.begin(), drives_.end(), [&uuid](const Drive& drive) { return drive.uuid == uuid; });
+        if (cached != drives_.end() && cached->catalogCreatedNs == catalog->createdNs()
+            && (!relative || nowNs - cached->runNs < RelativeRerunNs)) {
+            cached->catalog = catalog;
+            drives.push_back(std::move(*cached));
+            continue;
+        }
+
+        const std::shared_ptr<const MetadataIndex> index = MetadataIndex::open(uuid, catalog->createdNs(), nullptr);
+        if (!index) {
+            if (unindexed)
+                ++*unindexed;
+            changed = changed || cached != drives_.end();
+            continue;
+        }
+        Drive drive;
+        drive.uuid = uuid;
+        drive.catalogCreatedNs = catalog->createdNs();
+        drive.runNs = nowNs;
+        drive.entries = query.run(*catalog, *index, nowNs);
+        drive.catalog = catalog;
+        drives.push_back(std::move(drive));
+        changed = true;
+    }
+    // Drives whose catalog was forgotten.
+    changed = changed || drives.size() != drives_.size();
+    drives_ = std::move(drives);
+    return changed;
+}
+
+std::uint64_t QueryResults::count() const
+{
+    std::uint64_t total = 0;
+    for (const Drive& drive : drives_)
+        total += drive.entries.size();
+    return total;
+}
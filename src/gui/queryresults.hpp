@@ -0,0 +1,51 @@
+#ifndef QUERYRESULTS_HPP
+#define QUERYRESULTS_HPP
+
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class DriveCatalog;
+class MetadataQuery;
+
+// The last results of a saved query, one entry list per drive catalog, kept
+// in the cache directory so a query opens without scanning anything.
+// refresh() brings them up to date: a catalog that hasn't been built again
+// since keeps its results, and only new or rebuilt ones are queried. A query
+// with an age in it also runs again once its results are an hour old.
+class QueryResults
+{
+public:
+    struct Drive
+    {
+        QString uuid;
+        std::int64_t catalogCreatedNs = 0;
+        // When the query ran; ages in the query are relative to it.
+        std::int64_t runNs = 0;
+        std::vector<std::uint32_t> entries;
+        // Opened by refresh(); not saved.
+        std::shared_ptr<const DriveCatalog> catalog;
+    };
+
+    // Empty when there are none for this text of the query.
+    static QueryResults load(const QString& name, const QString& text);
+    static bool remove(const QString& name);
+    bool save(const QString& name) const;
+
+    // Returns whether the results changed. unindexed counts catalogs that
+    // have no metadata index yet. Once cancel is set, gives up between
+    // catalogs, returns false and leaves the results as they were.
+    bool refresh(const MetadataQuery& query, std::int64_t nowNs, int* unindexed, const std::atomic_bool* cancel = nullptr);
+
+    const std::vector<Drive>& drives() const { return drives_; }
+    std::uint64_t count() const;
+
+private:
+    QString text_;
+    std::vector<Drive> drives_;
+};
+
+#endif // QUERYRESULTS_HPP
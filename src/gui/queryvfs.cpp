@@ -0,0 +1,197 @@
+#include "queryvfs.hpp"
+
+#include <QDateTime>
+#include <QDir>
+#include <QSet>
+
+#include "drivecatalog.hpp"
+#include "queryresults.hpp"
+
+#include <cstring>
+
+#include <sys/stat.h>
+
+namespace {
+
+constexpr const char* UrlScheme = "query://";
+
+VfsStat statOf(const DriveCatalog& catalog, std::uint32_t entry)
+{
+    VfsStat st;
+    st.inode = entry + 1;
+    st.size = catalog.size(entry);
+    st.mtimeNs = catalog.mtimeNs(entry);
+    st.ctimeNs = st.mtimeNs;
+    st.mode = catalog.isDir(entry) ? (S_IFDIR | 0555) : (S_IFREG | 0444);
+    st.linkCount = 1;
+    return st;
+}
+
+bool failReadOnly(const QString& path, QString* error)
+{
+    if (error)
+        *error = QString("Query results are read-only: %1").arg(path);
+    return false;
+}
+
+} // namespace
+
+QString QueryVfs::rootUrl(const QString& name)
+{
+    return UrlScheme + name;
+}
+
+bool QueryVfs::splitUrl(const QString& url, QString* name, QString* innerPath)
+{
+    if (!url.startsWith(UrlScheme))
+        return false;
+    const QString rest = url.mid(static_cast<qsizetype>(std::strlen(UrlScheme)));
+    const qsizetype slash = rest.indexOf('/');
+    *name = slash < 0 ? rest : rest.left(slash);
+    if (!MetadataQuery::isValidName(*name))
+        return false;
+    *innerPath = slash < 0 ? QString() : QDir::cleanPath('/' + rest.mid(slash + 1)).mid(1);
+    return true;
+}
+
+QueryVfs::QueryVfs(QString name, MetadataQuery query)
+    : name_(std::move(name))
+    , query_(std::move(query))
+{
+}
+
+bool QueryVfs::findEntry(const QString& path, std::shared_ptr<const DriveCatalog>* catalog, qint64* entry) const
+{
+    QString name;
+    QString innerPath;
+    if (!splitUrl(path, &name, &innerPath) || name != name_)
+        return false;
+    if (innerPath.isEmpty()) {
+        catalog->reset();
+        *entry = -1;
+        return true;
+    }
+    const qsizetype slash = innerPath.indexOf('/');
+    const QString label = slash < 0 ? innerPath : innerPath.left(slash);
+    const std::lock_guard lock(mutex_);
+    for (const Drive& drive : drives_) {
+        if (drive.label != label)
+            continue;
+        *catalog = drive.catalog;
+        *entry = drive.catalog->findEntry(slash < 0 ? QString() : innerPath.mid(slash + 1));
+        return *entry >= 0;
+    }
+    return false;
+}
+
+std::unique_ptr<VfsFile> QueryVfs::open(const QString& path, OpenMode, std::uint32_t, QString* error) const
+{
+    if (error)
+        *error = QString("The drive is offline: %1").arg(path);
+    return nullptr;
+}
+
+bool QueryVfs::stat(const QString& path, VfsStat* st, QString* error) const
+{
+    std::shared_ptr<const DriveCatalog> catalog;
+    qint64 entry = -1;
+    if (!findEntry(path, &catalog, &entry)) {
+        if (error)
+            *error = QString("Failed to read: %1").arg(path);
+        return false;
+    }
+    if (catalog) {
+        *st = statOf(*catalog, static_cast<std::uint32_t>(entry));
+    } else {
+        *st = VfsStat();
+        st->mode = S_IFDIR | 0555;
+        st->linkCount = 1;
+    }
+    return true;
+}
+
+bool QueryVfs::statTarget(const QString& path, VfsStat* st, QString* error) const
+{
+    return stat(path, st, error);
+}
+
+bool QueryVfs::list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    QString name;
+    QString innerPath;
+    if (!splitUrl(path, &name, &innerPath) || name != name_ || !innerPath.isEmpty()) {
+        if (error)
+            *error = QString("Failed to read directory: %1").arg(path);
+        return false;
+    }
+
+    // Saved results of catalogs that haven't changed are used as they are.
+    QueryResults results = QueryResults::load(name_, query_.text());
+    int unindexed = 0;
+    if (results.refresh(query_, QDateTime::currentMSecsSinceEpoch() * 1000000LL, &unindexed))
+        results.save(name_);
+    if (results.drives().empty() && unindexed > 0) {
+        if (error)
+            *error = "No drive catalog can be queried yet. Update the catalogs of the drives to query them.";
+        return false;
+    }
+
+    std::vector<Drive> drives;
+    QSet<QString> labels;
+    entries->clear();
+    entries->reserve(static_cast<size_t>(results.count()));
+    for (const QueryResults::Drive& result : results.drives()) {
+        const DriveCatalog& catalog = *result.catalog;
+        // Result names start with the drive, so its label must be unique and
+        // one path component.
+        QString label = catalog.label().trimmed().isEmpty() ? result.uuid : catalog.label().trimmed();
+        label.replace('/', '_');
+        if (labels.contains(label))
+            label += QString(" (%1)").arg(result.uuid);
+        labels.insert(label);
+
+        for (const std::uint32_t entry : result.entries) {
+            if (entry < catalog.entryCount())
+                entries->push_back({label + '/' + catalog.relativePath(entry), statOf(catalog, entry)});
+        }
+        drives.push_back({label, result.catalog});
+    }
+
+    const std::lock_guard lock(mutex_);
+    drives_ = std::move(drives);
+    return true;
+}
+
+bool QueryVfs::listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    return list(path, entries, error);
+}
+
+bool QueryVfs::makeDirectory(const QString& path, std::uint32_t, QString* error) const
+{
+    return failReadOnly(path, error);
+}
+
+bool QueryVfs::rename(const QString& from, const QString&, QString* error) const
+{
+    return failReadOnly(from, error);
+}
+
+bool QueryVfs::unlink(const QString& path, QString* error) const
+{
+    return failReadOnly(path, error);
+}
+
+QString QueryVfs::catalogUrl(const QString& path) const
+{
+    std::shared_ptr<const DriveCatalog> catalog;
+    qint64 entry = -1;
+    if (!findEntry(path, &catalog, &entry) || !catalog)
+        return QString();
+    std::uint32_t folder = static_cast<std::uint32_t>(entry);
+    if (!catalog->isDir(folder))
+        folder = catalog->parent(folder);
+    const QString relativePath = catalog->relativePath(folder);
+    const QString root = DriveCatalog::rootUrl(catalog->uuid());
+    return relativePath.isEmpty() ? root : root + '/' + relativePath;
+}
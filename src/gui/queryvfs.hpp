@@ -0,0 +1,54 @@
+#ifndef QUERYVFS_HPP
+#define QUERYVFS_HPP
+
+#include "metadataquery.hpp"
+#include "vfs.hpp"
+
+#include <mutex>
+
+class DriveCatalog;
+
+// Presents the results of a MetadataQuery over every drive catalog as one
+// read-only folder, "query://<name>". Listing it brings the query's saved
+// QueryResults up to date on the listing thread, so a refresh sees catalogs
+// built since. Each result is named "<drive>/<path inside the drive>".
+class QueryVfs final : public Vfs
+{
+public:
+    static QString rootUrl(const QString& name);
+    static bool splitUrl(const QString& url, QString* name, QString* innerPath);
+
+    QueryVfs(QString name, MetadataQuery query);
+
+    std::unique_ptr<VfsFile> open(const QString& path, OpenMode mode, std::uint32_t permissions, QString* error) const override;
+    bool stat(const QString& path, VfsStat* st, QString* error) const override;
+    bool statTarget(const QString& path, VfsStat* st, QString* error) const override;
+    bool list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool makeDirectory(const QString& path, std::uint32_t permissions, QString* error) const override;
+    bool rename(const QString& from, const QString& to, QString* error) const override;
+    bool unlink(const QString& path, QString* error) const override;
+
+    const QString& name() const { return name_; }
+    const MetadataQuery& query() const { return query_; }
+    // The catalog folder a result opens: the folder itself, or the one
+    // holding a file. Empty for paths the last listing didn't have.
+    QString catalogUrl(const QString& path) const;
+
+private:
+    struct Drive
+    {
+        QString label;
+        std::shared_ptr<const DriveCatalog> catalog;
+    };
+
+    bool findEntry(const QString& path, std::shared_ptr<const DriveCatalog>* catalog, qint64* entry) const;
+
+    QString name_;
+    MetadataQuery query_;
+    // The drives of the last listing, by their label in result names.
+    mutable std::mutex mutex_;
+    mutable std::vector<Drive> drives_;
+};
+
+#endif // QUERYVFS_HPP
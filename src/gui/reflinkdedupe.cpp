@@ -0,0 +1,161 @@
+#include "reflinkdedupe.hpp"
+
+#include <QFile>
+#include <QThreadPool>
+
+#include "scopedfd.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+// btrfs silently truncates larger requests to 16 MiB, so ask for no more.
+constexpr std::uint64_t DedupeChunkSize = 16 * 1024 * 1024;
+
+QString dedupeErrorText(int errorCode, const QString& path)
+{
+    switch (errorCode) {
+    case EOPNOTSUPP:
+    case ENOTTY:
+    case EINVAL:
+        return QString("The filesystem doesn't support reflink deduplication: %1").arg(path);
+    case EXDEV:
+        return QString("Reflinks can't cross filesystems: %1").arg(path);
+    case EPERM:
+    case EACCES:
+        return QString("Permission denied: %1").arg(path);
+    case ETXTBSY:
+        return QString("File is in use: %1").arg(path);
+    default:
+        return QString("Failed to deduplicate %1: %2").arg(path, QString::fromLocal8Bit(std::strerror(errorCode)));
+    }
+}
+
+} // namespace
+
+bool dedupeFileRange(const DuplicateFile& source,
+                     const DuplicateFile& target,
+                     std::uint64_t size,
+                     std::uint64_t* bytesDeduped,
+                     const std::atomic_bool* cancel,
+                     QString* error)
+{
+    if (source.device != target.device) {
+        if (error)
+            *error = dedupeErrorText(EXDEV, target.path);
+        return false;
+    }
+
+    const ScopedFd sourceFd(::open(QFile::encodeName(source.path).constData(), O_RDONLY | O_CLOEXEC));
+    if (!sourceFd.isValid()) {
+        if (error)
+            *error = QString("Failed to open: %1").arg(source.path);
+        return false;
+    }
+    // A read-only descriptor is enough for the owner and keeps the mtime intact.
+    const ScopedFd targetFd(::open(QFile::encodeName(target.path).constData(), O_RDONLY | O_CLOEXEC));
+    if (!targetFd.isValid()) {
+        if (error)
+            *error = QString("Failed to open: %1").arg(target.path);
+        return false;
+    }
+
+    std::uint64_t offset = 0;
+    while (offset < size) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) {
+            if (error)
+                *error = QStringLiteral("Operation cancelled.");
+            return false;
+        }
+
+        // file_dedupe_range ends in a flexible array of per-destination records.
+        alignas(file_dedupe_range) unsigned char buffer[sizeof(file_dedupe_range) + sizeof(file_dedupe_range_info)] {};
+        auto* range = reinterpret_cast<file_dedupe_range*>(buffer);
+        range->src_offset = offset;
+        range->src_length = std::min(DedupeChunkSize, size - offset);
+        range->dest_count = 1;
+        file_dedupe_range_info& info = range->info[0];
+        info.dest_fd = targetFd.get();
+        info.dest_offset = offset;
+        if (::ioctl(sourceFd.get(), FIDEDUPERANGE, range) != 0) {
+            if (errno == EINTR)
+                continue;
+            if (error)
+                *error = dedupeErrorText(errno, target.path);
+            return false;
+        }
+        if (info.status == FILE_DEDUPE_RANGE_DIFFERS) {
+            if (error)
+                *error = QString("Contents differ, skipped: %1").arg(target.path);
+            return false;
+        }
+        if (info.status < 0) {
+            if (error)
+                *error = dedupeErrorText(-info.status, target.path);
+            return false;
+        }
+        if (info.bytes_deduped == 0) {
+            if (error)
+                *error = QString("The filesystem stopped deduplicating at offset %1: %2").arg(QString::number(offset), target.path);
+            return false;
+        }
+        offset += info.bytes_deduped;
+        if (bytesDeduped)
+            *bytesDeduped += info.bytes_deduped;
+    }
+    return true;
+}
+
+ReflinkDeduper::ReflinkDeduper() = default;
+
+ReflinkDeduper::ReflinkDeduper(Options options)
+    : options_(options)
+{
+}
+
+ReflinkDedupeResult ReflinkDeduper::run(const std::vector<ReflinkDedupeJob>& jobs,
+                                        const ProgressCallback& onProgress,
+                                        const std::atomic_bool* cancel) const
+{
+    ReflinkDedupeResult result;
+    std::mutex mutex;
+    size_t done = 0;
+
+    QThreadPool pool;
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    pool.setMaxThreadCount(options_.maxThreads > 0 ? options_.maxThreads : static_cast<int>(hardware));
+
+    for (size_t index = 0; index < jobs.size(); ++index) {
+        pool.start([&, index] {
+            const ReflinkDedupeJob& job = jobs[index];
+            std::uint64_t bytes = 0;
+            QString error;
+            bool ok = false;
+            if (!(cancel && cancel->load(std::memory_order_relaxed)))
+                ok = dedupeFileRange(job.source, job.target, job.size, &bytes, cancel, &error);
+
+            std::lock_guard lock(mutex);
+            result.bytesDeduped += bytes;
+            if (ok)
+                result.dedupedJobs.push_back(index);
+            else if (!error.isEmpty() && !(cancel && cancel->load(std::memory_order_relaxed)))
+                result.errors.push_back(error);
+            ++done;
+            if (onProgress)
+                onProgress(done, jobs.size());
+        });
+    }
+    pool.waitForDone();
+
+    std::sort(result.dedupedJobs.begin(), result.dedupedJobs.end());
+    return result;
+}
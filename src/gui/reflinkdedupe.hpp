@@ -0,0 +1,64 @@
+#ifndef REFLINKDEDUPE_HPP
+#define REFLINKDEDUPE_HPP
+
+#include <QString>
+#include <QStringList>
+
+#include "duplicatefinder.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct ReflinkDedupeJob
+{
+    DuplicateFile source;
+    DuplicateFile target;
+    std::uint64_t size = 0;
+};
+
+struct ReflinkDedupeResult
+{
+    std::uint64_t bytesDeduped = 0;
+    std::vector<size_t> dedupedJobs;
+    QStringList errors;
+};
+
+// Shares the extents of identical files with the FIDEDUPERANGE ioctl, so both
+// paths keep existing but their data is stored once (btrfs, XFS and others
+// with reflink support). The kernel locks and compares both ranges itself and
+// refuses to share anything that differs, so a file modified after the scan
+// is never corrupted. Jobs run in parallel on a bounded thread pool.
+class ReflinkDeduper
+{
+public:
+    struct Options
+    {
+        int maxThreads = 0;
+    };
+
+    using ProgressCallback = std::function<void(size_t jobsDone, size_t jobsTotal)>;
+
+    ReflinkDeduper();
+    explicit ReflinkDeduper(Options options);
+
+    ReflinkDedupeResult run(const std::vector<ReflinkDedupeJob>& jobs,
+                            const ProgressCallback& onProgress,
+                            const std::atomic_bool* cancel) const;
+
+private:
+    Options options_;
+};
+
+// Dedupes target against source in chunks and adds the shared byte count to
+// bytesDeduped. Returns false if the contents differ or the filesystem
+// doesn't support it.
+bool dedupeFileRange(const DuplicateFile& source,
+                     const DuplicateFile& target,
+                     std::uint64_t size,
+                     std::uint64_t* bytesDeduped,
+                     const std::atomic_bool* cancel,
+                     QString* error);
+
+#endif // REFLINKDEDUPE_HPP
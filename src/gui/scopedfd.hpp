@@ -0,0 +1,52 @@
+#ifndef SCOPEDFD_HPP
+#define SCOPEDFD_HPP
+
+#include <unistd.h>
+
+class ScopedFd
+{
+public:
+    ScopedFd() = default;
+    explicit ScopedFd(int fd)
+        : fd_(fd)
+    {
+    }
+    ~ScopedFd()
+    {
+        reset();
+    }
+    ScopedFd(const ScopedFd&) = delete;
+    ScopedFd& operator=(const ScopedFd&) = delete;
+    ScopedFd(ScopedFd&& other) noexcept
+        : fd_(other.release())
+    {
+    }
+    ScopedFd& operator=(ScopedFd&& other) noexcept
+    {
+        if (this != &other)
+            reset(other.release());
+        return *this;
+    }
+
+    int get() const { return fd_; }
+    bool isValid() const { return fd_ >= 0; }
+
+    int release()
+    {
+        const int fd = fd_;
+        fd_ = -1;
+        return fd;
+    }
+
+    void reset(int fd = -1)
+    {
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = fd;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+#endif // SCOPEDFD_HPP
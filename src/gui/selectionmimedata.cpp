@@ -0,0 +1,88 @@
+#include "selectionmimedata.hpp"
+
+#include <QStringList>
+#include <QUrl>
+#include <QVariant>
+
+namespace {
+
+constexpr const char* UriListMimeType = "text/uri-list";
+
+} // namespace
+
+PathList::PathList(const QString& directory)
+    : directory_(directory)
+{
+}
+
+PathList PathList::fromUriList(const QByteArray& uriList)
+{
+    PathList paths;
+    qsizetype begin = 0;
+    while (begin < uriList.size()) {
+        qsizetype end = uriList.indexOf('\n', begin);
+        if (end < 0)
+            end = uriList.size();
+        const QByteArray line = uriList.mid(begin, end - begin).trimmed();
+        begin = end + 1;
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        const QUrl url = QUrl::fromEncoded(line);
+        if (url.isLocalFile())
+            paths.append(url.toLocalFile());
+    }
+    return paths;
+}
+
+void PathList::append(QStringView name)
+{
+    names_.insert(names_.end(), name.utf16(), name.utf16() + name.size());
+    nameEnds_.push_back(static_cast<std::uint32_t>(names_.size()));
+}
+
+QString PathList::path(qsizetype index) const
+{
+    const std::uint32_t begin = index == 0 ? 0 : nameEnds_[static_cast<size_t>(index - 1)];
+    const QString name = QString::fromUtf16(names_.data() + begin, nameEnds_[static_cast<size_t>(index)] - begin);
+    if (directory_.isEmpty())
+        return name;
+    return directory_.endsWith('/') ? directory_ + name : directory_ + '/' + name;
+}
+
+SelectionMimeData::SelectionMimeData(std::shared_ptr<const PathList> paths, bool cut)
+    : paths_(std::move(paths))
+    , cut_(cut)
+{
+}
+
+std::shared_ptr<const PathList> SelectionMimeData::pathListFrom(const QMimeData* mime)
+{
+    const auto* selection = qobject_cast<const SelectionMimeData*>(mime);
+    return selection ? selection->paths_ : nullptr;
+}
+
+bool SelectionMimeData::hasFormat(const QString& mimeType) const
+{
+    return mimeType == QLatin1String(UriListMimeType) || mimeType == QLatin1String(CutMimeType);
+}
+
+QStringList SelectionMimeData::formats() const
+{
+    return {QString(UriListMimeType), QString(CutMimeType)};
+}
+
+QVariant SelectionMimeData::retrieveData(const QString& mimeType, QMetaType type) const
+{
+    if (mimeType == QLatin1String(CutMimeType))
+        return QByteArray(cut_ ? "1" : "0");
+    if (mimeType != QLatin1String(UriListMimeType))
+        return QMimeData::retrieveData(mimeType, type);
+    // QMimeData::urls() parses this as well, so one encoding serves both.
+    if (uriList_.isEmpty()) {
+        for (qsizetype i = 0; i < paths_->size(); ++i) {
+            uriList_ += QUrl::fromLocalFile(paths_->path(i)).toEncoded();
+            uriList_ += "\r\n";
+        }
+    }
+    return uriList_;
+}
@@ -0,0 +1,66 @@
+#ifndef SELECTIONMIMEDATA_HPP
+#define SELECTIONMIMEDATA_HPP
+
+#include <QByteArray>
+#include <QMimeData>
+#include <QString>
+#include <QStringView>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Paths picked for a copy, cut or drag: a folder and the picked names, packed
+// into one buffer. With an empty folder the names are whole paths. Never
+// changed once built, so the clipboard and the operation consuming it share
+// one.
+class PathList
+{
+public:
+    PathList() = default;
+    explicit PathList(const QString& directory);
+    // The local files of a text/uri-list; other URLs are skipped.
+    static PathList fromUriList(const QByteArray& uriList);
+
+    void append(QStringView name);
+    qsizetype size() const { return static_cast<qsizetype>(nameEnds_.size()); }
+    bool isEmpty() const { return nameEnds_.empty(); }
+    const QString& directory() const { return directory_; }
+    QString path(qsizetype index) const;
+
+private:
+    QString directory_;
+    std::vector<char16_t> names_;
+    std::vector<std::uint32_t> nameEnds_;
+};
+
+// Clipboard and drag data for a PathList. Nothing is encoded up front:
+// text/uri-list is made the first time another application asks for it, and
+// a paste or drop in this process takes the PathList itself through
+// pathListFrom(), without going through URLs at all.
+class SelectionMimeData : public QMimeData
+{
+    Q_OBJECT
+
+public:
+    static constexpr const char* CutMimeType = "application/x-kitaplik-cut";
+
+    SelectionMimeData(std::shared_ptr<const PathList> paths, bool cut);
+
+    // Null unless mime was made by this process.
+    static std::shared_ptr<const PathList> pathListFrom(const QMimeData* mime);
+    bool isCut() const { return cut_; }
+
+    bool hasFormat(const QString& mimeType) const override;
+    QStringList formats() const override;
+
+protected:
+    QVariant retrieveData(const QString& mimeType, QMetaType type) const override;
+
+private:
+    std::shared_ptr<const PathList> paths_;
+    bool cut_ = false;
+    mutable QByteArray uriList_;
+};
+
+#endif // SELECTIONMIMEDATA_HPP
@@ -0,0 +1,190 @@
+#include "selectionsummary.hpp"
+
+#include "entryselectionmodel.hpp"
+#include "listingmodel.hpp"
+
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr int RecountDelayMs = 250;
+
+} // namespace
+
+SelectionSummary::SelectionSummary(const ListingModel* listing, EntrySelectionModel* selection, QObject* parent)
+    : QObject(parent)
+    , listing_(listing)
+    , selection_(selection)
+{
+    recountTimer_.setSingleShot(true);
+    recountTimer_.setInterval(RecountDelayMs);
+    connect(&recountTimer_, &QTimer::timeout, this, &SelectionSummary::recount);
+    connect(selection_, &EntrySelectionModel::idsChanged, this, &SelectionSummary::applyChanges);
+    connect(&folderSizes_, &FolderSizes::sizeChanged, this, &SelectionSummary::updateFolder);
+    connect(&folderSizes_, &FolderSizes::sizeUnavailable, this, &SelectionSummary::skipFolder);
+    connect(listing_, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+        // Only new stats, which span every column, change sizes.
+        if (totals_.items() == 0 || topLeft.column() > ListingModel::SizeColumn || bottomRight.column() < ListingModel::SizeColumn)
+            return;
+        const EntryStore& entries = listing_->entries();
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+            if (selection_->isSelectedId(entries.id(static_cast<std::uint32_t>(row)))) {
+                recountTimer_.start();
+                return;
+            }
+        }
+    });
+}
+
+void SelectionSummary::applyChanges(const EntrySelection& added, const EntrySelection& removed, bool cleared)
+{
+    if (folderSizes_.vfs() != listing_->vfs())
+        folderSizes_.setVfs(listing_->vfs());
+    const bool multiple = totals_.items() > 1;
+    if (cleared) {
+        totals_ = Totals();
+        files_.clear();
+        folders_.clear();
+        folderIds_.clear();
+        countingChanged_ = !counting_.isEmpty();
+        counting_.clear();
+    }
+    bool known = true;
+    removed.forEach([&](std::uint32_t id) { known = remove(id) && known; });
+    if (!known) {
+        recount();
+        return;
+    }
+    added.forEach([this](std::uint32_t id) { add(id); });
+    if (countingChanged_ || (totals_.items() > 1) != multiple)
+        requestFolders();
+    emit changed();
+}
+
+void SelectionSummary::add(std::uint32_t id)
+{
+    const EntryStore& entries = listing_->entries();
+    const std::uint32_t entry = entries.indexOfId(id);
+    if (entry == EntryStore::NoEntry)
+        return;
+    if (!entries.isDir(entry)) {
+        const std::uint64_t bytes = entries.hasStat(entry) ? entries.fileSize(entry) : 0;
+        ++totals_.files;
+        totals_.bytes += bytes;
+        files_.insert(id, bytes);
+        return;
+    }
+    Folder folder;
+    folder.path = listing_->filePathForId(id);
+    if (const FolderSize* size = folderSizes_.size(folder.path, entries.mtimeNs(entry))) {
+        folder.size = *size;
+        folder.complete = true;
+    } else {
+        ++totals_.countingFolders;
+        counting_.insert(id);
+        countingChanged_ = true;
+    }
+    ++totals_.folders;
+    totals_.bytes += folder.size.bytes;
+    totals_.contents += folder.size.files + folder.size.folders;
+    folderIds_.insert(folder.path, id);
+    folders_.insert(id, folder);
+}
+
+bool SelectionSummary::remove(std::uint32_t id)
+{
+    const auto file = files_.constFind(id);
+    if (file != files_.constEnd()) {
+        --totals_.files;
+        totals_.bytes -= file.value();
+        files_.remove(id);
+        return true;
+    }
+    const auto it = folders_.constFind(id);
+    if (it != folders_.constEnd()) {
+        const Folder& folder = it.value();
+        --totals_.folders;
+        totals_.bytes -= folder.size.bytes;
+        totals_.contents -= folder.size.files + folder.size.folders;
+        if (!folder.complete) {
+            --totals_.countingFolders;
+            counting_.remove(id);
+            countingChanged_ = true;
+        }
+        if (folder.uncounted)
+            --totals_.uncountedFolders;
+        folderIds_.remove(folder.path);
+        folders_.remove(id);
+        return true;
+    }
+    return false;
+}
+
+void SelectionSummary::updateFolder(const QString& path, const FolderSize& size, bool complete)
+{
+    const auto id = folderIds_.constFind(path);
+    if (id == folderIds_.constEnd())
+        return;
+    Folder& folder = folders_[id.value()];
+    if (folder.complete)
+        return;
+    totals_.bytes = totals_.bytes - folder.size.bytes + size.bytes;
+    totals_.contents = totals_.contents - (folder.size.files + folder.size.folders) + size.files + size.folders;
+    folder.size = size;
+    if (complete) {
+        folder.complete = true;
+        --totals_.countingFolders;
+        counting_.remove(id.value());
+    }
+    emit changed();
+}
+
+void SelectionSummary::skipFolder(const QString& path)
+{
+    const auto id = folderIds_.constFind(path);
+    if (id == folderIds_.constEnd())
+        return;
+    Folder& folder = folders_[id.value()];
+    if (folder.complete)
+        return;
+    folder.complete = true;
+    folder.uncounted = true;
+    --totals_.countingFolders;
+    ++totals_.uncountedFolders;
+    counting_.remove(id.value());
+    emit changed();
+}
+
+// Stats changed the sizes of selected files, or an entry taken away was never
+// counted: everything is summed again.
+void SelectionSummary::recount()
+{
+    recountTimer_.stop();
+    totals_ = Totals();
+    files_.clear();
+    folders_.clear();
+    folderIds_.clear();
+    counting_.clear();
+    selection_->selectedIds().forEach([this](std::uint32_t id) { add(id); });
+    requestFolders();
+    emit changed();
+}
+
+void SelectionSummary::requestFolders()
+{
+    countingChanged_ = false;
+    if (totals_.items() < 2) {
+        folderSizes_.request({});
+        return;
+    }
+    const EntryStore& entries = listing_->entries();
+    std::vector<FolderSizes::Request> requests;
+    requests.reserve(size_t(counting_.size()));
+    for (const std::uint32_t id : std::as_const(counting_)) {
+        const std::uint32_t entry = entries.indexOfId(id);
+        if (entry != EntryStore::NoEntry)
+            requests.push_back({folders_.value(id).path, entries.mtimeNs(entry)});
+    }
+    folderSizes_.request(requests);
+}
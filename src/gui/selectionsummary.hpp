@@ -0,0 +1,88 @@
+#ifndef SELECTIONSUMMARY_HPP
+#define SELECTIONSUMMARY_HPP
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+#include "foldersizes.hpp"
+
+#include <cstdint>
+
+class EntrySelection;
+class EntrySelectionModel;
+class ListingModel;
+
+// Counts and sizes of everything the file view has selected, for the info
+// panel.
+//
+// The totals follow EntrySelectionModel::idsChanged(): each entry added to or
+// taken from the selection adds or takes away its own share, so growing a
+// selection of 100k files by one row is one step, not a new sum. A folder's
+// share is its size all the way down, from FolderSizes; it streams in as the
+// folder is walked, and countingFolders says how many are still going.
+// Folders are walked only while more than one entry is selected: a single
+// one gets its own info in the panel instead.
+class SelectionSummary : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Totals
+    {
+        std::uint64_t files = 0;
+        std::uint64_t folders = 0;
+        std::uint64_t bytes = 0;
+        // Files and folders inside the selected folders.
+        std::uint64_t contents = 0;
+        std::uint64_t countingFolders = 0;
+        // On high-latency mounts; left out of bytes and contents.
+        std::uint64_t uncountedFolders = 0;
+
+        std::uint64_t items() const { return files + folders; }
+    };
+
+    SelectionSummary(const ListingModel* listing, EntrySelectionModel* selection, QObject* parent = nullptr);
+
+    const Totals& totals() const { return totals_; }
+
+signals:
+    void changed();
+
+private:
+    struct Folder
+    {
+        QString path;
+        FolderSize size;
+        bool complete = false;
+        bool uncounted = false;
+    };
+
+    void applyChanges(const EntrySelection& added, const EntrySelection& removed, bool cleared);
+    void add(std::uint32_t id);
+    // False when the entry's share is not known.
+    bool remove(std::uint32_t id);
+    void updateFolder(const QString& path, const FolderSize& size, bool complete);
+    void skipFolder(const QString& path);
+    void recount();
+    void requestFolders();
+
+    const ListingModel* listing_;
+    EntrySelectionModel* selection_;
+    FolderSizes folderSizes_;
+    Totals totals_;
+    // The selected files, by entry ID, with the bytes each added.
+    QHash<std::uint32_t, std::uint64_t> files_;
+    // The selected folders, by entry ID, with what they count for so far.
+    QHash<std::uint32_t, Folder> folders_;
+    QHash<QString, std::uint32_t> folderIds_;
+    // Those of them still being walked; asked for again when this changes.
+    QSet<std::uint32_t> counting_;
+    bool countingChanged_ = false;
+    // Stats change the sizes of selected files; summed again once they settle.
+    QTimer recountTimer_;
+};
+
+#endif // SELECTIONSUMMARY_HPP
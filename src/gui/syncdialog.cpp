@@ -0,0 +1,309 @@
+#include "syncdialog.hpp"
+
+#include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QDir>
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QLocale>
+#include <QMessageBox>
+#include <QMetaObject>
+#include <QPointer>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// A first sync of a large tree lists every file; only this many are shown.
+constexpr size_t MaxListedChanges = 5000;
+
+QString formatSize(std::uint64_t bytes)
+{
+    return QLocale::system().formattedDataSize(static_cast<qint64>(bytes));
+}
+
+QString changeText(const SyncEntry& entry)
+{
+    switch (entry.change) {
+    case SyncChange::New:
+        return "New";
+    case SyncChange::Changed:
+        return entry.replacesTargetType ? "Replaced" : "Changed";
+    case SyncChange::Deleted:
+        return "Deleted";
+    }
+    return QString();
+}
+
+} // namespace
+
+SyncDialog::SyncDialog(const QString& source, QWidget* parent)
+    : QDialog(parent)
+    , source_(source)
+{
+    setWindowTitle(QString("Compare & Sync %1").arg(source_));
+    resize(800, 500);
+
+    QLabel* sourceLabel = new QLabel(QString("Source: %1").arg(source_), this);
+    targetEdit_ = new QLineEdit(this);
+    targetEdit_->setPlaceholderText("Target folder");
+    browseButton_ = new QPushButton("Browse...", this);
+    contentsCheck_ = new QCheckBox("Compare file contents", this);
+    contentsCheck_->setToolTip("Hash files whose size matches instead of trusting the modification time.");
+    deleteCheck_ = new QCheckBox("Delete files missing from source", this);
+    deleteCheck_->setChecked(true);
+
+    statusLabel_ = new QLabel("Choose a target folder and compare.", this);
+    progressBar_ = new QProgressBar(this);
+    progressBar_->setRange(0, 1);
+    changesTree_ = new QTreeWidget(this);
+    changesTree_->setColumnCount(3);
+    changesTree_->setHeaderLabels({"Change", "Path", "Size"});
+    changesTree_->setRootIsDecorated(false);
+    changesTree_->setUniformRowHeights(true);
+    changesTree_->header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
+    changesTree_->header()->setSectionResizeMode(1, QHeaderView::Stretch);
+    changesTree_->header()->setSectionResizeMode(2, QHeaderView::ResizeToContents);
+
+    compareButton_ = new QPushButton("Compare", this);
+    syncButton_ = new QPushButton("Sync", this);
+    stopButton_ = new QPushButton("Stop", this);
+    QDialogButtonBox* closeBox = new QDialogButtonBox(QDialogButtonBox::Close, this);
+
+    QHBoxLayout* targetRow = new QHBoxLayout();
+    targetRow->addWidget(new QLabel("Target:", this));
+    targetRow->addWidget(targetEdit_, 1);
+    targetRow->addWidget(browseButton_);
+
+    QHBoxLayout* optionsRow = new QHBoxLayout();
+    optionsRow->addWidget(contentsCheck_);
+    optionsRow->addWidget(deleteCheck_);
+    optionsRow->addStretch(1);
+
+    QHBoxLayout* actions = new QHBoxLayout();
+    actions->addWidget(compareButton_);
+    actions->addWidget(syncButton_);
+    actions->addStretch(1);
+    actions->addWidget(stopButton_);
+    actions->addWidget(closeBox);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(sourceLabel);
+    layout->addLayout(targetRow);
+    layout->addLayout(optionsRow);
+    layout->addWidget(statusLabel_);
+    layout->addWidget(progressBar_);
+    layout->addWidget(changesTree_, 1);
+    layout->addLayout(actions);
+
+    connect(browseButton_, &QPushButton::clicked, this, &SyncDialog::chooseTarget);
+    connect(compareButton_, &QPushButton::clicked, this, &SyncDialog::startCompare);
+    connect(syncButton_, &QPushButton::clicked, this, &SyncDialog::startSync);
+    connect(stopButton_, &QPushButton::clicked, this, [this] { cancel_.store(true); });
+    connect(closeBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    // Options and target change what the plan means, so it must be recomputed.
+    const auto discardPlan = [this] {
+        plan_ = SyncPlan();
+        changesTree_->clear();
+        setBusy(busy_);
+    };
+    connect(targetEdit_, &QLineEdit::textChanged, this, discardPlan);
+    connect(contentsCheck_, &QCheckBox::toggled, this, discardPlan);
+    connect(deleteCheck_, &QCheckBox::toggled, this, discardPlan);
+
+    setBusy(false);
+}
+
+SyncDialog::~SyncDialog()
+{
+    cancel_.store(true);
+    if (worker_.joinable())
+        worker_.join();
+}
+
+FolderSync::Options SyncDialog::syncOptions() const
+{
+    FolderSync::Options options;
+    options.compareContents = contentsCheck_->isChecked();
+    options.deleteExtraneous = deleteCheck_->isChecked();
+    return options;
+}
+
+void SyncDialog::setBusy(bool busy)
+{
+    busy_ = busy;
+    targetEdit_->setEnabled(!busy);
+    browseButton_->setEnabled(!busy);
+    contentsCheck_->setEnabled(!busy);
+    deleteCheck_->setEnabled(!busy);
+    compareButton_->setEnabled(!busy && !targetEdit_->text().trimmed().isEmpty());
+    syncButton_->setEnabled(!busy && !plan_.isEmpty());
+    stopButton_->setEnabled(busy);
+}
+
+void SyncDialog::chooseTarget()
+{
+    const QString dir = QFileDialog::getExistingDirectory(this, "Choose Target Folder", targetEdit_->text());
+    if (!dir.isEmpty())
+        targetEdit_->setText(dir);
+}
+
+void SyncDialog::startCompare()
+{
+    if (busy_)
+        return;
+    const QString target = QDir::cleanPath(targetEdit_->text().trimmed());
+    if (target.isEmpty())
+        return;
+
+    plan_ = SyncPlan();
+    changesTree_->clear();
+    cancel_.store(false);
+    setBusy(true);
+    progressBar_->setRange(0, 0);
+    statusLabel_->setText("Comparing...");
+
+    QPointer<SyncDialog> self(this);
+    worker_ = std::jthread([self, this, source = source_, target, options = syncOptions()] {
+        SyncPlan plan;
+        QStringList errors;
+        const bool completed = FolderSync(options).compare(source, target, &plan, &cancel_, &errors);
+        if (!self)
+            return;
+        QMetaObject::invokeMethod(
+            self,
+            [self, plan = std::move(plan), completed, errors] {
+                if (self)
+                    self->finishCompare(plan, completed, errors);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void SyncDialog::finishCompare(SyncPlan plan, bool completed, const QStringList& errors)
+{
+    progressBar_->setRange(0, 1);
+    progressBar_->setValue(1);
+    if (!completed) {
+        setBusy(false);
+        statusLabel_->setText(cancel_.load() ? QString("Compare stopped.") : QString("Compare failed."));
+        if (!cancel_.load() && !errors.isEmpty())
+            QMessageBox::warning(this, "Compare & Sync", errors.join("\n\n"));
+        return;
+    }
+
+    plan_ = std::move(plan);
+    const size_t listed = std::min(plan_.entries.size(), MaxListedChanges);
+    for (size_t i = 0; i < listed; ++i) {
+        const SyncEntry& entry = plan_.entries[i];
+        QTreeWidgetItem* item = new QTreeWidgetItem(changesTree_);
+        item->setText(0, changeText(entry));
+        item->setText(1, entry.type == SyncEntryType::Directory ? entry.relativePath + '/' : entry.relativePath);
+        if (entry.type == SyncEntryType::File)
+            item->setText(2, formatSize(entry.change == SyncChange::Deleted ? entry.targetSize : entry.sourceSize));
+    }
+    if (listed < plan_.entries.size()) {
+        QTreeWidgetItem* more = new QTreeWidgetItem(changesTree_);
+        more->setText(1, QString("... and %1 more").arg(QLocale::system().toString(static_cast<qulonglong>(plan_.entries.size() - listed))));
+    }
+
+    setBusy(false);
+    statusLabel_->setText(plan_.isEmpty()
+        ? QString("Target is up to date.")
+        : QString("%1 new, %2 changed, %3 deleted; %4 to copy")
+              .arg(QString::number(plan_.count(SyncChange::New)),
+                   QString::number(plan_.count(SyncChange::Changed)),
+                   QString::number(plan_.count(SyncChange::Deleted)),
+                   formatSize(plan_.bytesToCopy())));
+    if (!errors.isEmpty())
+        QMessageBox::warning(this, "Compare & Sync", QString("Some entries could not be read:\n\n%1").arg(errors.join("\n")));
+}
+
+void SyncDialog::startSync()
+{
+    if (busy_ || plan_.isEmpty())
+        return;
+
+    const size_t deletions = plan_.count(SyncChange::Deleted);
+    if (deletions > 0) {
+        const auto choice = QMessageBox::question(this,
+                                                  "Compare & Sync",
+                                                  QString("%1 entries in the target will be deleted. Continue?").arg(QString::number(deletions)),
+                                                  QMessageBox::Yes | QMessageBox::No);
+        if (choice != QMessageBox::Yes)
+            return;
+    }
+
+    cancel_.store(false);
+    setBusy(true);
+    progressBar_->setRange(0, 0);
+    statusLabel_->setText("Syncing...");
+
+    QPointer<SyncDialog> self(this);
+    worker_ = std::jthread([self, this, plan = plan_, options = syncOptions()] {
+        const auto onProgress = [self](const ParallelCopier::Progress& progress) {
+            if (!self)
+                return;
+            QMetaObject::invokeMethod(
+                self,
+                [self, progress] {
+                    if (self)
+                        self->updateSyncProgress(progress);
+                },
+                Qt::QueuedConnection);
+        };
+
+        QStringList errors;
+        const bool completed = FolderSync(options).apply(plan, onProgress, &cancel_, &errors);
+        if (!self)
+            return;
+        QMetaObject::invokeMethod(
+            self,
+            [self, completed, errors] {
+                if (self)
+                    self->finishSync(completed, errors);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void SyncDialog::updateSyncProgress(const ParallelCopier::Progress& progress)
+{
+    if (!busy_)
+        return;
+    const int permille = progress.bytesTotal > 0
+        ? static_cast<int>(std::min<std::uint64_t>(progress.bytesDone * 1000 / progress.bytesTotal, 1000))
+        : 0;
+    progressBar_->setRange(0, 1000);
+    progressBar_->setValue(permille);
+    statusLabel_->setText(QString("Copying... %1 of %2 files, %3 of %4")
+                              .arg(QString::number(progress.filesDone),
+                                   QString::number(progress.filesTotal),
+                                   formatSize(progress.bytesDone),
+                                   formatSize(progress.bytesTotal)));
+}
+
+void SyncDialog::finishSync(bool completed, const QStringList& errors)
+{
+    plan_ = SyncPlan();
+    changesTree_->clear();
+    progressBar_->setRange(0, 1);
+    progressBar_->setValue(1);
+    setBusy(false);
+
+    if (completed) {
+        statusLabel_->setText("Sync complete.");
+        return;
+    }
+    statusLabel_->setText(cancel_.load() ? QString("Sync stopped. Compare again to continue.") : QString("Sync finished with errors."));
+    if (!errors.isEmpty())
+        QMessageBox::warning(this, "Compare & Sync", errors.join("\n\n"));
+}
@@ -0,0 +1,55 @@
+#ifndef SYNCDIALOG_HPP
+#define SYNCDIALOG_HPP
+
+#include <QDialog>
+#include <QString>
+
+#include "foldersync.hpp"
+
+#include <atomic>
+#include <thread>
+
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QProgressBar;
+class QPushButton;
+class QTreeWidget;
+
+// Compares a folder with a mirror target, lists what differs and applies the
+// difference one way, from source to target.
+class SyncDialog : public QDialog
+{
+public:
+    explicit SyncDialog(const QString& source, QWidget* parent = nullptr);
+    ~SyncDialog() override;
+
+private:
+    void chooseTarget();
+    void startCompare();
+    void finishCompare(SyncPlan plan, bool completed, const QStringList& errors);
+    void startSync();
+    void updateSyncProgress(const ParallelCopier::Progress& progress);
+    void finishSync(bool completed, const QStringList& errors);
+    void setBusy(bool busy);
+    FolderSync::Options syncOptions() const;
+
+    QString source_;
+    QLineEdit* targetEdit_ = nullptr;
+    QCheckBox* contentsCheck_ = nullptr;
+    QCheckBox* deleteCheck_ = nullptr;
+    QLabel* statusLabel_ = nullptr;
+    QProgressBar* progressBar_ = nullptr;
+    QTreeWidget* changesTree_ = nullptr;
+    QPushButton* browseButton_ = nullptr;
+    QPushButton* compareButton_ = nullptr;
+    QPushButton* syncButton_ = nullptr;
+    QPushButton* stopButton_ = nullptr;
+
+    SyncPlan plan_;
+    bool busy_ = false;
+    std::atomic_bool cancel_ = false;
+    std::jthread worker_;
+};
+
+#endif // SYNCDIALOG_HPP
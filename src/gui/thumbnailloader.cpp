@@ -0,0 +1,163 @@
+#include "thumbnailloader.hpp"
+
+#include <QFile>
+#include <QImageReader>
+#include <QMetaObject>
+
+#include "memorygovernor.hpp"
+#include "scopedfd.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace {
+
+// The cache counts its cost in KiB.
+constexpr qsizetype CostUnit = 1024;
+
+QImage readThumbnail(const QString& path, int size)
+{
+    // Non-blocking, so a FIFO named like an image can't hang a decode thread.
+    const ScopedFd fd(::open(QFile::encodeName(path).constData(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC));
+    struct stat st {};
+    if (!fd.isValid() || ::fstat(fd.get(), &st) != 0 || !S_ISREG(st.st_mode))
+        return QImage();
+    QFile file;
+    if (!file.open(fd.get(), QIODevice::ReadOnly, QFileDevice::DontCloseHandle))
+        return QImage();
+    // The suffix is a hint; the reader still looks at the content.
+    QImageReader reader(&file, path.sliced(path.lastIndexOf('.') + 1).toLatin1().toLower());
+    reader.setAutoTransform(true);
+    const QSize full = reader.size();
+    if (full.isValid() && (full.width() > size || full.height() > size))
+        reader.setScaledSize(full.scaled(size, size, Qt::KeepAspectRatio));
+    QImage image = reader.read();
+    // Not every format can decode scaled, and some don't know their size up front.
+    if (!image.isNull() && (image.width() > size || image.height() > size))
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return image;
+}
+
+} // namespace
+
+ThumbnailLoader::ThumbnailLoader(QObject* parent)
+    : QObject(parent)
+{
+    // The MemoryGovernor sets the limit.
+    cache_.setMaxCost(std::numeric_limits<qsizetype>::max());
+    memoryHandle_ = MemoryGovernor::instance().registerCache(QStringLiteral("Thumbnails"), 8, [this](std::int64_t target) {
+        cache_.setMaxCost(static_cast<qsizetype>(target / CostUnit));
+        cache_.setMaxCost(std::numeric_limits<qsizetype>::max());
+        reportUsage();
+    });
+    // Decoding is CPU bound; leave cores for the UI and the listings.
+    const int threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) / 2, 1, 4);
+    for (int i = 0; i < threads; ++i)
+        threads_.emplace_back([this](std::stop_token stop) { run(stop); });
+}
+
+ThumbnailLoader::~ThumbnailLoader()
+{
+    for (std::jthread& thread : threads_)
+        thread.request_stop();
+    threads_.clear();
+    MemoryGovernor::instance().unregisterCache(memoryHandle_);
+}
+
+bool ThumbnailLoader::canLoad(QStringView name)
+{
+    static const QSet<QString> suffixes = [] {
+        QSet<QString> result;
+        for (const QByteArray& format : QImageReader::supportedImageFormats())
+            result.insert(QString::fromLatin1(format).toLower());
+        return result;
+    }();
+    const qsizetype dot = name.lastIndexOf('.');
+    return dot > 0 && suffixes.contains(name.sliced(dot + 1).toString().toLower());
+}
+
+void ThumbnailLoader::setSize(int size)
+{
+    if (size == size_)
+        return;
+    {
+        std::lock_guard lock(mutex_);
+        size_ = size;
+        ++generation_;
+        queue_.clear();
+    }
+    cache_.clear();
+    failed_.clear();
+    reportUsage();
+}
+
+const QPixmap* ThumbnailLoader::thumbnail(std::uint32_t id, std::int64_t mtimeNs) const
+{
+    const Thumbnail* thumbnail = cache_.object(id);
+    return thumbnail && thumbnail->mtimeNs == mtimeNs ? &thumbnail->pixmap : nullptr;
+}
+
+bool ThumbnailLoader::hasFailed(std::uint32_t id, std::int64_t mtimeNs) const
+{
+    const auto it = failed_.constFind(id);
+    return it != failed_.constEnd() && it.value() == mtimeNs;
+}
+
+void ThumbnailLoader::request(const std::vector<Request>& requests)
+{
+    std::lock_guard lock(mutex_);
+    queue_.clear();
+    for (const Request& request : requests) {
+        if (!thumbnail(request.id, request.mtimeNs) && !hasFailed(request.id, request.mtimeNs) && !running_.contains(request.id))
+            queue_.push_back(request);
+    }
+    wake_.notify_all();
+}
+
+void ThumbnailLoader::run(std::stop_token stop)
+{
+    for (;;) {
+        Request next;
+        int size = 0;
+        std::uint64_t generation = 0;
+        {
+            std::unique_lock lock(mutex_);
+            if (!wake_.wait(lock, stop, [this] { return !queue_.empty(); }))
+                return;
+            next = std::move(queue_.front());
+            queue_.pop_front();
+            running_.insert(next.id);
+            size = size_;
+            generation = generation_;
+        }
+        const QImage image = readThumbnail(next.path, size);
+        QMetaObject::invokeMethod(
+            this, [this, generation, next = std::move(next), image] { deliver(generation, next, image); }, Qt::QueuedConnection);
+    }
+}
+
+void ThumbnailLoader::deliver(std::uint64_t generation, const Request& request, const QImage& image)
+{
+    {
+        std::lock_guard lock(mutex_);
+        running_.erase(request.id);
+        if (generation != generation_)
+            return;
+    }
+    if (image.isNull()) {
+        failed_.insert(request.id, request.mtimeNs);
+    } else {
+        failed_.remove(request.id);
+        cache_.insert(request.id, new Thumbnail{QPixmap::fromImage(image), request.mtimeNs}, std::max<qsizetype>(1, image.sizeInBytes() / CostUnit));
+        reportUsage();
+    }
+    emit thumbnailReady(request.id);
+}
+
+void ThumbnailLoader::reportUsage()
+{
+    MemoryGovernor::instance().reportUsage(memoryHandle_, std::int64_t(cache_.totalCost()) * CostUnit);
+}
@@ -0,0 +1,87 @@
+#ifndef THUMBNAILLOADER_HPP
+#define THUMBNAILLOADER_HPP
+
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QString>
+#include <QStringView>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Decodes image thumbnails on a few background threads, by entry ID (see
+// EntryStore::id()).
+//
+// The queue is a priority list, not a backlog: request() replaces it with
+// what the view needs now, most urgent first, so work for items scrolled
+// past is dropped before it starts. Images are decoded at thumbnail size
+// where the format allows it (JPEG decodes straight to a fraction of its
+// size) and kept in a cache whose size the MemoryGovernor bounds.
+class ThumbnailLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Request
+    {
+        std::uint32_t id = 0;
+        // The file's modification time; a thumbnail is good for one only.
+        std::int64_t mtimeNs = 0;
+        QString path;
+    };
+
+    explicit ThumbnailLoader(QObject* parent = nullptr);
+    ~ThumbnailLoader() override;
+
+    // Whether a file of this name is an image Qt can read, by its suffix.
+    static bool canLoad(QStringView name);
+
+    // Longest side, in pixels. Changing it drops every thumbnail.
+    void setSize(int size);
+    int size() const { return size_; }
+
+    // Null until loaded for this modification time.
+    const QPixmap* thumbnail(std::uint32_t id, std::int64_t mtimeNs) const;
+    // Whether id was tried at this modification time and isn't a readable image.
+    bool hasFailed(std::uint32_t id, std::int64_t mtimeNs) const;
+    void request(const std::vector<Request>& requests);
+
+signals:
+    void thumbnailReady(std::uint32_t id);
+
+private:
+    struct Thumbnail
+    {
+        QPixmap pixmap;
+        std::int64_t mtimeNs = 0;
+    };
+
+    void run(std::stop_token stop);
+    void deliver(std::uint64_t generation, const Request& request, const QImage& image);
+    void reportUsage();
+
+    int size_ = 0;
+    int memoryHandle_ = 0;
+    QCache<std::uint32_t, Thumbnail> cache_;
+    QHash<std::uint32_t, std::int64_t> failed_;
+
+    // Shared with the threads.
+    std::mutex mutex_;
+    std::condition_variable_any wake_;
+    std::deque<Request> queue_;
+    std::unordered_set<std::uint32_t> running_;
+    std::uint64_t generation_ = 0;
+
+    // Last, so they are joined before anything they use goes away.
+    std::vector<std::jthread> threads_;
+};
+
+#endif // THUMBNAILLOADER_HPP
@@ -0,0 +1,247 @@
+#include "vfs.hpp"
+
+#include <QFile>
+
+#include "scopedfd.hpp"
+
+#include <cerrno>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr unsigned StatxMask = STATX_BASIC_STATS | STATX_BTIME;
+
+std::int64_t toNanoseconds(const statx_timestamp& ts)
+{
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+VfsStat fromNative(const struct statx& st)
+{
+    VfsStat result;
+    result.device = static_cast<std::uint64_t>(makedev(st.stx_dev_major, st.stx_dev_minor));
+    result.inode = st.stx_ino;
+    result.size = st.stx_size;
+    result.mtimeNs = toNanoseconds(st.stx_mtime);
+    result.ctimeNs = toNanoseconds(st.stx_ctime);
+    result.btimeNs = (st.stx_mask & STATX_BTIME) ? toNanoseconds(st.stx_btime) : 0;
+    result.mode = st.stx_mode;
+    result.linkCount = st.stx_nlink;
+    result.uid = st.stx_uid;
+    result.gid = st.stx_gid;
+    return result;
+}
+
+bool statNative(int dirFd, const char* path, int flags, VfsStat* st)
+{
+    struct statx native {};
+    if (::statx(dirFd, path, flags | AT_NO_AUTOMOUNT, StatxMask, &native) != 0)
+        return false;
+    *st = fromNative(native);
+    return true;
+}
+
+class NativeFile final : public VfsFile
+{
+public:
+    explicit NativeFile(ScopedFd fd)
+        : fd_(std::move(fd))
+    {
+    }
+
+    qint64 read(std::uint64_t offset, char* data, size_t size) override
+    {
+        size_t done = 0;
+        while (done < size) {
+            const ssize_t n = ::pread(fd_.get(), data + done, size - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return -1;
+            if (n == 0)
+                break;
+            done += static_cast<size_t>(n);
+        }
+        return static_cast<qint64>(done);
+    }
+
+    qint64 write(std::uint64_t offset, const char* data, size_t size) override
+    {
+        size_t done = 0;
+        while (done < size) {
+            const ssize_t n = ::pwrite(fd_.get(), data + done, size - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return -1;
+            done += static_cast<size_t>(n);
+        }
+        return static_cast<qint64>(done);
+    }
+
+    bool stat(VfsStat* st) const override
+    {
+        return statNative(fd_.get(), "", AT_EMPTY_PATH, st);
+    }
+
+    bool close() override
+    {
+        return !fd_.isValid() || ::close(fd_.release()) == 0;
+    }
+
+private:
+    ScopedFd fd_;
+};
+
+} // namespace
+
+bool VfsStat::isDir() const
+{
+    return S_ISDIR(mode);
+}
+
+bool VfsStat::isFile() const
+{
+    return S_ISREG(mode);
+}
+
+bool VfsStat::isSymLink() const
+{
+    return S_ISLNK(mode);
+}
+
+const Vfs& Vfs::native()
+{
+    static const NativeVfs instance;
+    return instance;
+}
+
+std::unique_ptr<VfsFile> NativeVfs::open(const QString& path, OpenMode mode, std::uint32_t permissions, QString* error) const
+{
+    int flags = O_CLOEXEC;
+    switch (mode) {
+    case OpenMode::Read:
+        flags |= O_RDONLY;
+        break;
+    case OpenMode::Write:
+        flags |= O_WRONLY | O_CREAT | O_TRUNC;
+        break;
+    case OpenMode::CreateNew:
+        flags |= O_WRONLY | O_CREAT | O_EXCL;
+        break;
+    }
+    ScopedFd fd(::open(QFile::encodeName(path).constData(), flags, permissions & 07777));
+    if (!fd.isValid()) {
+        if (error)
+            *error = QString("Failed to open: %1").arg(path);
+        return nullptr;
+    }
+    return std::make_unique<NativeFile>(std::move(fd));
+}
+
+bool NativeVfs::stat(const QString& path, VfsStat* st, QString* error) const
+{
+    if (!statNative(AT_FDCWD, QFile::encodeName(path).constData(), AT_SYMLINK_NOFOLLOW, st)) {
+        if (error)
+            *error = QString("Failed to read: %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+bool NativeVfs::statTarget(const QString& path, VfsStat* st, QString* error) const
+{
+    if (!statNative(AT_FDCWD, QFile::encodeName(path).constData(), 0, st)) {
+        if (error)
+            *error = QString("Failed to read: %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+bool NativeVfs::list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? ::fdopendir(fd) : nullptr;
+    if (!dir) {
+        if (fd >= 0)
+            ::close(fd);
+        if (error)
+            *error = QString("Failed to read directory: %1").arg(path);
+        return false;
+    }
+
+    entries->clear();
+    while (const dirent* ent = ::readdir(dir)) {
+        const char* name = ent->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        VfsDirEntry entry;
+        if (!statNative(::dirfd(dir), name, AT_SYMLINK_NOFOLLOW, &entry.stat))
+            continue;
+        entry.name = QFile::decodeName(name);
+        entries->push_back(std::move(entry));
+    }
+    ::closedir(dir);
+    return true;
+}
+
+bool NativeVfs::listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const
+{
+    DIR* dir = ::opendir(QFile::encodeName(path).constData());
+    if (!dir) {
+        if (error)
+            *error = QString("Failed to read directory: %1").arg(path);
+        return false;
+    }
+
+    entries->clear();
+    while (const dirent* ent = ::readdir(dir)) {
+        const char* name = ent->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        VfsDirEntry entry;
+        entry.name = QFile::decodeName(name);
+        entry.stat.inode = ent->d_ino;
+        entry.stat.mode = ent->d_type == DT_UNKNOWN ? 0 : DTTOIF(ent->d_type);
+        entries->push_back(std::move(entry));
+    }
+    ::closedir(dir);
+    return true;
+}
+
+bool NativeVfs::makeDirectory(const QString& path, std::uint32_t permissions, QString* error) const
+{
+    if (::mkdir(QFile::encodeName(path).constData(), permissions & 07777) != 0) {
+        if (error)
+            *error = QString("Failed to create directory: %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+bool NativeVfs::rename(const QString& from, const QString& to, QString* error) const
+{
+    if (::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) != 0) {
+        if (error)
+            *error = QString("Failed to rename:\n%1\n→ %2").arg(from, to);
+        return false;
+    }
+    return true;
+}
+
+bool NativeVfs::unlink(const QString& path, QString* error) const
+{
+    const QByteArray native = QFile::encodeName(path);
+    if (::unlink(native.constData()) != 0 && (errno != EISDIR || ::rmdir(native.constData()) != 0)) {
+        if (error)
+            *error = QString("Failed to delete: %1").arg(path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,104 @@
+#ifndef VFS_HPP
+#define VFS_HPP
+
+#include <QString>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct VfsStat
+{
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::uint64_t size = 0;
+    std::int64_t mtimeNs = 0;
+    std::int64_t ctimeNs = 0;
+    // 0 where the filesystem doesn't record creation times.
+    std::int64_t btimeNs = 0;
+    std::uint32_t mode = 0;
+    std::uint32_t linkCount = 0;
+    std::uint32_t uid = 0;
+    std::uint32_t gid = 0;
+
+    bool isDir() const;
+    bool isFile() const;
+    bool isSymLink() const;
+};
+
+struct VfsDirEntry
+{
+    QString name;
+    VfsStat stat;
+};
+
+// An open file. Reads and writes are positional, so one handle can be shared
+// by several threads.
+class VfsFile
+{
+public:
+    virtual ~VfsFile() = default;
+
+    // Returns the number of bytes transferred, or -1 on error. A short read
+    // means end of file.
+    virtual qint64 read(std::uint64_t offset, char* data, size_t size) = 0;
+    virtual qint64 write(std::uint64_t offset, const char* data, size_t size) = 0;
+    virtual bool stat(VfsStat* st) const = 0;
+    // Reports write-back errors some filesystems only surface on close.
+    virtual bool close() = 0;
+};
+
+// The file operations the engines need, behind an interface, so scanners and
+// copiers can run against an in-memory tree or a simulated slow mount as well
+// as the real filesystem. Paths are absolute and use '/'. Every call is
+// thread-safe.
+class Vfs
+{
+public:
+    enum class OpenMode
+    {
+        Read,
+        // Creates the file if missing and truncates it otherwise.
+        Write,
+        // Fails if the file exists.
+        CreateNew,
+    };
+
+    virtual ~Vfs() = default;
+
+    virtual std::unique_ptr<VfsFile> open(const QString& path, OpenMode mode, std::uint32_t permissions, QString* error) const = 0;
+    // Describes a symbolic link itself rather than its target.
+    virtual bool stat(const QString& path, VfsStat* st, QString* error) const = 0;
+    // Follows symbolic links.
+    virtual bool statTarget(const QString& path, VfsStat* st, QString* error) const = 0;
+    // Entries come in no particular order, without "." and "..".
+    virtual bool list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const = 0;
+    // Like list(), without a stat per entry: one round trip on a network
+    // filesystem instead of one per entry. Only the file type bits of mode
+    // are set, and only where the filesystem reports them.
+    virtual bool listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const = 0;
+    virtual bool makeDirectory(const QString& path, std::uint32_t permissions, QString* error) const = 0;
+    // Replaces an existing file at the destination.
+    virtual bool rename(const QString& from, const QString& to, QString* error) const = 0;
+    // Removes a file, symbolic link or empty directory.
+    virtual bool unlink(const QString& path, QString* error) const = 0;
+
+    // The process-wide NativeVfs.
+    static const Vfs& native();
+};
+
+// The local filesystem through POSIX calls.
+class NativeVfs final : public Vfs
+{
+public:
+    std::unique_ptr<VfsFile> open(const QString& path, OpenMode mode, std::uint32_t permissions, QString* error) const override;
+    bool stat(const QString& path, VfsStat* st, QString* error) const override;
+    bool statTarget(const QString& path, VfsStat* st, QString* error) const override;
+    bool list(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool listNames(const QString& path, std::vector<VfsDirEntry>* entries, QString* error) const override;
+    bool makeDirectory(const QString& path, std::uint32_t permissions, QString* error) const override;
+    bool rename(const QString& from, const QString& to, QString* error) const override;
+    bool unlink(const QString& path, QString* error) const override;
+};
+
+#endif // VFS_HPP
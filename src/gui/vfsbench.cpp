@@ -0,0 +1,133 @@
+// Times the walker and the copier on an in-memory tree behind a simulated
+// slow mount, so changes to their latency hiding can be measured without a
+// real network filesystem. Every run sees the same tree and the same delays.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include "latencyvfs.hpp"
+#include "memoryvfs.hpp"
+#include "parallelcopier.hpp"
+#include "parallelwalker.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+namespace {
+
+struct Settings
+{
+    int folders = 20;
+    int filesPerFolder = 100;
+    int fileBytes = 16 * 1024;
+    LatencyVfs::Options latency;
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printRun(const char* engine,
+              int threads,
+              double seconds,
+              std::uint64_t items,
+              const LatencyVfs::Counters& before,
+              const LatencyVfs::Counters& after)
+{
+    std::printf("%-6s %3d threads  %8.3f s  %8llu items  %8llu calls  %6llu faults\n",
+                engine,
+                threads,
+                seconds,
+                static_cast<unsigned long long>(items),
+                static_cast<unsigned long long>(after.calls - before.calls),
+                static_cast<unsigned long long>(after.faults - before.faults));
+}
+
+void walk(const LatencyVfs& vfs, int threads)
+{
+    ParallelWalker::Options options;
+    options.maxThreads = threads;
+    options.vfs = &vfs;
+    std::mutex mutex;
+    std::uint64_t entries = 0;
+    const LatencyVfs::Counters before = vfs.counters();
+    const auto start = std::chrono::steady_clock::now();
+    ParallelWalker(options).walk(QStringLiteral("/source"), [&](std::vector<WalkEntry>&& batch) {
+        std::lock_guard lock(mutex);
+        entries += batch.size();
+    });
+    printRun("walk", threads, secondsSince(start), entries, before, vfs.counters());
+}
+
+void copy(const MemoryVfs& memory, const LatencyVfs& vfs, const Settings& settings, int threads)
+{
+    // A destination of its own, made without delays, so runs don't collide.
+    const QString destination = QString("/copy-%1").arg(threads);
+    memory.makeDirectory(destination, 0755, nullptr);
+    std::vector<CopyJob> jobs;
+    for (int folder = 0; folder < settings.folders; ++folder) {
+        const QString folderPath = QString("%1/%2").arg(destination).arg(folder);
+        memory.makeDirectory(folderPath, 0755, nullptr);
+        for (int file = 0; file < settings.filesPerFolder; ++file) {
+            jobs.push_back({QString("/source/%1/%2").arg(folder).arg(file),
+                            QString("%1/%2").arg(folderPath).arg(file),
+                            std::uint64_t(settings.fileBytes)});
+        }
+    }
+
+    ParallelCopier::Options options;
+    options.maxThreads = threads;
+    options.vfs = &vfs;
+    const LatencyVfs::Counters before = vfs.counters();
+    const auto start = std::chrono::steady_clock::now();
+    ParallelCopier(options).run(jobs, {}, nullptr, nullptr);
+    printRun("copy", threads, secondsSince(start), jobs.size(), before, vfs.counters());
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Walks and copies an in-memory tree behind a simulated slow mount."));
+    parser.addHelpOption();
+    const QCommandLineOption foldersOption("folders", "Folders in the tree.", "n", "20");
+    const QCommandLineOption filesOption("files", "Files per folder.", "n", "100");
+    const QCommandLineOption bytesOption("bytes", "Bytes per file.", "n", "16384");
+    const QCommandLineOption latencyOption("latency-us", "Delay of each metadata call.", "us", "1000");
+    const QCommandLineOption dataLatencyOption("data-latency-us", "Delay of each read or write.", "us", "200");
+    const QCommandLineOption bandwidthOption("bandwidth", "Bytes per second, 0 for unlimited.", "n", "0");
+    const QCommandLineOption jitterOption("jitter", "Spread of each delay, 0 to 1.", "x", "0.2");
+    const QCommandLineOption faultOption("fault-rate", "Chance that a call fails, 0 to 1.", "x", "0");
+    parser.addOptions(
+        {foldersOption, filesOption, bytesOption, latencyOption, dataLatencyOption, bandwidthOption, jitterOption, faultOption});
+    parser.process(app);
+
+    Settings settings;
+    settings.folders = parser.value(foldersOption).toInt();
+    settings.filesPerFolder = parser.value(filesOption).toInt();
+    settings.fileBytes = parser.value(bytesOption).toInt();
+    settings.latency.metadataLatency = std::chrono::microseconds(parser.value(latencyOption).toLongLong());
+    settings.latency.dataLatency = std::chrono::microseconds(parser.value(dataLatencyOption).toLongLong());
+    settings.latency.bytesPerSecond = parser.value(bandwidthOption).toULongLong();
+    settings.latency.jitter = parser.value(jitterOption).toDouble();
+    settings.latency.faultRate = parser.value(faultOption).toDouble();
+    settings.latency.seed = 1;
+
+    MemoryVfs memory;
+    const QByteArray contents(settings.fileBytes, 'x');
+    for (int folder = 0; folder < settings.folders; ++folder) {
+        for (int file = 0; file < settings.filesPerFolder; ++file)
+            memory.addFile(QString("/source/%1/%2").arg(folder).arg(file), contents);
+    }
+    const LatencyVfs slow(memory, settings.latency);
+
+    for (const int threads : {1, 4, 16, 64})
+        walk(slow, threads);
+    for (const int threads : {1, 4, 16, 64})
+        copy(memory, slow, settings, threads);
+    return 0;
+}